@@ -30,6 +30,7 @@ export type SidecarEvent = {
 export type SendTextRequest = {
   peer: string;
   text: string;
+  dedupeKey?: string;
 };
 
 export type SendMediaRequest = {
@@ -40,6 +41,7 @@ export type SendMediaRequest = {
   mediaType?: string;
   filename?: string;
   outFormat?: string;
+  dedupeKey?: string;
 };
 
 export type SendStatusRequest = {
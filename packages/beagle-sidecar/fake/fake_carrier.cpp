@@ -0,0 +1,1137 @@
+// In-process implementation of the Carrier and filetransfer APIs declared in
+// fake/include, linked instead of libcarrier/libcarrierfiletrans when the
+// sidecar is configured with -DBEAGLE_SDK_FAKE=ON. See fake_carrier.h.
+
+#include "fake_carrier.h"
+
+#include <carrier_config.h>
+#include <carrier_filetransfer.h>
+#include <carrier_session.h>
+
+#include "logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The real SDK accepts bulk messages of a few MB; the sidecar caps files at 5MB.
+constexpr size_t kMaxMessageBytes = 8 * 1024 * 1024;
+
+struct FileOffer {
+  std::string from;
+  std::string filename;
+  std::string bytes;
+};
+
+}  // namespace
+
+struct Carrier {
+  CarrierCallbacks callbacks;
+  void* context = nullptr;
+  std::string userid;
+  std::string address;
+  CarrierUserInfo self;
+  CarrierFileTransferConnectCallback* ft_connect = nullptr;
+  void* ft_context = nullptr;
+
+  std::mutex mu;
+  std::condition_variable cv;
+  std::multimap<Clock::time_point, std::function<void()>> tasks;  // equal keys keep post order
+  std::map<std::string, CarrierFriendInfo> friends;
+  std::set<std::string> requests;                   // pending friend requests from instances
+  std::map<std::string, FileOffer> offers;          // fileid -> file offered by a peer
+  uint32_t next_msgid = 1;
+  bool ready = false;
+  bool running = false;
+  bool killed = false;
+  bool delete_on_exit = false;
+  std::thread::id run_thread;
+};
+
+struct CarrierFileTransfer {
+  uint64_t id = 0;
+  Carrier* carrier = nullptr;
+  std::string peer;
+  CarrierFileTransferInfo info;
+  CarrierFileTransferCallbacks callbacks;
+  void* context = nullptr;
+  bool local_sender = true;  // false when the peer offered the file
+  std::string data;          // bytes sent so far, or the offered file
+};
+
+namespace {
+
+struct Stats {
+  std::atomic<uint64_t> sent{0};
+  std::atomic<uint64_t> delivered{0};
+  std::atomic<uint64_t> lost{0};
+  std::atomic<uint64_t> offline_errors{0};
+  std::atomic<uint64_t> offline_receipts{0};
+  std::atomic<uint64_t> inbound{0};
+  std::atomic<uint64_t> files_out{0};
+  std::atomic<uint64_t> files_in{0};
+};
+
+// Lock order: Network::mu before Carrier::mu. Callbacks run with no lock held.
+struct Network {
+  std::mutex mu;
+  std::map<std::string, FakePeerOptions> peers;
+  std::vector<Carrier*> carriers;
+  std::unordered_map<uint64_t, CarrierFileTransfer*> transfers;
+  uint64_t next_transfer_id = 1;
+  uint64_t next_instance = 1;
+  uint64_t next_fileid = 1;
+  FakeOutboundHook hook;
+  std::mt19937_64 rng{1};
+  bool env_loaded = false;
+  Stats stats;
+};
+
+static Network& network() {
+  // Leaked on purpose: instances may still be torn down from static destructors.
+  static Network* net = new Network();
+  return *net;
+}
+
+thread_local int g_last_error = 0;
+
+static void set_error(int code) {
+  g_last_error = CARRIER_GENERAL_ERROR(code);
+}
+
+static const char kBase58[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+static uint64_t fnv1a(const std::string& s) {
+  uint64_t h = 1469598103934665603ULL;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static uint64_t splitmix(uint64_t& x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static std::string base58_run(uint64_t seed, size_t n) {
+  std::string out;
+  out.reserve(n);
+  for (size_t i = 0; i < n; ++i) out.push_back(kBase58[splitmix(seed) % 58]);
+  return out;
+}
+
+static bool is_base58(const std::string& s) {
+  for (char c : s) {
+    if (c == '\0' || !std::strchr(kBase58, c)) return false;
+  }
+  return true;
+}
+
+static void copy_field(char* dst, size_t cap, const std::string& src) {
+  std::snprintf(dst, cap, "%s", src.c_str());
+}
+
+static int64_t wall_now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static bool is_live_locked(Network& net, Carrier* c) {
+  return std::find(net.carriers.begin(), net.carriers.end(), c) != net.carriers.end();
+}
+
+static Carrier* instance_by_userid_locked(Network& net, const std::string& userid) {
+  for (Carrier* c : net.carriers) {
+    if (c->userid == userid) return c;
+  }
+  return nullptr;
+}
+
+// Queues fn on c's carrier_run() thread after delay_ms; Network::mu must be held.
+static void post_locked(Carrier* c, int delay_ms, std::function<void()> fn) {
+  std::lock_guard<std::mutex> lock(c->mu);
+  if (c->killed) return;
+  c->tasks.emplace(Clock::now() + std::chrono::milliseconds(delay_ms), std::move(fn));
+  c->cv.notify_all();
+}
+
+static bool post(Carrier* c, int delay_ms, std::function<void()> fn) {
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  if (!is_live_locked(net, c)) return false;
+  post_locked(c, delay_ms, std::move(fn));
+  return true;
+}
+
+// One-way delay towards a peer; Network::mu must be held.
+static int peer_delay_locked(Network& net, const std::string& peer) {
+  auto it = net.peers.find(peer);
+  if (it == net.peers.end()) return 0;
+  int delay = std::max(0, it->second.latency_ms);
+  if (it->second.jitter_ms > 0) {
+    delay += static_cast<int>(net.rng() % static_cast<uint64_t>(it->second.jitter_ms + 1));
+  }
+  return delay;
+}
+
+static CarrierFriendInfo make_friend_info(const std::string& userid,
+                                          const std::string& name,
+                                          bool online) {
+  CarrierFriendInfo info;
+  std::memset(&info, 0, sizeof(info));
+  copy_field(info.user_info.userid, sizeof(info.user_info.userid), userid);
+  copy_field(info.user_info.name, sizeof(info.user_info.name), name);
+  copy_field(info.label, sizeof(info.label), name);
+  info.status = online ? CarrierConnectionStatus_Connected : CarrierConnectionStatus_Disconnected;
+  info.presence = CarrierPresenceStatus_None;
+  return info;
+}
+
+static void fire_friend_added(Carrier* c, const CarrierFriendInfo& info) {
+  if (c->callbacks.friend_added) c->callbacks.friend_added(c, &info, c->context);
+  if (info.status == CarrierConnectionStatus_Connected && c->callbacks.friend_connection) {
+    c->callbacks.friend_connection(c, info.user_info.userid, info.status, c->context);
+  }
+}
+
+// Adds friend `info` to c and queues friend_added; Network::mu must be held.
+static void befriend_locked(Carrier* c, const CarrierFriendInfo& info, int delay_ms) {
+  {
+    std::lock_guard<std::mutex> lock(c->mu);
+    if (c->friends.count(info.user_info.userid)) return;
+    c->friends[info.user_info.userid] = info;
+  }
+  post_locked(c, delay_ms, [c, info]() { fire_friend_added(c, info); });
+}
+
+static void deliver_message_locked(Carrier* c,
+                                   int delay_ms,
+                                   const std::string& from,
+                                   std::string payload,
+                                   int64_t ts_us,
+                                   bool offline) {
+  post_locked(c, delay_ms, [c, from, payload, ts_us, offline]() {
+    network().stats.inbound++;
+    if (c->callbacks.friend_message) {
+      c->callbacks.friend_message(c, from.c_str(), payload.data(), payload.size(),
+                                  ts_us, offline, c->context);
+    }
+  });
+}
+
+static int offer_file_locked(Network& net,
+                             Carrier* c,
+                             int delay_ms,
+                             const std::string& from,
+                             const std::string& filename,
+                             const std::string& bytes) {
+  CarrierFileTransferInfo info;
+  std::memset(&info, 0, sizeof(info));
+  copy_field(info.filename, sizeof(info.filename), filename);
+  std::string fileid = base58_run(fnv1a(from) ^ net.next_fileid++, CARRIER_MAX_FILE_ID_LEN - 1);
+  copy_field(info.fileid, sizeof(info.fileid), fileid);
+  info.size = bytes.size();
+  {
+    std::lock_guard<std::mutex> lock(c->mu);
+    if (!c->friends.count(from)) return 0;
+    c->offers[fileid] = FileOffer{from, filename, bytes};
+  }
+  post_locked(c, delay_ms, [c, from, info]() {
+    if (c->ft_connect) {
+      c->ft_connect(c, from.c_str(), &info, c->ft_context);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(c->mu);
+    c->offers.erase(info.fileid);
+  });
+  return 1;
+}
+
+// Runs fn on a transfer that may have been closed since the task was queued.
+static std::function<void()> on_transfer(uint64_t id, std::function<void(CarrierFileTransfer*)> fn) {
+  return [id, fn]() {
+    CarrierFileTransfer* ft = nullptr;
+    {
+      Network& net = network();
+      std::lock_guard<std::mutex> lock(net.mu);
+      auto it = net.transfers.find(id);
+      if (it == net.transfers.end()) return;
+      ft = it->second;
+    }
+    fn(ft);
+  };
+}
+
+static void set_transfer_state(CarrierFileTransfer* ft, FileTransferConnection state) {
+  if (ft->callbacks.state_changed) ft->callbacks.state_changed(ft, state, ft->context);
+}
+
+static void call_outbound_hook(const FakeOutbound& out) {
+  FakeOutboundHook hook;
+  {
+    Network& net = network();
+    std::lock_guard<std::mutex> lock(net.mu);
+    hook = net.hook;
+  }
+  if (hook) hook(out);
+}
+
+static int env_int(const char* name, int fallback) {
+  const char* v = std::getenv(name);
+  if (!v || !*v) return fallback;
+  return std::atoi(v);
+}
+
+static double env_double(const char* name, double fallback) {
+  const char* v = std::getenv(name);
+  if (!v || !*v) return fallback;
+  return std::atof(v);
+}
+
+// Seeds peers from BEAGLE_FAKE_* once, before the first instance exists.
+static void load_env_peers_locked(Network& net) {
+  if (net.env_loaded) return;
+  net.env_loaded = true;
+  net.rng.seed(static_cast<uint64_t>(env_int("BEAGLE_FAKE_SEED", 1)));
+  int count = env_int("BEAGLE_FAKE_PEERS", 0);
+  if (count <= 0 || !net.peers.empty()) return;
+  FakePeerOptions opts;
+  opts.latency_ms = env_int("BEAGLE_FAKE_LATENCY_MS", 0);
+  opts.jitter_ms = env_int("BEAGLE_FAKE_JITTER_MS", 0);
+  opts.loss = env_double("BEAGLE_FAKE_LOSS", 0);
+  opts.echo = env_int("BEAGLE_FAKE_ECHO", 1) != 0;
+  for (int i = 0; i < count; ++i) {
+    opts.name = "fake-peer-" + std::to_string(i);
+    net.peers[fake_carrier_make_userid(opts.name)] = opts;
+  }
+  log_line("[fake-carrier] seeded " + std::to_string(count) + " peers latency_ms="
+           + std::to_string(opts.latency_ms) + " loss=" + std::to_string(opts.loss));
+}
+
+}  // namespace
+
+// ---- control API ----------------------------------------------------------
+
+std::string fake_carrier_make_userid(const std::string& seed) {
+  return base58_run(fnv1a(seed), CARRIER_MAX_ID_LEN - 1);
+}
+
+std::string fake_carrier_make_address(const std::string& userid) {
+  return userid + base58_run(fnv1a("address:" + userid), CARRIER_MAX_ADDRESS_LEN - (CARRIER_MAX_ID_LEN - 1));
+}
+
+void fake_carrier_add_peer(const std::string& userid, const FakePeerOptions& options) {
+  if (userid.empty()) return;
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  bool existed = net.peers.count(userid) > 0;
+  bool was_online = existed && net.peers[userid].online;
+  net.peers[userid] = options;
+  std::string name = options.name.empty() ? userid.substr(0, 8) : options.name;
+  for (Carrier* c : net.carriers) {
+    if (!existed) {
+      befriend_locked(c, make_friend_info(userid, name, options.online), options.latency_ms);
+      continue;
+    }
+    if (was_online == options.online) continue;
+    {
+      std::lock_guard<std::mutex> clock(c->mu);
+      auto it = c->friends.find(userid);
+      if (it == c->friends.end()) continue;
+      it->second.status = options.online ? CarrierConnectionStatus_Connected
+                                         : CarrierConnectionStatus_Disconnected;
+    }
+    CarrierConnectionStatus status = options.online ? CarrierConnectionStatus_Connected
+                                                    : CarrierConnectionStatus_Disconnected;
+    post_locked(c, options.latency_ms, [c, userid, status]() {
+      if (c->callbacks.friend_connection) {
+        c->callbacks.friend_connection(c, userid.c_str(), status, c->context);
+      }
+    });
+  }
+}
+
+void fake_carrier_remove_peer(const std::string& userid) {
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  net.peers.erase(userid);
+  for (Carrier* c : net.carriers) {
+    {
+      std::lock_guard<std::mutex> clock(c->mu);
+      if (!c->friends.erase(userid)) continue;
+    }
+    post_locked(c, 0, [c, userid]() {
+      if (c->callbacks.friend_removed) c->callbacks.friend_removed(c, userid.c_str(), c->context);
+    });
+  }
+}
+
+bool fake_carrier_set_peer_online(const std::string& userid, bool online) {
+  FakePeerOptions opts;
+  {
+    Network& net = network();
+    std::lock_guard<std::mutex> lock(net.mu);
+    auto it = net.peers.find(userid);
+    if (it == net.peers.end()) return false;
+    opts = it->second;
+  }
+  opts.online = online;
+  fake_carrier_add_peer(userid, opts);
+  return true;
+}
+
+std::vector<std::string> fake_carrier_peers() {
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  std::vector<std::string> out;
+  out.reserve(net.peers.size());
+  for (const auto& kv : net.peers) out.push_back(kv.first);
+  return out;
+}
+
+int fake_carrier_deliver(Carrier* to,
+                         const std::string& from,
+                         const std::string& payload,
+                         int64_t ts_us,
+                         bool offline) {
+  if (ts_us == 0) ts_us = wall_now_us();
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  int queued = 0;
+  for (Carrier* c : net.carriers) {
+    if (to && c != to) continue;
+    {
+      std::lock_guard<std::mutex> clock(c->mu);
+      if (!c->friends.count(from)) continue;
+    }
+    deliver_message_locked(c, peer_delay_locked(net, from), from, payload, ts_us, offline);
+    queued++;
+  }
+  return queued;
+}
+
+int fake_carrier_send_file(Carrier* to,
+                           const std::string& from,
+                           const std::string& filename,
+                           const std::string& bytes) {
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  int queued = 0;
+  for (Carrier* c : net.carriers) {
+    if (to && c != to) continue;
+    queued += offer_file_locked(net, c, peer_delay_locked(net, from), from, filename, bytes);
+  }
+  return queued;
+}
+
+void fake_carrier_set_outbound_hook(FakeOutboundHook hook) {
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  net.hook = std::move(hook);
+}
+
+std::vector<Carrier*> fake_carrier_instances() {
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  return net.carriers;
+}
+
+std::string fake_carrier_instance_userid(Carrier* carrier) {
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  return is_live_locked(net, carrier) ? carrier->userid : std::string();
+}
+
+FakeCarrierStats fake_carrier_stats() {
+  const Stats& s = network().stats;
+  FakeCarrierStats out;
+  out.sent = s.sent.load();
+  out.delivered = s.delivered.load();
+  out.lost = s.lost.load();
+  out.offline_errors = s.offline_errors.load();
+  out.offline_receipts = s.offline_receipts.load();
+  out.inbound = s.inbound.load();
+  out.files_out = s.files_out.load();
+  out.files_in = s.files_in.load();
+  return out;
+}
+
+// ---- carrier.h --------------------------------------------------------------
+
+extern "C" {
+
+int carrier_get_error(void) {
+  return g_last_error;
+}
+
+void carrier_clear_error(void) {
+  g_last_error = 0;
+}
+
+Carrier* carrier_new(const CarrierOptions* options, CarrierCallbacks* callbacks, void* context) {
+  if (!options || !callbacks) {
+    set_error(ERROR_INVALID_ARGS);
+    return nullptr;
+  }
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  load_env_peers_locked(net);
+
+  Carrier* c = new Carrier();
+  c->callbacks = *callbacks;
+  c->context = context;
+  std::string seed = options->persistent_location && *options->persistent_location
+      ? std::string(options->persistent_location)
+      : "fake-carrier-" + std::to_string(net.next_instance);
+  net.next_instance++;
+  c->userid = fake_carrier_make_userid(seed);
+  c->address = fake_carrier_make_address(c->userid);
+  if (instance_by_userid_locked(net, c->userid)) {
+    delete c;
+    set_error(ERROR_ALREADY_EXIST);
+    return nullptr;
+  }
+  std::memset(&c->self, 0, sizeof(c->self));
+  copy_field(c->self.userid, sizeof(c->self.userid), c->userid);
+  for (const auto& kv : net.peers) {
+    std::string name = kv.second.name.empty() ? kv.first.substr(0, 8) : kv.second.name;
+    c->friends[kv.first] = make_friend_info(kv.first, name, kv.second.online);
+  }
+  net.carriers.push_back(c);
+  return c;
+}
+
+int carrier_run(Carrier* c, int interval) {
+  if (!c) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  if (interval <= 0) interval = 1000;
+  std::unique_lock<std::mutex> lock(c->mu);
+  if (c->running) {
+    set_error(ERROR_ALREADY_RUN);
+    return -1;
+  }
+  c->running = true;
+  c->run_thread = std::this_thread::get_id();
+  auto now = Clock::now();
+  c->tasks.emplace(now, [c]() {
+    if (c->callbacks.connection_status) {
+      c->callbacks.connection_status(c, CarrierConnectionStatus_Connected, c->context);
+    }
+    {
+      std::lock_guard<std::mutex> guard(c->mu);
+      c->ready = true;
+    }
+    if (c->callbacks.ready) c->callbacks.ready(c, c->context);
+    std::vector<std::string> online;
+    {
+      std::lock_guard<std::mutex> guard(c->mu);
+      for (const auto& kv : c->friends) {
+        if (kv.second.status == CarrierConnectionStatus_Connected) online.push_back(kv.first);
+      }
+    }
+    if (!c->callbacks.friend_connection) return;
+    for (const auto& id : online) {
+      c->callbacks.friend_connection(c, id.c_str(), CarrierConnectionStatus_Connected, c->context);
+    }
+  });
+
+  auto interval_d = std::chrono::milliseconds(interval);
+  auto next_idle = now + interval_d;
+  while (!c->killed) {
+    now = Clock::now();
+    if (!c->tasks.empty() && c->tasks.begin()->first <= now) {
+      auto fn = std::move(c->tasks.begin()->second);
+      c->tasks.erase(c->tasks.begin());
+      lock.unlock();
+      fn();
+      lock.lock();
+      continue;
+    }
+    if (now >= next_idle) {
+      next_idle = now + interval_d;
+      if (c->callbacks.idle) {
+        lock.unlock();
+        c->callbacks.idle(c, c->context);
+        lock.lock();
+      }
+      continue;
+    }
+    auto wake = next_idle;
+    if (!c->tasks.empty() && c->tasks.begin()->first < wake) wake = c->tasks.begin()->first;
+    c->cv.wait_until(lock, wake);
+  }
+  c->running = false;
+  c->tasks.clear();
+  c->cv.notify_all();
+  bool self_delete = c->delete_on_exit;
+  lock.unlock();
+  if (self_delete) delete c;
+  return 0;
+}
+
+void carrier_kill(Carrier* c) {
+  if (!c) return;
+  {
+    Network& net = network();
+    std::lock_guard<std::mutex> lock(net.mu);
+    auto it = std::find(net.carriers.begin(), net.carriers.end(), c);
+    if (it == net.carriers.end()) return;
+    net.carriers.erase(it);
+  }
+  std::unique_lock<std::mutex> lock(c->mu);
+  c->killed = true;
+  c->cv.notify_all();
+  if (c->running) {
+    if (c->run_thread == std::this_thread::get_id()) {
+      c->delete_on_exit = true;
+      return;
+    }
+    c->cv.wait(lock, [c]() { return !c->running; });
+  }
+  lock.unlock();
+  delete c;
+}
+
+bool carrier_is_ready(Carrier* c) {
+  if (!c) return false;
+  std::lock_guard<std::mutex> lock(c->mu);
+  return c->ready;
+}
+
+static char* copy_id(const std::string& id, char* out, size_t len) {
+  if (!out || len <= id.size()) {
+    set_error(ERROR_BUFFER_TOO_SMALL);
+    return nullptr;
+  }
+  std::memcpy(out, id.c_str(), id.size() + 1);
+  return out;
+}
+
+char* carrier_get_address(Carrier* c, char* address, size_t len) {
+  if (!c) {
+    set_error(ERROR_INVALID_ARGS);
+    return nullptr;
+  }
+  return copy_id(c->address, address, len);
+}
+
+char* carrier_get_nodeid(Carrier* c, char* nodeid, size_t len) {
+  if (!c) {
+    set_error(ERROR_INVALID_ARGS);
+    return nullptr;
+  }
+  return copy_id(c->userid, nodeid, len);
+}
+
+char* carrier_get_userid(Carrier* c, char* userid, size_t len) {
+  return carrier_get_nodeid(c, userid, len);
+}
+
+char* carrier_get_id_by_address(const char* address, char* userid, size_t len) {
+  std::string addr = address ? address : "";
+  if (addr.size() != CARRIER_MAX_ADDRESS_LEN || !is_base58(addr)) {
+    set_error(ERROR_INVALID_ARGS);
+    return nullptr;
+  }
+  return copy_id(addr.substr(0, CARRIER_MAX_ID_LEN - 1), userid, len);
+}
+
+int carrier_set_self_info(Carrier* c, const CarrierUserInfo* info) {
+  if (!c || !info) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  CarrierUserInfo copy;
+  {
+    std::lock_guard<std::mutex> lock(c->mu);
+    c->self = *info;
+    copy_field(c->self.userid, sizeof(c->self.userid), c->userid);
+    copy = c->self;
+  }
+  post(c, 0, [c, copy]() {
+    if (c->callbacks.self_info) c->callbacks.self_info(c, &copy, c->context);
+  });
+  return 0;
+}
+
+int carrier_get_self_info(Carrier* c, CarrierUserInfo* info) {
+  if (!c || !info) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  std::lock_guard<std::mutex> lock(c->mu);
+  *info = c->self;
+  return 0;
+}
+
+int carrier_get_friends(Carrier* c, CarrierFriendsIterateCallback* callback, void* context) {
+  if (!c || !callback) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  std::vector<CarrierFriendInfo> snapshot;
+  {
+    std::lock_guard<std::mutex> lock(c->mu);
+    if (!c->ready) {
+      set_error(ERROR_NOT_READY);
+      return -1;
+    }
+    for (const auto& kv : c->friends) snapshot.push_back(kv.second);
+  }
+  for (const auto& info : snapshot) {
+    if (!callback(&info, context)) return 0;
+  }
+  callback(nullptr, context);
+  return 0;
+}
+
+int carrier_get_friend_info(Carrier* c, const char* friendid, CarrierFriendInfo* info) {
+  if (!c || !friendid || !info) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  std::lock_guard<std::mutex> lock(c->mu);
+  auto it = c->friends.find(friendid);
+  if (it == c->friends.end()) {
+    set_error(ERROR_NOT_EXIST);
+    return -1;
+  }
+  *info = it->second;
+  return 0;
+}
+
+// Friend requests to registered peers are accepted after the peer latency;
+// requests to another instance arrive there through friend_request.
+int carrier_add_friend(Carrier* c, const char* address, const char* hello) {
+  char idbuf[CARRIER_MAX_ID_LEN + 1];
+  if (!c || !carrier_get_id_by_address(address, idbuf, sizeof(idbuf))) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  std::string userid = idbuf;
+  if (userid == c->userid) {
+    set_error(ERROR_ADD_SELF);
+    return -1;
+  }
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  {
+    std::lock_guard<std::mutex> clock(c->mu);
+    if (c->friends.count(userid)) {
+      set_error(ERROR_ALREADY_EXIST);
+      return -1;
+    }
+  }
+  auto peer = net.peers.find(userid);
+  if (peer != net.peers.end()) {
+    std::string name = peer->second.name.empty() ? userid.substr(0, 8) : peer->second.name;
+    befriend_locked(c, make_friend_info(userid, name, peer->second.online),
+                    2 * peer_delay_locked(net, userid));
+    return 0;
+  }
+  if (Carrier* target = instance_by_userid_locked(net, userid)) {
+    CarrierUserInfo from_info;
+    std::string greeting = hello ? hello : "";
+    std::string from = c->userid;
+    {
+      std::lock_guard<std::mutex> clock(c->mu);
+      from_info = c->self;
+    }
+    {
+      std::lock_guard<std::mutex> clock(target->mu);
+      target->requests.insert(from);
+    }
+    post_locked(target, 0, [target, from, from_info, greeting]() {
+      if (target->callbacks.friend_request) {
+        target->callbacks.friend_request(target, from.c_str(), &from_info, greeting.c_str(),
+                                         target->context);
+      }
+    });
+  }
+  return 0;
+}
+
+int carrier_accept_friend(Carrier* c, const char* userid) {
+  if (!c || !userid) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  {
+    std::lock_guard<std::mutex> clock(c->mu);
+    if (!c->requests.erase(userid)) {
+      set_error(ERROR_NO_MATCHED_REQUEST);
+      return -1;
+    }
+  }
+  Carrier* requester = instance_by_userid_locked(net, userid);
+  befriend_locked(c, make_friend_info(userid, userid, requester != nullptr), 0);
+  if (requester) befriend_locked(requester, make_friend_info(c->userid, c->userid, true), 0);
+  return 0;
+}
+
+int carrier_remove_friend(Carrier* c, const char* userid) {
+  if (!c || !userid) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  std::lock_guard<std::mutex> lock(c->mu);
+  if (!c->friends.erase(userid)) {
+    set_error(ERROR_NOT_EXIST);
+    return -1;
+  }
+  return 0;
+}
+
+// Online peers get the message after their latency and a ByFriend receipt one
+// round trip later, unless the loss roll drops it (Error receipt). Offline
+// peers refuse with ERROR_FRIEND_OFFLINE, or queue with an Offline receipt
+// when they model Express-stored delivery.
+int carrier_send_friend_message(Carrier* c,
+                                const char* to,
+                                const void* msg,
+                                size_t len,
+                                uint32_t* msgid,
+                                CarrierFriendMessageReceiptCallback* cb,
+                                void* context) {
+  if (!c || !to || !msg || len == 0) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  if (len > kMaxMessageBytes) {
+    set_error(ERROR_TOO_LONG);
+    return -1;
+  }
+  std::string peer = to;
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  uint32_t id = 0;
+  bool online = false;
+  {
+    std::lock_guard<std::mutex> clock(c->mu);
+    auto it = c->friends.find(peer);
+    if (it == c->friends.end()) {
+      set_error(ERROR_NOT_EXIST);
+      return -1;
+    }
+    online = it->second.status == CarrierConnectionStatus_Connected;
+    id = c->next_msgid++;
+  }
+  if (msgid) *msgid = id;
+
+  FakePeerOptions opts;
+  auto pit = net.peers.find(peer);
+  if (pit != net.peers.end()) opts = pit->second;
+  Carrier* target = instance_by_userid_locked(net, peer);
+  int delay = peer_delay_locked(net, peer);
+
+  auto receipt = [cb, context, id](CarrierReceiptState state) {
+    return [cb, context, id, state]() { cb(id, state, context); };
+  };
+
+  if (!online) {
+    if (opts.offline_receipts && cb) {
+      net.stats.offline_receipts++;
+      post_locked(c, delay, receipt(CarrierReceipt_Offline));
+      return 0;
+    }
+    net.stats.offline_errors++;
+    set_error(ERROR_FRIEND_OFFLINE);
+    return -1;
+  }
+
+  net.stats.sent++;
+  if (opts.loss > 0 && std::uniform_real_distribution<double>(0, 1)(net.rng) < opts.loss) {
+    net.stats.lost++;
+    if (cb) post_locked(c, delay, receipt(CarrierReceipt_Error));
+    return 0;
+  }
+
+  FakeOutbound out;
+  out.carrier = c;
+  out.from = c->userid;
+  out.to = peer;
+  out.payload.assign(static_cast<const char*>(msg), len);
+  out.msgid = id;
+  int64_t sent_us = wall_now_us();
+  bool echo = opts.echo;
+  post_locked(c, delay, [out, target, sent_us, echo, delay]() {
+    network().stats.delivered++;
+    if (target) {
+      Network& inner = network();
+      std::lock_guard<std::mutex> guard(inner.mu);
+      if (is_live_locked(inner, target)) {
+        deliver_message_locked(target, 0, out.from, out.payload, sent_us, false);
+      }
+      return;
+    }
+    call_outbound_hook(out);
+    if (echo) {
+      Network& inner = network();
+      std::lock_guard<std::mutex> guard(inner.mu);
+      if (is_live_locked(inner, out.carrier)) {
+        deliver_message_locked(out.carrier, delay, out.to, out.payload, wall_now_us(), false);
+      }
+    }
+  });
+  if (cb) post_locked(c, 2 * delay, receipt(CarrierReceipt_ByFriend));
+  return 0;
+}
+
+// ---- carrier_config.h ---------------------------------------------------------
+
+CarrierOptions* carrier_config_load(const char* config_file,
+                                    int (*extra_config_handle)(void* cfg, CarrierOptions* options),
+                                    CarrierOptions* options) {
+  (void)extra_config_handle;
+  if (!config_file || !options) return nullptr;
+  std::ifstream in(config_file);
+  if (!in) return nullptr;
+  std::memset(options, 0, sizeof(*options));
+  options->udp_enabled = true;
+  return options;
+}
+
+void carrier_config_free(CarrierOptions* options) {
+  if (!options) return;
+  std::free(const_cast<char*>(options->persistent_location));
+  std::memset(options, 0, sizeof(*options));
+}
+
+// ---- carrier_filetransfer.h -----------------------------------------------------
+
+int carrier_filetransfer_init(Carrier* c, CarrierFileTransferConnectCallback* callback, void* context) {
+  if (!c) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  std::lock_guard<std::mutex> lock(c->mu);
+  c->ft_connect = callback;
+  c->ft_context = context;
+  return 0;
+}
+
+// Transfers stay owned by the caller, which closes them after cleanup.
+void carrier_filetransfer_cleanup(Carrier* c) {
+  if (!c) return;
+  std::lock_guard<std::mutex> lock(c->mu);
+  c->ft_connect = nullptr;
+  c->ft_context = nullptr;
+  c->offers.clear();
+}
+
+char* carrier_filetransfer_fileid(char* fileid, size_t length) {
+  if (!fileid || length < CARRIER_MAX_FILE_ID_LEN) {
+    set_error(ERROR_BUFFER_TOO_SMALL);
+    return nullptr;
+  }
+  uint64_t n = 0;
+  {
+    Network& net = network();
+    std::lock_guard<std::mutex> lock(net.mu);
+    n = net.next_fileid++ ^ net.rng();
+  }
+  std::string id = base58_run(n, CARRIER_MAX_FILE_ID_LEN - 1);
+  std::memcpy(fileid, id.c_str(), id.size() + 1);
+  return fileid;
+}
+
+CarrierFileTransfer* carrier_filetransfer_new(Carrier* c,
+                                              const char* address,
+                                              const CarrierFileTransferInfo* fileinfo,
+                                              CarrierFileTransferCallbacks* callbacks,
+                                              void* context) {
+  if (!c || !address || !callbacks) {
+    set_error(ERROR_INVALID_ARGS);
+    return nullptr;
+  }
+  auto* ft = new CarrierFileTransfer();
+  ft->carrier = c;
+  ft->peer = address;
+  std::memset(&ft->info, 0, sizeof(ft->info));
+  if (fileinfo) ft->info = *fileinfo;
+  ft->callbacks = *callbacks;
+  ft->context = context;
+  {
+    std::lock_guard<std::mutex> lock(c->mu);
+    auto it = c->offers.find(ft->info.fileid);
+    if (it != c->offers.end() && it->second.from == ft->peer) {
+      ft->local_sender = false;
+      ft->data = std::move(it->second.bytes);
+      c->offers.erase(it);
+    }
+  }
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  ft->id = net.next_transfer_id++;
+  net.transfers[ft->id] = ft;
+  return ft;
+}
+
+void carrier_filetransfer_close(CarrierFileTransfer* ft) {
+  if (!ft) return;
+  {
+    Network& net = network();
+    std::lock_guard<std::mutex> lock(net.mu);
+    net.transfers.erase(ft->id);
+  }
+  delete ft;
+}
+
+int carrier_filetransfer_connect(CarrierFileTransfer* ft) {
+  if (!ft || !ft->local_sender) {
+    set_error(ft ? ERROR_WRONG_STATE : ERROR_INVALID_ARGS);
+    return -1;
+  }
+  Carrier* c = ft->carrier;
+  Network& net = network();
+  std::lock_guard<std::mutex> lock(net.mu);
+  bool online = false;
+  {
+    std::lock_guard<std::mutex> clock(c->mu);
+    auto it = c->friends.find(ft->peer);
+    if (it == c->friends.end()) {
+      set_error(ERROR_NOT_EXIST);
+      return -1;
+    }
+    online = it->second.status == CarrierConnectionStatus_Connected;
+  }
+  int delay = peer_delay_locked(net, ft->peer);
+  std::string fileid = ft->info.fileid;
+  post_locked(c, 0, on_transfer(ft->id, [](CarrierFileTransfer* t) {
+    set_transfer_state(t, FileTransferConnection_connecting);
+  }));
+  if (!online) {
+    post_locked(c, delay, on_transfer(ft->id, [](CarrierFileTransfer* t) {
+      set_transfer_state(t, FileTransferConnection_failed);
+    }));
+    return 0;
+  }
+  post_locked(c, delay, on_transfer(ft->id, [](CarrierFileTransfer* t) {
+    set_transfer_state(t, FileTransferConnection_connected);
+  }));
+  post_locked(c, 2 * delay, on_transfer(ft->id, [fileid](CarrierFileTransfer* t) {
+    if (t->callbacks.pull) t->callbacks.pull(t, fileid.c_str(), 0, t->context);
+  }));
+  return 0;
+}
+
+int carrier_filetransfer_accept_connect(CarrierFileTransfer* ft) {
+  if (!ft || ft->local_sender) {
+    set_error(ft ? ERROR_WRONG_STATE : ERROR_INVALID_ARGS);
+    return -1;
+  }
+  post(ft->carrier, 0, on_transfer(ft->id, [](CarrierFileTransfer* t) {
+    set_transfer_state(t, FileTransferConnection_connected);
+  }));
+  return 0;
+}
+
+// Streams the offered file in user-data sized chunks, then an empty chunk.
+int carrier_filetransfer_pull(CarrierFileTransfer* ft, const char* fileid, uint64_t offset) {
+  if (!ft || !fileid || ft->local_sender || std::strcmp(fileid, ft->info.fileid) != 0) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  std::string id = fileid;
+  post(ft->carrier, 0, on_transfer(ft->id, [id, offset](CarrierFileTransfer* t) {
+    size_t off = static_cast<size_t>(std::min<uint64_t>(offset, t->data.size()));
+    bool ok = true;
+    while (ok && off < t->data.size()) {
+      size_t n = std::min<size_t>(CARRIER_MAX_USER_DATA_LEN, t->data.size() - off);
+      ok = t->callbacks.data &&
+           t->callbacks.data(t, id.c_str(),
+                             reinterpret_cast<const uint8_t*>(t->data.data() + off), n, t->context);
+      off += n;
+    }
+    if (ok) {
+      network().stats.files_in++;
+      if (t->callbacks.data) t->callbacks.data(t, id.c_str(), nullptr, 0, t->context);
+    }
+    post(t->carrier, 0, on_transfer(t->id, [](CarrierFileTransfer* done) {
+      set_transfer_state(done, FileTransferConnection_closed);
+    }));
+  }));
+  return 0;
+}
+
+ssize_t carrier_filetransfer_send(CarrierFileTransfer* ft,
+                                  const char* fileid,
+                                  const uint8_t* data,
+                                  size_t length) {
+  if (!ft || !fileid || !ft->local_sender || std::strcmp(fileid, ft->info.fileid) != 0) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  if (length > 0) {
+    if (!data) {
+      set_error(ERROR_INVALID_ARGS);
+      return -1;
+    }
+    ft->data.append(reinterpret_cast<const char*>(data), length);
+    return static_cast<ssize_t>(length);
+  }
+
+  network().stats.files_out++;
+  FakeOutbound out;
+  out.carrier = ft->carrier;
+  out.from = fake_carrier_instance_userid(ft->carrier);
+  out.to = ft->peer;
+  out.payload = ft->data;
+  out.file = true;
+  out.filename = ft->info.filename;
+  {
+    Network& net = network();
+    std::lock_guard<std::mutex> lock(net.mu);
+    if (Carrier* target = instance_by_userid_locked(net, ft->peer)) {
+      offer_file_locked(net, target, 0, out.from, out.filename, out.payload);
+      out.carrier = nullptr;
+    }
+    int delay = peer_delay_locked(net, ft->peer);
+    if (is_live_locked(net, ft->carrier)) {
+      post_locked(ft->carrier, delay, on_transfer(ft->id, [](CarrierFileTransfer* t) {
+        set_transfer_state(t, FileTransferConnection_closed);
+      }));
+    }
+  }
+  if (out.carrier) call_outbound_hook(out);
+  return 0;
+}
+
+int carrier_filetransfer_cancel(CarrierFileTransfer* ft, const char* fileid, int status, const char* reason) {
+  (void)fileid;
+  (void)status;
+  (void)reason;
+  if (!ft) {
+    set_error(ERROR_INVALID_ARGS);
+    return -1;
+  }
+  post(ft->carrier, 0, on_transfer(ft->id, [](CarrierFileTransfer* t) {
+    set_transfer_state(t, FileTransferConnection_closed);
+  }));
+  return 0;
+}
+
+}  // extern "C"
@@ -0,0 +1,198 @@
+/*
+ * In-process stand-in for the Elastos Carrier public API (carrier.h).
+ *
+ * Only the subset used by the sidecar is declared. Types, constants and
+ * signatures mirror the upstream header so beagle_sdk.cpp builds unchanged
+ * against either the real SDK or the fake (-DBEAGLE_SDK_FAKE=ON).
+ */
+#ifndef __FAKE_CARRIER_H__
+#define __FAKE_CARRIER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CARRIER_MAX_ADDRESS_LEN 52
+#define CARRIER_MAX_ID_LEN 45
+#define CARRIER_MAX_USER_NAME_LEN 63
+#define CARRIER_MAX_USER_DESCRIPTION_LEN 127
+#define CARRIER_MAX_PHONE_LEN 31
+#define CARRIER_MAX_EMAIL_LEN 127
+#define CARRIER_MAX_REGION_LEN 127
+#define CARRIER_MAX_GENDER_LEN 31
+#define CARRIER_MAX_NODE_NAME_LEN 63
+#define CARRIER_MAX_NODE_DESCRIPTION_LEN 127
+#define CARRIER_MAX_APP_MESSAGE_LEN 1024
+#define CARRIER_MAX_INVITE_DATA_LEN 8192
+#define CARRIER_MAX_BUNDLE_LEN 511
+
+typedef struct Carrier Carrier;
+
+typedef struct BootstrapNode {
+  const char *ipv4;
+  const char *ipv6;
+  const char *port;
+  const char *public_key;
+} BootstrapNode;
+
+typedef struct ExpressNode {
+  const char *ipv4;
+  const char *port;
+  const char *public_key;
+} ExpressNode;
+
+typedef struct CarrierOptions {
+  const char *persistent_location;
+  bool udp_enabled;
+  const char *secret_key;
+  int log_level;
+  const char *log_file;
+  void *log_printer;
+  size_t bootstraps_size;
+  BootstrapNode *bootstraps;
+  size_t express_nodes_size;
+  ExpressNode *express_nodes;
+} CarrierOptions;
+
+typedef enum CarrierConnectionStatus {
+  CarrierConnectionStatus_Connected,
+  CarrierConnectionStatus_Disconnected,
+} CarrierConnectionStatus;
+
+typedef enum CarrierPresenceStatus {
+  CarrierPresenceStatus_None,
+  CarrierPresenceStatus_Away,
+  CarrierPresenceStatus_Busy,
+} CarrierPresenceStatus;
+
+typedef enum CarrierReceiptState {
+  CarrierReceipt_ByFriend,
+  CarrierReceipt_Offline,
+  CarrierReceipt_Error,
+} CarrierReceiptState;
+
+typedef struct CarrierUserInfo {
+  char userid[CARRIER_MAX_ID_LEN + 1];
+  char name[CARRIER_MAX_USER_NAME_LEN + 1];
+  char description[CARRIER_MAX_USER_DESCRIPTION_LEN + 1];
+  int has_avatar;
+  char gender[CARRIER_MAX_GENDER_LEN + 1];
+  char phone[CARRIER_MAX_PHONE_LEN + 1];
+  char email[CARRIER_MAX_EMAIL_LEN + 1];
+  char region[CARRIER_MAX_REGION_LEN + 1];
+} CarrierUserInfo;
+
+typedef struct CarrierFriendInfo {
+  CarrierUserInfo user_info;
+  char label[CARRIER_MAX_USER_NAME_LEN + 1];
+  CarrierConnectionStatus status;
+  CarrierPresenceStatus presence;
+} CarrierFriendInfo;
+
+typedef struct CarrierCallbacks {
+  void (*idle)(Carrier *carrier, void *context);
+  void (*connection_status)(Carrier *carrier, CarrierConnectionStatus status, void *context);
+  void (*ready)(Carrier *carrier, void *context);
+  void (*self_info)(Carrier *carrier, const CarrierUserInfo *info, void *context);
+  bool (*friend_list)(Carrier *carrier, const CarrierFriendInfo *info, void *context);
+  void (*friend_connection)(Carrier *carrier, const char *friendid,
+                            CarrierConnectionStatus status, void *context);
+  void (*friend_info)(Carrier *carrier, const char *friendid,
+                      const CarrierFriendInfo *info, void *context);
+  void (*friend_presence)(Carrier *carrier, const char *friendid,
+                          CarrierPresenceStatus presence, void *context);
+  void (*friend_request)(Carrier *carrier, const char *userid,
+                         const CarrierUserInfo *info, const char *hello, void *context);
+  void (*friend_added)(Carrier *carrier, const CarrierFriendInfo *info, void *context);
+  void (*friend_removed)(Carrier *carrier, const char *friendid, void *context);
+  void (*friend_message)(Carrier *carrier, const char *from, const void *msg, size_t len,
+                         int64_t timestamp, bool offline, void *context);
+  void (*friend_invite)(Carrier *carrier, const char *from, const char *bundle,
+                        const void *data, size_t len, void *context);
+} CarrierCallbacks;
+
+typedef bool CarrierFriendsIterateCallback(const CarrierFriendInfo *info, void *context);
+typedef void CarrierFriendMessageReceiptCallback(uint32_t msgid, CarrierReceiptState state,
+                                                 void *context);
+
+Carrier *carrier_new(const CarrierOptions *options, CarrierCallbacks *callbacks, void *context);
+void carrier_kill(Carrier *carrier);
+int carrier_run(Carrier *carrier, int interval);
+
+char *carrier_get_address(Carrier *carrier, char *address, size_t len);
+char *carrier_get_nodeid(Carrier *carrier, char *nodeid, size_t len);
+char *carrier_get_userid(Carrier *carrier, char *userid, size_t len);
+char *carrier_get_id_by_address(const char *address, char *userid, size_t len);
+
+int carrier_set_self_info(Carrier *carrier, const CarrierUserInfo *info);
+int carrier_get_self_info(Carrier *carrier, CarrierUserInfo *info);
+bool carrier_is_ready(Carrier *carrier);
+
+int carrier_get_friends(Carrier *carrier, CarrierFriendsIterateCallback *callback, void *context);
+int carrier_get_friend_info(Carrier *carrier, const char *friendid, CarrierFriendInfo *info);
+int carrier_add_friend(Carrier *carrier, const char *address, const char *hello);
+int carrier_accept_friend(Carrier *carrier, const char *userid);
+int carrier_remove_friend(Carrier *carrier, const char *userid);
+
+int carrier_send_friend_message(Carrier *carrier, const char *to, const void *msg, size_t len,
+                                uint32_t *msgid, CarrierFriendMessageReceiptCallback *cb,
+                                void *context);
+
+#define CARRIER_SUCCESS 0
+
+#define CARRIER_FACILITY_GENERAL 0x01
+#define CARRIER_FACILITY_SYS 0x02
+
+#define ERROR_INVALID_ARGS 0x01
+#define ERROR_OUT_OF_MEMORY 0x02
+#define ERROR_BUFFER_TOO_SMALL 0x03
+#define ERROR_BAD_PERSISTENT_DATA 0x04
+#define ERROR_INVALID_PERSISTENCE_FILE 0x05
+#define ERROR_INVALID_CONTROL_PACKET 0x06
+#define ERROR_INVALID_CREDENTIAL 0x07
+#define ERROR_ALREADY_RUN 0x08
+#define ERROR_NOT_READY 0x09
+#define ERROR_NOT_EXIST 0x0A
+#define ERROR_ALREADY_EXIST 0x0B
+#define ERROR_NO_MATCHED_REQUEST 0x0C
+#define ERROR_INVALID_USERID 0x0D
+#define ERROR_INVALID_NODEID 0x0E
+#define ERROR_WRONG_STATE 0x0F
+#define ERROR_BEING_BUSY 0x10
+#define ERROR_LANGUAGE_BINDING 0x11
+#define ERROR_ENCRYPT 0x12
+#define ERROR_SDP_TOO_LONG 0x13
+#define ERROR_INVALID_SDP 0x14
+#define ERROR_NOT_IMPLEMENTED 0x15
+#define ERROR_LIMIT_EXCEEDED 0x16
+#define ERROR_PORT_ALLOC 0x17
+#define ERROR_BAD_PROXY_TYPE 0x18
+#define ERROR_BAD_PROXY_HOST 0x19
+#define ERROR_BAD_PROXY_PORT 0x1A
+#define ERROR_PROXY_NOT_AVAILABLE 0x1B
+#define ERROR_ENCRYPTED_PERSISTENT_DATA 0x1C
+#define ERROR_BAD_BOOTSTRAP_HOST 0x1D
+#define ERROR_BAD_BOOTSTRAP_PORT 0x1E
+#define ERROR_TOO_LONG 0x1F
+#define ERROR_ADD_SELF 0x20
+#define ERROR_BAD_ADDRESS 0x21
+#define ERROR_FRIEND_OFFLINE 0x22
+#define ERROR_UNKNOWN 0xFF
+
+#define CARRIER_MK_ERROR(facility, code) (0x80000000 | ((facility) << 24) | \
+                                          ((((code) & 0x80000000) >> 8) | ((code) & 0x7FFFFFFF)))
+#define CARRIER_GENERAL_ERROR(code) CARRIER_MK_ERROR(CARRIER_FACILITY_GENERAL, code)
+#define CARRIER_SYS_ERROR(code) CARRIER_MK_ERROR(CARRIER_FACILITY_SYS, code)
+
+int carrier_get_error(void);
+void carrier_clear_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FAKE_CARRIER_H__ */
@@ -0,0 +1,22 @@
+/*
+ * In-process stand-in for the Carrier sample config loader (carrier_config.h).
+ */
+#ifndef __FAKE_CARRIER_CONFIG_H__
+#define __FAKE_CARRIER_CONFIG_H__
+
+#include <carrier.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+CarrierOptions *carrier_config_load(const char *config_file,
+                                    int (*extra_config_handle)(void *cfg, CarrierOptions *options),
+                                    CarrierOptions *options);
+void carrier_config_free(CarrierOptions *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FAKE_CARRIER_CONFIG_H__ */
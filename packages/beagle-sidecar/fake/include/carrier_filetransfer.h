@@ -0,0 +1,76 @@
+/*
+ * In-process stand-in for the Carrier filetransfer API (carrier_filetransfer.h).
+ */
+#ifndef __FAKE_CARRIER_FILETRANSFER_H__
+#define __FAKE_CARRIER_FILETRANSFER_H__
+
+#include <sys/types.h>
+
+#include <carrier.h>
+#include <carrier_session.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CARRIER_MAX_FILE_ID_LEN 45
+#define CARRIER_MAX_FILE_NAME_LEN 255
+
+typedef struct CarrierFileTransfer CarrierFileTransfer;
+
+typedef struct CarrierFileTransferInfo {
+  char filename[CARRIER_MAX_FILE_NAME_LEN + 1];
+  char fileid[CARRIER_MAX_FILE_ID_LEN + 1];
+  uint64_t size;
+} CarrierFileTransferInfo;
+
+typedef enum FileTransferConnection {
+  FileTransferConnection_initialized = 1,
+  FileTransferConnection_connecting,
+  FileTransferConnection_connected,
+  FileTransferConnection_closed,
+  FileTransferConnection_failed,
+} FileTransferConnection;
+
+typedef struct CarrierFileTransferCallbacks {
+  void (*state_changed)(CarrierFileTransfer *filetransfer, FileTransferConnection state,
+                        void *context);
+  void (*file)(CarrierFileTransfer *filetransfer, const char *fileid, const char *filename,
+               uint64_t size, void *context);
+  void (*pull)(CarrierFileTransfer *filetransfer, const char *fileid, uint64_t offset,
+               void *context);
+  bool (*data)(CarrierFileTransfer *filetransfer, const char *fileid, const uint8_t *data,
+               size_t length, void *context);
+  void (*pending)(CarrierFileTransfer *filetransfer, const char *fileid, void *context);
+  void (*resume)(CarrierFileTransfer *filetransfer, const char *fileid, void *context);
+  void (*cancel)(CarrierFileTransfer *filetransfer, const char *fileid, int status,
+                 const char *reason, void *context);
+} CarrierFileTransferCallbacks;
+
+typedef void CarrierFileTransferConnectCallback(Carrier *carrier, const char *address,
+                                                const CarrierFileTransferInfo *fileinfo,
+                                                void *context);
+
+int carrier_filetransfer_init(Carrier *carrier, CarrierFileTransferConnectCallback *callback,
+                              void *context);
+void carrier_filetransfer_cleanup(Carrier *carrier);
+char *carrier_filetransfer_fileid(char *fileid, size_t length);
+CarrierFileTransfer *carrier_filetransfer_new(Carrier *carrier, const char *address,
+                                              const CarrierFileTransferInfo *fileinfo,
+                                              CarrierFileTransferCallbacks *callbacks,
+                                              void *context);
+void carrier_filetransfer_close(CarrierFileTransfer *filetransfer);
+int carrier_filetransfer_connect(CarrierFileTransfer *filetransfer);
+int carrier_filetransfer_accept_connect(CarrierFileTransfer *filetransfer);
+int carrier_filetransfer_pull(CarrierFileTransfer *filetransfer, const char *fileid,
+                              uint64_t offset);
+ssize_t carrier_filetransfer_send(CarrierFileTransfer *filetransfer, const char *fileid,
+                                  const uint8_t *data, size_t length);
+int carrier_filetransfer_cancel(CarrierFileTransfer *filetransfer, const char *fileid,
+                                int status, const char *reason);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FAKE_CARRIER_FILETRANSFER_H__ */
@@ -0,0 +1,12 @@
+/*
+ * In-process stand-in for carrier_session.h. The sidecar only needs the
+ * user-data size limit that the filetransfer API borrows from sessions.
+ */
+#ifndef __FAKE_CARRIER_SESSION_H__
+#define __FAKE_CARRIER_SESSION_H__
+
+#include <carrier.h>
+
+#define CARRIER_MAX_USER_DATA_LEN 1280
+
+#endif /* __FAKE_CARRIER_SESSION_H__ */
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <carrier.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Control surface of the in-process fake Carrier (-DBEAGLE_SDK_FAKE=ON).
+//
+// The fake keeps one simulated network per process: peers registered here are
+// friends of every Carrier instance, so each sidecar account sees them in its
+// friend list. Instances created by carrier_new() in the same process can also
+// message each other directly. All callbacks run on the instance's
+// carrier_run() thread, as with the real SDK.
+//
+// Without any calls to this API a fake build still comes up usable: the
+// BEAGLE_FAKE_PEERS, BEAGLE_FAKE_LATENCY_MS, BEAGLE_FAKE_JITTER_MS,
+// BEAGLE_FAKE_LOSS, BEAGLE_FAKE_ECHO and BEAGLE_FAKE_SEED environment
+// variables seed a set of echoing peers when the first instance is created.
+
+struct FakePeerOptions {
+  bool online = true;
+  int latency_ms = 0;         // one-way delay for messages, receipts and presence
+  int jitter_ms = 0;          // uniform extra delay in [0, jitter_ms]
+  double loss = 0;            // probability an online send is lost (Error receipt)
+  bool offline_receipts = false;  // offline sends succeed and get an Offline receipt
+  bool echo = false;          // send every delivered message back to the sender
+  std::string name;
+};
+
+// A message or completed file leaving a Carrier instance towards a fake peer.
+struct FakeOutbound {
+  Carrier* carrier = nullptr;
+  std::string from;  // userid of the sending instance
+  std::string to;
+  std::string payload;
+  bool file = false;  // true for filetransfer uploads; payload holds the file
+  std::string filename;
+  uint32_t msgid = 0;
+};
+
+using FakeOutboundHook = std::function<void(const FakeOutbound&)>;
+
+// Deterministic 44-character userid / 52-character address for a seed.
+std::string fake_carrier_make_userid(const std::string& seed);
+std::string fake_carrier_make_address(const std::string& userid);
+
+// Registers (or reconfigures) a peer and befriends it on every instance.
+void fake_carrier_add_peer(const std::string& userid, const FakePeerOptions& options);
+void fake_carrier_remove_peer(const std::string& userid);
+// Flips presence; instances get friend_connection after the peer latency.
+bool fake_carrier_set_peer_online(const std::string& userid, bool online);
+std::vector<std::string> fake_carrier_peers();
+
+// Delivers payload from peer `from` as a friend message. to == nullptr
+// delivers to every instance that has `from` as a friend. ts_us = 0 stamps
+// the current time. Returns the number of instances the message was queued on.
+int fake_carrier_deliver(Carrier* to,
+                         const std::string& from,
+                         const std::string& payload,
+                         int64_t ts_us = 0,
+                         bool offline = false);
+// Offers a file from peer `from` through the filetransfer connect callback.
+int fake_carrier_send_file(Carrier* to,
+                           const std::string& from,
+                           const std::string& filename,
+                           const std::string& bytes);
+
+// Replaces the hook that observes outbound messages; runs on the sending
+// instance's carrier thread.
+void fake_carrier_set_outbound_hook(FakeOutboundHook hook);
+
+// Live instances and their userids, in creation order.
+std::vector<Carrier*> fake_carrier_instances();
+std::string fake_carrier_instance_userid(Carrier* carrier);
+
+struct FakeCarrierStats {
+  uint64_t sent = 0;             // carrier_send_friend_message calls accepted
+  uint64_t delivered = 0;        // messages that reached a peer or instance
+  uint64_t lost = 0;             // dropped by the loss rate
+  uint64_t offline_errors = 0;   // sends refused with ERROR_FRIEND_OFFLINE
+  uint64_t offline_receipts = 0; // sends accepted for an offline peer
+  uint64_t inbound = 0;          // friend_message callbacks fired
+  uint64_t files_out = 0;
+  uint64_t files_in = 0;
+};
+
+FakeCarrierStats fake_carrier_stats();
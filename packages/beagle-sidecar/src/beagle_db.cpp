@@ -0,0 +1,1207 @@
+#include "beagle_db.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#if BEAGLE_HAVE_MYSQL
+#include <mysql.h>
+#endif
+
+#if BEAGLE_HAVE_SQLITE
+#include <sqlite3.h>
+#endif
+
+#if !BEAGLE_HAVE_MYSQL
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+extern char** environ;
+#endif
+
+namespace {
+
+#if !BEAGLE_HAVE_MYSQL
+static std::string sql_escape(const std::string& in) {
+  std::string out;
+  out.reserve(in.size() + 8);
+  for (char c : in) {
+    if (c == '\\' || c == '\'') out.push_back('\\');
+    out.push_back(c);
+  }
+  return out;
+}
+
+// Substitutes `?` placeholders (outside quoted literals) with SQL literals.
+static std::string inline_params(const std::string& sql, const std::vector<DbValue>& params) {
+  std::string out;
+  out.reserve(sql.size() + params.size() * 16);
+  size_t next = 0;
+  char quote = 0;
+  for (size_t i = 0; i < sql.size(); ++i) {
+    char c = sql[i];
+    if (quote) {
+      out.push_back(c);
+      if (c == '\\' && i + 1 < sql.size()) {
+        out.push_back(sql[++i]);
+      } else if (c == quote) {
+        quote = 0;
+      }
+      continue;
+    }
+    if (c == '\'' || c == '"' || c == '`') {
+      quote = c;
+      out.push_back(c);
+      continue;
+    }
+    if (c != '?' || next >= params.size()) {
+      out.push_back(c);
+      continue;
+    }
+    const DbValue& v = params[next++];
+    if (v.kind == DbValue::Int) {
+      out += std::to_string(v.i);
+    } else if (v.kind == DbValue::Text) {
+      out += "'" + sql_escape(v.s) + "'";
+    } else {
+      out += "NULL";
+    }
+  }
+  return out;
+}
+
+// Starts the mysql CLI with `sql` on stdin, fed from an unlinked temp file so
+// a long transaction is not bound by ARG_MAX. There is no shell: the password
+// reaches the child only through MYSQL_PWD in its environment, never a command
+// line. With capture_fd set, stdout comes back through a pipe and stderr is
+// discarded. Returns the child pid, or -1.
+static pid_t mysql_cli_spawn(const MysqlEndpoint& ep,
+                             bool select_db,
+                             bool batch,
+                             const std::string& sql,
+                             int* capture_fd) {
+  const char* tmp_dir = std::getenv("TMPDIR");
+  std::string tmpl = std::string(tmp_dir && *tmp_dir ? tmp_dir : "/tmp") + "/beagle-sql-XXXXXX";
+  std::vector<char> path(tmpl.begin(), tmpl.end());
+  path.push_back('\0');
+  int sql_fd = mkstemp(path.data());
+  if (sql_fd < 0) return -1;
+  unlink(path.data());
+  size_t off = 0;
+  while (off < sql.size()) {
+    ssize_t n = write(sql_fd, sql.data() + off, sql.size() - off);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      close(sql_fd);
+      return -1;
+    }
+    off += static_cast<size_t>(n);
+  }
+  lseek(sql_fd, 0, SEEK_SET);
+
+  std::vector<std::string> args = {"mysql"};
+  if (batch) {
+    args.push_back("--batch");
+    args.push_back("--skip-column-names");
+    args.push_back("--raw");
+  }
+  args.push_back("--protocol=TCP");
+  args.push_back("--host=" + ep.host);
+  args.push_back("--port=" + std::to_string(ep.port));
+  args.push_back("--user=" + ep.user);
+  if (select_db && !ep.database.empty()) args.push_back("--database=" + ep.database);
+  std::vector<char*> argv;
+  for (auto& a : args) argv.push_back(&a[0]);
+  argv.push_back(nullptr);
+
+  std::vector<std::string> env_strings;
+  for (char** e = environ; e && *e; ++e) {
+    if (std::strncmp(*e, "MYSQL_PWD=", 10) != 0) env_strings.push_back(*e);
+  }
+  env_strings.push_back("MYSQL_PWD=" + ep.password);
+  std::vector<char*> envp;
+  for (auto& e : env_strings) envp.push_back(&e[0]);
+  envp.push_back(nullptr);
+
+  int out_pipe[2] = {-1, -1};
+  if (capture_fd && pipe(out_pipe) != 0) {
+    close(sql_fd);
+    return -1;
+  }
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, sql_fd, STDIN_FILENO);
+  if (capture_fd) {
+    posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, out_pipe[0]);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+  }
+  pid_t pid = -1;
+  int rc = posix_spawnp(&pid, "mysql", &actions, nullptr, argv.data(), envp.data());
+  posix_spawn_file_actions_destroy(&actions);
+  close(sql_fd);
+  if (capture_fd) close(out_pipe[1]);
+  if (rc != 0) {
+    if (capture_fd) close(out_pipe[0]);
+    return -1;
+  }
+  if (capture_fd) *capture_fd = out_pipe[0];
+  return pid;
+}
+
+static int mysql_cli_wait(pid_t pid) {
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) return -1;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static bool mysql_cli_exec(const MysqlEndpoint& ep, const std::string& sql, bool select_db) {
+  pid_t pid = mysql_cli_spawn(ep, select_db, false, sql, nullptr);
+  int rc = pid < 0 ? -1 : mysql_cli_wait(pid);
+  if (rc != 0) log_warn("[beagle-db] mysql cli failed rc=" + std::to_string(rc));
+  return rc == 0;
+}
+
+static bool mysql_cli_query(const MysqlEndpoint& ep,
+                            const std::string& sql,
+                            std::vector<DbRow>& rows,
+                            size_t max_rows) {
+  int out_fd = -1;
+  pid_t pid = mysql_cli_spawn(ep, true, true, sql, &out_fd);
+  if (pid < 0) return false;
+  FILE* fp = fdopen(out_fd, "r");
+  if (!fp) {
+    close(out_fd);
+    mysql_cli_wait(pid);
+    return false;
+  }
+  std::string line;
+  char buf[4096];
+  while (std::fgets(buf, sizeof(buf), fp) != nullptr) {
+    line += buf;
+    if (line.empty() || line.back() != '\n') continue;
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+    DbRow row;
+    size_t start = 0;
+    while (true) {
+      size_t tab = line.find('\t', start);
+      std::string field = line.substr(start, tab == std::string::npos ? std::string::npos : tab - start);
+      row.push_back(field == "NULL" ? std::string() : field);
+      if (tab == std::string::npos) break;
+      start = tab + 1;
+    }
+    rows.push_back(std::move(row));
+    line.clear();
+    if (max_rows > 0 && rows.size() >= max_rows) break;
+  }
+  // Closing the read end first lets a child still writing exit on EPIPE.
+  std::fclose(fp);
+  int rc = mysql_cli_wait(pid);
+  return rc == 0 || !rows.empty();
+}
+#endif
+
+#if BEAGLE_HAVE_MYSQL
+// MYSQL_BIND::is_null is `bool*` on MySQL 8 and `my_bool*` on MariaDB/5.x.
+using MysqlBool = std::remove_pointer<decltype(std::declval<MYSQL_BIND>().is_null)>::type;
+
+static std::once_flag g_mysql_library_once;
+
+static bool is_connection_lost(unsigned int err) {
+  return err == 2006 /* CR_SERVER_GONE_ERROR */ || err == 2013 /* CR_SERVER_LOST */;
+}
+
+static MYSQL* open_native(const MysqlEndpoint& ep, bool select_db) {
+  std::call_once(g_mysql_library_once, []() { mysql_library_init(0, nullptr, nullptr); });
+  MYSQL* handle = mysql_init(nullptr);
+  if (!handle) return nullptr;
+  unsigned int connect_timeout = 5;
+  unsigned int io_timeout = 30;
+  unsigned int protocol = MYSQL_PROTOCOL_TCP;
+  mysql_options(handle, MYSQL_OPT_CONNECT_TIMEOUT, &connect_timeout);
+  mysql_options(handle, MYSQL_OPT_READ_TIMEOUT, &io_timeout);
+  mysql_options(handle, MYSQL_OPT_WRITE_TIMEOUT, &io_timeout);
+  mysql_options(handle, MYSQL_OPT_PROTOCOL, &protocol);
+  mysql_options(handle, MYSQL_SET_CHARSET_NAME, "utf8mb4");
+  const char* db = (select_db && !ep.database.empty()) ? ep.database.c_str() : nullptr;
+  if (!mysql_real_connect(handle,
+                          ep.host.c_str(),
+                          ep.user.c_str(),
+                          ep.password.c_str(),
+                          db,
+                          static_cast<unsigned int>(ep.port),
+                          nullptr,
+                          CLIENT_MULTI_STATEMENTS)) {
+    log_warn(std::string("[beagle-db] mysql connect failed host=") + ep.host
+             + " port=" + std::to_string(ep.port)
+             + " err=" + mysql_error(handle));
+    mysql_close(handle);
+    return nullptr;
+  }
+  return handle;
+}
+
+// Runs a (possibly multi-statement) text query and drains every result set.
+static bool native_exec(MYSQL* handle, const std::string& sql) {
+  if (mysql_real_query(handle, sql.data(), static_cast<unsigned long>(sql.size())) != 0) return false;
+  int status = 0;
+  do {
+    MYSQL_RES* res = mysql_store_result(handle);
+    if (res) mysql_free_result(res);
+    status = mysql_next_result(handle);
+  } while (status == 0);
+  return status < 0;
+}
+#endif
+
+}  // namespace
+
+struct MysqlConnection {
+#if BEAGLE_HAVE_MYSQL
+  MYSQL* handle = nullptr;
+  std::unordered_map<std::string, MYSQL_STMT*> stmts;
+  bool broken = false;
+
+  ~MysqlConnection() {
+    for (auto& kv : stmts) mysql_stmt_close(kv.second);
+    if (handle) mysql_close(handle);
+  }
+#else
+  bool in_tx = false;
+  std::string tx_sql;
+  bool broken = false;
+#endif
+};
+
+MysqlPool::MysqlPool(const MysqlEndpoint& endpoint, size_t max_connections)
+    : endpoint_(endpoint), max_connections_(max_connections == 0 ? 1 : max_connections) {}
+
+MysqlPool::~MysqlPool() {
+  std::lock_guard<std::mutex> lock(mu_);
+  for (MysqlConnection* conn : idle_) delete conn;
+  idle_.clear();
+}
+
+bool MysqlPool::native_available() {
+#if BEAGLE_HAVE_MYSQL
+  return true;
+#else
+  return false;
+#endif
+}
+
+MysqlConnection* MysqlPool::acquire() {
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    cv_.wait(lock, [this]() { return !idle_.empty() || open_count_ < max_connections_; });
+    if (!idle_.empty()) {
+      MysqlConnection* conn = idle_.back();
+      idle_.pop_back();
+      return conn;
+    }
+    open_count_++;
+  }
+  std::unique_ptr<MysqlConnection> conn(new MysqlConnection());
+#if BEAGLE_HAVE_MYSQL
+  conn->handle = open_native(endpoint_, true);
+  if (!conn->handle) {
+    std::lock_guard<std::mutex> lock(mu_);
+    open_count_--;
+    cv_.notify_one();
+    return nullptr;
+  }
+#endif
+  return conn.release();
+}
+
+void MysqlPool::release(MysqlConnection* conn) {
+  if (!conn) return;
+  std::lock_guard<std::mutex> lock(mu_);
+  if (conn->broken) {
+    delete conn;
+    open_count_--;
+  } else {
+    idle_.push_back(conn);
+  }
+  cv_.notify_one();
+}
+
+bool MysqlPool::ensure_database() {
+  if (endpoint_.database.empty()) return true;
+  std::string name;
+  for (char c : endpoint_.database) {
+    if (c == '`') name.push_back('`');
+    name.push_back(c);
+  }
+  std::string sql = "CREATE DATABASE IF NOT EXISTS `" + name + "`";
+#if BEAGLE_HAVE_MYSQL
+  MYSQL* handle = open_native(endpoint_, false);
+  if (!handle) return false;
+  bool ok = native_exec(handle, sql);
+  if (!ok) log_warn(std::string("[beagle-db] create database failed: ") + mysql_error(handle));
+  mysql_close(handle);
+  return ok;
+#else
+  return mysql_cli_exec(endpoint_, sql + ";", false);
+#endif
+}
+
+bool MysqlPool::exec(const std::string& sql) {
+  MysqlConnection* conn = acquire();
+  if (!conn) return false;
+#if BEAGLE_HAVE_MYSQL
+  bool ok = native_exec(conn->handle, sql);
+  if (!ok) {
+    log_warn(std::string("[beagle-db] exec failed: ") + mysql_error(conn->handle));
+    conn->broken = is_connection_lost(mysql_errno(conn->handle));
+  }
+#else
+  bool ok = mysql_cli_exec(endpoint_, sql, true);
+#endif
+  release(conn);
+  return ok;
+}
+
+bool MysqlPool::exec_prepared(const std::string& sql,
+                              const std::vector<DbValue>& params,
+                              unsigned long long* affected_rows) {
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    MysqlConnection* conn = acquire();
+    if (!conn) return false;
+    bool ok = run_prepared(conn, sql, params, nullptr, 0, affected_rows);
+    bool retry = !ok && conn->broken;
+    release(conn);
+    if (ok || !retry) return ok;
+  }
+  return false;
+}
+
+bool MysqlPool::query_prepared(const std::string& sql,
+                               const std::vector<DbValue>& params,
+                               std::vector<DbRow>& rows,
+                               size_t max_rows) {
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    rows.clear();
+    MysqlConnection* conn = acquire();
+    if (!conn) return false;
+    bool ok = run_prepared(conn, sql, params, &rows, max_rows, nullptr);
+    bool retry = !ok && conn->broken;
+    release(conn);
+    if (ok || !retry) return ok;
+  }
+  return false;
+}
+
+bool MysqlPool::begin(MysqlConnection* conn) {
+#if BEAGLE_HAVE_MYSQL
+  if (mysql_autocommit(conn->handle, 0) == 0) return true;
+  log_warn(std::string("[beagle-db] begin failed: ") + mysql_error(conn->handle));
+  conn->broken = true;
+  return false;
+#else
+  conn->in_tx = true;
+  conn->tx_sql = "START TRANSACTION;";
+  return true;
+#endif
+}
+
+bool MysqlPool::finish(MysqlConnection* conn, bool commit) {
+#if BEAGLE_HAVE_MYSQL
+  bool ok = commit ? mysql_commit(conn->handle) == 0 : mysql_rollback(conn->handle) == 0;
+  if (!ok) {
+    log_warn(std::string("[beagle-db] ") + (commit ? "commit" : "rollback")
+             + " failed: " + mysql_error(conn->handle));
+  }
+  if (mysql_autocommit(conn->handle, 1) != 0) conn->broken = true;
+  if (!ok) conn->broken = true;
+  return ok;
+#else
+  bool ok = true;
+  if (commit) ok = mysql_cli_exec(endpoint_, conn->tx_sql + "COMMIT;", true);
+  conn->in_tx = false;
+  conn->tx_sql.clear();
+  return ok;
+#endif
+}
+
+bool MysqlPool::Transaction::exec_prepared(const std::string& sql, const std::vector<DbValue>& params) {
+  return pool_->run_prepared(conn_, sql, params, nullptr, 0, nullptr);
+}
+
+bool MysqlPool::run_prepared(MysqlConnection* conn,
+                             const std::string& sql,
+                             const std::vector<DbValue>& params,
+                             std::vector<DbRow>* rows,
+                             size_t max_rows,
+                             unsigned long long* affected_rows) {
+#if BEAGLE_HAVE_MYSQL
+  MYSQL_STMT* stmt = nullptr;
+  auto cached = conn->stmts.find(sql);
+  if (cached != conn->stmts.end()) {
+    stmt = cached->second;
+  } else {
+    stmt = mysql_stmt_init(conn->handle);
+    if (!stmt) {
+      conn->broken = true;
+      return false;
+    }
+    if (mysql_stmt_prepare(stmt, sql.data(), static_cast<unsigned long>(sql.size())) != 0) {
+      log_warn(std::string("[beagle-db] prepare failed: ") + mysql_stmt_error(stmt));
+      conn->broken = is_connection_lost(mysql_stmt_errno(stmt));
+      mysql_stmt_close(stmt);
+      return false;
+    }
+    conn->stmts[sql] = stmt;
+  }
+
+  if (mysql_stmt_param_count(stmt) != params.size()) {
+    log_warn("[beagle-db] parameter count mismatch expected="
+             + std::to_string(mysql_stmt_param_count(stmt))
+             + " got=" + std::to_string(params.size()));
+    return false;
+  }
+
+  std::vector<MYSQL_BIND> binds(params.size());
+  std::vector<unsigned long> lengths(params.size());
+  for (size_t i = 0; i < params.size(); ++i) {
+    MYSQL_BIND& b = binds[i];
+    std::memset(&b, 0, sizeof(b));
+    const DbValue& v = params[i];
+    if (v.kind == DbValue::Int) {
+      b.buffer_type = MYSQL_TYPE_LONGLONG;
+      b.buffer = const_cast<long long*>(&v.i);
+    } else if (v.kind == DbValue::Text) {
+      lengths[i] = static_cast<unsigned long>(v.s.size());
+      b.buffer_type = MYSQL_TYPE_STRING;
+      b.buffer = const_cast<char*>(v.s.data());
+      b.buffer_length = lengths[i];
+      b.length = &lengths[i];
+    } else {
+      b.buffer_type = MYSQL_TYPE_NULL;
+    }
+  }
+  if ((!binds.empty() && mysql_stmt_bind_param(stmt, binds.data()) != 0)
+      || mysql_stmt_execute(stmt) != 0) {
+    log_warn(std::string("[beagle-db] execute failed: ") + mysql_stmt_error(stmt));
+    conn->broken = is_connection_lost(mysql_stmt_errno(stmt));
+    return false;
+  }
+  if (affected_rows) *affected_rows = static_cast<unsigned long long>(mysql_stmt_affected_rows(stmt));
+
+  MYSQL_RES* meta = mysql_stmt_result_metadata(stmt);
+  if (!meta) return true;
+  bool ok = true;
+  if (rows) {
+    unsigned int cols = mysql_num_fields(meta);
+    std::vector<MYSQL_BIND> out(cols);
+    std::vector<std::vector<char>> buffers(cols, std::vector<char>(256));
+    std::vector<unsigned long> out_lengths(cols);
+    std::unique_ptr<MysqlBool[]> nulls(new MysqlBool[cols]());
+    for (unsigned int c = 0; c < cols; ++c) {
+      std::memset(&out[c], 0, sizeof(out[c]));
+      out[c].buffer_type = MYSQL_TYPE_STRING;
+      out[c].buffer = buffers[c].data();
+      out[c].buffer_length = static_cast<unsigned long>(buffers[c].size());
+      out[c].length = &out_lengths[c];
+      out[c].is_null = &nulls[c];
+    }
+    ok = mysql_stmt_bind_result(stmt, out.data()) == 0 && mysql_stmt_store_result(stmt) == 0;
+    while (ok) {
+      int rc = mysql_stmt_fetch(stmt);
+      if (rc == MYSQL_NO_DATA) break;
+      if (rc == 1) {
+        ok = false;
+        break;
+      }
+      DbRow row(cols);
+      for (unsigned int c = 0; c < cols; ++c) {
+        if (nulls[c]) continue;
+        if (out_lengths[c] > buffers[c].size()) {
+          std::vector<char> big(out_lengths[c]);
+          MYSQL_BIND one;
+          std::memset(&one, 0, sizeof(one));
+          one.buffer_type = MYSQL_TYPE_STRING;
+          one.buffer = big.data();
+          one.buffer_length = static_cast<unsigned long>(big.size());
+          mysql_stmt_fetch_column(stmt, &one, c, 0);
+          row[c].assign(big.data(), big.size());
+        } else {
+          row[c].assign(buffers[c].data(), out_lengths[c]);
+        }
+      }
+      rows->push_back(std::move(row));
+      if (max_rows > 0 && rows->size() >= max_rows) break;
+    }
+    if (!ok) {
+      log_warn(std::string("[beagle-db] fetch failed: ") + mysql_stmt_error(stmt));
+      conn->broken = is_connection_lost(mysql_stmt_errno(stmt));
+    }
+  }
+  mysql_free_result(meta);
+  mysql_stmt_free_result(stmt);
+  return ok;
+#else
+  std::string inlined = inline_params(sql, params);
+  if (affected_rows) *affected_rows = 0;
+  if (conn->in_tx) {
+    conn->tx_sql += inlined + ";";
+    return true;
+  }
+  if (rows) return mysql_cli_query(endpoint_, inlined + ";", *rows, max_rows);
+  return mysql_cli_exec(endpoint_, inlined + ";", true);
+#endif
+}
+
+size_t db_batch_chunk(size_t remaining) {
+  static const size_t kChunks[] = {128, 32, 8, 1};
+  for (size_t n : kChunks) {
+    if (remaining >= n) return n;
+  }
+  return 0;
+}
+
+namespace {
+
+static std::string friend_info_values_sql(const char* head, size_t rows) {
+  std::string sql = head;
+  for (size_t i = 0; i < rows; ++i) {
+    if (i) sql += ",";
+    sql += "(?,?,?,?,?,?,?,?,?,?,?)";
+  }
+  return sql;
+}
+
+static void append_friend_info_params(std::vector<DbValue>& params, const FriendInfoRow& r) {
+  params.push_back(DbValue::text(r.friendid));
+  params.push_back(DbValue::text(r.name));
+  params.push_back(DbValue::text(r.gender));
+  params.push_back(DbValue::text(r.phone));
+  params.push_back(DbValue::text(r.email));
+  params.push_back(DbValue::text(r.description));
+  params.push_back(DbValue::text(r.region));
+  params.push_back(DbValue::text(r.label));
+  params.push_back(DbValue::integer(r.status));
+  params.push_back(DbValue::integer(r.presence));
+  params.push_back(DbValue::text(r.ts));
+}
+
+// Pending writes beyond this are dropped (oldest first) while the database is unreachable.
+static const size_t kMaxPendingRows = 20000;
+
+}  // namespace
+
+bool MysqlStore::column_exists(const std::string& table, const std::string& column) {
+  std::vector<DbRow> rows;
+  return pool_.query_prepared(
+             "SELECT 1 FROM INFORMATION_SCHEMA.COLUMNS WHERE TABLE_SCHEMA=? AND TABLE_NAME=? AND COLUMN_NAME=? LIMIT 1",
+             {DbValue::text(database_), DbValue::text(table), DbValue::text(column)},
+             rows,
+             1)
+      && !rows.empty();
+}
+
+bool MysqlStore::ensure_schema() {
+  pool_.ensure_database();
+  const char* schema =
+      "CREATE TABLE IF NOT EXISTS beagle_friend_info ("
+      "friendid VARCHAR(128) PRIMARY KEY,"
+      "name VARCHAR(128),"
+      "gender VARCHAR(64),"
+      "phone VARCHAR(64),"
+      "email VARCHAR(256),"
+      "description TEXT,"
+      "region VARCHAR(128),"
+      "label VARCHAR(128),"
+      "status INT,"
+      "presence INT,"
+      "updated_at DATETIME"
+      ");"
+      "CREATE TABLE IF NOT EXISTS beagle_friend_info_history ("
+      "id BIGINT AUTO_INCREMENT PRIMARY KEY,"
+      "friendid VARCHAR(128),"
+      "name VARCHAR(128),"
+      "gender VARCHAR(64),"
+      "phone VARCHAR(64),"
+      "email VARCHAR(256),"
+      "description TEXT,"
+      "region VARCHAR(128),"
+      "label VARCHAR(128),"
+      "status INT,"
+      "presence INT,"
+      "changed_at DATETIME"
+      ");"
+      "CREATE TABLE IF NOT EXISTS beagle_friend_events ("
+      "id BIGINT AUTO_INCREMENT PRIMARY KEY,"
+      "friendid VARCHAR(128),"
+      "event_type VARCHAR(32),"
+      "status INT,"
+      "presence INT,"
+      "ip VARCHAR(64),"
+      "location VARCHAR(128),"
+      "ts DATETIME"
+      ");"
+      "CREATE TABLE IF NOT EXISTS beagle_crawler_node_cache ("
+      "userid VARCHAR(128) PRIMARY KEY,"
+      "ip VARCHAR(64),"
+      "location VARCHAR(128),"
+      "source_file VARCHAR(255),"
+      "seen_at DATETIME,"
+      "updated_at DATETIME,"
+      "KEY idx_seen_at (seen_at)"
+      ");"
+      "CREATE TABLE IF NOT EXISTS beagle_meta ("
+      "meta_key VARCHAR(64) PRIMARY KEY,"
+      "meta_value TEXT,"
+      "updated_at DATETIME"
+      ");";
+  bool ok = pool_.exec(schema);
+  if (!ok) log_warn("[beagle-db] mysql schema init failed");
+  if (!column_exists("beagle_friend_events", "ip")) {
+    pool_.exec("ALTER TABLE beagle_friend_events ADD COLUMN ip VARCHAR(64) NULL AFTER presence;");
+  }
+  if (!column_exists("beagle_friend_events", "location")) {
+    pool_.exec("ALTER TABLE beagle_friend_events ADD COLUMN location VARCHAR(128) NULL AFTER ip;");
+  }
+  return ok;
+}
+
+bool MysqlStore::write_batch(const std::vector<FriendInfoRow>& infos,
+                                   const std::vector<FriendEventRow>& events) {
+  return pool_.transaction([&](MysqlPool::Transaction& tx) {
+    std::vector<DbValue> params;
+    for (size_t i = 0; i < infos.size();) {
+      size_t n = db_batch_chunk(infos.size() - i);
+      params.clear();
+      for (size_t k = 0; k < n; ++k) append_friend_info_params(params, infos[i + k]);
+      if (!tx.exec_prepared(friend_info_values_sql(
+              "REPLACE INTO beagle_friend_info(friendid,name,gender,phone,email,description,region,label,status,presence,updated_at) VALUES ",
+              n), params)) {
+        return false;
+      }
+      if (!tx.exec_prepared(friend_info_values_sql(
+              "INSERT INTO beagle_friend_info_history(friendid,name,gender,phone,email,description,region,label,status,presence,changed_at) VALUES ",
+              n), params)) {
+        return false;
+      }
+      i += n;
+    }
+    for (size_t i = 0; i < events.size();) {
+      size_t n = db_batch_chunk(events.size() - i);
+      params.clear();
+      std::string sql = "INSERT INTO beagle_friend_events(friendid,event_type,status,presence,ip,location,ts) VALUES ";
+      for (size_t k = 0; k < n; ++k) {
+        const FriendEventRow& r = events[i + k];
+        if (k) sql += ",";
+        sql += "(?,?,?,?,?,?,?)";
+        params.push_back(DbValue::text(r.friendid));
+        params.push_back(DbValue::text(r.event_type));
+        params.push_back(DbValue::integer(r.status));
+        params.push_back(DbValue::integer(r.presence));
+        params.push_back(DbValue::text(r.ip));
+        params.push_back(DbValue::text(r.location));
+        params.push_back(DbValue::text(r.ts));
+      }
+      if (!tx.exec_prepared(sql, params)) return false;
+      i += n;
+    }
+    return true;
+  });
+}
+
+bool MysqlStore::persist_crawler_nodes(const std::vector<CrawlerNodeRow>& rows) {
+  return pool_.transaction([&](MysqlPool::Transaction& tx) {
+    std::vector<DbValue> params;
+    for (size_t i = 0; i < rows.size();) {
+      size_t n = db_batch_chunk(rows.size() - i);
+      std::string sql = "REPLACE INTO beagle_crawler_node_cache(userid,ip,location,source_file,seen_at,updated_at) VALUES ";
+      params.clear();
+      for (size_t k = 0; k < n; ++k) {
+        const CrawlerNodeRow& r = rows[i + k];
+        if (k) sql += ",";
+        sql += "(?,?,?,?,FROM_UNIXTIME(?),NOW())";
+        params.push_back(DbValue::text(r.userid));
+        params.push_back(DbValue::text(r.ip));
+        params.push_back(DbValue::text(r.location));
+        params.push_back(DbValue::text(r.source_file));
+        params.push_back(DbValue::integer(r.seen_at));
+      }
+      if (!tx.exec_prepared(sql, params)) return false;
+      i += n;
+    }
+    return true;
+  });
+}
+
+bool MysqlStore::lookup_crawler_node(const std::string& userid, std::string& ip, std::string& location) {
+  std::vector<DbRow> rows;
+  if (!pool_.query_prepared("SELECT ip,location FROM beagle_crawler_node_cache WHERE userid=? LIMIT 1",
+                            {DbValue::text(userid)},
+                            rows,
+                            1)
+      || rows.empty() || rows[0].size() < 2) {
+    return false;
+  }
+  ip = rows[0][0];
+  location = rows[0][1];
+  return true;
+}
+
+bool MysqlStore::get_meta(const std::string& key, std::string& value) {
+  std::vector<DbRow> rows;
+  if (!pool_.query_prepared("SELECT meta_value FROM beagle_meta WHERE meta_key=? LIMIT 1",
+                            {DbValue::text(key)},
+                            rows,
+                            1)
+      || rows.empty() || rows[0].empty()) {
+    return false;
+  }
+  value = rows[0][0];
+  return true;
+}
+
+bool MysqlStore::set_meta(const std::string& key, const std::string& value) {
+  return pool_.exec_prepared("REPLACE INTO beagle_meta(meta_key,meta_value,updated_at) VALUES (?,?,NOW())",
+                             {DbValue::text(key), DbValue::text(value)});
+}
+
+struct SqliteConnection {
+#if BEAGLE_HAVE_SQLITE
+  sqlite3* db = nullptr;
+  std::unordered_map<std::string, sqlite3_stmt*> stmts;
+
+  ~SqliteConnection() {
+    for (auto& kv : stmts) sqlite3_finalize(kv.second);
+    if (db) sqlite3_close(db);
+  }
+#endif
+};
+
+#if BEAGLE_HAVE_SQLITE
+namespace {
+
+static bool sqlite_exec(SqliteConnection* conn, const char* sql) {
+  char* err = nullptr;
+  if (sqlite3_exec(conn->db, sql, nullptr, nullptr, &err) == SQLITE_OK) return true;
+  log_warn(std::string("[beagle-db] sqlite exec failed: ") + (err ? err : "unknown"));
+  sqlite3_free(err);
+  return false;
+}
+
+// Returns the cached statement for sql, reset and with params bound.
+static sqlite3_stmt* sqlite_prepare(SqliteConnection* conn, const char* sql, const std::vector<DbValue>& params) {
+  sqlite3_stmt* stmt = nullptr;
+  auto it = conn->stmts.find(sql);
+  if (it != conn->stmts.end()) {
+    stmt = it->second;
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  } else {
+    if (sqlite3_prepare_v2(conn->db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+      log_warn(std::string("[beagle-db] sqlite prepare failed: ") + sqlite3_errmsg(conn->db));
+      sqlite3_finalize(stmt);
+      return nullptr;
+    }
+    conn->stmts[sql] = stmt;
+  }
+  for (size_t i = 0; i < params.size(); ++i) {
+    const DbValue& v = params[i];
+    int idx = static_cast<int>(i + 1);
+    if (v.kind == DbValue::Int) {
+      sqlite3_bind_int64(stmt, idx, static_cast<sqlite3_int64>(v.i));
+    } else if (v.kind == DbValue::Text) {
+      sqlite3_bind_text(stmt, idx, v.s.data(), static_cast<int>(v.s.size()), SQLITE_TRANSIENT);
+    } else {
+      sqlite3_bind_null(stmt, idx);
+    }
+  }
+  return stmt;
+}
+
+static bool sqlite_run(SqliteConnection* conn, const char* sql, const std::vector<DbValue>& params) {
+  sqlite3_stmt* stmt = sqlite_prepare(conn, sql, params);
+  if (!stmt) return false;
+  int rc = sqlite3_step(stmt);
+  sqlite3_reset(stmt);
+  if (rc == SQLITE_DONE || rc == SQLITE_ROW) return true;
+  log_warn(std::string("[beagle-db] sqlite step failed: ") + sqlite3_errmsg(conn->db));
+  return false;
+}
+
+static SqliteConnection* sqlite_open(const std::string& path, bool read_only) {
+  std::unique_ptr<SqliteConnection> conn(new SqliteConnection());
+  int flags = SQLITE_OPEN_NOMUTEX | (read_only ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE));
+  if (sqlite3_open_v2(path.c_str(), &conn->db, flags, nullptr) != SQLITE_OK) {
+    log_warn(std::string("[beagle-db] sqlite open failed path=") + path
+             + " err=" + (conn->db ? sqlite3_errmsg(conn->db) : "out of memory"));
+    return nullptr;
+  }
+  sqlite3_busy_timeout(conn->db, 5000);
+  if (!read_only) {
+    sqlite_exec(conn.get(), "PRAGMA journal_mode=WAL;");
+    sqlite_exec(conn.get(), "PRAGMA synchronous=NORMAL;");
+  }
+  return conn.release();
+}
+
+static const char* kSqliteInsertFriendInfo =
+    "INSERT OR REPLACE INTO beagle_friend_info(friendid,name,gender,phone,email,description,region,label,status,presence,updated_at) "
+    "VALUES(?,?,?,?,?,?,?,?,?,?,?)";
+static const char* kSqliteInsertFriendHistory =
+    "INSERT INTO beagle_friend_info_history(friendid,name,gender,phone,email,description,region,label,status,presence,changed_at) "
+    "VALUES(?,?,?,?,?,?,?,?,?,?,?)";
+static const char* kSqliteInsertFriendEvent =
+    "INSERT INTO beagle_friend_events(friendid,event_type,status,presence,ip,location,ts) VALUES(?,?,?,?,?,?,?)";
+static const char* kSqliteReplaceCrawlerNode =
+    "INSERT OR REPLACE INTO beagle_crawler_node_cache(userid,ip,location,source_file,seen_at,updated_at) "
+    "VALUES(?,?,?,?,datetime(?,'unixepoch','localtime'),datetime('now','localtime'))";
+
+// Runs fn inside BEGIN IMMEDIATE/COMMIT, rolling back if it fails.
+template <typename Fn>
+static bool sqlite_transaction(SqliteConnection* conn, Fn fn) {
+  if (!sqlite_exec(conn, "BEGIN IMMEDIATE;")) return false;
+  if (fn() && sqlite_exec(conn, "COMMIT;")) return true;
+  sqlite_exec(conn, "ROLLBACK;");
+  return false;
+}
+
+}  // namespace
+#endif
+
+SqliteStore::SqliteStore(const std::string& path) : path_(path) {}
+
+SqliteStore::~SqliteStore() {
+  delete reader_;
+  delete writer_;
+}
+
+bool SqliteStore::available() {
+#if BEAGLE_HAVE_SQLITE
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool SqliteStore::open() {
+#if BEAGLE_HAVE_SQLITE
+  std::lock_guard<std::mutex> lock(write_mu_);
+  if (writer_) return true;
+  writer_ = sqlite_open(path_, false);
+  return writer_ != nullptr;
+#else
+  log_warn("[beagle-db] sqlite backend requested but this build has no SQLite support");
+  return false;
+#endif
+}
+
+bool SqliteStore::ensure_schema() {
+#if BEAGLE_HAVE_SQLITE
+  {
+    std::lock_guard<std::mutex> lock(write_mu_);
+    if (!writer_) return false;
+    static const char* schema =
+        "CREATE TABLE IF NOT EXISTS beagle_friend_info ("
+        "friendid TEXT PRIMARY KEY,"
+        "name TEXT,"
+        "gender TEXT,"
+        "phone TEXT,"
+        "email TEXT,"
+        "description TEXT,"
+        "region TEXT,"
+        "label TEXT,"
+        "status INTEGER,"
+        "presence INTEGER,"
+        "updated_at TEXT"
+        ");"
+        "CREATE TABLE IF NOT EXISTS beagle_friend_info_history ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "friendid TEXT,"
+        "name TEXT,"
+        "gender TEXT,"
+        "phone TEXT,"
+        "email TEXT,"
+        "description TEXT,"
+        "region TEXT,"
+        "label TEXT,"
+        "status INTEGER,"
+        "presence INTEGER,"
+        "changed_at TEXT"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_friend_info_history_friend ON beagle_friend_info_history(friendid, changed_at);"
+        "CREATE TABLE IF NOT EXISTS beagle_friend_events ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "friendid TEXT,"
+        "event_type TEXT,"
+        "status INTEGER,"
+        "presence INTEGER,"
+        "ip TEXT,"
+        "location TEXT,"
+        "ts TEXT"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_friend_events_friend_ts ON beagle_friend_events(friendid, ts);"
+        "CREATE INDEX IF NOT EXISTS idx_friend_events_ts ON beagle_friend_events(ts);"
+        "CREATE TABLE IF NOT EXISTS beagle_crawler_node_cache ("
+        "userid TEXT PRIMARY KEY,"
+        "ip TEXT,"
+        "location TEXT,"
+        "source_file TEXT,"
+        "seen_at TEXT,"
+        "updated_at TEXT"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_crawler_node_cache_seen_at ON beagle_crawler_node_cache(seen_at);"
+        "CREATE TABLE IF NOT EXISTS beagle_meta ("
+        "meta_key TEXT PRIMARY KEY,"
+        "meta_value TEXT,"
+        "updated_at TEXT"
+        ");";
+    if (!sqlite_exec(writer_, schema)) return false;
+  }
+  // Open the reader only once the tables exist so it never sees an empty file.
+  std::lock_guard<std::mutex> lock(read_mu_);
+  if (!reader_) reader_ = sqlite_open(path_, true);
+  return reader_ != nullptr;
+#else
+  return false;
+#endif
+}
+
+bool SqliteStore::write_batch(const std::vector<FriendInfoRow>& infos,
+                              const std::vector<FriendEventRow>& events) {
+#if BEAGLE_HAVE_SQLITE
+  std::lock_guard<std::mutex> lock(write_mu_);
+  if (!writer_) return false;
+  return sqlite_transaction(writer_, [&]() {
+    std::vector<DbValue> params;
+    for (const FriendInfoRow& r : infos) {
+      params.clear();
+      append_friend_info_params(params, r);
+      if (!sqlite_run(writer_, kSqliteInsertFriendInfo, params)) return false;
+      if (!sqlite_run(writer_, kSqliteInsertFriendHistory, params)) return false;
+    }
+    for (const FriendEventRow& r : events) {
+      if (!sqlite_run(writer_,
+                      kSqliteInsertFriendEvent,
+                      {DbValue::text(r.friendid),
+                       DbValue::text(r.event_type),
+                       DbValue::integer(r.status),
+                       DbValue::integer(r.presence),
+                       DbValue::text(r.ip),
+                       DbValue::text(r.location),
+                       DbValue::text(r.ts)})) {
+        return false;
+      }
+    }
+    return true;
+  });
+#else
+  (void)infos;
+  (void)events;
+  return false;
+#endif
+}
+
+bool SqliteStore::persist_crawler_nodes(const std::vector<CrawlerNodeRow>& rows) {
+#if BEAGLE_HAVE_SQLITE
+  std::lock_guard<std::mutex> lock(write_mu_);
+  if (!writer_) return false;
+  return sqlite_transaction(writer_, [&]() {
+    for (const CrawlerNodeRow& r : rows) {
+      if (!sqlite_run(writer_,
+                      kSqliteReplaceCrawlerNode,
+                      {DbValue::text(r.userid),
+                       DbValue::text(r.ip),
+                       DbValue::text(r.location),
+                       DbValue::text(r.source_file),
+                       DbValue::integer(r.seen_at)})) {
+        return false;
+      }
+    }
+    return true;
+  });
+#else
+  (void)rows;
+  return false;
+#endif
+}
+
+bool SqliteStore::lookup_crawler_node(const std::string& userid, std::string& ip, std::string& location) {
+#if BEAGLE_HAVE_SQLITE
+  std::lock_guard<std::mutex> lock(read_mu_);
+  if (!reader_) return false;
+  sqlite3_stmt* stmt = sqlite_prepare(reader_,
+                                      "SELECT ip,location FROM beagle_crawler_node_cache WHERE userid=? LIMIT 1",
+                                      {DbValue::text(userid)});
+  if (!stmt) return false;
+  bool found = sqlite3_step(stmt) == SQLITE_ROW;
+  if (found) {
+    const unsigned char* a = sqlite3_column_text(stmt, 0);
+    const unsigned char* b = sqlite3_column_text(stmt, 1);
+    ip = a ? reinterpret_cast<const char*>(a) : "";
+    location = b ? reinterpret_cast<const char*>(b) : "";
+  }
+  sqlite3_reset(stmt);
+  return found;
+#else
+  (void)userid;
+  (void)ip;
+  (void)location;
+  return false;
+#endif
+}
+
+bool SqliteStore::get_meta(const std::string& key, std::string& value) {
+#if BEAGLE_HAVE_SQLITE
+  std::lock_guard<std::mutex> lock(read_mu_);
+  if (!reader_) return false;
+  sqlite3_stmt* stmt = sqlite_prepare(reader_,
+                                      "SELECT meta_value FROM beagle_meta WHERE meta_key=? LIMIT 1",
+                                      {DbValue::text(key)});
+  if (!stmt) return false;
+  bool found = sqlite3_step(stmt) == SQLITE_ROW;
+  if (found) {
+    const unsigned char* v = sqlite3_column_text(stmt, 0);
+    value = v ? reinterpret_cast<const char*>(v) : "";
+  }
+  sqlite3_reset(stmt);
+  return found;
+#else
+  (void)key;
+  (void)value;
+  return false;
+#endif
+}
+
+bool SqliteStore::set_meta(const std::string& key, const std::string& value) {
+#if BEAGLE_HAVE_SQLITE
+  std::lock_guard<std::mutex> lock(write_mu_);
+  if (!writer_) return false;
+  return sqlite_run(writer_,
+                    "INSERT OR REPLACE INTO beagle_meta(meta_key,meta_value,updated_at) "
+                    "VALUES(?,?,datetime('now','localtime'))",
+                    {DbValue::text(key), DbValue::text(value)});
+#else
+  (void)key;
+  (void)value;
+  return false;
+#endif
+}
+
+DbBatchWriter::DbBatchWriter(BeagleDbStore* store, size_t max_batch, int flush_ms, bool prepare_schema)
+    : store_(store),
+      max_batch_(max_batch == 0 ? 1 : max_batch),
+      flush_ms_(flush_ms < 1 ? 1 : flush_ms),
+      prepare_schema_(prepare_schema) {
+  thread_ = std::thread([this]() { run(); });
+}
+
+DbBatchWriter::~DbBatchWriter() { stop(); }
+
+void DbBatchWriter::enqueue_info(FriendInfoRow row) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (stop_) return;
+  infos_.push_back(std::move(row));
+  if (pending_locked() >= max_batch_) cv_.notify_one();
+}
+
+void DbBatchWriter::enqueue_event(FriendEventRow row) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (stop_) return;
+  events_.push_back(std::move(row));
+  if (pending_locked() >= max_batch_) cv_.notify_one();
+}
+
+void DbBatchWriter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) thread_.join();
+}
+
+void DbBatchWriter::run() {
+  if (prepare_schema_ && !store_->ensure_schema()) {
+    log_warn(std::string("[beagle-db] ") + store_->name() + " schema init failed");
+  }
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    if (!stop_ && pending_locked() == 0) {
+      cv_.wait(lock, [this]() { return stop_ || pending_locked() > 0; });
+    }
+    // Give the batch flush_ms to fill up unless it is already full.
+    if (!stop_ && pending_locked() < max_batch_) {
+      cv_.wait_for(lock, std::chrono::milliseconds(flush_ms_), [this]() {
+        return stop_ || pending_locked() >= max_batch_;
+      });
+    }
+    if (pending_locked() == 0) {
+      if (stop_) break;
+      continue;
+    }
+
+    std::vector<FriendInfoRow> infos;
+    std::vector<FriendEventRow> events;
+    size_t take_infos = std::min(infos_.size(), max_batch_);
+    size_t take_events = std::min(events_.size(), max_batch_ - take_infos);
+    infos.assign(std::make_move_iterator(infos_.begin()),
+                 std::make_move_iterator(infos_.begin() + static_cast<long>(take_infos)));
+    infos_.erase(infos_.begin(), infos_.begin() + static_cast<long>(take_infos));
+    events.assign(std::make_move_iterator(events_.begin()),
+                  std::make_move_iterator(events_.begin() + static_cast<long>(take_events)));
+    events_.erase(events_.begin(), events_.begin() + static_cast<long>(take_events));
+    bool stopping = stop_;
+    lock.unlock();
+
+    auto started = std::chrono::steady_clock::now();
+    bool ok = store_->write_batch(infos, events);
+    long long elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+
+    lock.lock();
+    if (ok) {
+      if (elapsed_ms >= 500) {
+        log_line("[beagle-db] slow batch infos=" + std::to_string(infos.size())
+                 + " events=" + std::to_string(events.size())
+                 + " ms=" + std::to_string(elapsed_ms));
+      }
+      continue;
+    }
+    if (stopping) {
+      log_warn("[beagle-db] dropping unwritten rows at shutdown infos=" + std::to_string(infos.size())
+               + " events=" + std::to_string(events.size()));
+      continue;
+    }
+    // Put the batch back in front and back off before retrying.
+    infos_.insert(infos_.begin(), std::make_move_iterator(infos.begin()), std::make_move_iterator(infos.end()));
+    events_.insert(events_.begin(), std::make_move_iterator(events.begin()), std::make_move_iterator(events.end()));
+    size_t before = dropped_;
+    while (pending_locked() > kMaxPendingRows) {
+      if (events_.size() >= infos_.size()) {
+        events_.pop_front();
+      } else {
+        infos_.pop_front();
+      }
+      dropped_++;
+    }
+    if (dropped_ != before) {
+      log_warn("[beagle-db] writer backlog full, dropped_total=" + std::to_string(dropped_));
+    }
+    cv_.wait_for(lock, std::chrono::seconds(2), [this]() { return stop_; });
+  }
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Value bound to a `?` placeholder of a prepared statement.
+struct DbValue {
+  enum Kind { Null, Int, Text };
+  Kind kind = Null;
+  long long i = 0;
+  std::string s;
+
+  static DbValue null() { return DbValue(); }
+  static DbValue integer(long long v) {
+    DbValue out;
+    out.kind = Int;
+    out.i = v;
+    return out;
+  }
+  static DbValue text(std::string v) {
+    DbValue out;
+    out.kind = Text;
+    out.s = std::move(v);
+    return out;
+  }
+};
+
+// One result row; NULL columns come back as empty strings.
+using DbRow = std::vector<std::string>;
+
+struct MysqlEndpoint {
+  std::string host = "localhost";
+  int port = 3306;
+  std::string user;
+  std::string password;
+  std::string database;
+};
+
+struct MysqlConnection;
+
+// Thread-safe pool of native MySQL connections (libmysqlclient) with a
+// per-connection prepared statement cache. Connections are opened lazily and
+// reopened once when the server went away. Builds without libmysqlclient fall
+// back to running the `mysql` CLI per statement with parameters inlined.
+class MysqlPool {
+ public:
+  explicit MysqlPool(const MysqlEndpoint& endpoint, size_t max_connections = 4);
+  ~MysqlPool();
+
+  MysqlPool(const MysqlPool&) = delete;
+  MysqlPool& operator=(const MysqlPool&) = delete;
+
+  // True when built against libmysqlclient.
+  static bool native_available();
+
+  // Creates the configured database if missing (connects without selecting it).
+  bool ensure_database();
+
+  // Runs one or more `;`-separated statements without parameters (schema DDL).
+  bool exec(const std::string& sql);
+
+  // Prepares (cached per connection) and executes a statement with `?` placeholders.
+  bool exec_prepared(const std::string& sql,
+                     const std::vector<DbValue>& params,
+                     unsigned long long* affected_rows = nullptr);
+
+  // Like exec_prepared but collects up to max_rows rows (0 = all) as strings.
+  bool query_prepared(const std::string& sql,
+                      const std::vector<DbValue>& params,
+                      std::vector<DbRow>& rows,
+                      size_t max_rows = 0);
+
+  // Runs fn on one pooled connection inside BEGIN/COMMIT; rolls back when fn
+  // returns false. fn must only use the Transaction it is handed.
+  class Transaction {
+   public:
+    bool exec_prepared(const std::string& sql, const std::vector<DbValue>& params);
+
+   private:
+    friend class MysqlPool;
+    Transaction(MysqlPool* pool, MysqlConnection* conn) : pool_(pool), conn_(conn) {}
+    MysqlPool* pool_;
+    MysqlConnection* conn_;
+  };
+  template <typename Fn>
+  bool transaction(Fn fn) {
+    MysqlConnection* conn = acquire();
+    if (!conn) return false;
+    bool ok = begin(conn);
+    if (ok) {
+      Transaction tx(this, conn);
+      ok = fn(tx);
+      ok = finish(conn, ok) && ok;
+    }
+    release(conn);
+    return ok;
+  }
+
+ private:
+  MysqlConnection* acquire();
+  void release(MysqlConnection* conn);
+  bool begin(MysqlConnection* conn);
+  bool finish(MysqlConnection* conn, bool commit);
+  bool run_prepared(MysqlConnection* conn,
+                    const std::string& sql,
+                    const std::vector<DbValue>& params,
+                    std::vector<DbRow>* rows,
+                    size_t max_rows,
+                    unsigned long long* affected_rows);
+
+  MysqlEndpoint endpoint_;
+  size_t max_connections_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::vector<MysqlConnection*> idle_;
+  size_t open_count_ = 0;
+};
+
+// Largest multi-row chunk (128, 32, 8 or 1 rows) that fits in `remaining`.
+// Keeping to a few fixed sizes bounds the prepared statement cache.
+size_t db_batch_chunk(size_t remaining);
+
+// Snapshot of a friend's Carrier info, written to beagle_friend_info and its history.
+struct FriendInfoRow {
+  std::string friendid;
+  std::string name;
+  std::string gender;
+  std::string phone;
+  std::string email;
+  std::string description;
+  std::string region;
+  std::string label;
+  int status = 0;
+  int presence = 0;
+  std::string ts;  // "YYYY-MM-DD HH:MM:SS", local time
+};
+
+// One online/offline transition, written to beagle_friend_events.
+struct FriendEventRow {
+  std::string friendid;
+  std::string event_type;
+  int status = 0;
+  int presence = 0;
+  std::string ip;
+  std::string location;
+  std::string ts;
+};
+
+// Last known address of a node as seen in crawler output, cached in beagle_crawler_node_cache.
+struct CrawlerNodeRow {
+  std::string userid;
+  std::string ip;
+  std::string location;
+  std::string source_file;
+  long long seen_at = 0;  // unix seconds
+};
+
+// Storage backend for the beagle_* tables (MySQL or embedded SQLite).
+// Implementations are safe to call from several threads.
+class BeagleDbStore {
+ public:
+  virtual ~BeagleDbStore() = default;
+  virtual const char* name() const = 0;
+  // Creates/migrates beagle_friend_info(_history), beagle_friend_events,
+  // beagle_crawler_node_cache and beagle_meta.
+  virtual bool ensure_schema() = 0;
+  // Writes the batch atomically; false leaves the caller free to retry it.
+  virtual bool write_batch(const std::vector<FriendInfoRow>& infos,
+                           const std::vector<FriendEventRow>& events) = 0;
+  virtual bool persist_crawler_nodes(const std::vector<CrawlerNodeRow>& rows) = 0;
+  virtual bool lookup_crawler_node(const std::string& userid, std::string& ip, std::string& location) = 0;
+  // Bookkeeping values in beagle_meta (e.g. which crawler index the node cache
+  // was last filled from); get_meta is false when the key is missing.
+  virtual bool get_meta(const std::string& key, std::string& value) = 0;
+  virtual bool set_meta(const std::string& key, const std::string& value) = 0;
+};
+
+class MysqlStore : public BeagleDbStore {
+ public:
+  explicit MysqlStore(const MysqlEndpoint& endpoint) : pool_(endpoint), database_(endpoint.database) {}
+  const char* name() const override { return MysqlPool::native_available() ? "mysql" : "mysql-cli"; }
+  bool ensure_schema() override;
+  bool write_batch(const std::vector<FriendInfoRow>& infos,
+                   const std::vector<FriendEventRow>& events) override;
+  bool persist_crawler_nodes(const std::vector<CrawlerNodeRow>& rows) override;
+  bool lookup_crawler_node(const std::string& userid, std::string& ip, std::string& location) override;
+  bool get_meta(const std::string& key, std::string& value) override;
+  bool set_meta(const std::string& key, const std::string& value) override;
+
+ private:
+  bool column_exists(const std::string& table, const std::string& column);
+
+  MysqlPool pool_;
+  std::string database_;
+};
+
+struct SqliteConnection;
+
+// Embedded SQLite backend: one WAL-mode database file, a writer connection
+// for batched transactions and a separate reader connection for lookups.
+// Only functional when built with SQLite (BEAGLE_HAVE_SQLITE); otherwise open() fails.
+class SqliteStore : public BeagleDbStore {
+ public:
+  explicit SqliteStore(const std::string& path);
+  ~SqliteStore() override;
+
+  static bool available();
+
+  bool open();
+  const char* name() const override { return "sqlite"; }
+  bool ensure_schema() override;
+  bool write_batch(const std::vector<FriendInfoRow>& infos,
+                   const std::vector<FriendEventRow>& events) override;
+  bool persist_crawler_nodes(const std::vector<CrawlerNodeRow>& rows) override;
+  bool lookup_crawler_node(const std::string& userid, std::string& ip, std::string& location) override;
+  bool get_meta(const std::string& key, std::string& value) override;
+  bool set_meta(const std::string& key, const std::string& value) override;
+
+ private:
+  std::string path_;
+  std::mutex write_mu_;
+  std::mutex read_mu_;
+  SqliteConnection* writer_ = nullptr;
+  SqliteConnection* reader_ = nullptr;
+};
+
+// Background writer that groups friend info/event rows into multi-row
+// statements. A batch is flushed once max_batch rows are pending or
+// flush_ms after the oldest pending row, whichever comes first.
+class DbBatchWriter {
+ public:
+  // With prepare_schema the writer thread runs store->ensure_schema() before
+  // its first batch, so a slow database does not hold up the caller; rows
+  // queue in the meantime.
+  DbBatchWriter(BeagleDbStore* store, size_t max_batch, int flush_ms, bool prepare_schema = false);
+  ~DbBatchWriter();
+
+  DbBatchWriter(const DbBatchWriter&) = delete;
+  DbBatchWriter& operator=(const DbBatchWriter&) = delete;
+
+  void enqueue_info(FriendInfoRow row);
+  void enqueue_event(FriendEventRow row);
+
+  // Writes everything still pending and joins the thread; idempotent.
+  void stop();
+
+ private:
+  void run();
+  size_t pending_locked() const { return infos_.size() + events_.size(); }
+
+  BeagleDbStore* store_;
+  size_t max_batch_;
+  int flush_ms_;
+  bool prepare_schema_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<FriendInfoRow> infos_;
+  std::deque<FriendEventRow> events_;
+  bool stop_ = false;
+  unsigned long long dropped_ = 0;
+  std::thread thread_;
+};
@@ -1,7 +1,16 @@
 #include "beagle_sdk.h"
+#include "beagle_db.h"
+#include "crawler_index.h"
+#include "incoming_dedupe.h"
+#include "latency.h"
+#include "logger.h"
+#include "media_codec.h"
+#include "rotating_log.h"
+#include "tcp_peers.h"
 
 #include <array>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <cerrno>
@@ -12,8 +21,10 @@
 #include <ctime>
 #include <cstring>
 #include <dirent.h>
+#include <fcntl.h>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <deque>
 #include <map>
 #include <memory>
@@ -40,8 +51,10 @@ BeagleSdk::~BeagleSdk() { stop(); }
 bool BeagleSdk::start(const BeagleSdkOptions& options, BeagleIncomingCallback on_incoming) {
   (void)on_incoming;
   stop();
-  std::cerr << "[beagle-sdk] start stub. data_dir=" << options.data_dir
-            << " (BEAGLE_SDK_STUB=ON; no real Carrier account will be created)\n";
+  std::ostringstream msg;
+  msg << "[beagle-sdk] start stub. data_dir=" << options.data_dir
+      << " (BEAGLE_SDK_STUB=ON; no real Carrier account will be created)";
+  log_line(msg.str());
   user_id_ = options.account_id.empty() ? "stub-user" : ("stub-user-" + options.account_id);
   address_ = options.account_id.empty() ? "stub-address" : ("stub-address-" + options.account_id);
   return true;
@@ -51,17 +64,26 @@ void BeagleSdk::stop() {
   user_id_.clear();
   address_.clear();
   state_ = nullptr;
-  std::cerr << "[beagle-sdk] stop stub.\n";
+  log_line("[beagle-sdk] stop stub.");
 }
 
-bool BeagleSdk::send_text(const std::string& peer, const std::string& text) {
-  std::cerr << "[beagle-sdk] send_text stub. peer=" << peer << " text=" << text << "\n";
+bool BeagleSdk::send_text(const std::string& peer,
+                          const std::string& text,
+                          const std::string& dedupe_key,
+                          BeagleSendOutcome* outcome) {
+  (void)dedupe_key;
+  if (outcome) *outcome = BeagleSendOutcome();
+  std::ostringstream msg;
+  msg << "[beagle-sdk] send_text stub. peer=" << peer << " text_len=" << text.size();
+  log_line(msg.str());
   return true;
 }
 
 bool BeagleSdk::add_friend(const std::string& address, const std::string& hello) {
-  std::cerr << "[beagle-sdk] add_friend stub. address=" << address
-            << " hello=" << hello << "\n";
+  std::ostringstream msg;
+  msg << "[beagle-sdk] add_friend stub. address=" << address
+      << " hello=" << hello;
+  log_line(msg.str());
   return !address.empty();
 }
 
@@ -74,19 +96,41 @@ bool BeagleSdk::friend_is_online(const std::string& userid) const {
   return true;
 }
 
+bool BeagleSdk::has_friend(const std::string& address) const {
+  (void)address;
+  return false;
+}
+
+uint64_t BeagleSdk::when_friend_online(const std::string& userid, BeagleFriendOnlineCallback fn) {
+  if (fn) fn(userid);
+  return 0;
+}
+
+bool BeagleSdk::cancel_friend_online_wait(uint64_t id) {
+  (void)id;
+  return false;
+}
+
 bool BeagleSdk::send_media(const std::string& peer,
                            const std::string& caption,
                            const std::string& media_path,
                            const std::string& media_url,
                            const std::string& media_type,
                            const std::string& filename,
-                           const std::string& out_format) {
-  std::cerr << "[beagle-sdk] send_media stub. peer=" << peer
-            << " caption=" << caption
-            << " media_path=" << media_path
-            << " media_url=" << media_url
-            << " media_type=" << media_type
-            << " filename=" << filename << "\n";
+                           const std::string& out_format,
+                           const std::string& dedupe_key,
+                           BeagleSendOutcome* outcome) {
+  (void)out_format;
+  (void)dedupe_key;
+  if (outcome) *outcome = BeagleSendOutcome();
+  std::ostringstream msg;
+  msg << "[beagle-sdk] send_media stub. peer=" << peer
+      << " caption_len=" << caption.size()
+      << " media_path=" << media_path
+      << " media_url=" << media_url
+      << " media_type=" << media_type
+      << " filename=" << filename;
+  log_line(msg.str());
   return true;
 }
 
@@ -99,15 +143,17 @@ bool BeagleSdk::send_status(const std::string& peer,
                             const std::string& group_address,
                             const std::string& group_name,
                             const std::string& seq) {
-  std::cerr << "[beagle-sdk] send_status stub. peer=" << peer
-            << " state=" << state
-            << " phase=" << phase
-            << " ttl_ms=" << ttl_ms
-            << " chat_type=" << chat_type
-            << " group_user_id=" << group_user_id
-            << " group_address=" << group_address
-            << " group_name=" << group_name
-            << " seq=" << seq << "\n";
+  std::ostringstream msg;
+  msg << "[beagle-sdk] send_status stub. peer=" << peer
+      << " state=" << state
+      << " phase=" << phase
+      << " ttl_ms=" << ttl_ms
+      << " chat_type=" << chat_type
+      << " group_user_id=" << group_user_id
+      << " group_address=" << group_address
+      << " group_name=" << group_name
+      << " seq=" << seq;
+  log_line(msg.str());
   return true;
 }
 
@@ -118,6 +164,23 @@ BeagleStatus BeagleSdk::status() const {
   return s;
 }
 
+bool BeagleSdk::history(const HistoryQuery& query, HistoryPage& out) const {
+  (void)query;
+  out = HistoryPage();
+  return true;
+}
+
+bool BeagleSdk::search(const std::string& query,
+                       const std::string& peer,
+                       size_t limit,
+                       std::vector<SearchHit>& out) const {
+  (void)query;
+  (void)peer;
+  (void)limit;
+  out.clear();
+  return true;
+}
+
 #else
 
 extern "C" {
@@ -128,8 +191,6 @@ extern "C" {
 }
 
 namespace {
-constexpr size_t kMaxBeaglechatFileBytes = 5 * 1024 * 1024;
-
 static std::string log_ts() {
   std::time_t now = std::time(nullptr);
   std::tm tm_buf{};
@@ -139,10 +200,6 @@ static std::string log_ts() {
   return std::string(out);
 }
 
-static void log_line(const std::string& msg) {
-  std::cerr << "[" << log_ts() << "] " << msg << "\n";
-}
-
 struct RuntimeState;
 
 struct FriendState {
@@ -160,6 +217,8 @@ struct FriendState {
 
 struct DbConfig {
   bool enabled = false;
+  std::string backend = "mysql";  // "mysql" or "sqlite"
+  std::string sqlite_path;        // empty: <data dir>/beagle.sqlite; relative paths resolve against the data dir
   std::string host = "localhost";
   int port = 3306;
   std::string user = "beagle";
@@ -169,6 +228,8 @@ struct DbConfig {
   std::string crawler_data_dir = "~/.elacrawler";
   int crawler_refresh_seconds = 60;
   int crawler_lookback_files = 20;
+  int write_batch_size = 500;
+  int write_flush_ms = 200;
 };
 
 struct PushApiServerConfig {
@@ -208,6 +269,29 @@ struct MessageReceiptContext {
   std::string peer;
   std::string text;
   bool notify_on_offline = false;
+  long long requested_us = 0;  // latency_now_us() of the originating request
+  long long sent_us = 0;       // latency_now_us() when carrier_send_friend_message was called
+};
+
+// One send that could not be delivered yet. Kept per peer in FIFO order and
+// journaled to outbox.log (compacted into outbox.jsonl) so agent replies
+// survive restarts.
+struct OutboxEntry {
+  std::string id;
+  std::string peer;
+  std::string kind;  // "text" or "media"
+  std::string dedupe_key;
+  std::string text;  // message body, or caption for media
+  std::string media_path;
+  std::string media_url;
+  std::string media_type;
+  std::string filename;
+  std::string out_format;
+  bool owns_media = false;  // media_path is our private copy under outbox/
+  long long created_ts = 0;
+  long long next_attempt_ts = 0;
+  int attempts = 0;
+  long long requested_us = 0;  // latency_now_us() of the send request; not persisted
 };
 
 struct ProfileInfo {
@@ -233,9 +317,19 @@ struct RuntimeState {
   std::string db_config_path;
   std::string push_config_path;
   std::string friend_state_path;
+  std::string friend_state_log_path;  // append-only deltas on top of friend_state.tsv
   std::string friend_event_log_path;
   std::string incoming_event_log_path;
+  std::unique_ptr<RotatingLogWriter> friend_event_log;    // writes friend_event_log_path
+  std::unique_ptr<RotatingLogWriter> incoming_event_log;  // writes incoming_event_log_path
+  std::unique_ptr<HistoryStore> history;                  // forwarded inbound + delivered outbound
+  std::unique_ptr<SearchIndex> search;                    // full-text index over history
+  std::string outbox_path;
+  std::string outbox_log_path;  // append-only add/retry/ack records on top of outbox.jsonl
+  std::string outbox_media_dir;
   std::string media_dir;
+  std::string history_dir;
+  std::string search_dir;
   std::string user_id;
   std::string address;
   std::string self_display_name;
@@ -245,16 +339,44 @@ struct RuntimeState {
   std::unordered_set<std::string> welcomed_peers;
   std::unordered_map<std::string, bool> peer_prefers_inline_media;
   std::unordered_map<std::string, std::string> peer_media_payload_hint;
-  std::unordered_set<std::string> seen_incoming_signatures;
-  std::deque<std::string> seen_incoming_order;
+  IncomingSignatureWindow seen_incoming;
   std::map<std::string, FriendState> friend_state;
   DbConfig db;
+  std::unique_ptr<BeagleDbStore> db_store;  // set when db.enabled and the backend opened
+  std::unique_ptr<DbBatchWriter> db_writer;  // declared last: flushed before the store goes away
   PushConfig push;
   std::unordered_map<std::string, PushPeerNotifyState> push_peer_notify_state;
+  std::shared_ptr<CrawlerIndex> crawler;  // process-wide per crawlerDataDir; set when db.use_crawler_index
+  // Index last written to beagle_crawler_node_cache; only the crawler persist thread touches it.
+  std::shared_ptr<const MappedCrawlerIndex> crawler_persisted;
   std::mutex crawler_mu;
-  std::map<std::string, std::pair<std::string, std::string>> crawler_index;
-  std::string crawler_index_signature;
-  std::time_t crawler_index_last_refresh = 0;
+  std::condition_variable crawler_cv;
+  std::thread crawler_thread;
+  bool crawler_stop = false;
+  std::mutex outbox_mu;
+  std::condition_variable outbox_cv;
+  std::thread outbox_thread;
+  bool outbox_stop = false;
+  std::ofstream friend_state_log;  // guarded by state_mu
+  size_t friend_state_log_lines = 0;
+  std::condition_variable friend_state_cv;  // waits on state_mu
+  std::thread friend_state_thread;
+  bool friend_state_stop = false;
+  std::thread push_setup_thread;  // start-up push profile + registration
+  std::atomic<bool> push_setup_stop{false};
+  bool outbox_kick_all = false;
+  std::unordered_set<std::string> outbox_kicked_peers;
+  std::map<std::string, std::deque<OutboxEntry>> outbox;
+  std::unordered_set<std::string> outbox_dedupe_keys;
+  std::unordered_set<std::string> delivered_dedupe_keys;
+  std::deque<std::string> delivered_dedupe_order;
+  unsigned long long outbox_seq = 0;
+  int outbox_log_fd = -1;  // guarded by outbox_mu
+  size_t outbox_log_lines = 0;
+  // when_friend_online() waits: userid -> (id, callback), fired on connect.
+  std::mutex online_waiters_mu;
+  std::multimap<std::string, std::pair<uint64_t, BeagleFriendOnlineCallback>> online_waiters;
+  uint64_t next_online_waiter = 1;
 };
 
 struct TransferContext {
@@ -299,9 +421,10 @@ static void mark_sender_transfer_result(const std::shared_ptr<TransferContext>&
   ctx->transfer_detail = detail;
   ctx->transfer_cv.notify_all();
 }
-static void persist_crawler_index_to_db(
+static bool persist_crawler_index_to_db(
     RuntimeState* state,
-    const std::map<std::string, std::pair<std::string, std::string>>& rows,
+    const MappedCrawlerIndex& index,
+    const MappedCrawlerIndex* previous,
     const std::string& source_file,
     std::time_t seen_at);
 static std::pair<std::string, std::string> lookup_ip_location_from_crawler_cache_db(
@@ -330,7 +453,7 @@ static bool ensure_dir(const std::string& path) {
     std::string part = (pos == std::string::npos) ? path : path.substr(0, pos);
     if (!part.empty() && !is_dir(part)) {
       if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) {
-        log_line(std::string("[beagle-sdk] mkdir failed path=") + part
+        log_warn(std::string("[beagle-sdk] mkdir failed path=") + part
                  + " errno=" + std::to_string(errno));
         return false;
       }
@@ -340,18 +463,10 @@ static bool ensure_dir(const std::string& path) {
   }
 
   if (is_dir(path)) return true;
-  log_line(std::string("[beagle-sdk] directory missing after mkdir path=") + path);
+  log_warn(std::string("[beagle-sdk] directory missing after mkdir path=") + path);
   return false;
 }
 
-static std::vector<std::string> split_ws(const std::string& s) {
-  std::vector<std::string> out;
-  std::istringstream iss(s);
-  std::string token;
-  while (iss >> token) out.push_back(token);
-  return out;
-}
-
 static std::string trim_copy(const std::string& s);
 
 static bool csv_has_token(const std::string& csv, const std::string& token) {
@@ -387,54 +502,6 @@ static std::string expand_home(const std::string& path) {
   return path;
 }
 
-static bool is_valid_ip_token(const std::string& ip) {
-  if (ip.empty()) return false;
-  for (char c : ip) {
-    if (std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == ':' || c == '-') continue;
-    return false;
-  }
-  return true;
-}
-
-static std::string endpoint_to_ip(const std::string& endpoint) {
-  if (endpoint.empty() || endpoint == "*") return "";
-  if (endpoint.front() == '[') {
-    size_t end = endpoint.find(']');
-    if (end == std::string::npos || end <= 1) return "";
-    if (end + 2 > endpoint.size() || endpoint[end + 1] != ':') return "";
-    std::string port = endpoint.substr(end + 2);
-    if (port.empty()) return "";
-    if (port != "*") {
-      for (char c : port) {
-        if (!std::isdigit(static_cast<unsigned char>(c))) return "";
-      }
-    }
-    return endpoint.substr(1, end - 1);
-  }
-  size_t colon = endpoint.rfind(':');
-  if (colon == std::string::npos || colon == 0) return "";
-  std::string port = endpoint.substr(colon + 1);
-  if (port.empty()) return "";
-  if (port != "*") {
-    for (char c : port) {
-      if (!std::isdigit(static_cast<unsigned char>(c))) return "";
-    }
-  }
-  return endpoint.substr(0, colon);
-}
-
-static std::string endpoint_to_port(const std::string& endpoint) {
-  if (endpoint.empty() || endpoint == "*") return "";
-  if (endpoint.front() == '[') {
-    size_t end = endpoint.find(']');
-    if (end == std::string::npos || end + 2 > endpoint.size() || endpoint[end + 1] != ':') return "";
-    return endpoint.substr(end + 2);
-  }
-  size_t colon = endpoint.rfind(':');
-  if (colon == std::string::npos || colon + 1 >= endpoint.size()) return "";
-  return endpoint.substr(colon + 1);
-}
-
 static bool is_ipv4_private(const std::string& ip) {
   int a = -1, b = -1, c = -1, d = -1;
   if (std::sscanf(ip.c_str(), "%d.%d.%d.%d", &a, &b, &c, &d) != 4) return false;
@@ -456,181 +523,74 @@ static std::string guess_location_from_ip(const std::string& ip) {
   return "public-network";
 }
 
+// Peer of the Carrier connection (remote port 33445) this process holds, else
+// any Carrier peer on the host, else any peer of this process.
 static std::string detect_remote_ip_for_current_process() {
-#ifdef _WIN32
-  return "";
-#else
-  FILE* fp = popen("ss -tnp state established 2>/dev/null", "r");
-  if (!fp) return "";
-  std::array<char, 1024> buf{};
-  std::string needle = "pid=" + std::to_string(::getpid()) + ",";
   std::set<std::string> strict_carrier_ips;
   std::set<std::string> fallback_ips;
-  while (std::fgets(buf.data(), static_cast<int>(buf.size()), fp)) {
-    std::string line(buf.data());
-    bool pid_matched = line.find(needle) != std::string::npos;
-    std::vector<std::string> parts = split_ws(line);
-    std::vector<std::string> endpoints;
-    endpoints.reserve(parts.size());
-    for (const auto& p : parts) {
-      if (!endpoint_to_ip(p).empty()) endpoints.push_back(p);
-    }
-    if (endpoints.size() < 2) continue;
-    std::string local_ip = endpoint_to_ip(endpoints[0]);
-    std::string peer_ip = endpoint_to_ip(endpoints[1]);
-    std::string peer_port = endpoint_to_port(endpoints[1]);
-    std::string local_port = endpoint_to_port(endpoints[0]);
-    (void)local_ip;
-    (void)local_port;
-
-    std::string ip = peer_ip;
-    if (ip.empty() || ip == "127.0.0.1" || ip == "::1") continue;
-    if (pid_matched && peer_port == "33445") {
-      strict_carrier_ips.insert(ip);
-      continue;
+  for (const TcpPeer& peer : established_tcp_peers()) {
+    if (peer.ip == "127.0.0.1" || peer.ip == "::1") continue;
+    if (peer.own && peer.port == 33445) {
+      strict_carrier_ips.insert(peer.ip);
+    } else if (peer.port == 33445 || peer.own) {
+      fallback_ips.insert(peer.ip);
     }
-    if (peer_port == "33445") {
-      fallback_ips.insert(ip);
-      continue;
-    }
-    if (pid_matched) fallback_ips.insert(ip);
   }
-  pclose(fp);
   if (!strict_carrier_ips.empty()) return *strict_carrier_ips.begin();
   if (!fallback_ips.empty()) return *fallback_ips.begin();
   return "";
-#endif
 }
 
-static std::vector<std::string> list_entries(const std::string& dirpath, bool want_dirs, bool suffix_lst) {
-  std::vector<std::string> out;
-  DIR* d = opendir(dirpath.c_str());
-  if (!d) return out;
-  struct dirent* ent = nullptr;
-  while ((ent = readdir(d)) != nullptr) {
-    std::string name = ent->d_name;
-    if (name.empty() || name == "." || name == "..") continue;
-    if (want_dirs && ent->d_type != DT_DIR && ent->d_type != DT_UNKNOWN) continue;
-    if (!want_dirs && ent->d_type == DT_DIR) continue;
-    if (suffix_lst) {
-      if (name.size() < 4 || name.substr(name.size() - 4) != ".lst") continue;
-    }
-    out.push_back(name);
-  }
-  closedir(d);
-  std::sort(out.begin(), out.end());
-  return out;
-}
-
-static std::vector<std::string> find_recent_crawler_lsts(const std::string& data_dir, size_t max_files) {
-  std::string root = expand_home(data_dir);
-  if (root.empty() || max_files == 0) return {};
-  std::vector<std::string> dates = list_entries(root, true, false);
-  if (dates.empty()) return {};
-  std::vector<std::string> out;
-  out.reserve(max_files);
-  for (auto it = dates.rbegin(); it != dates.rend(); ++it) {
-    std::string day_dir = root + "/" + *it;
-    std::vector<std::string> files = list_entries(day_dir, false, true);
-    if (files.empty()) continue;
-    for (auto fit = files.rbegin(); fit != files.rend(); ++fit) {
-      out.push_back(day_dir + "/" + *fit);
-      if (out.size() >= max_files) return out;
-    }
-  }
-  return out;
-}
-
-static bool parse_crawler_line(const std::string& line,
-                               std::string& userid,
-                               std::string& ip,
-                               std::string& location) {
-  size_t c1 = line.find(',');
-  if (c1 == std::string::npos) return false;
-  size_t c2 = line.find(',', c1 + 1);
-  if (c2 == std::string::npos) return false;
-  userid = trim_copy(line.substr(0, c1));
-  ip = trim_copy(line.substr(c1 + 1, c2 - c1 - 1));
-  location = trim_copy(line.substr(c2 + 1));
-  if (userid.empty()) return false;
-  if (!ip.empty() && !is_valid_ip_token(ip)) ip.clear();
-  return true;
-}
-
-static void refresh_crawler_index_if_needed(RuntimeState* state) {
-  if (!state || !state->db.use_crawler_index) return;
-  std::time_t now = std::time(nullptr);
-  {
-    std::lock_guard<std::mutex> lock(state->crawler_mu);
-    if (state->crawler_index_last_refresh != 0
-        && now - state->crawler_index_last_refresh < state->db.crawler_refresh_seconds) {
+// beagle_meta key holding the fingerprint of the last index fully persisted.
+static const char* const kCrawlerFingerprintKey = "crawler_index_fingerprint";
+
+static void persist_crawler_snapshot(RuntimeState* state) {
+  // Wait for the shared refresh thread's first pass rather than persisting
+  // the index reopened from disk and then the refreshed one on top of it.
+  if (!state || !state->crawler || !state->crawler->checked()) return;
+  // Also retries a persist that failed earlier.
+  std::shared_ptr<const CrawlerSnapshot> snap = state->crawler->snapshot();
+  if (!snap || !snap->index || snap->index == state->crawler_persisted || !state->db_store) return;
+  // Before this account's first persist, trust only the DB's own record of
+  // the index it was filled from. A failed persist, a new or wiped DB, or an
+  // index refreshed by another account all mean writing every row.
+  if (!state->crawler_persisted) {
+    std::string stored;
+    if (!snap->fingerprint.empty() && state->db_store->get_meta(kCrawlerFingerprintKey, stored)
+        && stored == snap->fingerprint) {
+      state->crawler_persisted = snap->index;
       return;
     }
-    state->crawler_index_last_refresh = now;
-  }
-
-  std::vector<std::string> files =
-      find_recent_crawler_lsts(state->db.crawler_data_dir, static_cast<size_t>(state->db.crawler_lookback_files));
-  if (files.empty()) return;
-
-  std::string signature;
-  signature.reserve(files.size() * 64);
-  std::time_t newest_mtime = 0;
-  std::string newest_file;
-  for (const auto& f : files) {
-    struct stat st{};
-    if (stat(f.c_str(), &st) != 0) continue;
-    signature += f;
-    signature.push_back('|');
-    signature += std::to_string(static_cast<long long>(st.st_mtime));
-    signature.push_back(';');
-    if (st.st_mtime >= newest_mtime) {
-      newest_mtime = st.st_mtime;
-      newest_file = f;
-    }
-  }
-  if (signature.empty()) return;
-
-  {
-    std::lock_guard<std::mutex> lock(state->crawler_mu);
-    if (state->crawler_index_signature == signature) return;
   }
-
-  std::map<std::string, std::pair<std::string, std::string>> next;
-  for (const auto& f : files) {
-    std::ifstream in(f);
-    if (!in) continue;
-    std::string line;
-    while (std::getline(in, line)) {
-      std::string userid;
-      std::string ip;
-      std::string location;
-      if (!parse_crawler_line(line, userid, ip, location)) continue;
-      if (next.find(userid) != next.end()) continue;
-      next[userid] = {ip, location};
-    }
+  if (persist_crawler_index_to_db(state,
+                                  *snap->index,
+                                  state->crawler_persisted.get(),
+                                  snap->newest_file,
+                                  static_cast<std::time_t>(snap->newest_mtime))) {
+    // Recorded only after every chunk landed.
+    if (!snap->fingerprint.empty()) state->db_store->set_meta(kCrawlerFingerprintKey, snap->fingerprint);
+    state->crawler_persisted = snap->index;
   }
+}
 
-  if (newest_file.empty()) newest_file = files.front();
-  persist_crawler_index_to_db(state, next, newest_file, newest_mtime);
-  {
-    std::lock_guard<std::mutex> lock(state->crawler_mu);
-    state->crawler_index.swap(next);
-    state->crawler_index_signature = signature;
+// Copies new snapshots of the shared crawler index into this account's DB.
+// The index refreshes itself on one thread per process (CrawlerIndex::start_refresh);
+// a poll here is only a snapshot load and a pointer compare.
+static void crawler_persist_loop(RuntimeState* state) {
+  std::unique_lock<std::mutex> lock(state->crawler_mu);
+  while (!state->crawler_stop) {
+    lock.unlock();
+    persist_crawler_snapshot(state);
+    lock.lock();
+    state->crawler_cv.wait_for(lock, std::chrono::seconds(1), [state]() { return state->crawler_stop; });
   }
-  log_line("[beagle-sdk] crawler index loaded from last "
-           + std::to_string(files.size()) + " file(s)");
 }
 
 static std::pair<std::string, std::string> lookup_ip_location_from_crawler(RuntimeState* state,
                                                                             const std::string& friendid) {
-  if (!state || friendid.empty() || !state->db.use_crawler_index) return {"", ""};
-  refresh_crawler_index_if_needed(state);
-  {
-    std::lock_guard<std::mutex> lock(state->crawler_mu);
-    auto it = state->crawler_index.find(friendid);
-    if (it != state->crawler_index.end()) return it->second;
-  }
+  if (!state || friendid.empty() || !state->crawler) return {"", ""};
+  CrawlerNode node;
+  if (state->crawler->lookup(friendid, node)) return {node.ip, node.location};
   return lookup_ip_location_from_crawler_cache_db(state, friendid);
 }
 
@@ -647,64 +607,6 @@ static std::string basename_of(const std::string& path) {
   return path.substr(pos + 1);
 }
 
-static std::string sanitize_filename(const std::string& name) {
-  std::string out;
-  out.reserve(name.size());
-  for (char c : name) {
-    if (c == '/' || c == '\\' || c == '\0') {
-      out.push_back('_');
-    } else {
-      out.push_back(c);
-    }
-  }
-  if (out.empty()) return "file.bin";
-  return out;
-}
-
-static std::string lowercase(std::string s) {
-  for (char& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-  return s;
-}
-
-static std::string infer_media_type_from_filename(const std::string& filename) {
-  std::string lower = lowercase(filename);
-  if (lower.size() >= 4 && lower.rfind(".jpg") == lower.size() - 4) return "image/jpeg";
-  if (lower.size() >= 5 && lower.rfind(".jpeg") == lower.size() - 5) return "image/jpeg";
-  if (lower.size() >= 4 && lower.rfind(".png") == lower.size() - 4) return "image/png";
-  if (lower.size() >= 4 && lower.rfind(".gif") == lower.size() - 4) return "image/gif";
-  if (lower.size() >= 5 && lower.rfind(".webp") == lower.size() - 5) return "image/webp";
-  if (lower.size() >= 4 && lower.rfind(".mp4") == lower.size() - 4) return "video/mp4";
-  if (lower.size() >= 4 && lower.rfind(".mp3") == lower.size() - 4) return "audio/mpeg";
-  if (lower.size() >= 4 && lower.rfind(".wav") == lower.size() - 4) return "audio/wav";
-  if (lower.size() >= 4 && lower.rfind(".pdf") == lower.size() - 4) return "application/pdf";
-  return "application/octet-stream";
-}
-
-static std::string json_quote(const std::string& in) {
-  std::string out;
-  out.reserve(in.size() + 2);
-  out.push_back('"');
-  for (char c : in) {
-    switch (c) {
-      case '\\': out += "\\\\"; break;
-      case '"': out += "\\\""; break;
-      case '\n': out += "\\n"; break;
-      case '\r': out += "\\r"; break;
-      case '\t': out += "\\t"; break;
-      default:
-        if (static_cast<unsigned char>(c) < 0x20) {
-          char buf[7];
-          std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
-          out += buf;
-        } else {
-          out.push_back(c);
-        }
-    }
-  }
-  out.push_back('"');
-  return out;
-}
-
 static bool read_file_binary(const std::string& path, std::vector<unsigned char>& out) {
   std::ifstream in(path, std::ios::binary);
   if (!in) return false;
@@ -717,67 +619,6 @@ static bool read_file_binary(const std::string& path, std::vector<unsigned char>
   return static_cast<bool>(in);
 }
 
-static bool parse_json_string_field(const std::string& json,
-                                    const std::string& key,
-                                    std::string& value) {
-  std::string marker = "\"" + key + "\"";
-  size_t pos = json.find(marker);
-  if (pos == std::string::npos) return false;
-  pos = json.find(':', pos + marker.size());
-  if (pos == std::string::npos) return false;
-  while (++pos < json.size() && std::isspace(static_cast<unsigned char>(json[pos]))) {}
-  if (pos >= json.size() || json[pos] != '"') return false;
-
-  std::string out;
-  bool escaped = false;
-  for (++pos; pos < json.size(); ++pos) {
-    char c = json[pos];
-    if (escaped) {
-      switch (c) {
-        case '"': out.push_back('"'); break;
-        case '\\': out.push_back('\\'); break;
-        case '/': out.push_back('/'); break;
-        case 'b': out.push_back('\b'); break;
-        case 'f': out.push_back('\f'); break;
-        case 'n': out.push_back('\n'); break;
-        case 'r': out.push_back('\r'); break;
-        case 't': out.push_back('\t'); break;
-        default: out.push_back(c); break;
-      }
-      escaped = false;
-      continue;
-    }
-    if (c == '\\') {
-      escaped = true;
-      continue;
-    }
-    if (c == '"') {
-      value = out;
-      return true;
-    }
-    out.push_back(c);
-  }
-  return false;
-}
-
-static bool parse_json_u64_field(const std::string& json,
-                                 const std::string& key,
-                                 uint64_t& value) {
-  std::string marker = "\"" + key + "\"";
-  size_t pos = json.find(marker);
-  if (pos == std::string::npos) return false;
-  pos = json.find(':', pos + marker.size());
-  if (pos == std::string::npos) return false;
-  while (++pos < json.size() && std::isspace(static_cast<unsigned char>(json[pos]))) {}
-  if (pos >= json.size() || !std::isdigit(static_cast<unsigned char>(json[pos]))) return false;
-  uint64_t out = 0;
-  for (; pos < json.size() && std::isdigit(static_cast<unsigned char>(json[pos])); ++pos) {
-    out = out * 10 + static_cast<uint64_t>(json[pos] - '0');
-  }
-  value = out;
-  return true;
-}
-
 static bool is_friend_offline_error(int err) {
   return err == CARRIER_GENERAL_ERROR(ERROR_FRIEND_OFFLINE);
 }
@@ -790,6 +631,19 @@ static std::string trim_copy_simple(const std::string& s) {
   return s.substr(b, e - b);
 }
 
+#ifndef BEAGLE_EXPRESS_DEFAULT_URL
+#define BEAGLE_EXPRESS_DEFAULT_URL "https://lens.beagle.chat:443"
+#endif
+
+// Express relay base URL; BEAGLE_EXPRESS_URL overrides it and an empty value
+// disables the fallback (fake-SDK builds default to disabled).
+static std::string express_base_url() {
+  const char* env = std::getenv("BEAGLE_EXPRESS_URL");
+  std::string url = env ? env : BEAGLE_EXPRESS_DEFAULT_URL;
+  while (!url.empty() && url.back() == '/') url.pop_back();
+  return url;
+}
+
 static bool post_payload_to_express_node(RuntimeState* state,
                                          const std::string& receiver_id,
                                          const void* bytes,
@@ -799,6 +653,11 @@ static bool post_payload_to_express_node(RuntimeState* state,
     detail = "invalid args";
     return false;
   }
+  const std::string base_url = express_base_url();
+  if (base_url.empty()) {
+    detail = "express disabled";
+    return false;
+  }
 
   char path_template[] = "/tmp/beagle_express_payload_XXXXXX";
   int fd = mkstemp(path_template);
@@ -825,7 +684,7 @@ static bool post_payload_to_express_node(RuntimeState* state,
     return false;
   }
 
-  std::string url = "https://lens.beagle.chat:443/" + receiver_id + "/" + state->user_id;
+  std::string url = base_url + "/" + receiver_id + "/" + state->user_id;
   std::ostringstream cmd;
   cmd << "curl -sS -m 25 --connect-timeout 8 -o /dev/null -w \"%{http_code}\" "
       << "-H \"Content-Type: application/octet-stream\" "
@@ -849,302 +708,6 @@ static bool post_payload_to_express_node(RuntimeState* state,
   return (code == "200" || code == "201");
 }
 
-struct PackedFilePayload {
-  std::string filename;
-  std::string content_type;
-  uint64_t declared_size = 0;
-  const unsigned char* bytes = nullptr;
-  size_t bytes_len = 0;
-};
-
-static int b64_value(unsigned char c) {
-  if (c >= 'A' && c <= 'Z') return c - 'A';
-  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
-  if (c >= '0' && c <= '9') return c - '0' + 52;
-  if (c == '+') return 62;
-  if (c == '/') return 63;
-  return -1;
-}
-
-static bool base64_decode(const std::string& in, std::vector<unsigned char>& out) {
-  out.clear();
-  out.reserve((in.size() * 3) / 4);
-  int val = 0;
-  int valb = -8;
-  for (unsigned char c : in) {
-    if (std::isspace(c)) continue;
-    if (c == '=') break;
-    int d = b64_value(c);
-    if (d < 0) return false;
-    val = (val << 6) + d;
-    valb += 6;
-    if (valb >= 0) {
-      out.push_back(static_cast<unsigned char>((val >> valb) & 0xFF));
-      valb -= 8;
-    }
-  }
-  return !out.empty();
-}
-
-struct InlineJsonMedia {
-  std::string filename;
-  std::string media_type;
-  std::vector<unsigned char> bytes;
-};
-
-static std::string trim_data_url_prefix(const std::string& data) {
-  size_t comma = data.find(',');
-  if (comma == std::string::npos) return data;
-  std::string prefix = lowercase(data.substr(0, comma));
-  if (prefix.find("base64") != std::string::npos) return data.substr(comma + 1);
-  return data;
-}
-
-static bool has_file_extension(const std::string& filename) {
-  size_t slash = filename.find_last_of("/\\");
-  size_t dot = filename.find_last_of('.');
-  return dot != std::string::npos && (slash == std::string::npos || dot > slash + 1);
-}
-
-static bool decode_inline_json_media_payload(const void* msg, size_t len, InlineJsonMedia& out) {
-  if (!msg || len < 8 || len > (kMaxBeaglechatFileBytes * 2)) return false;
-  std::string body(static_cast<const char*>(msg), len);
-  while (!body.empty() && (body.back() == '\0' || std::isspace(static_cast<unsigned char>(body.back())))) {
-    body.pop_back();
-  }
-  size_t start = 0;
-  while (start < body.size() && std::isspace(static_cast<unsigned char>(body[start]))) start++;
-  if (start > 0) body.erase(0, start);
-  if (body.empty() || body.front() != '{' || body.back() != '}') return false;
-
-  std::string type;
-  if (!parse_json_string_field(body, "type", type)) return false;
-  type = lowercase(type);
-  if (type != "image" &&
-      type != "file" &&
-      type != "audio" &&
-      type != "text" &&
-      type != "unknown") return false;
-
-  std::string data;
-  if (!parse_json_string_field(body, "data", data) || data.empty()) return false;
-
-  std::string filename;
-  parse_json_string_field(body, "fileName", filename);
-  if (filename.empty()) parse_json_string_field(body, "filename", filename);
-  std::string ext;
-  parse_json_string_field(body, "fileExtension", ext);
-  if (!ext.empty() && ext[0] != '.') ext = "." + ext;
-  if (!filename.empty() && !ext.empty() && !has_file_extension(filename)) filename += ext;
-  if (filename.empty()) {
-    filename = (type == "image" ? "image" : "file");
-    if (!ext.empty()) filename += ext;
-  }
-  filename = sanitize_filename(filename);
-
-  std::string media_type;
-  if (!parse_json_string_field(body, "mediaType", media_type) || media_type.empty()) {
-    media_type = infer_media_type_from_filename(filename);
-  }
-
-  std::vector<unsigned char> decoded;
-  std::string b64 = trim_data_url_prefix(data);
-  if (!base64_decode(b64, decoded)) return false;
-  if (decoded.size() > kMaxBeaglechatFileBytes) return false;
-
-  out.filename = filename;
-  out.media_type = media_type;
-  out.bytes.swap(decoded);
-  return true;
-}
-
-static bool is_swift_filemodel_json_payload(const void* msg, size_t len) {
-  if (!msg || len < 8 || len > (kMaxBeaglechatFileBytes * 2)) return false;
-  std::string body(static_cast<const char*>(msg), len);
-  while (!body.empty() && (body.back() == '\0' || std::isspace(static_cast<unsigned char>(body.back())))) {
-    body.pop_back();
-  }
-  size_t start = 0;
-  while (start < body.size() && std::isspace(static_cast<unsigned char>(body[start]))) start++;
-  if (start > 0) body.erase(0, start);
-  if (body.empty() || body.front() != '{' || body.back() != '}') return false;
-  std::string file_name;
-  std::string file_extension;
-  std::string data_b64;
-  if (!parse_json_string_field(body, "fileName", file_name) || file_name.empty()) return false;
-  if (!parse_json_string_field(body, "fileExtension", file_extension) || file_extension.empty()) return false;
-  if (!parse_json_string_field(body, "data", data_b64) || data_b64.empty()) return false;
-  if (data_b64.find("base64,") != std::string::npos) return false;
-  return true;
-}
-
-static bool decode_beaglechat_file_payload(const void* msg, size_t len, PackedFilePayload& out) {
-  if (!msg || len < 5) return false;
-  const unsigned char* p = static_cast<const unsigned char*>(msg);
-  uint32_t meta_len = (static_cast<uint32_t>(p[0]) << 24)
-                    | (static_cast<uint32_t>(p[1]) << 16)
-                    | (static_cast<uint32_t>(p[2]) << 8)
-                    | static_cast<uint32_t>(p[3]);
-  if (meta_len == 0 || meta_len > 4096) return false;
-  if (static_cast<size_t>(meta_len) + 4 > len) return false;
-
-  std::string meta(reinterpret_cast<const char*>(p + 4), meta_len);
-  std::string type;
-  if (!parse_json_string_field(meta, "type", type) || type != "file") return false;
-
-  std::string filename;
-  if (!parse_json_string_field(meta, "filename", filename) || filename.empty()) return false;
-
-  std::string content_type;
-  if (!parse_json_string_field(meta, "contentType", content_type) || content_type.empty()) {
-    content_type = infer_media_type_from_filename(filename);
-  }
-
-  uint64_t declared_size = 0;
-  parse_json_u64_field(meta, "size", declared_size);
-
-  out.filename = sanitize_filename(filename);
-  out.content_type = content_type;
-  out.declared_size = declared_size;
-  out.bytes = p + 4 + meta_len;
-  out.bytes_len = len - 4 - meta_len;
-  return true;
-}
-
-static bool encode_beaglechat_file_payload(const std::string& filename,
-                                           const std::string& content_type,
-                                           const std::vector<unsigned char>& data,
-                                           std::vector<unsigned char>& out) {
-  std::ostringstream meta;
-  meta << "{"
-       << "\"type\":\"file\","
-       << "\"filename\":" << json_quote(filename) << ","
-       << "\"contentType\":" << json_quote(content_type.empty() ? "application/octet-stream" : content_type) << ","
-       << "\"size\":" << data.size()
-       << "}";
-  std::string meta_json = meta.str();
-  if (meta_json.empty() || meta_json.size() > 4096) return false;
-
-  uint32_t meta_len = static_cast<uint32_t>(meta_json.size());
-  out.resize(4 + meta_len + data.size());
-  out[0] = static_cast<unsigned char>((meta_len >> 24) & 0xFF);
-  out[1] = static_cast<unsigned char>((meta_len >> 16) & 0xFF);
-  out[2] = static_cast<unsigned char>((meta_len >> 8) & 0xFF);
-  out[3] = static_cast<unsigned char>(meta_len & 0xFF);
-  std::memcpy(out.data() + 4, meta_json.data(), meta_json.size());
-  if (!data.empty()) std::memcpy(out.data() + 4 + meta_json.size(), data.data(), data.size());
-  return true;
-}
-
-static std::string base64_encode_bytes(const std::vector<unsigned char>& data) {
-  static const char* kTable =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-  std::string out;
-  out.reserve(((data.size() + 2) / 3) * 4);
-  size_t i = 0;
-  while (i + 3 <= data.size()) {
-    uint32_t n = (static_cast<uint32_t>(data[i]) << 16)
-               | (static_cast<uint32_t>(data[i + 1]) << 8)
-               | static_cast<uint32_t>(data[i + 2]);
-    out.push_back(kTable[(n >> 18) & 0x3F]);
-    out.push_back(kTable[(n >> 12) & 0x3F]);
-    out.push_back(kTable[(n >> 6) & 0x3F]);
-    out.push_back(kTable[n & 0x3F]);
-    i += 3;
-  }
-  size_t rem = data.size() - i;
-  if (rem == 1) {
-    uint32_t n = static_cast<uint32_t>(data[i]) << 16;
-    out.push_back(kTable[(n >> 18) & 0x3F]);
-    out.push_back(kTable[(n >> 12) & 0x3F]);
-    out.push_back('=');
-    out.push_back('=');
-  } else if (rem == 2) {
-    uint32_t n = (static_cast<uint32_t>(data[i]) << 16)
-               | (static_cast<uint32_t>(data[i + 1]) << 8);
-    out.push_back(kTable[(n >> 18) & 0x3F]);
-    out.push_back(kTable[(n >> 12) & 0x3F]);
-    out.push_back(kTable[(n >> 6) & 0x3F]);
-    out.push_back('=');
-  }
-  return out;
-}
-
-static bool encode_inline_json_media_payload(const std::string& filename,
-                                             const std::string& media_type,
-                                             const std::vector<unsigned char>& data,
-                                             std::string& out) {
-  if (filename.empty() || data.empty()) return false;
-  std::string mt = media_type.empty() ? infer_media_type_from_filename(filename) : media_type;
-  std::string type = lowercase(mt).rfind("image/", 0) == 0 ? "image" : "file";
-  std::string ext;
-  size_t dot = filename.find_last_of('.');
-  if (dot != std::string::npos && dot + 1 < filename.size()) {
-    ext = filename.substr(dot + 1);
-  }
-  std::string b64 = base64_encode_bytes(data);
-  if (b64.empty()) return false;
-  std::string data_url = "data:" + mt + ";base64," + b64;
-
-  std::ostringstream json;
-  json << "{"
-       << "\"type\":" << json_quote(type) << ","
-       << "\"fileName\":" << json_quote(filename) << ","
-       << "\"filename\":" << json_quote(filename) << ","
-       << "\"fileExtension\":" << json_quote(ext) << ","
-       << "\"mediaType\":" << json_quote(mt) << ","
-       << "\"data\":" << json_quote(data_url)
-       << "}";
-  out = json.str();
-  return !out.empty();
-}
-
-static bool encode_swift_filemodel_media_payload(const std::string& filename,
-                                                 const std::string& media_type,
-                                                 const std::vector<unsigned char>& data,
-                                                 std::string& out) {
-  if (filename.empty() || data.empty()) return false;
-  std::string stem = filename;
-  std::string ext = ".bin";
-  size_t dot = filename.find_last_of('.');
-  if (dot != std::string::npos && dot > 0 && dot + 1 < filename.size()) {
-    stem = filename.substr(0, dot);
-    ext = filename.substr(dot);
-  }
-  if (stem.empty()) stem = "file";
-  if (ext.empty() || ext[0] != '.') ext = "." + ext;
-  std::string mt = lowercase(media_type.empty() ? infer_media_type_from_filename(filename) : media_type);
-  std::string type = "unknown";
-  if (mt.rfind("image/", 0) == 0) type = "image";
-  else if (mt.rfind("audio/", 0) == 0) type = "audio";
-  else if (mt.rfind("text/", 0) == 0) type = "text";
-  std::string b64 = base64_encode_bytes(data);
-  if (b64.empty()) return false;
-
-  std::ostringstream json;
-  json << "{"
-       << "\"fileName\":" << json_quote(stem) << ","
-       << "\"fileExtension\":" << json_quote(ext) << ","
-       << "\"data\":" << json_quote(b64) << ","
-       << "\"type\":" << json_quote(type)
-       << "}";
-  out = json.str();
-  return !out.empty();
-}
-
-static bool encode_legacy_inline_data_payload(const std::vector<unsigned char>& data,
-                                              std::string& out) {
-  if (data.empty()) return false;
-  std::string b64 = base64_encode_bytes(data);
-  if (b64.empty()) return false;
-  std::ostringstream json;
-  json << "{"
-       << "\"data\":" << json_quote(b64)
-       << "}";
-  out = json.str();
-  return !out.empty();
-}
-
 static bool read_file(const std::string& path, std::string& out) {
   std::ifstream in(path);
   if (!in) return false;
@@ -1161,6 +724,24 @@ static bool write_file(const std::string& path, const std::string& data) {
   return static_cast<bool>(out);
 }
 
+// Writes data to path and fsyncs it, so a following rename() publishes complete contents.
+static bool write_file_durable(const std::string& path, const std::string& data) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  size_t off = 0;
+  while (off < data.size()) {
+    ssize_t n = ::write(fd, data.data() + off, data.size() - off);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      ::close(fd);
+      return false;
+    }
+    off += static_cast<size_t>(n);
+  }
+  bool ok = ::fsync(fd) == 0;
+  return ::close(fd) == 0 && ok;
+}
+
 static std::string json_escape(const std::string& in) {
   std::string out;
   out.reserve(in.size() + 8);
@@ -1184,11 +765,6 @@ static std::string json_escape(const std::string& in) {
   return out;
 }
 
-static std::string dedupe_text_fragment(const std::string& text) {
-  if (text.size() <= 256) return text;
-  return text.substr(0, 192) + "...|" + std::to_string(text.size()) + "|..." + text.substr(text.size() - 48);
-}
-
 static std::string preview_text(const std::string& text, size_t max_len = 120) {
   std::string out;
   out.reserve(std::min(text.size(), max_len));
@@ -1206,48 +782,14 @@ static std::string preview_text(const std::string& text, size_t max_len = 120) {
   return out;
 }
 
-static std::string build_incoming_signature(const BeagleIncomingMessage& incoming, bool offline) {
-  std::ostringstream sig;
-  sig << incoming.peer << "|"
-      << incoming.ts << "|"
-      << (offline ? 1 : 0) << "|"
-      << incoming.filename << "|"
-      << incoming.media_type << "|"
-      << incoming.size << "|"
-      << dedupe_text_fragment(incoming.text);
-  return sig.str();
-}
-
-static bool remember_incoming_signature(RuntimeState* state, const std::string& signature) {
-  if (!state) return true;
-  constexpr size_t kMaxSeenIncoming = 20000;
-  std::lock_guard<std::mutex> lock(state->state_mu);
-  auto inserted = state->seen_incoming_signatures.insert(signature);
-  if (!inserted.second) return false;
-  state->seen_incoming_order.push_back(signature);
-  while (state->seen_incoming_order.size() > kMaxSeenIncoming) {
-    const std::string& oldest = state->seen_incoming_order.front();
-    state->seen_incoming_signatures.erase(oldest);
-    state->seen_incoming_order.pop_front();
-  }
-  return true;
-}
-
 static void ensure_profile_file(RuntimeState* state);
 
-static bool append_line(const std::string& path, const std::string& line) {
-  std::ofstream out(path, std::ios::app);
-  if (!out) return false;
-  out << line << "\n";
-  return static_cast<bool>(out);
-}
-
 static void log_incoming_event(RuntimeState* state,
                                const BeagleIncomingMessage& incoming,
                                bool offline,
                                const char* action,
                                const std::string& signature) {
-  if (!state || state->incoming_event_log_path.empty()) return;
+  if (!state || !state->incoming_event_log) return;
   std::ostringstream line;
   line << "{"
        << "\"loggedAt\":\"" << json_escape(log_ts()) << "\","
@@ -1264,7 +806,30 @@ static void log_incoming_event(RuntimeState* state,
        << "\"size\":" << incoming.size << ","
        << "\"signature\":\"" << json_escape(signature) << "\""
        << "}";
-  append_line(state->incoming_event_log_path, line.str());
+  state->incoming_event_log->append(line.str());
+}
+
+// ts_ms <= 0 means "now" (outbound sends).
+static void record_history(RuntimeState* state,
+                           const std::string& peer,
+                           const char* direction,
+                           long long ts_ms,
+                           const std::string& text,
+                           const std::string& filename,
+                           const std::string& media_type,
+                           const std::string& msg_id) {
+  if (!state || !state->history) return;
+  HistoryRecord rec;
+  rec.peer = peer;
+  rec.direction = direction;
+  rec.ts_ms = ts_ms > 0 ? ts_ms
+      : std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+  rec.text = text;
+  rec.filename = filename;
+  rec.media_type = media_type;
+  rec.msg_id = msg_id;
+  if (state->history->append(rec) && state->search) state->search->add(rec);
 }
 
 static bool extract_json_string(const std::string& body, const std::string& key, std::string& out) {
@@ -1515,6 +1080,8 @@ static void ensure_profile_metadata(RuntimeState* state,
 static std::string default_db_json() {
   return std::string("{\n")
       + "  \"enabled\": false,\n"
+      + "  \"backend\": \"mysql\",\n"
+      + "  \"sqlitePath\": \"\",\n"
       + "  \"host\": \"localhost\",\n"
       + "  \"port\": 3306,\n"
       + "  \"user\": \"beagle\",\n"
@@ -1523,7 +1090,9 @@ static std::string default_db_json() {
       + "  \"useCrawlerIndex\": false,\n"
       + "  \"crawlerDataDir\": \"~/.elacrawler\",\n"
       + "  \"crawlerRefreshSeconds\": 60,\n"
-      + "  \"crawlerLookbackFiles\": 20\n"
+      + "  \"crawlerLookbackFiles\": 20,\n"
+      + "  \"writeBatchSize\": 500,\n"
+      + "  \"writeFlushMs\": 200\n"
       + "}\n";
 }
 
@@ -1570,7 +1139,7 @@ static void ensure_profile_file(RuntimeState* state) {
   if (!state || state->profile_path.empty()) return;
   if (file_exists(state->profile_path)) return;
   if (!write_file(state->profile_path, default_profile_json())) {
-    log_line(std::string("[beagle-sdk] failed to write default profile to ") + state->profile_path);
+    log_warn(std::string("[beagle-sdk] failed to write default profile to ") + state->profile_path);
   }
 }
 
@@ -1578,7 +1147,7 @@ static void ensure_db_file(RuntimeState* state) {
   if (!state || state->db_config_path.empty()) return;
   if (file_exists(state->db_config_path)) return;
   if (!write_file(state->db_config_path, default_db_json())) {
-    log_line(std::string("[beagle-sdk] failed to write default db config to ") + state->db_config_path);
+    log_warn(std::string("[beagle-sdk] failed to write default db config to ") + state->db_config_path);
   }
 }
 
@@ -1586,7 +1155,7 @@ static void ensure_push_file(RuntimeState* state) {
   if (!state || state->push_config_path.empty()) return;
   if (file_exists(state->push_config_path)) return;
   if (!write_file(state->push_config_path, default_push_json())) {
-    log_line(std::string("[beagle-sdk] failed to write default push config to ") + state->push_config_path);
+    log_warn(std::string("[beagle-sdk] failed to write default push config to ") + state->push_config_path);
   }
 }
 
@@ -1610,6 +1179,10 @@ static void load_db_config(RuntimeState* state, DbConfig& db) {
   std::string body;
   if (!read_file(state->db_config_path, body)) return;
   extract_json_bool(body, "enabled", db.enabled);
+  extract_json_string(body, "backend", db.backend);
+  extract_json_string(body, "sqlitePath", db.sqlite_path);
+  db.backend = lowercase(trim_copy(db.backend));
+  if (db.backend != "sqlite") db.backend = "mysql";
   extract_json_string(body, "host", db.host);
   extract_json_int(body, "port", db.port);
   extract_json_string(body, "user", db.user);
@@ -1622,6 +1195,11 @@ static void load_db_config(RuntimeState* state, DbConfig& db) {
   if (db.crawler_refresh_seconds < 5) db.crawler_refresh_seconds = 5;
   if (db.crawler_lookback_files < 1) db.crawler_lookback_files = 1;
   if (db.crawler_lookback_files > 200) db.crawler_lookback_files = 200;
+  extract_json_int(body, "writeBatchSize", db.write_batch_size);
+  extract_json_int(body, "writeFlushMs", db.write_flush_ms);
+  if (db.write_batch_size < 1) db.write_batch_size = 1;
+  if (db.write_batch_size > 5000) db.write_batch_size = 5000;
+  if (db.write_flush_ms < 10) db.write_flush_ms = 10;
 }
 
 static void load_push_config(RuntimeState* state, PushConfig& push) {
@@ -1663,105 +1241,450 @@ static void load_push_config(RuntimeState* state, PushConfig& push) {
     push.servers.push_back(std::move(server));
   }
 
-  if (push.os.empty()) push.os = detect_os_name();
-  if (push.brand.empty()) push.brand = "OpenClaw";
-  if (push.model.empty()) push.model = "Beagle Sidecar";
-  if (push.token_type.empty()) push.token_type = "sidecar";
-  if (push.app_name.empty()) push.app_name = "openclaw-beagle-sidecar";
-  if (push.env.empty()) push.env = "prod";
+  if (push.os.empty()) push.os = detect_os_name();
+  if (push.brand.empty()) push.brand = "OpenClaw";
+  if (push.model.empty()) push.model = "Beagle Sidecar";
+  if (push.token_type.empty()) push.token_type = "sidecar";
+  if (push.app_name.empty()) push.app_name = "openclaw-beagle-sidecar";
+  if (push.env.empty()) push.env = "prod";
+}
+
+static void load_welcomed_peers(RuntimeState* state) {
+  if (!state || state->welcome_state_path.empty()) return;
+  std::ifstream in(state->welcome_state_path);
+  if (!in) return;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty()) state->welcomed_peers.insert(line);
+  }
+}
+
+static void save_welcomed_peers(RuntimeState* state) {
+  if (!state || state->welcome_state_path.empty()) return;
+  std::ostringstream out;
+  {
+    std::lock_guard<std::mutex> lock(state->state_mu); // Lock access to welcomed_peers
+    for (const auto& peer : state->welcomed_peers) {
+      out << peer << "\n";
+    }
+  }
+  write_file(state->welcome_state_path, out.str());
+}
+
+static std::string sanitize_tsv(const std::string& in) {
+  std::string out = in;
+  for (char& c : out) {
+    if (c == '\t' || c == '\n' || c == '\r') c = ' ';
+  }
+  return out;
+}
+
+static std::string friend_state_line(const FriendState& fs) {
+  std::ostringstream out;
+  out << sanitize_tsv(fs.friendid) << "\t"
+      << sanitize_tsv(fs.name) << "\t"
+      << sanitize_tsv(fs.gender) << "\t"
+      << sanitize_tsv(fs.phone) << "\t"
+      << sanitize_tsv(fs.email) << "\t"
+      << sanitize_tsv(fs.description) << "\t"
+      << sanitize_tsv(fs.region) << "\t"
+      << sanitize_tsv(fs.label) << "\t"
+      << fs.status << "\t"
+      << fs.presence << "\n";
+  return out.str();
+}
+
+// Reads friend_state.tsv-format lines; later lines for the same friend win.
+static size_t read_friend_state_file(RuntimeState* state, const std::string& path) {
+  std::ifstream in(path);
+  if (!in) return 0;
+  size_t lines = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty()) continue;
+    std::vector<std::string> fields;
+    std::string current;
+    for (char c : line) {
+      if (c == '\t') {
+        fields.push_back(current);
+        current.clear();
+      } else {
+        current.push_back(c);
+      }
+    }
+    fields.push_back(current);
+    if (fields.size() < 10) continue;
+    FriendState fs;
+    fs.friendid = fields[0];
+    fs.name = fields[1];
+    fs.gender = fields[2];
+    fs.phone = fields[3];
+    fs.email = fields[4];
+    fs.description = fields[5];
+    fs.region = fields[6];
+    fs.label = fields[7];
+    fs.status = std::atoi(fields[8].c_str());
+    fs.presence = std::atoi(fields[9].c_str());
+    if (!fs.friendid.empty()) state->friend_state[fs.friendid] = std::move(fs);
+    lines++;
+  }
+  return lines;
+}
+
+// friend_state.tsv is the last compacted snapshot; friend_state.log holds the
+// records changed since then (.log.1 is left behind by an interrupted compaction).
+static void load_friend_state(RuntimeState* state) {
+  if (!state || state->friend_state_path.empty()) return;
+  std::lock_guard<std::mutex> lock(state->state_mu);
+  read_friend_state_file(state, state->friend_state_path);
+  if (state->friend_state_log_path.empty()) return;
+  read_friend_state_file(state, state->friend_state_log_path + ".1");
+  state->friend_state_log_lines = read_friend_state_file(state, state->friend_state_log_path);
+}
+
+constexpr size_t kFriendStateCompactMinLines = 1024;
+constexpr int kFriendStateCompactSeconds = 300;
+
+// Appends the current record for friendid; caller holds state_mu. O(1) per change.
+static void save_friend_state(RuntimeState* state, const std::string& friendid) {
+  if (!state || state->friend_state_log_path.empty()) return;
+  auto it = state->friend_state.find(friendid);
+  if (it == state->friend_state.end()) return;
+  if (!state->friend_state_log.is_open()) {
+    state->friend_state_log.open(state->friend_state_log_path, std::ios::app);
+    if (!state->friend_state_log) {
+      log_warn(std::string("[beagle-sdk] friend state log open failed path=") + state->friend_state_log_path);
+      return;
+    }
+  }
+  state->friend_state_log << friend_state_line(it->second);
+  state->friend_state_log.flush();
+  state->friend_state_log_lines++;
+  if (state->friend_state_log_lines >= std::max(kFriendStateCompactMinLines, state->friend_state.size())) {
+    state->friend_state_cv.notify_one();
+  }
+}
+
+// Moves a delta log to rotated. A .log.1 left by a failed compaction still
+// holds deltas found nowhere else on disk, so the log is appended to it then
+// instead of being renamed over it.
+static bool rotate_delta_log(const std::string& log_path, const std::string& rotated) {
+  if (!file_exists(rotated)) return std::rename(log_path.c_str(), rotated.c_str()) == 0;
+  std::string older;
+  std::string newer;
+  std::ifstream in_old(rotated, std::ios::binary);
+  older.assign(std::istreambuf_iterator<char>(in_old), std::istreambuf_iterator<char>());
+  std::ifstream in_new(log_path, std::ios::binary);
+  newer.assign(std::istreambuf_iterator<char>(in_new), std::istreambuf_iterator<char>());
+  std::string tmp = rotated + ".tmp";
+  if (!write_file_durable(tmp, older + newer) || std::rename(tmp.c_str(), rotated.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+  std::remove(log_path.c_str());
+  return true;
+}
+
+// Folds the delta log into friend_state.tsv: the log is rotated under state_mu,
+// the snapshot is written to a temp file, fsynced and renamed over the old one.
+static void compact_friend_state(RuntimeState* state) {
+  if (!state || state->friend_state_path.empty() || state->friend_state_log_path.empty()) return;
+  std::string rotated = state->friend_state_log_path + ".1";
+  std::string snapshot;
+  size_t friends = 0;
+  size_t folded = 0;
+  {
+    std::lock_guard<std::mutex> lock(state->state_mu);
+    if (state->friend_state_log_lines == 0) return;
+    for (const auto& kv : state->friend_state) snapshot += friend_state_line(kv.second);
+    friends = state->friend_state.size();
+    folded = state->friend_state_log_lines;
+    if (state->friend_state_log.is_open()) state->friend_state_log.close();
+    if (rotate_delta_log(state->friend_state_log_path, rotated)) state->friend_state_log_lines = 0;
+  }
+  std::string tmp = state->friend_state_path + ".tmp";
+  if (!write_file_durable(tmp, snapshot) || std::rename(tmp.c_str(), state->friend_state_path.c_str()) != 0) {
+    // Keep the rotated log; load_friend_state replays it.
+    log_warn(std::string("[beagle-sdk] friend state compaction failed path=") + state->friend_state_path
+             + " errno=" + std::to_string(errno));
+    return;
+  }
+  std::remove(rotated.c_str());
+  log_line("[beagle-sdk] friend state compacted friends=" + std::to_string(friends)
+           + " folded_deltas=" + std::to_string(folded));
+}
+
+static void friend_state_compactor_loop(RuntimeState* state) {
+  std::unique_lock<std::mutex> lock(state->state_mu);
+  while (!state->friend_state_stop) {
+    state->friend_state_cv.wait_for(lock, std::chrono::seconds(kFriendStateCompactSeconds), [state]() {
+      return state->friend_state_stop
+          || state->friend_state_log_lines >= std::max(kFriendStateCompactMinLines, state->friend_state.size());
+    });
+    if (state->friend_state_log_lines == 0) continue;
+    lock.unlock();
+    compact_friend_state(state);
+    lock.lock();
+  }
+}
+
+constexpr size_t kOutboxMaxPerPeer = 1000;
+constexpr size_t kMaxDeliveredDedupeKeys = 4096;
+constexpr long long kOutboxMaxAgeSeconds = 3LL * 24LL * 3600LL;
+constexpr int kOutboxPollSeconds = 15;
+
+static std::string outbox_entry_to_json(const OutboxEntry& e) {
+  std::ostringstream line;
+  line << "{"
+       << "\"id\":\"" << json_escape(e.id) << "\","
+       << "\"peer\":\"" << json_escape(e.peer) << "\","
+       << "\"kind\":\"" << json_escape(e.kind) << "\","
+       << "\"dedupeKey\":\"" << json_escape(e.dedupe_key) << "\","
+       << "\"createdTs\":" << e.created_ts << ","
+       << "\"attempts\":" << e.attempts << ","
+       << "\"ownsMedia\":" << (e.owns_media ? 1 : 0) << ","
+       << "\"mediaPath\":\"" << json_escape(e.media_path) << "\","
+       << "\"mediaUrl\":\"" << json_escape(e.media_url) << "\","
+       << "\"mediaType\":\"" << json_escape(e.media_type) << "\","
+       << "\"filename\":\"" << json_escape(e.filename) << "\","
+       << "\"outFormat\":\"" << json_escape(e.out_format) << "\","
+       << "\"text\":\"" << json_escape(e.text) << "\""
+       << "}";
+  return line.str();
+}
+
+static bool outbox_entry_from_json(const std::string& line, OutboxEntry& e) {
+  if (!parse_json_string_field(line, "id", e.id) || e.id.empty()) return false;
+  if (!parse_json_string_field(line, "peer", e.peer) || e.peer.empty()) return false;
+  if (!parse_json_string_field(line, "kind", e.kind)) return false;
+  if (e.kind != "text" && e.kind != "media") return false;
+  parse_json_string_field(line, "dedupeKey", e.dedupe_key);
+  uint64_t n = 0;
+  if (parse_json_u64_field(line, "createdTs", n)) e.created_ts = static_cast<long long>(n);
+  if (parse_json_u64_field(line, "attempts", n)) e.attempts = static_cast<int>(n);
+  if (parse_json_u64_field(line, "ownsMedia", n)) e.owns_media = (n != 0);
+  parse_json_string_field(line, "mediaPath", e.media_path);
+  parse_json_string_field(line, "mediaUrl", e.media_url);
+  parse_json_string_field(line, "mediaType", e.media_type);
+  parse_json_string_field(line, "filename", e.filename);
+  parse_json_string_field(line, "outFormat", e.out_format);
+  parse_json_string_field(line, "text", e.text);
+  return true;
+}
+
+static size_t outbox_pending_locked(const RuntimeState* state) {
+  size_t n = 0;
+  for (const auto& kv : state->outbox) n += kv.second.size();
+  return n;
+}
+
+constexpr size_t kOutboxCompactMinLines = 1024;
+
+// outbox.jsonl is the last compacted snapshot, one entry per line; outbox.log
+// journals what changed since: "add" records carry a whole entry, "retry" an
+// entry's new attempt count and "ack" an entry that was delivered or dropped.
+// Replaying them is idempotent, so a crash anywhere in a compaction leaves a
+// loadable outbox.
+static std::string outbox_add_record(const OutboxEntry& e) {
+  return "{\"op\":\"add\"," + outbox_entry_to_json(e).substr(1);
+}
+
+static std::string outbox_retry_record(const OutboxEntry& e) {
+  return "{\"op\":\"retry\",\"id\":\"" + json_escape(e.id) + "\",\"peer\":\"" + json_escape(e.peer)
+      + "\",\"attempts\":" + std::to_string(e.attempts) + "}";
+}
+
+static std::string outbox_ack_record(const OutboxEntry& e) {
+  return "{\"op\":\"ack\",\"id\":\"" + json_escape(e.id) + "\",\"peer\":\"" + json_escape(e.peer) + "\"}";
+}
+
+static bool outbox_compact_due_locked(const RuntimeState* state) {
+  return state->outbox_log_lines >= std::max(kOutboxCompactMinLines, outbox_pending_locked(state));
+}
+
+// Appends one record to outbox.log and fsyncs it, so a send reported as
+// queued survives a crash. Caller holds outbox_mu. O(1) per change.
+static void append_outbox_record_locked(RuntimeState* state, const std::string& record) {
+  if (!state || state->outbox_log_path.empty()) return;
+  int& fd = state->outbox_log_fd;
+  if (fd < 0) {
+    fd = ::open(state->outbox_log_path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+      log_warn(std::string("[beagle-sdk] outbox journal open failed path=") + state->outbox_log_path
+               + " errno=" + std::to_string(errno));
+      return;
+    }
+    // A crash can leave a torn last record; start the next one on its own line.
+    off_t end = ::lseek(fd, 0, SEEK_END);
+    char last = '\n';
+    if (end > 0 && ::pread(fd, &last, 1, end - 1) == 1 && last != '\n') {
+      ssize_t ignored = ::write(fd, "\n", 1);
+      (void)ignored;
+    }
+  }
+  const std::string line = record + "\n";
+  off_t start = ::lseek(fd, 0, SEEK_END);
+  bool ok = true;
+  size_t off = 0;
+  while (off < line.size()) {
+    ssize_t n = ::write(fd, line.data() + off, line.size() - off);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      ok = false;
+      break;
+    }
+    off += static_cast<size_t>(n);
+  }
+  if (!ok || ::fsync(fd) != 0) {
+    log_warn(std::string("[beagle-sdk] outbox journal write failed path=") + state->outbox_log_path
+             + " errno=" + std::to_string(errno));
+    if (start >= 0) {
+      int ignored = ::ftruncate(fd, start);
+      (void)ignored;
+    }
+    return;
+  }
+  state->outbox_log_lines++;
+  if (outbox_compact_due_locked(state)) state->outbox_cv.notify_all();
+}
+
+// Sequence part of an entry id ("<created_ts>-<seq>").
+static unsigned long long outbox_id_seq(const std::string& id) {
+  size_t dash = id.rfind('-');
+  return dash == std::string::npos ? 0 : std::strtoull(id.c_str() + dash + 1, nullptr, 10);
 }
 
-static void load_welcomed_peers(RuntimeState* state) {
-  if (!state || state->welcome_state_path.empty()) return;
-  std::ifstream in(state->welcome_state_path);
-  if (!in) return;
+// Applies a snapshot or journal file to state->outbox; ids holds the ids of
+// the entries added so far. Returns the number of records read.
+static size_t read_outbox_file(RuntimeState* state, const std::string& path, std::unordered_set<std::string>& ids) {
+  std::ifstream in(path);
+  if (!in) return 0;
+  size_t records = 0;
   std::string line;
   while (std::getline(in, line)) {
-    if (!line.empty()) state->welcomed_peers.insert(line);
+    line = trim_copy(line);
+    // Skips blank lines and a record torn by a crash.
+    if (line.empty() || line.back() != '}') continue;
+    records++;
+    std::string op = "add";  // snapshot lines carry no op
+    parse_json_string_field(line, "op", op);
+    if (op == "add") {
+      OutboxEntry e;
+      if (!outbox_entry_from_json(line, e) || !ids.insert(e.id).second) continue;
+      // New ids must not collide with replayed ones after a quick restart.
+      state->outbox_seq = std::max(state->outbox_seq, outbox_id_seq(e.id));
+      state->outbox[e.peer].push_back(std::move(e));
+      continue;
+    }
+    std::string id;
+    std::string peer;
+    if (!parse_json_string_field(line, "id", id) || !parse_json_string_field(line, "peer", peer)) continue;
+    auto it = state->outbox.find(peer);
+    if (it == state->outbox.end()) continue;
+    auto& queue = it->second;
+    auto entry = std::find_if(queue.begin(), queue.end(), [&id](const OutboxEntry& e) { return e.id == id; });
+    if (entry == queue.end()) continue;
+    if (op == "retry") {
+      uint64_t n = 0;
+      if (parse_json_u64_field(line, "attempts", n)) entry->attempts = static_cast<int>(n);
+    } else if (op == "ack") {
+      ids.erase(id);
+      queue.erase(entry);
+      if (queue.empty()) state->outbox.erase(it);
+    }
   }
+  return records;
 }
 
-static void save_welcomed_peers(RuntimeState* state) {
-  if (!state || state->welcome_state_path.empty()) return;
-  std::ostringstream out;
-  {
-    std::lock_guard<std::mutex> lock(state->state_mu); // Lock access to welcomed_peers
-    for (const auto& peer : state->welcomed_peers) {
-      out << peer << "\n";
+static void load_outbox(RuntimeState* state) {
+  if (!state || state->outbox_path.empty()) return;
+  std::lock_guard<std::mutex> lock(state->outbox_mu);
+  std::unordered_set<std::string> ids;
+  read_outbox_file(state, state->outbox_path, ids);
+  if (!state->outbox_log_path.empty()) {
+    // .log.1 is left behind by an interrupted compaction.
+    read_outbox_file(state, state->outbox_log_path + ".1", ids);
+    state->outbox_log_lines = read_outbox_file(state, state->outbox_log_path, ids);
+  }
+  size_t loaded = 0;
+  for (const auto& kv : state->outbox) {
+    for (const auto& e : kv.second) {
+      if (!e.dedupe_key.empty()) state->outbox_dedupe_keys.insert(e.dedupe_key);
+      ++loaded;
     }
   }
-  write_file(state->welcome_state_path, out.str());
-}
-
-static std::string sanitize_tsv(const std::string& in) {
-  std::string out = in;
-  for (char& c : out) {
-    if (c == '\t' || c == '\n' || c == '\r') c = ' ';
+  if (loaded > 0) {
+    log_line("[beagle-sdk] outbox restored entries=" + std::to_string(loaded)
+             + " peers=" + std::to_string(state->outbox.size()));
   }
-  return out;
 }
 
-static void load_friend_state(RuntimeState* state) {
-  if (!state || state->friend_state_path.empty()) return;
-  std::ifstream in(state->friend_state_path);
-  if (!in) return;
-  std::string line;
-  while (std::getline(in, line)) {
-    if (line.empty()) continue;
-    std::vector<std::string> fields;
-    std::string current;
-    for (char c : line) {
-      if (c == '\t') {
-        fields.push_back(current);
-        current.clear();
-      } else {
-        current.push_back(c);
+// Folds outbox.log into outbox.jsonl like compact_friend_state(): the journal
+// is rotated under outbox_mu, then the snapshot is written to a fsynced temp
+// file and renamed over the old one.
+static void compact_outbox(RuntimeState* state) {
+  if (!state || state->outbox_path.empty() || state->outbox_log_path.empty()) return;
+  std::string rotated = state->outbox_log_path + ".1";
+  std::string snapshot;
+  size_t entries = 0;
+  size_t folded = 0;
+  {
+    std::lock_guard<std::mutex> lock(state->outbox_mu);
+    if (state->outbox_log_lines == 0) return;
+    for (const auto& kv : state->outbox) {
+      for (const auto& e : kv.second) {
+        snapshot += outbox_entry_to_json(e) + "\n";
+        ++entries;
       }
     }
-    fields.push_back(current);
-    if (fields.size() < 10) continue;
-    FriendState fs;
-    fs.friendid = fields[0];
-    fs.name = fields[1];
-    fs.gender = fields[2];
-    fs.phone = fields[3];
-    fs.email = fields[4];
-    fs.description = fields[5];
-    fs.region = fields[6];
-    fs.label = fields[7];
-    fs.status = std::atoi(fields[8].c_str());
-    fs.presence = std::atoi(fields[9].c_str());
-    if (!fs.friendid.empty()) state->friend_state[fs.friendid] = std::move(fs);
+    folded = state->outbox_log_lines;
+    if (state->outbox_log_fd >= 0) {
+      ::close(state->outbox_log_fd);
+      state->outbox_log_fd = -1;
+    }
+    if (rotate_delta_log(state->outbox_log_path, rotated)) state->outbox_log_lines = 0;
   }
+  std::string tmp = state->outbox_path + ".tmp";
+  if (!write_file_durable(tmp, snapshot) || std::rename(tmp.c_str(), state->outbox_path.c_str()) != 0) {
+    // Keep the rotated journal; load_outbox replays it.
+    log_warn(std::string("[beagle-sdk] outbox compaction failed path=") + state->outbox_path
+             + " errno=" + std::to_string(errno));
+    return;
+  }
+  std::remove(rotated.c_str());
+  log_debug("[beagle-sdk] outbox compacted entries=" + std::to_string(entries)
+            + " folded_records=" + std::to_string(folded));
 }
 
-static void save_friend_state(RuntimeState* state) {
-  if (!state || state->friend_state_path.empty()) return;
-  std::ostringstream out;
-  for (const auto& kv : state->friend_state) {
-    const FriendState& fs = kv.second;
-    out << sanitize_tsv(fs.friendid) << "\t"
-        << sanitize_tsv(fs.name) << "\t"
-        << sanitize_tsv(fs.gender) << "\t"
-        << sanitize_tsv(fs.phone) << "\t"
-        << sanitize_tsv(fs.email) << "\t"
-        << sanitize_tsv(fs.description) << "\t"
-        << sanitize_tsv(fs.region) << "\t"
-        << sanitize_tsv(fs.label) << "\t"
-        << fs.status << "\t"
-        << fs.presence << "\n";
-  }
-  write_file(state->friend_state_path, out.str());
-}
-
-static std::string sql_escape(const std::string& in) {
-  std::string out;
-  out.reserve(in.size() + 8);
-  for (char c : in) {
-    if (c == '\\' || c == '\'') out.push_back('\\');
-    out.push_back(c);
+static void remember_delivered_dedupe_key_locked(RuntimeState* state, const std::string& key) {
+  if (key.empty()) return;
+  if (!state->delivered_dedupe_keys.insert(key).second) return;
+  state->delivered_dedupe_order.push_back(key);
+  while (state->delivered_dedupe_order.size() > kMaxDeliveredDedupeKeys) {
+    state->delivered_dedupe_keys.erase(state->delivered_dedupe_order.front());
+    state->delivered_dedupe_order.pop_front();
   }
-  return out;
+}
+
+static void discard_outbox_media(const OutboxEntry& e) {
+  if (e.owns_media && !e.media_path.empty()) std::remove(e.media_path.c_str());
+}
+
+static void kick_outbox_peer(RuntimeState* state, const std::string& peer) {
+  if (!state || peer.empty()) return;
+  std::lock_guard<std::mutex> lock(state->outbox_mu);
+  auto it = state->outbox.find(peer);
+  if (it == state->outbox.end() || it->second.empty()) return;
+  state->outbox_kicked_peers.insert(peer);
+  state->outbox_cv.notify_all();
+}
+
+static void kick_outbox_all(RuntimeState* state) {
+  if (!state) return;
+  std::lock_guard<std::mutex> lock(state->outbox_mu);
+  if (state->outbox.empty()) return;
+  state->outbox_kick_all = true;
+  state->outbox_cv.notify_all();
 }
 
 static std::string shell_escape(const std::string& in) {
@@ -1777,193 +1700,96 @@ static std::string shell_escape(const std::string& in) {
   return out;
 }
 
-static int mysql_exec(const DbConfig& db, const std::string& sql) {
-  if (!db.enabled) return 0;
-  std::ostringstream cmd;
-  cmd << "mysql --protocol=TCP"
-      << " --host=" << shell_escape(db.host)
-      << " --port=" << db.port
-      << " --user=" << shell_escape(db.user)
-      << " --password=" << shell_escape(db.password);
-  if (!db.database.empty()) cmd << " --database=" << shell_escape(db.database);
-  cmd << " --execute=" << shell_escape(sql);
-  int rc = std::system(cmd.str().c_str());
-  return rc;
-}
-
-static bool mysql_query_has_rows(const DbConfig& db, const std::string& sql) {
-  if (!db.enabled) return false;
-  std::ostringstream cmd;
-  cmd << "mysql --batch --skip-column-names --raw --protocol=TCP"
-      << " --host=" << shell_escape(db.host)
-      << " --port=" << db.port
-      << " --user=" << shell_escape(db.user)
-      << " --password=" << shell_escape(db.password);
-  if (!db.database.empty()) cmd << " --database=" << shell_escape(db.database);
-  cmd << " --execute=" << shell_escape(sql) << " 2>/dev/null";
-  FILE* fp = popen(cmd.str().c_str(), "r");
-  if (!fp) return false;
-  char line[64];
-  bool has = std::fgets(line, sizeof(line), fp) != nullptr;
-  pclose(fp);
-  return has;
-}
-
-static bool mysql_query_first_line(const DbConfig& db,
-                                   const std::string& sql,
-                                   std::string& out_line) {
-  if (!db.enabled) return false;
-  std::ostringstream cmd;
-  cmd << "mysql --batch --skip-column-names --raw --protocol=TCP"
-      << " --host=" << shell_escape(db.host)
-      << " --port=" << db.port
-      << " --user=" << shell_escape(db.user)
-      << " --password=" << shell_escape(db.password);
-  if (!db.database.empty()) cmd << " --database=" << shell_escape(db.database);
-  cmd << " --execute=" << shell_escape(sql) << " 2>/dev/null";
-  FILE* fp = popen(cmd.str().c_str(), "r");
-  if (!fp) return false;
-  char line[1024];
-  bool ok = std::fgets(line, sizeof(line), fp) != nullptr;
-  pclose(fp);
-  if (!ok) return false;
-  out_line = line;
-  while (!out_line.empty() && (out_line.back() == '\n' || out_line.back() == '\r')) {
-    out_line.pop_back();
-  }
-  return !out_line.empty();
-}
-
-static bool mysql_column_exists(const DbConfig& db,
-                                const std::string& table,
-                                const std::string& column) {
-  std::ostringstream sql;
-  sql << "SELECT 1 FROM INFORMATION_SCHEMA.COLUMNS WHERE TABLE_SCHEMA='"
-      << sql_escape(db.database) << "' AND TABLE_NAME='"
-      << sql_escape(table) << "' AND COLUMN_NAME='"
-      << sql_escape(column) << "' LIMIT 1;";
-  return mysql_query_has_rows(db, sql.str());
-}
-
-static void persist_crawler_index_to_db(RuntimeState* state,
-                                        const std::map<std::string, std::pair<std::string, std::string>>& rows,
+static MysqlEndpoint mysql_endpoint(const DbConfig& db) {
+  MysqlEndpoint ep;
+  ep.host = db.host;
+  ep.port = db.port;
+  ep.user = db.user;
+  ep.password = db.password;
+  ep.database = db.database;
+  return ep;
+}
+
+static constexpr size_t kCrawlerPersistChunkRows = 2000;
+
+// Writes the rows of index that differ from previous (all rows when previous is
+// null) in transactions of at most kCrawlerPersistChunkRows rows.
+static bool persist_crawler_index_to_db(RuntimeState* state,
+                                        const MappedCrawlerIndex& index,
+                                        const MappedCrawlerIndex* previous,
                                         const std::string& source_file,
                                         std::time_t seen_at) {
-  if (!state || !state->db.enabled || rows.empty()) return;
-  std::ostringstream sql;
-  sql << "REPLACE INTO beagle_crawler_node_cache(userid,ip,location,source_file,seen_at,updated_at) VALUES ";
-  bool first = true;
-  for (const auto& kv : rows) {
-    const std::string& userid = kv.first;
-    const std::string& ip = kv.second.first;
-    const std::string& location = kv.second.second;
-    if (userid.empty()) continue;
-    if (!first) sql << ",";
-    first = false;
-    sql << "('"
-        << sql_escape(userid) << "','"
-        << sql_escape(ip) << "','"
-        << sql_escape(location) << "','"
-        << sql_escape(source_file) << "',"
-        << "FROM_UNIXTIME(" << static_cast<long long>(seen_at) << "),"
-        << "NOW())";
-  }
-  if (first) return;
-  sql << ";";
-  int rc = mysql_exec(state->db, sql.str());
-  if (rc != 0) {
-    log_line("[beagle-sdk] crawler cache persist failed rc=" + std::to_string(rc));
-  } else {
-    log_line("[beagle-sdk] crawler cache persisted rows=" + std::to_string(rows.size()));
-  }
+  if (!state || !state->db_store) return false;
+  auto started = std::chrono::steady_clock::now();
+  std::vector<CrawlerNodeRow> batch;
+  batch.reserve(std::min(index.size(), kCrawlerPersistChunkRows));
+  size_t written = 0;
+  size_t chunks = 0;
+  bool ok = true;
+  auto flush = [&]() {
+    if (!ok || batch.empty()) return;
+    ok = state->db_store->persist_crawler_nodes(batch);
+    if (ok) {
+      written += batch.size();
+      chunks++;
+    }
+    batch.clear();
+  };
+  size_t unchanged = index.for_each_changed(previous, [&](const std::string& userid, const CrawlerNode& node) {
+    if (!ok) return;
+    CrawlerNodeRow row;
+    row.userid = userid;
+    row.ip = node.ip;
+    row.location = node.location;
+    row.source_file = source_file;
+    row.seen_at = static_cast<long long>(seen_at);
+    batch.push_back(std::move(row));
+    if (batch.size() >= kCrawlerPersistChunkRows) flush();
+  });
+  flush();
+  long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - started).count();
+  log_write(ok ? LogLevel::Info : LogLevel::Warn, __FILE__, __LINE__,
+            std::string("[beagle-sdk] crawler cache ") + (ok ? "persisted" : "persist failed")
+                + " changed=" + std::to_string(written)
+                + " unchanged=" + std::to_string(unchanged)
+                + " chunks=" + std::to_string(chunks)
+                + " ms=" + std::to_string(ms));
+  return ok;
 }
 
 static std::pair<std::string, std::string> lookup_ip_location_from_crawler_cache_db(RuntimeState* state,
                                                                                      const std::string& friendid) {
-  if (!state || !state->db.enabled || friendid.empty()) return {"", ""};
-  std::ostringstream sql;
-  sql << "SELECT ip,location FROM beagle_crawler_node_cache WHERE userid='"
-      << sql_escape(friendid) << "' LIMIT 1;";
-  std::string line;
-  if (!mysql_query_first_line(state->db, sql.str(), line)) return {"", ""};
-  size_t tab = line.find('\t');
-  if (tab == std::string::npos) return {"", ""};
-  std::string ip = line.substr(0, tab);
-  std::string location = line.substr(tab + 1);
+  if (!state || !state->db_store || friendid.empty()) return {"", ""};
+  std::string ip;
+  std::string location;
+  if (!state->db_store->lookup_crawler_node(friendid, ip, location)) return {"", ""};
   return {ip, location};
 }
 
 static void ensure_db(RuntimeState* state, const DbConfig& db) {
   if (!state || !db.enabled) return;
-  std::string create_db = "CREATE DATABASE IF NOT EXISTS " + db.database + ";";
-  {
-    std::ostringstream cmd;
-    cmd << "mysql --protocol=TCP"
-        << " --host=" << shell_escape(db.host)
-        << " --port=" << db.port
-        << " --user=" << shell_escape(db.user)
-        << " --password=" << shell_escape(db.password)
-        << " --execute=" << shell_escape(create_db);
-    std::system(cmd.str().c_str());
-  }
-
-  const char* schema =
-      "CREATE TABLE IF NOT EXISTS beagle_friend_info ("
-      "friendid VARCHAR(128) PRIMARY KEY,"
-      "name VARCHAR(128),"
-      "gender VARCHAR(64),"
-      "phone VARCHAR(64),"
-      "email VARCHAR(256),"
-      "description TEXT,"
-      "region VARCHAR(128),"
-      "label VARCHAR(128),"
-      "status INT,"
-      "presence INT,"
-      "updated_at DATETIME"
-      ");"
-      "CREATE TABLE IF NOT EXISTS beagle_friend_info_history ("
-      "id BIGINT AUTO_INCREMENT PRIMARY KEY,"
-      "friendid VARCHAR(128),"
-      "name VARCHAR(128),"
-      "gender VARCHAR(64),"
-      "phone VARCHAR(64),"
-      "email VARCHAR(256),"
-      "description TEXT,"
-      "region VARCHAR(128),"
-      "label VARCHAR(128),"
-      "status INT,"
-      "presence INT,"
-      "changed_at DATETIME"
-      ");"
-      "CREATE TABLE IF NOT EXISTS beagle_friend_events ("
-      "id BIGINT AUTO_INCREMENT PRIMARY KEY,"
-      "friendid VARCHAR(128),"
-      "event_type VARCHAR(32),"
-      "status INT,"
-      "presence INT,"
-      "ip VARCHAR(64),"
-      "location VARCHAR(128),"
-      "ts DATETIME"
-      ");"
-      "CREATE TABLE IF NOT EXISTS beagle_crawler_node_cache ("
-      "userid VARCHAR(128) PRIMARY KEY,"
-      "ip VARCHAR(64),"
-      "location VARCHAR(128),"
-      "source_file VARCHAR(255),"
-      "seen_at DATETIME,"
-      "updated_at DATETIME,"
-      "KEY idx_seen_at (seen_at)"
-      ");";
-  int rc = mysql_exec(db, schema);
-  if (rc != 0) {
-    log_line(std::string("[beagle-sdk] mysql schema init failed rc=") + std::to_string(rc));
-  }
-  if (!mysql_column_exists(db, "beagle_friend_events", "ip")) {
-    mysql_exec(db, "ALTER TABLE beagle_friend_events ADD COLUMN ip VARCHAR(64) NULL AFTER presence;");
-  }
-  if (!mysql_column_exists(db, "beagle_friend_events", "location")) {
-    mysql_exec(db, "ALTER TABLE beagle_friend_events ADD COLUMN location VARCHAR(128) NULL AFTER ip;");
+  if (db.backend == "sqlite") {
+    std::string path = expand_home(trim_copy(db.sqlite_path));
+    if (path.empty()) path = "beagle.sqlite";
+    if (path[0] != '/') path = state->persistent_location + "/" + path;
+    std::unique_ptr<SqliteStore> store(new SqliteStore(path));
+    if (!store->open()) {
+      log_warn(std::string("[beagle-sdk] sqlite backend unavailable path=") + path);
+      return;
+    }
+    log_line(std::string("[beagle-sdk] db backend=sqlite path=") + path);
+    state->db_store = std::move(store);
+  } else {
+    state->db_store.reset(new MysqlStore(mysql_endpoint(db)));
+    log_line(std::string("[beagle-sdk] db backend=") + state->db_store->name()
+             + " host=" + db.host + " port=" + std::to_string(db.port));
   }
+  // Schema setup (several mysql round trips) runs on the writer thread.
+  state->db_writer.reset(new DbBatchWriter(state->db_store.get(),
+                                           static_cast<size_t>(db.write_batch_size),
+                                           db.write_flush_ms,
+                                           true));
 }
 
 static std::string now_mysql_ts() {
@@ -1994,25 +1820,24 @@ static void log_friend_event(RuntimeState* state,
     ip = detect_remote_ip_for_current_process();
     location = guess_location_from_ip(ip);
   }
-  if (!state->friend_event_log_path.empty()) {
+  if (state->friend_event_log) {
     std::ostringstream line;
     line << ts << "\t" << friendid << "\t" << event_type
          << "\tstatus=" << status << "\tpresence=" << presence
          << "\tip=" << (ip.empty() ? "-" : ip)
          << "\tlocation=" << (location.empty() ? "-" : location);
-    append_line(state->friend_event_log_path, line.str());
+    state->friend_event_log->append(line.str());
   }
-  if (state->db.enabled) {
-    std::ostringstream sql;
-    sql << "INSERT INTO beagle_friend_events(friendid,event_type,status,presence,ip,location,ts) VALUES('"
-        << sql_escape(friendid) << "','"
-        << sql_escape(event_type) << "',"
-        << status << ","
-        << presence << ",'"
-        << sql_escape(ip) << "','"
-        << sql_escape(location) << "','"
-        << sql_escape(ts) << "');";
-    mysql_exec(state->db, sql.str());
+  if (state->db_writer) {
+    FriendEventRow row;
+    row.friendid = friendid;
+    row.event_type = event_type;
+    row.status = status;
+    row.presence = presence;
+    row.ip = ip;
+    row.location = location;
+    row.ts = ts;
+    state->db_writer->enqueue_event(std::move(row));
   }
 }
 
@@ -2093,45 +1918,29 @@ static void store_friend_info(RuntimeState* state,
                               const std::string& friendid,
                               const CarrierFriendInfo* info) {
   if (!state || friendid.empty() || !info) return;
-  std::lock_guard<std::mutex> lock(state->state_mu);
-  auto it = state->friend_state.find(friendid);
-  FriendState next = from_friend_info(friendid, info);
-  if (it != state->friend_state.end() && friend_info_equals(it->second, info)) return;
-  state->friend_state[friendid] = next;
-  save_friend_state(state);
+  {
+    std::lock_guard<std::mutex> lock(state->state_mu);
+    auto it = state->friend_state.find(friendid);
+    if (it != state->friend_state.end() && friend_info_equals(it->second, info)) return;
+    state->friend_state[friendid] = from_friend_info(friendid, info);
+    save_friend_state(state, friendid);
+  }
 
-  if (state->db.enabled) {
-    std::string ts = now_mysql_ts();
+  if (state->db_writer) {
     const CarrierUserInfo& ui = info->user_info;
-    std::ostringstream upsert;
-    upsert << "REPLACE INTO beagle_friend_info(friendid,name,gender,phone,email,description,region,label,status,presence,updated_at) VALUES('"
-           << sql_escape(friendid) << "','"
-           << sql_escape(ui.name) << "','"
-           << sql_escape(ui.gender) << "','"
-           << sql_escape(ui.phone) << "','"
-           << sql_escape(ui.email) << "','"
-           << sql_escape(ui.description) << "','"
-           << sql_escape(ui.region) << "','"
-           << sql_escape(info->label) << "',"
-           << static_cast<int>(info->status) << ","
-           << static_cast<int>(info->presence) << ",'"
-           << sql_escape(ts) << "');";
-    mysql_exec(state->db, upsert.str());
-
-    std::ostringstream history;
-    history << "INSERT INTO beagle_friend_info_history(friendid,name,gender,phone,email,description,region,label,status,presence,changed_at) VALUES('"
-            << sql_escape(friendid) << "','"
-            << sql_escape(ui.name) << "','"
-            << sql_escape(ui.gender) << "','"
-            << sql_escape(ui.phone) << "','"
-            << sql_escape(ui.email) << "','"
-            << sql_escape(ui.description) << "','"
-            << sql_escape(ui.region) << "','"
-            << sql_escape(info->label) << "',"
-            << static_cast<int>(info->status) << ","
-            << static_cast<int>(info->presence) << ",'"
-            << sql_escape(ts) << "');";
-    mysql_exec(state->db, history.str());
+    FriendInfoRow row;
+    row.friendid = friendid;
+    row.name = ui.name;
+    row.gender = ui.gender;
+    row.phone = ui.phone;
+    row.email = ui.email;
+    row.description = ui.description;
+    row.region = ui.region;
+    row.label = info->label;
+    row.status = static_cast<int>(info->status);
+    row.presence = static_cast<int>(info->presence);
+    row.ts = now_mysql_ts();
+    state->db_writer->enqueue_info(std::move(row));
   }
 }
 
@@ -2150,7 +1959,7 @@ static void update_friend_status(RuntimeState* state,
     fs.presence = presence >= 0 ? presence : 0;
     state->friend_state[friendid] = fs;
     if (fs.status != 0) state->push_peer_notify_state.erase(friendid);
-    save_friend_state(state);
+    save_friend_state(state, friendid);
     if (log_event) log_friend_event(state, friendid, status ? "online" : "offline", status, presence);
     return;
   }
@@ -2168,7 +1977,7 @@ static void update_friend_status(RuntimeState* state,
   it->second.status = next_status;
   it->second.presence = next_presence;
   if (became_online) state->push_peer_notify_state.erase(friendid);
-  save_friend_state(state);
+  save_friend_state(state, friendid);
   if (log_event && changed) log_friend_event(state, friendid, next_status ? "online" : "offline", next_status, next_presence);
 }
 
@@ -2429,7 +2238,19 @@ static bool should_send_offline_notification_locked(RuntimeState* state,
   return false;
 }
 
-static bool send_push_registration(RuntimeState* state) {
+// The start-up pushes run while stop() may be waiting: each call gets at most
+// kPushSetupCallSeconds, all of them together kPushSetupBudgetSeconds, and
+// none starts once stop() has set push_setup_stop.
+constexpr long kPushSetupCallSeconds = 5;
+constexpr int kPushSetupBudgetSeconds = 20;
+
+static long push_setup_seconds_left(RuntimeState* state, std::chrono::steady_clock::time_point deadline) {
+  if (state->push_setup_stop) return 0;
+  auto left = std::chrono::duration_cast<std::chrono::seconds>(deadline - std::chrono::steady_clock::now()).count();
+  return std::min<long>(kPushSetupCallSeconds, static_cast<long>(left));
+}
+
+static bool send_push_registration(RuntimeState* state, std::chrono::steady_clock::time_point deadline) {
   if (!state) return false;
   const PushConfig& push = state->push;
   if (!push.enabled || !push.register_on_start || push.servers.empty()) return false;
@@ -2454,16 +2275,20 @@ static bool send_push_registration(RuntimeState* state) {
         + "?appKey=" + url_encode(server.app_key);
     std::string detail;
     std::string body = build_push_request_body(fields);
-    if (post_json_with_curl(url, body, 15, detail)) {
+    long timeout = push_setup_seconds_left(state, deadline);
+    if (timeout <= 0) return false;
+    if (post_json_with_curl(url, body, timeout, detail)) {
       log_line(std::string("[beagle-sdk] push register ok url=") + url + " detail=" + detail);
       return true;
     }
-    log_line(std::string("[beagle-sdk] push register failed url=") + url + " detail=" + detail);
+    log_warn(std::string("[beagle-sdk] push register failed url=") + url + " detail=" + detail);
   }
   return false;
 }
 
-static bool send_push_profile_update(RuntimeState* state, const ProfileInfo& profile) {
+static bool send_push_profile_update(RuntimeState* state,
+                                     const ProfileInfo& profile,
+                                     std::chrono::steady_clock::time_point deadline) {
   if (!state) return false;
   const PushConfig& push = state->push;
   if (!push.enabled || push.servers.empty() || state->user_id.empty()) return false;
@@ -2482,11 +2307,13 @@ static bool send_push_profile_update(RuntimeState* state, const ProfileInfo& pro
         + "?appKey=" + url_encode(server.app_key);
     std::string detail;
     std::string body = build_push_request_body(fields);
-    if (post_json_with_curl(url, body, 15, detail)) {
+    long timeout = push_setup_seconds_left(state, deadline);
+    if (timeout <= 0) return false;
+    if (post_json_with_curl(url, body, timeout, detail)) {
       log_line(std::string("[beagle-sdk] push profile ok url=") + url + " detail=" + detail);
       return true;
     }
-    log_line(std::string("[beagle-sdk] push profile failed url=") + url + " detail=" + detail);
+    log_warn(std::string("[beagle-sdk] push profile failed url=") + url + " detail=" + detail);
   }
   return false;
 }
@@ -2525,7 +2352,7 @@ static void maybe_notify_offline_delivery(RuntimeState* state,
       delivered = true;
       break;
     }
-    log_line(std::string("[beagle-sdk] offline notification failed peer=") + peer
+    log_warn(std::string("[beagle-sdk] offline notification failed peer=") + peer
              + " url=" + url + " detail=" + detail);
   }
 
@@ -2556,7 +2383,7 @@ static void apply_profile(RuntimeState* state, const ProfileInfo& profile) {
   if (rc < 0) {
     std::ostringstream msg;
     msg << "[beagle-sdk] set self info failed: 0x" << std::hex << carrier_get_error() << std::dec;
-    log_line(msg.str());
+    log_warn(msg.str());
   } else {
     log_line("[beagle-sdk] self info updated");
   }
@@ -2585,7 +2412,7 @@ static void send_welcome_once(RuntimeState* state, const std::string& peer, cons
     std::ostringstream msg;
     msg << "[beagle-sdk] welcome message failed (" << reason
         << "): 0x" << std::hex << carrier_get_error() << std::dec;
-    log_line(msg.str());
+    log_warn(msg.str());
   } else {
     {
       std::lock_guard<std::mutex> lock(state->state_mu);
@@ -2655,11 +2482,11 @@ static void filetransfer_state_changed_callback(CarrierFileTransfer* ft,
   else if (state == FileTransferConnection_connected) state_name = "connected";
   else if (state == FileTransferConnection_closed) state_name = "closed";
   else if (state == FileTransferConnection_failed) state_name = "failed";
-  log_line(std::string("[beagle-sdk] filetransfer state ")
-           + state_name
-           + " peer=" + ctx->peer
-           + " file=" + ctx->filename
-           + " sender=" + (ctx->is_sender ? "1" : "0"));
+  log_debug(std::string("[beagle-sdk] filetransfer state ")
+            + state_name
+            + " peer=" + ctx->peer
+            + " file=" + ctx->filename
+            + " sender=" + (ctx->is_sender ? "1" : "0"));
 
   if (state == FileTransferConnection_connected && !ctx->is_sender && !ctx->fileid.empty()) {
     carrier_filetransfer_pull(ft, ctx->fileid.c_str(), 0);
@@ -2950,7 +2777,7 @@ static void filetransfer_connect_callback(Carrier* carrier,
   ctx->target_path = path.str();
   ctx->target.open(ctx->target_path, std::ios::binary | std::ios::trunc);
   if (!ctx->target) {
-    log_line(std::string("[beagle-sdk] failed to open target file: ") + ctx->target_path);
+    log_warn(std::string("[beagle-sdk] failed to open target file: ") + ctx->target_path);
     return;
   }
 
@@ -2960,7 +2787,7 @@ static void filetransfer_connect_callback(Carrier* carrier,
     std::ostringstream msg;
     msg << "[beagle-sdk] carrier_filetransfer_new(receiver) failed: 0x" << std::hex
         << carrier_get_error() << std::dec;
-    log_line(msg.str());
+    log_warn(msg.str());
     ctx->target.close();
     return;
   }
@@ -2969,7 +2796,7 @@ static void filetransfer_connect_callback(Carrier* carrier,
     std::ostringstream msg;
     msg << "[beagle-sdk] carrier_filetransfer_accept_connect failed: 0x" << std::hex
         << carrier_get_error() << std::dec;
-    log_line(msg.str());
+    log_warn(msg.str());
     take_transfer(ctx->ft);
     carrier_filetransfer_close(ctx->ft);
     ctx->target.close();
@@ -2990,6 +2817,12 @@ void friend_message_callback(Carrier* carrier,
   if (!state || !state->on_incoming) return;
 
   BeagleIncomingMessage incoming;
+  incoming.received_us = latency_now_us();
+  if (!offline && timestamp > 0) {
+    long long wall_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    latency_record(LatencyStage::InCarrierToCallback, wall_us - timestamp);
+  }
   incoming.peer = from ? from : "";
   PackedFilePayload file_payload;
   if (decode_beaglechat_file_payload(msg, len, file_payload)) {
@@ -3003,7 +2836,7 @@ void friend_message_callback(Carrier* carrier,
       incoming.media_type = file_payload.content_type;
       incoming.size = static_cast<unsigned long long>(file_payload.bytes_len);
       incoming.text = "[file rejected: exceeds 5MB beaglechat payload limit]";
-      log_line(std::string("[beagle-sdk] rejected incoming beaglechat file from ")
+      log_warn(std::string("[beagle-sdk] rejected incoming beaglechat file from ")
                + incoming.peer + " file=" + incoming.filename
                + " size=" + std::to_string(file_payload.bytes_len));
     } else {
@@ -3024,7 +2857,7 @@ void friend_message_callback(Carrier* carrier,
                + incoming.peer + " file=" + incoming.filename
                + " size=" + std::to_string(file_payload.bytes_len));
     } else {
-      log_line(std::string("[beagle-sdk] failed to persist incoming file from ")
+      log_warn(std::string("[beagle-sdk] failed to persist incoming file from ")
                + incoming.peer + " file=" + file_payload.filename);
       incoming.text.assign(static_cast<const char*>(msg), len);
     }
@@ -3055,19 +2888,21 @@ void friend_message_callback(Carrier* carrier,
                  + incoming.peer + " file=" + incoming.filename
                  + " size=" + std::to_string(inline_media.bytes.size()));
       } else {
-        log_line(std::string("[beagle-sdk] failed to persist inline json media from ")
+        log_warn(std::string("[beagle-sdk] failed to persist inline json media from ")
                  + incoming.peer + " file=" + inline_media.filename);
         incoming.text.assign(static_cast<const char*>(msg), len);
       }
     } else {
       if (len > 1024) {
-        log_line(std::string("[beagle-sdk] inline json media decode miss peer=") + incoming.peer
+        log_warn(std::string("[beagle-sdk] inline json media decode miss peer=") + incoming.peer
                  + " len=" + std::to_string(len));
       }
       incoming.text.assign(static_cast<const char*>(msg), len);
     }
   }
   incoming.ts = timestamp;
+  incoming.decoded_us = latency_now_us();
+  latency_record(LatencyStage::InCallbackToDecoded, incoming.decoded_us - incoming.received_us);
   std::string signature = build_incoming_signature(incoming, offline);
   // Carrier sometimes replays very old offline messages from Express.
   // Drop stale offline payloads immediately to avoid re-triggering agents.
@@ -3087,13 +2922,13 @@ void friend_message_callback(Carrier* carrier,
             << " size=" << incoming.size;
       } else {
         msg << " kind=text"
-            << " text=\"" << preview_text(incoming.text) << "\"";
+            << " text_len=" << incoming.text.size();
       }
       log_line(msg.str());
       return;
     }
   }
-  if (!remember_incoming_signature(state, signature)) {
+  if (!state->seen_incoming.remember(signature)) {
     log_incoming_event(state, incoming, offline, "skipped_replay", signature);
     std::ostringstream msg;
     msg << "[beagle-sdk] skipped replayed incoming message"
@@ -3107,13 +2942,14 @@ void friend_message_callback(Carrier* carrier,
           << " size=" << incoming.size;
     } else {
       msg << " kind=text"
-          << " text=\"" << preview_text(incoming.text) << "\"";
+          << " text_len=" << incoming.text.size();
     }
-    msg << " signature=\"" << preview_text(signature, 160) << "\"";
     log_line(msg.str());
     return;
   }
   log_incoming_event(state, incoming, offline, "forwarded", signature);
+  record_history(state, incoming.peer, "in", incoming.ts / 1000, incoming.text,
+                 incoming.filename, incoming.media_type, incoming.msg_id);
   state->on_incoming(incoming);
 
   {
@@ -3134,7 +2970,7 @@ void friend_message_callback(Carrier* carrier,
   if (!incoming.media_path.empty()) {
     line << " [file] " << incoming.filename << " (" << incoming.size << " bytes)";
   } else {
-    line << ": " << incoming.text;
+    line << " text_len=" << incoming.text.size();
   }
   log_line(line.str());
 }
@@ -3152,7 +2988,7 @@ void friend_request_callback(Carrier* carrier,
   if (rc < 0) {
     std::ostringstream msg;
     msg << "[beagle-sdk] accept friend failed: 0x" << std::hex << carrier_get_error() << std::dec;
-    log_line(msg.str());
+    log_warn(msg.str());
   } else {
     log_line(std::string("[beagle-sdk] accepted friend: ") + userid);
     send_welcome_once(state, userid, "accepted");
@@ -3185,11 +3021,23 @@ void ready_callback(Carrier* carrier, void* context) {
     if (rc < 0) {
       std::ostringstream msg;
       msg << "[beagle-sdk] carrier_get_friends failed: 0x" << std::hex << carrier_get_error() << std::dec;
-      log_line(msg.str());
+      log_warn(msg.str());
     } else {
       log_line("[beagle-sdk] carrier_get_friends ok");
     }
+    kick_outbox_all(state);
+  }
+}
+
+static void fire_online_waiters(RuntimeState* state, const std::string& userid) {
+  std::vector<BeagleFriendOnlineCallback> ready;
+  {
+    std::lock_guard<std::mutex> lock(state->online_waiters_mu);
+    auto range = state->online_waiters.equal_range(userid);
+    for (auto it = range.first; it != range.second; ++it) ready.push_back(std::move(it->second.second));
+    state->online_waiters.erase(range.first, range.second);
   }
+  for (auto& fn : ready) fn(userid);
 }
 
 void friend_connection_callback(Carrier* carrier,
@@ -3203,6 +3051,8 @@ void friend_connection_callback(Carrier* carrier,
            + " is " + (is_online ? "online" : "offline"));
   if (is_online && friendid) {
     send_welcome_once(state, friendid, "online");
+    kick_outbox_peer(state, friendid);
+    fire_online_waiters(state, friendid);
   }
   if (friendid) {
     update_friend_status(state, friendid, is_online ? 1 : 0, -1, true);
@@ -3256,7 +3106,7 @@ bool friend_list_callback(const CarrierFriendInfo* info, void* context) {
   if (!state || !info) return false;
   const char* fid = info->user_info.userid;
   if (!fid || !*fid) return true;
-  log_line(std::string("[beagle-sdk] friend list item ") + fid);
+  log_debug(std::string("[beagle-sdk] friend list item ") + fid);
   store_friend_info(state, fid, info);
   emit_friend_info_event(state, fid, info);
   // Emit presence for friends that are currently online at startup.
@@ -3285,7 +3135,7 @@ void friend_invite_callback(Carrier* carrier,
   auto* state = static_cast<RuntimeState*>(context);
   std::string payload;
   if (data && len) payload.assign(static_cast<const char*>(data), len);
-  log_line(std::string("[beagle-sdk] invite from ") + (from ? from : "") + " data=" + payload);
+  log_line(std::string("[beagle-sdk] invite from ") + (from ? from : "") + " data_len=" + std::to_string(payload.size()));
 
   if (!state || !state->on_incoming || !from) return;
   BeagleIncomingMessage incoming;
@@ -3329,27 +3179,49 @@ static void friend_message_receipt_callback(uint32_t msgid,
       break;
   }
 
-  log_line(std::string("[beagle-sdk] message receipt msgid=") + std::to_string(msgid)
-           + " peer=" + receipt->peer
-           + " state=" + state_name);
+  if (receipt->sent_us > 0) {
+    long long now = latency_now_us();
+    latency_record(LatencyStage::OutSendToReceipt, now - receipt->sent_us);
+    if (receipt->requested_us > 0) latency_record(LatencyStage::OutTotal, now - receipt->requested_us);
+  }
+
+  log_debug(std::string("[beagle-sdk] message receipt msgid=") + std::to_string(msgid)
+            + " peer=" + receipt->peer
+            + " state=" + state_name);
 
   if (receipt->notify_on_offline && state == CarrierReceipt_Offline && receipt->state) {
     maybe_notify_offline_delivery(receipt->state, receipt->peer, receipt->text);
   }
 }
 
+// Carrier errors that no amount of retrying will fix; such sends are not queued.
+static bool is_permanent_send_error(int err) {
+  return err == static_cast<int>(CARRIER_GENERAL_ERROR(ERROR_INVALID_ARGS))
+      || err == static_cast<int>(CARRIER_GENERAL_ERROR(ERROR_NOT_EXIST))
+      || err == static_cast<int>(CARRIER_GENERAL_ERROR(ERROR_INVALID_USERID))
+      || err == static_cast<int>(CARRIER_GENERAL_ERROR(ERROR_TOO_LONG));
+}
+
 static bool send_text_internal(RuntimeState* state,
                                const std::string& peer,
                                const std::string& text,
-                               bool notify_on_offline) {
+                               bool notify_on_offline,
+                               bool* retryable = nullptr,
+                               long long requested_us = 0) {
+  if (retryable) *retryable = false;
   if (!state || !state->carrier) return false;
   uint32_t msgid = 0;
   MessageReceiptContext* receipt_context = nullptr;
   CarrierFriendMessageReceiptCallback* receipt_callback = nullptr;
   if (notify_on_offline) {
-    receipt_context = new MessageReceiptContext{state, peer, text, notify_on_offline};
+    receipt_context = new MessageReceiptContext{state, peer, text, notify_on_offline, requested_us, 0};
     receipt_callback = friend_message_receipt_callback;
   }
+  long long send_start_us = latency_now_us();
+  if (requested_us > 0) latency_record(LatencyStage::OutRequestToSend, send_start_us - requested_us);
+  // The receipt may fire on the Carrier thread before this call returns, so
+  // stamp the context up front with the call start.
+  if (receipt_context) receipt_context->sent_us = send_start_us;
   int rc = carrier_send_friend_message(state->carrier,
                                        peer.c_str(),
                                        text.data(),
@@ -3357,6 +3229,7 @@ static bool send_text_internal(RuntimeState* state,
                                        &msgid,
                                        receipt_callback,
                                        receipt_context);
+  latency_record(LatencyStage::OutSendCall, latency_now_us() - send_start_us);
   if (rc < 0) {
     if (receipt_context) delete receipt_context;
     int err = carrier_get_error();
@@ -3373,23 +3246,27 @@ static bool send_text_internal(RuntimeState* state,
                    oss << std::hex << err;
                    return oss.str();
                  }());
+      kick_outbox_all(state);
       return true;
     }
-    log_line(std::string("[beagle-sdk] send_text express fallback failed peer=")
+    log_warn(std::string("[beagle-sdk] send_text express fallback failed peer=")
              + peer + " detail=" + detail);
     std::ostringstream msg;
     msg << "[beagle-sdk] send_text failed: 0x" << std::hex << err << std::dec;
-    log_line(msg.str());
+    log_warn(msg.str());
+    if (retryable) *retryable = !is_permanent_send_error(err);
     return false;
   }
-  log_line(std::string("[beagle-sdk] send_text ok msgid=") + std::to_string(msgid) + " peer=" + peer);
+  log_debug(std::string("[beagle-sdk] send_text ok msgid=") + std::to_string(msgid) + " peer=" + peer);
   return true;
 }
 
+static void outbox_worker_loop(RuntimeState* state);
+
 bool BeagleSdk::start(const BeagleSdkOptions& options, BeagleIncomingCallback on_incoming) {
   stop();
   if (options.config_path.empty()) {
-    log_line("[beagle-sdk] missing config file path");
+    log_warn("[beagle-sdk] missing config file path");
     return false;
   }
 
@@ -3401,14 +3278,14 @@ bool BeagleSdk::start(const BeagleSdkOptions& options, BeagleIncomingCallback on
 
   CarrierOptions opts;
   if (!carrier_config_load(options.config_path.c_str(), nullptr, &opts)) {
-    log_line(std::string("[beagle-sdk] failed to load config: ") + options.config_path);
+    log_warn(std::string("[beagle-sdk] failed to load config: ") + options.config_path);
     return false;
   }
 
   if (!options.data_dir.empty()) {
     state->persistent_location = options.data_dir;
     if (!ensure_dir(state->persistent_location)) {
-      log_line(std::string("[beagle-sdk] failed to prepare data dir: ") + state->persistent_location);
+      log_warn(std::string("[beagle-sdk] failed to prepare data dir: ") + state->persistent_location);
       carrier_config_free(&opts);
       return false;
     }
@@ -3419,24 +3296,51 @@ bool BeagleSdk::start(const BeagleSdkOptions& options, BeagleIncomingCallback on
     state->db_config_path = state->persistent_location + "/beagle_db.json";
     state->push_config_path = state->persistent_location + "/beagle_push.json";
     state->friend_state_path = state->persistent_location + "/friend_state.tsv";
+    state->friend_state_log_path = state->persistent_location + "/friend_state.log";
     state->friend_event_log_path = state->persistent_location + "/friend_events.log";
     state->incoming_event_log_path = state->persistent_location + "/incoming_events.jsonl";
+    state->outbox_path = state->persistent_location + "/outbox.jsonl";
+    state->outbox_log_path = state->persistent_location + "/outbox.log";
+    state->outbox_media_dir = state->persistent_location + "/outbox";
     state->media_dir = state->persistent_location + "/media";
+    state->history_dir = state->persistent_location + "/history";
+    state->search_dir = state->persistent_location + "/search";
     if (!ensure_dir(state->media_dir)) {
-      log_line(std::string("[beagle-sdk] failed to prepare media dir: ") + state->media_dir);
+      log_warn(std::string("[beagle-sdk] failed to prepare media dir: ") + state->media_dir);
       carrier_config_free(&opts);
       return false;
     }
   } else {
     state->media_dir = "./media";
     state->incoming_event_log_path = "./incoming_events.jsonl";
+    state->history_dir = "./history";
+    state->search_dir = "./search";
     if (!ensure_dir(state->media_dir)) {
-      log_line(std::string("[beagle-sdk] failed to prepare media dir: ") + state->media_dir);
+      log_warn(std::string("[beagle-sdk] failed to prepare media dir: ") + state->media_dir);
       carrier_config_free(&opts);
       return false;
     }
   }
 
+  RotationPolicy rotation;
+  if (!state->friend_event_log_path.empty()) {
+    state->friend_event_log.reset(new RotatingLogWriter(state->friend_event_log_path, rotation));
+  }
+  if (!state->incoming_event_log_path.empty()) {
+    state->incoming_event_log.reset(new RotatingLogWriter(state->incoming_event_log_path, rotation));
+  }
+  state->history.reset(new HistoryStore(state->history_dir));
+  if (!state->history->open()) {
+    log_warn(std::string("[beagle-sdk] history disabled, cannot open ") + state->history_dir);
+    state->history.reset();
+  } else {
+    state->search.reset(new SearchIndex(state->search_dir, *state->history));
+    if (!state->search->open()) {
+      log_warn(std::string("[beagle-sdk] search disabled, cannot open ") + state->search_dir);
+      state->search.reset();
+    }
+  }
+
   CarrierCallbacks callbacks;
   memset(&callbacks, 0, sizeof(callbacks));
   callbacks.connection_status = connection_status_callback;
@@ -3459,7 +3363,7 @@ bool BeagleSdk::start(const BeagleSdkOptions& options, BeagleIncomingCallback on
   if (!carrier) {
     std::ostringstream msg;
     msg << "[beagle-sdk] carrier_new failed: 0x" << std::hex << carrier_get_error() << std::dec;
-    log_line(msg.str());
+    log_error(msg.str());
     return false;
   }
 
@@ -3469,7 +3373,7 @@ bool BeagleSdk::start(const BeagleSdkOptions& options, BeagleIncomingCallback on
     std::ostringstream msg;
     msg << "[beagle-sdk] carrier_filetransfer_init failed: 0x" << std::hex
         << carrier_get_error() << std::dec;
-    log_line(msg.str());
+    log_error(msg.str());
   }
 
   char buf[CARRIER_MAX_ADDRESS_LEN + 1] = {0};
@@ -3501,20 +3405,34 @@ bool BeagleSdk::start(const BeagleSdkOptions& options, BeagleIncomingCallback on
   load_push_config(state, state->push);
   ensure_db(state, state->db);
   if (state->db.use_crawler_index) {
-    refresh_crawler_index_if_needed(state);
+    state->crawler = CrawlerIndex::shared(state->db.crawler_data_dir,
+                                          static_cast<size_t>(state->db.crawler_lookback_files),
+                                          options.crawler_cache_dir.empty()
+                                              ? state->persistent_location + "/crawler_index"
+                                              : options.crawler_cache_dir);
+    state->crawler->start_refresh(state->db.crawler_refresh_seconds);
+    state->crawler_thread = std::thread([state]() { crawler_persist_loop(state); });
   }
   load_friend_state(state);
-  send_push_profile_update(state, profile);
-  send_push_registration(state);
+  load_outbox(state);
+  // Push servers are reached with curl; start() does not wait, and stop()
+  // waits for one bounded call at most.
+  state->push_setup_thread = std::thread([state, profile]() {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(kPushSetupBudgetSeconds);
+    send_push_profile_update(state, profile, deadline);
+    send_push_registration(state, deadline);
+  });
 
   state->loop_thread = std::thread([state]() {
     int rc = carrier_run(state->carrier, 10);
     if (rc != 0) {
       std::ostringstream msg;
       msg << "[beagle-sdk] carrier_run failed: 0x" << std::hex << carrier_get_error() << std::dec;
-      log_line(msg.str());
+      log_error(msg.str());
     }
   });
+  state->outbox_thread = std::thread([state]() { outbox_worker_loop(state); });
+  state->friend_state_thread = std::thread([state]() { friend_state_compactor_loop(state); });
 
   state_ = state;
   owned_state.release();
@@ -3524,11 +3442,38 @@ bool BeagleSdk::start(const BeagleSdkOptions& options, BeagleIncomingCallback on
 void BeagleSdk::stop() {
   RuntimeState* state = runtime_state_from_ptr(state_);
   if (!state) return;
+  state->push_setup_stop = true;
+  {
+    std::lock_guard<std::mutex> lock(state->outbox_mu);
+    state->outbox_stop = true;
+    state->outbox_cv.notify_all();
+  }
+  if (state->outbox_thread.joinable()) state->outbox_thread.join();
+  compact_outbox(state);
+  if (state->outbox_log_fd >= 0) ::close(state->outbox_log_fd);
+  if (state->push_setup_thread.joinable()) state->push_setup_thread.join();
   if (state->carrier) {
     carrier_filetransfer_cleanup(state->carrier);
     carrier_kill(state->carrier);
     if (state->loop_thread.joinable()) state->loop_thread.join();
   }
+  {
+    std::lock_guard<std::mutex> lock(state->crawler_mu);
+    state->crawler_stop = true;
+    state->crawler_cv.notify_all();
+  }
+  if (state->crawler_thread.joinable()) state->crawler_thread.join();
+  if (state->db_writer) state->db_writer->stop();
+  {
+    std::lock_guard<std::mutex> lock(state->state_mu);
+    state->friend_state_stop = true;
+    state->friend_state_cv.notify_all();
+  }
+  if (state->friend_state_thread.joinable()) state->friend_state_thread.join();
+  compact_friend_state(state);
+  if (state->friend_event_log) state->friend_event_log->stop();
+  if (state->incoming_event_log) state->incoming_event_log->stop();
+  if (state->search) state->search->stop();
   {
     std::lock_guard<std::mutex> lock(g_ft_mu);
     for (auto it = g_transfers.begin(); it != g_transfers.end();) {
@@ -3550,11 +3495,6 @@ void BeagleSdk::stop() {
   delete state;
 }
 
-bool BeagleSdk::send_text(const std::string& peer, const std::string& text) {
-  RuntimeState* state = runtime_state_from_ptr(state_);
-  return send_text_internal(state, peer, text, true);
-}
-
 bool BeagleSdk::add_friend(const std::string& address, const std::string& hello) {
   RuntimeState* state = runtime_state_from_ptr(state_);
   std::string target = trim_copy(address);
@@ -3573,7 +3513,7 @@ bool BeagleSdk::add_friend(const std::string& address, const std::string& hello)
   std::ostringstream msg;
   msg << "[beagle-sdk] add_friend failed address=" << target
       << " err=0x" << std::hex << carrier_get_error() << std::dec;
-  log_line(msg.str());
+  log_warn(msg.str());
   return false;
 }
 
@@ -3595,6 +3535,50 @@ bool BeagleSdk::friend_is_online(const std::string& userid) const {
   return info.status == CarrierConnectionStatus_Connected;
 }
 
+uint64_t BeagleSdk::when_friend_online(const std::string& userid, BeagleFriendOnlineCallback fn) {
+  RuntimeState* state = runtime_state_from_ptr(state_);
+  std::string peer = trim_copy(userid);
+  if (!state || !fn || peer.empty()) return 0;
+  uint64_t id = 0;
+  {
+    std::lock_guard<std::mutex> lock(state->online_waiters_mu);
+    id = state->next_online_waiter++;
+    state->online_waiters.emplace(peer, std::make_pair(id, std::move(fn)));
+  }
+  // Registered before checking, so a connect in between is not missed; the
+  // check only fires the wait if the callback has not taken it already.
+  if (friend_is_online(peer)) {
+    BeagleFriendOnlineCallback now;
+    {
+      std::lock_guard<std::mutex> lock(state->online_waiters_mu);
+      auto range = state->online_waiters.equal_range(peer);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.first != id) continue;
+        now = std::move(it->second.second);
+        state->online_waiters.erase(it);
+        break;
+      }
+    }
+    if (now) {
+      now(peer);
+      return 0;
+    }
+  }
+  return id;
+}
+
+bool BeagleSdk::cancel_friend_online_wait(uint64_t id) {
+  RuntimeState* state = runtime_state_from_ptr(state_);
+  if (!state || id == 0) return false;
+  std::lock_guard<std::mutex> lock(state->online_waiters_mu);
+  for (auto it = state->online_waiters.begin(); it != state->online_waiters.end(); ++it) {
+    if (it->second.first != id) continue;
+    state->online_waiters.erase(it);
+    return true;
+  }
+  return false;
+}
+
 bool BeagleSdk::has_friend(const std::string& address_or_userid) const {
   RuntimeState* state = runtime_state_from_ptr(state_);
   std::string id = trim_copy(address_or_userid);
@@ -3673,14 +3657,17 @@ bool BeagleSdk::send_status(const std::string& peer,
   return send_text_internal(runtime, normalized_peer, wire_payload, false);
 }
 
-bool BeagleSdk::send_media(const std::string& peer,
-                           const std::string& caption,
-                           const std::string& media_path,
-                           const std::string& media_url,
-                           const std::string& media_type,
-                           const std::string& filename,
-                           const std::string& out_format) {
-  RuntimeState* state = runtime_state_from_ptr(state_);
+static bool send_media_internal(RuntimeState* state,
+                                const std::string& peer,
+                                const std::string& caption,
+                                const std::string& media_path,
+                                const std::string& media_url,
+                                const std::string& media_type,
+                                const std::string& filename,
+                                const std::string& out_format,
+                                bool* retryable,
+                                long long requested_us = 0) {
+  if (retryable) *retryable = false;
   if (!state || !state->carrier) return false;
 
   if (media_path.empty()) {
@@ -3698,12 +3685,12 @@ bool BeagleSdk::send_media(const std::string& peer,
       if (!payload.empty()) payload += "\n";
       payload += "mediaType: " + media_type;
     }
-    return send_text_internal(state, peer, payload, false);
+    return send_text_internal(state, peer, payload, false, retryable, requested_us);
   }
 
   unsigned long long size = file_size_bytes(media_path);
   if (size == 0) {
-    log_line(std::string("[beagle-sdk] send_media invalid file path: ") + media_path);
+    log_warn(std::string("[beagle-sdk] send_media invalid file path: ") + media_path);
     return false;
   }
   std::string send_filename = sanitize_filename(!filename.empty() ? filename : basename_of(media_path));
@@ -3713,11 +3700,11 @@ bool BeagleSdk::send_media(const std::string& peer,
 
   std::vector<unsigned char> file_bytes;
   if (!read_file_binary(media_path, file_bytes)) {
-    log_line(std::string("[beagle-sdk] send_media failed to read file: ") + media_path);
+    log_warn(std::string("[beagle-sdk] send_media failed to read file: ") + media_path);
     return false;
   }
   if (file_bytes.size() > kMaxBeaglechatFileBytes) {
-    log_line(std::string("[beagle-sdk] send_media file too large for beaglechat payload: ")
+    log_warn(std::string("[beagle-sdk] send_media file too large for beaglechat payload: ")
              + media_path + " size=" + std::to_string(file_bytes.size())
              + " max=" + std::to_string(kMaxBeaglechatFileBytes));
     return false;
@@ -3744,13 +3731,13 @@ bool BeagleSdk::send_media(const std::string& peer,
   bool use_swift_json = (out_mode == "swift-json");
   bool use_legacy_inline = (out_mode == "legacy-inline");
   bool prefer_message_media_path = false;
-  log_line(std::string("[beagle-sdk] send_media mode peer=") + peer
-           + " out_mode=" + out_mode
-           + " force_filetransfer=" + (force_filetransfer ? "1" : "0")
-           + " try_filetransfer_first=" + (try_filetransfer_first ? "1" : "0")
-           + " use_packed=" + (use_packed ? "1" : "0")
-           + " use_swift_json=" + (use_swift_json ? "1" : "0")
-           + " use_legacy_inline=" + (use_legacy_inline ? "1" : "0"));
+  log_debug(std::string("[beagle-sdk] send_media mode peer=") + peer
+            + " out_mode=" + out_mode
+            + " force_filetransfer=" + (force_filetransfer ? "1" : "0")
+            + " try_filetransfer_first=" + (try_filetransfer_first ? "1" : "0")
+            + " use_packed=" + (use_packed ? "1" : "0")
+            + " use_swift_json=" + (use_swift_json ? "1" : "0")
+            + " use_legacy_inline=" + (use_legacy_inline ? "1" : "0"));
   const char* legacy_peers_env = std::getenv("BEAGLE_MEDIA_LEGACY_INLINE_PEERS");
   if (legacy_peers_env && csv_has_token(legacy_peers_env, peer)) {
     use_legacy_inline = true;
@@ -3810,8 +3797,8 @@ bool BeagleSdk::send_media(const std::string& peer,
   }
 
   if (try_filetransfer_first) {
-    log_line(std::string("[beagle-sdk] send_media trying filetransfer peer=") + peer
-             + " file=" + send_filename);
+    log_debug(std::string("[beagle-sdk] send_media trying filetransfer peer=") + peer
+              + " file=" + send_filename);
     std::string ft_detail;
     int wait_ms = 8000;
     const char* wait_env = std::getenv("BEAGLE_FILETRANSFER_WAIT_MS");
@@ -3841,10 +3828,13 @@ bool BeagleSdk::send_media(const std::string& peer,
                + " detail=" + ft_detail);
       return true;
     }
-    log_line(std::string("[beagle-sdk] send_media(filetransfer) failed peer=")
+    log_warn(std::string("[beagle-sdk] send_media(filetransfer) failed peer=")
              + peer + " file=" + send_filename
              + " detail=" + ft_detail);
-    if (force_filetransfer) return false;
+    if (force_filetransfer) {
+      if (retryable) *retryable = true;
+      return false;
+    }
   }
 
   std::vector<unsigned char> payload_packed;
@@ -3855,7 +3845,7 @@ bool BeagleSdk::send_media(const std::string& peer,
 
   if (use_packed) {
     if (!encode_beaglechat_file_payload(send_filename, send_media_type, file_bytes, payload_packed)) {
-      log_line("[beagle-sdk] send_media failed to pack beaglechat payload");
+      log_warn("[beagle-sdk] send_media failed to pack beaglechat payload");
       return false;
     }
     payload_ptr = payload_packed.data();
@@ -3864,19 +3854,19 @@ bool BeagleSdk::send_media(const std::string& peer,
   } else {
     if (use_legacy_inline) {
       if (!encode_legacy_inline_data_payload(file_bytes, payload_inline)) {
-        log_line("[beagle-sdk] send_media failed to encode legacy inline data payload");
+        log_warn("[beagle-sdk] send_media failed to encode legacy inline data payload");
         return false;
       }
       payload_mode = "legacy-inline";
     } else if (use_swift_json) {
       if (!encode_swift_filemodel_media_payload(send_filename, send_media_type, file_bytes, payload_inline)) {
-        log_line("[beagle-sdk] send_media failed to encode swift filemodel payload");
+        log_warn("[beagle-sdk] send_media failed to encode swift filemodel payload");
         return false;
       }
       payload_mode = "swift-json";
     } else {
       if (!encode_inline_json_media_payload(send_filename, send_media_type, file_bytes, payload_inline)) {
-        log_line("[beagle-sdk] send_media failed to encode inline json media payload");
+        log_warn("[beagle-sdk] send_media failed to encode inline json media payload");
         return false;
       }
       payload_mode = "inline-json";
@@ -3886,6 +3876,8 @@ bool BeagleSdk::send_media(const std::string& peer,
   }
 
   uint32_t msgid = 0;
+  long long send_start_us = latency_now_us();
+  if (requested_us > 0) latency_record(LatencyStage::OutRequestToSend, send_start_us - requested_us);
   int rc = carrier_send_friend_message(state->carrier,
                                        peer.c_str(),
                                        payload_ptr,
@@ -3893,6 +3885,7 @@ bool BeagleSdk::send_media(const std::string& peer,
                                        &msgid,
                                        nullptr,
                                        nullptr);
+  latency_record(LatencyStage::OutSendCall, latency_now_us() - send_start_us);
   if (rc < 0) {
     int err = carrier_get_error();
     std::string detail;
@@ -3907,16 +3900,18 @@ bool BeagleSdk::send_media(const std::string& peer,
                    oss << std::hex << err;
                    return oss.str();
                  }());
+      kick_outbox_all(state);
       return true;
     }
-    log_line(std::string("[beagle-sdk] send_media(") + payload_mode
+    log_warn(std::string("[beagle-sdk] send_media(") + payload_mode
              + ") express fallback failed peer="
              + peer + " file=" + send_filename + " detail=" + detail);
     std::ostringstream msg;
     msg << "[beagle-sdk] send_media(" << payload_mode
         << ") failed: 0x" << std::hex
         << err << std::dec;
-    log_line(msg.str());
+    log_warn(msg.str());
+    if (retryable) *retryable = !is_permanent_send_error(err);
     return false;
   }
   log_line(std::string("[beagle-sdk] send_media(") + payload_mode
@@ -3929,12 +3924,326 @@ bool BeagleSdk::send_media(const std::string& peer,
   return true;
 }
 
+static bool deliver_outbox_entry(RuntimeState* state, const OutboxEntry& entry, bool* retryable) {
+  if (entry.kind == "media") {
+    return send_media_internal(state,
+                               entry.peer,
+                               entry.text,
+                               entry.media_path,
+                               entry.media_url,
+                               entry.media_type,
+                               entry.filename,
+                               entry.out_format,
+                               retryable,
+                               entry.requested_us);
+  }
+  return send_text_internal(state, entry.peer, entry.text, true, retryable, entry.requested_us);
+}
+
+static long long outbox_backoff_seconds(int attempts) {
+  long long delay = 30;
+  for (int i = 1; i < attempts && delay < 900; ++i) delay *= 2;
+  return std::min<long long>(delay, 900);
+}
+
+// Copies from to to and fsyncs the copy: the outbox entry that points at it
+// is durable, so the file must be too.
+static bool copy_file_contents(const std::string& from, const std::string& to) {
+  int in = ::open(from.c_str(), O_RDONLY);
+  if (in < 0) return false;
+  int out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    ::close(in);
+    return false;
+  }
+  bool ok = true;
+  char buf[65536];
+  while (ok) {
+    ssize_t n = ::read(in, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      ok = n == 0;
+      break;
+    }
+    for (ssize_t off = 0; off < n;) {
+      ssize_t w = ::write(out, buf + off, static_cast<size_t>(n - off));
+      if (w < 0 && errno == EINTR) continue;
+      if (w <= 0) {
+        ok = false;
+        break;
+      }
+      off += w;
+    }
+  }
+  ::close(in);
+  ok = ok && ::fsync(out) == 0;
+  return ::close(out) == 0 && ok;
+}
+
+static bool enqueue_outbox_entry(RuntimeState* state, OutboxEntry entry) {
+  long long now = static_cast<long long>(std::time(nullptr));
+  {
+    std::lock_guard<std::mutex> lock(state->outbox_mu);
+    entry.id = std::to_string(now) + "-" + std::to_string(++state->outbox_seq);
+  }
+  // Media callers often hand us temp files; keep a private copy until delivered.
+  if (entry.kind == "media" && !entry.media_path.empty() && !state->outbox_media_dir.empty()
+      && ensure_dir(state->outbox_media_dir)) {
+    std::string copy = state->outbox_media_dir + "/" + entry.id + "_"
+        + sanitize_filename(basename_of(entry.media_path));
+    if (copy_file_contents(entry.media_path, copy)) {
+      entry.media_path = copy;
+      entry.owns_media = true;
+    } else {
+      log_warn(std::string("[beagle-sdk] outbox media copy failed path=") + entry.media_path);
+    }
+  }
+  entry.created_ts = now;
+  entry.next_attempt_ts = now + outbox_backoff_seconds(1);
+
+  std::lock_guard<std::mutex> lock(state->outbox_mu);
+  auto& queue = state->outbox[entry.peer];
+  if (queue.size() >= kOutboxMaxPerPeer) {
+    log_warn(std::string("[beagle-sdk] outbox full peer=") + entry.peer
+             + " pending=" + std::to_string(queue.size()));
+    discard_outbox_media(entry);
+    if (!entry.dedupe_key.empty()) state->delivered_dedupe_keys.erase(entry.dedupe_key);
+    return false;
+  }
+  if (!entry.dedupe_key.empty()) {
+    state->delivered_dedupe_keys.erase(entry.dedupe_key);
+    state->outbox_dedupe_keys.insert(entry.dedupe_key);
+  }
+  log_line(std::string("[beagle-sdk] outbox queued peer=") + entry.peer
+           + " id=" + entry.id
+           + " kind=" + entry.kind
+           + " pending_peer=" + std::to_string(queue.size() + 1));
+  append_outbox_record_locked(state, outbox_add_record(entry));
+  queue.push_back(std::move(entry));
+  return true;
+}
+
+// Delivers queued entries for one peer strictly in order; stops at the first
+// entry that still fails so later messages never overtake earlier ones.
+static void flush_outbox_peer(RuntimeState* state, const std::string& peer) {
+  while (true) {
+    OutboxEntry entry;
+    {
+      std::lock_guard<std::mutex> lock(state->outbox_mu);
+      if (state->outbox_stop) return;
+      auto it = state->outbox.find(peer);
+      if (it == state->outbox.end() || it->second.empty()) return;
+      entry = it->second.front();
+    }
+
+    long long now = static_cast<long long>(std::time(nullptr));
+    bool expired = entry.created_ts > 0 && now - entry.created_ts > kOutboxMaxAgeSeconds;
+    bool retryable = false;
+    bool ok = !expired && deliver_outbox_entry(state, entry, &retryable);
+
+    std::lock_guard<std::mutex> lock(state->outbox_mu);
+    auto it = state->outbox.find(peer);
+    if (it == state->outbox.end() || it->second.empty() || it->second.front().id != entry.id) return;
+    OutboxEntry& front = it->second.front();
+    if (!ok && retryable) {
+      front.attempts++;
+      front.next_attempt_ts = now + outbox_backoff_seconds(front.attempts);
+      log_warn(std::string("[beagle-sdk] outbox retry deferred peer=") + peer
+               + " id=" + front.id
+               + " attempts=" + std::to_string(front.attempts)
+               + " next_in=" + std::to_string(front.next_attempt_ts - now) + "s");
+      append_outbox_record_locked(state, outbox_retry_record(front));
+      return;
+    }
+    if (ok) {
+      log_line(std::string("[beagle-sdk] outbox delivered peer=") + peer
+               + " id=" + front.id
+               + " attempts=" + std::to_string(front.attempts + 1));
+    } else {
+      log_warn(std::string("[beagle-sdk] outbox dropped peer=") + peer
+               + " id=" + front.id
+               + " reason=" + (expired ? "expired" : "permanent_error"));
+    }
+    if (!front.dedupe_key.empty()) {
+      state->outbox_dedupe_keys.erase(front.dedupe_key);
+      if (ok) remember_delivered_dedupe_key_locked(state, front.dedupe_key);
+    }
+    append_outbox_record_locked(state, outbox_ack_record(front));
+    discard_outbox_media(front);
+    it->second.pop_front();
+    if (it->second.empty()) state->outbox.erase(it);
+  }
+}
+
+static void outbox_worker_loop(RuntimeState* state) {
+  std::unique_lock<std::mutex> lock(state->outbox_mu);
+  while (!state->outbox_stop) {
+    state->outbox_cv.wait_for(lock, std::chrono::seconds(kOutboxPollSeconds), [state]() {
+      return state->outbox_stop || state->outbox_kick_all || !state->outbox_kicked_peers.empty()
+          || outbox_compact_due_locked(state);
+    });
+    if (state->outbox_stop) break;
+    if (outbox_compact_due_locked(state)) {
+      lock.unlock();
+      compact_outbox(state);
+      lock.lock();
+    }
+    bool kick_all = state->outbox_kick_all;
+    std::unordered_set<std::string> kicked;
+    kicked.swap(state->outbox_kicked_peers);
+    state->outbox_kick_all = false;
+    if (state->outbox.empty()) continue;
+
+    long long now = static_cast<long long>(std::time(nullptr));
+    std::vector<std::string> due;
+    for (const auto& kv : state->outbox) {
+      if (kv.second.empty()) continue;
+      if (kick_all || kicked.count(kv.first) || kv.second.front().next_attempt_ts <= now) {
+        due.push_back(kv.first);
+      }
+    }
+    if (due.empty()) continue;
+
+    lock.unlock();
+    bool ready = false;
+    {
+      std::lock_guard<std::mutex> state_lock(state->state_mu);
+      ready = state->status.ready;
+    }
+    // Before ready_callback nothing can go out; ready_callback kicks us again.
+    if (ready) {
+      for (const auto& peer : due) flush_outbox_peer(state, peer);
+    }
+    lock.lock();
+  }
+}
+
+static bool send_or_queue(RuntimeState* state, OutboxEntry entry, BeagleSendOutcome* outcome) {
+  entry.dedupe_key = trim_copy(entry.dedupe_key);
+  bool must_queue = false;
+  {
+    std::lock_guard<std::mutex> lock(state->outbox_mu);
+    if (!entry.dedupe_key.empty()) {
+      if (state->outbox_dedupe_keys.count(entry.dedupe_key)
+          || state->delivered_dedupe_keys.count(entry.dedupe_key)) {
+        log_line(std::string("[beagle-sdk] send deduped peer=") + entry.peer
+                 + " key=" + entry.dedupe_key);
+        if (outcome) outcome->duplicate = true;
+        return true;
+      }
+      // Reserve the key while the send is in flight so a concurrent retry dedupes.
+      remember_delivered_dedupe_key_locked(state, entry.dedupe_key);
+    }
+    auto it = state->outbox.find(entry.peer);
+    must_queue = it != state->outbox.end() && !it->second.empty();
+  }
+  if (!must_queue) {
+    std::lock_guard<std::mutex> lock(state->state_mu);
+    must_queue = !state->status.ready;
+  }
+
+  if (!must_queue) {
+    bool retryable = false;
+    if (deliver_outbox_entry(state, entry, &retryable)) return true;
+    if (!retryable) {
+      std::lock_guard<std::mutex> lock(state->outbox_mu);
+      if (!entry.dedupe_key.empty()) state->delivered_dedupe_keys.erase(entry.dedupe_key);
+      return false;
+    }
+  }
+
+  if (!enqueue_outbox_entry(state, std::move(entry))) return false;
+  if (outcome) outcome->queued = true;
+  return true;
+}
+
+bool BeagleSdk::send_text(const std::string& peer,
+                          const std::string& text,
+                          const std::string& dedupe_key,
+                          BeagleSendOutcome* outcome) {
+  if (outcome) *outcome = BeagleSendOutcome();
+  RuntimeState* state = runtime_state_from_ptr(state_);
+  if (!state || !state->carrier || trim_copy(peer).empty()) return false;
+  OutboxEntry entry;
+  entry.kind = "text";
+  entry.peer = peer;
+  entry.requested_us = latency_request_start();
+  entry.text = text;
+  entry.dedupe_key = dedupe_key;
+  BeagleSendOutcome local;
+  if (!outcome) outcome = &local;
+  if (!send_or_queue(state, std::move(entry), outcome)) return false;
+  if (!outcome->duplicate) record_history(state, peer, "out", 0, text, "", "", dedupe_key);
+  return true;
+}
+
+bool BeagleSdk::send_media(const std::string& peer,
+                           const std::string& caption,
+                           const std::string& media_path,
+                           const std::string& media_url,
+                           const std::string& media_type,
+                           const std::string& filename,
+                           const std::string& out_format,
+                           const std::string& dedupe_key,
+                           BeagleSendOutcome* outcome) {
+  if (outcome) *outcome = BeagleSendOutcome();
+  RuntimeState* state = runtime_state_from_ptr(state_);
+  if (!state || !state->carrier || trim_copy(peer).empty()) return false;
+  if (!media_path.empty() && file_size_bytes(media_path) == 0) {
+    log_warn(std::string("[beagle-sdk] send_media invalid file path: ") + media_path);
+    return false;
+  }
+  OutboxEntry entry;
+  entry.kind = "media";
+  entry.peer = peer;
+  entry.requested_us = latency_request_start();
+  entry.text = caption;
+  entry.media_path = media_path;
+  entry.media_url = media_url;
+  entry.media_type = media_type;
+  entry.filename = filename;
+  entry.out_format = out_format;
+  entry.dedupe_key = dedupe_key;
+  BeagleSendOutcome local;
+  if (!outcome) outcome = &local;
+  if (!send_or_queue(state, std::move(entry), outcome)) return false;
+  if (!outcome->duplicate) {
+    std::string name = !filename.empty() ? filename
+        : basename_of(!media_path.empty() ? media_path : media_url);
+    record_history(state, peer, "out", 0, caption, name, media_type, dedupe_key);
+  }
+  return true;
+}
+
+bool BeagleSdk::history(const HistoryQuery& query, HistoryPage& out) const {
+  out = HistoryPage();
+  RuntimeState* state = runtime_state_from_ptr(state_);
+  if (!state || !state->history) return false;
+  return state->history->query(query, out);
+}
+
+bool BeagleSdk::search(const std::string& query,
+                       const std::string& peer,
+                       size_t limit,
+                       std::vector<SearchHit>& out) const {
+  out.clear();
+  RuntimeState* state = runtime_state_from_ptr(state_);
+  if (!state || !state->search) return false;
+  return state->search->search(query, peer, limit, out);
+}
+
 #if !BEAGLE_SDK_STUB
 BeagleStatus BeagleSdk::status() const {
   RuntimeState* state = runtime_state_from_ptr(state_);
   if (!state) return {};
-  std::lock_guard<std::mutex> lock(state->state_mu);
-  return state->status;
+  BeagleStatus out;
+  {
+    std::lock_guard<std::mutex> lock(state->state_mu);
+    out = state->status;
+  }
+  std::lock_guard<std::mutex> lock(state->outbox_mu);
+  out.outbox_pending = static_cast<unsigned long long>(outbox_pending_locked(state));
+  return out;
 }
 #endif
 
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "history_store.h"
+#include "search_index.h"
+
+#include <cstdint>
 #include <functional>
 #include <string>
 
@@ -13,9 +17,12 @@ struct BeagleIncomingMessage {
   unsigned long long size = 0;
   std::string msg_id;
   long long ts = 0;
+  long long received_us = 0;  // latency_now_us() at callback entry
+  long long decoded_us = 0;   // latency_now_us() once the payload was decoded
 };
 
 using BeagleIncomingCallback = std::function<void(const BeagleIncomingMessage&)>;
+using BeagleFriendOnlineCallback = std::function<void(const std::string& userid)>;
 
 struct BeagleSdkOptions {
   std::string config_path;
@@ -28,6 +35,9 @@ struct BeagleSdkOptions {
   std::string profile_description;
   std::string profile_region;
   std::string openclaw_agent_id;
+  // Where the crawler index is compiled; one place per process so every
+  // account shares it (default <data_dir>/crawler_index).
+  std::string crawler_cache_dir;
   bool emit_presence = false;
 };
 
@@ -39,6 +49,13 @@ struct BeagleStatus {
   long long last_offline_ts = 0;
   unsigned long long online_count = 0;
   unsigned long long offline_count = 0;
+  unsigned long long outbox_pending = 0;
+};
+
+// How a send request was settled when it did not go out immediately.
+struct BeagleSendOutcome {
+  bool queued = false;     // held in the durable outbox until the peer or express is reachable
+  bool duplicate = false;  // dedupe key already seen; nothing was sent again
 };
 
 class BeagleSdk {
@@ -53,10 +70,20 @@ public:
   bool start(const BeagleSdkOptions& options, BeagleIncomingCallback on_incoming);
   void stop();
 
-  bool send_text(const std::string& peer, const std::string& text);
+  bool send_text(const std::string& peer,
+                 const std::string& text,
+                 const std::string& dedupe_key = "",
+                 BeagleSendOutcome* outcome = nullptr);
   bool add_friend(const std::string& address, const std::string& hello);
   std::string id_from_address(const std::string& address) const;
   bool friend_is_online(const std::string& userid) const;
+  // Calls fn once when userid is online: right away on the calling thread if
+  // it already is, otherwise from the Carrier thread when it connects.
+  // Returns an id for cancel_friend_online_wait(), or 0 if fn already ran.
+  // Waits still pending at stop() are dropped without being called.
+  uint64_t when_friend_online(const std::string& userid, BeagleFriendOnlineCallback fn);
+  // False if the wait already fired or was cancelled.
+  bool cancel_friend_online_wait(uint64_t id);
   bool has_friend(const std::string& address) const;
   bool send_media(const std::string& peer,
                   const std::string& caption,
@@ -64,7 +91,9 @@ public:
                   const std::string& media_url,
                   const std::string& media_type,
                   const std::string& filename,
-                  const std::string& out_format = "");
+                  const std::string& out_format = "",
+                  const std::string& dedupe_key = "",
+                  BeagleSendOutcome* outcome = nullptr);
   bool send_status(const std::string& peer,
                    const std::string& state,
                    const std::string& phase,
@@ -78,6 +107,10 @@ public:
   const std::string& userid() const { return user_id_; }
   const std::string& address() const { return address_; }
   BeagleStatus status() const;
+  // Stored inbound and outbound messages, oldest first; false when history is unavailable.
+  bool history(const HistoryQuery& query, HistoryPage& out) const;
+  // Ranked full-text hits over the same history; false when search is unavailable.
+  bool search(const std::string& query, const std::string& peer, size_t limit, std::vector<SearchHit>& out) const;
 
 private:
   std::string user_id_;
@@ -0,0 +1,605 @@
+#include "crawler_index.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+static std::string expand_home(const std::string& path) {
+  if (path.empty()) return path;
+  if (path[0] != '~') return path;
+  const char* home = std::getenv("HOME");
+  if (!home) return path;
+  if (path.size() == 1) return std::string(home);
+  if (path[1] == '/') return std::string(home) + path.substr(1);
+  return path;
+}
+
+static bool is_valid_ip_token(const char* p, size_t n) {
+  if (n == 0) return false;
+  for (size_t i = 0; i < n; ++i) {
+    char c = p[i];
+    if (std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == ':' || c == '-') continue;
+    return false;
+  }
+  return true;
+}
+
+static void trim_span(const char*& p, size_t& n) {
+  while (n > 0 && std::isspace(static_cast<unsigned char>(*p))) {
+    ++p;
+    --n;
+  }
+  while (n > 0 && std::isspace(static_cast<unsigned char>(p[n - 1]))) --n;
+}
+
+static std::vector<std::string> list_entries(const std::string& dirpath, bool want_dirs, bool suffix_lst) {
+  std::vector<std::string> out;
+  DIR* d = opendir(dirpath.c_str());
+  if (!d) return out;
+  struct dirent* ent = nullptr;
+  while ((ent = readdir(d)) != nullptr) {
+    std::string name = ent->d_name;
+    if (name.empty() || name == "." || name == "..") continue;
+    if (want_dirs && ent->d_type != DT_DIR && ent->d_type != DT_UNKNOWN) continue;
+    if (!want_dirs && ent->d_type == DT_DIR) continue;
+    if (suffix_lst) {
+      if (name.size() < 4 || name.substr(name.size() - 4) != ".lst") continue;
+    }
+    out.push_back(name);
+  }
+  closedir(d);
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+// Newest first: date directories and file names both sort chronologically.
+static std::vector<std::string> find_recent_crawler_lsts(const std::string& data_dir, size_t max_files) {
+  std::string root = expand_home(data_dir);
+  if (root.empty() || max_files == 0) return {};
+  std::vector<std::string> dates = list_entries(root, true, false);
+  if (dates.empty()) return {};
+  std::vector<std::string> out;
+  out.reserve(max_files);
+  for (auto it = dates.rbegin(); it != dates.rend(); ++it) {
+    std::string day_dir = root + "/" + *it;
+    std::vector<std::string> files = list_entries(day_dir, false, true);
+    if (files.empty()) continue;
+    for (auto fit = files.rbegin(); fit != files.rend(); ++fit) {
+      out.push_back(day_dir + "/" + *fit);
+      if (out.size() >= max_files) return out;
+    }
+  }
+  return out;
+}
+
+struct IndexHeader {
+  char magic[8];
+  uint32_t record_size;
+  uint32_t version;
+  uint64_t count;
+  uint64_t heap_offset;
+  uint64_t meta_offset;  // trailer after the heap; see IndexFileWriter::publish
+};
+
+struct IndexRecord {
+  char userid[MappedCrawlerIndex::kUseridBytes];
+  uint32_t heap_off;  // ip bytes, then location bytes
+  uint16_t ip_len;
+  uint16_t loc_len;
+  uint8_t reserved[8];
+};
+
+static_assert(sizeof(IndexHeader) == 40, "crawler index header must stay 40 bytes");
+static_assert(sizeof(IndexRecord) == 64, "crawler index records must stay 64 bytes");
+
+static const char kIndexMagic[8] = {'B', 'C', 'R', 'I', 'D', 'X', '2', '\0'};
+
+static bool mkdirs(const std::string& path) {
+  if (path.empty()) return false;
+  std::string cur;
+  size_t pos = 0;
+  while (pos != std::string::npos) {
+    pos = path.find('/', pos + 1);
+    cur = path.substr(0, pos);
+    if (cur.empty()) continue;
+    if (::mkdir(cur.c_str(), 0755) != 0 && errno != EEXIST) return false;
+  }
+  return true;
+}
+
+static uint64_t fnv1a64(const std::string& s) {
+  uint64_t h = 1469598103934665603ULL;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static std::string window_fingerprint(const std::string& signature) {
+  if (signature.empty()) return "";
+  char buf[17];
+  std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(fnv1a64(signature)));
+  return buf;
+}
+
+// Streams sorted records into `<path>.tmp` and publishes it with rename().
+// `meta` is stored as a trailer so it is replaced atomically with the records.
+class IndexFileWriter {
+ public:
+  explicit IndexFileWriter(const std::string& path) : path_(path), tmp_(path + ".tmp") {
+    out_ = std::fopen(tmp_.c_str(), "wb");
+    heap_ = std::tmpfile();
+    if (out_) {
+      IndexHeader header{};
+      ok_ = std::fwrite(&header, sizeof(header), 1, out_) == 1;
+    }
+    ok_ = ok_ && heap_ != nullptr;
+  }
+
+  ~IndexFileWriter() {
+    if (out_) std::fclose(out_);
+    if (heap_) std::fclose(heap_);
+    if (!published_) std::remove(tmp_.c_str());
+  }
+
+  bool add(const char* userid, size_t userid_len, const char* ip, size_t ip_len, const char* loc, size_t loc_len) {
+    if (!ok_ || userid_len == 0 || userid_len >= MappedCrawlerIndex::kUseridBytes) return false;
+    IndexRecord rec{};
+    std::memcpy(rec.userid, userid, userid_len);
+    rec.heap_off = static_cast<uint32_t>(heap_size_);
+    rec.ip_len = static_cast<uint16_t>(std::min<size_t>(ip_len, 0xFFFF));
+    rec.loc_len = static_cast<uint16_t>(std::min<size_t>(loc_len, 0xFFFF));
+    ok_ = std::fwrite(&rec, sizeof(rec), 1, out_) == 1
+        && (rec.ip_len == 0 || std::fwrite(ip, 1, rec.ip_len, heap_) == rec.ip_len)
+        && (rec.loc_len == 0 || std::fwrite(loc, 1, rec.loc_len, heap_) == rec.loc_len);
+    heap_size_ += rec.ip_len + rec.loc_len;
+    count_++;
+    return ok_;
+  }
+
+  bool publish(const std::string& meta = std::string()) {
+    if (!ok_) return false;
+    IndexHeader header{};
+    std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.record_size = sizeof(IndexRecord);
+    header.version = 2;
+    header.count = count_;
+    header.heap_offset = sizeof(IndexHeader) + count_ * sizeof(IndexRecord);
+    header.meta_offset = header.heap_offset + heap_size_;
+    std::rewind(heap_);
+    char buf[1 << 16];
+    size_t n = 0;
+    while ((n = std::fread(buf, 1, sizeof(buf), heap_)) > 0) {
+      if (std::fwrite(buf, 1, n, out_) != n) return false;
+    }
+    if (!meta.empty() && std::fwrite(meta.data(), 1, meta.size(), out_) != meta.size()) return false;
+    if (std::fseek(out_, 0, SEEK_SET) != 0 || std::fwrite(&header, sizeof(header), 1, out_) != 1) return false;
+    if (std::fflush(out_) != 0 || ::fsync(fileno(out_)) != 0) return false;
+    std::fclose(out_);
+    out_ = nullptr;
+    if (std::rename(tmp_.c_str(), path_.c_str()) != 0) return false;
+    published_ = true;
+    return true;
+  }
+
+  size_t count() const { return count_; }
+
+ private:
+  std::string path_;
+  std::string tmp_;
+  FILE* out_ = nullptr;
+  FILE* heap_ = nullptr;
+  bool ok_ = false;
+  bool published_ = false;
+  size_t count_ = 0;
+  size_t heap_size_ = 0;
+};
+
+struct ParsedLine {
+  std::string userid;
+  std::string ip;
+  std::string location;
+  size_t order = 0;
+};
+
+// Compiles one `.lst` (`userid,ip,location` lines; the first line for a userid
+// wins) into a sorted segment file.
+static bool compile_crawler_file(const std::string& path, const std::string& segment_path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+  std::ostringstream buf;
+  buf << in.rdbuf();
+  const std::string data = buf.str();
+  std::vector<ParsedLine> lines;
+  size_t pos = 0;
+  while (pos < data.size()) {
+    size_t eol = data.find('\n', pos);
+    if (eol == std::string::npos) eol = data.size();
+    const char* line = data.data() + pos;
+    size_t len = eol - pos;
+    pos = eol + 1;
+
+    const char* c1 = static_cast<const char*>(std::memchr(line, ',', len));
+    if (!c1) continue;
+    const char* c2 = static_cast<const char*>(std::memchr(c1 + 1, ',', line + len - (c1 + 1)));
+    if (!c2) continue;
+    const char* uid = line;
+    size_t uid_len = static_cast<size_t>(c1 - line);
+    const char* ip = c1 + 1;
+    size_t ip_len = static_cast<size_t>(c2 - ip);
+    const char* loc = c2 + 1;
+    size_t loc_len = static_cast<size_t>(line + len - loc);
+    trim_span(uid, uid_len);
+    trim_span(ip, ip_len);
+    trim_span(loc, loc_len);
+    if (uid_len == 0 || uid_len >= MappedCrawlerIndex::kUseridBytes) continue;
+    ParsedLine p;
+    p.userid.assign(uid, uid_len);
+    if (is_valid_ip_token(ip, ip_len)) p.ip.assign(ip, ip_len);
+    p.location.assign(loc, loc_len);
+    p.order = lines.size();
+    lines.push_back(std::move(p));
+  }
+  std::stable_sort(lines.begin(), lines.end(), [](const ParsedLine& a, const ParsedLine& b) {
+    return a.userid < b.userid;
+  });
+  IndexFileWriter writer(segment_path);
+  const std::string* prev = nullptr;
+  for (const auto& p : lines) {
+    if (prev && *prev == p.userid) continue;
+    prev = &p.userid;
+    writer.add(p.userid.data(), p.userid.size(), p.ip.data(), p.ip.size(), p.location.data(), p.location.size());
+  }
+  return writer.publish();
+}
+
+}  // namespace
+
+MappedCrawlerIndex::~MappedCrawlerIndex() {
+  if (map_) ::munmap(map_, map_size_);
+}
+
+std::shared_ptr<const MappedCrawlerIndex> MappedCrawlerIndex::open(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return nullptr;
+  struct stat st{};
+  if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(IndexHeader)) {
+    ::close(fd);
+    return nullptr;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void* map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) return nullptr;
+  std::shared_ptr<MappedCrawlerIndex> out(new MappedCrawlerIndex());
+  out->map_ = map;
+  out->map_size_ = size;
+  IndexHeader header;
+  std::memcpy(&header, map, sizeof(header));
+  if (std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0
+      || header.record_size != sizeof(IndexRecord)
+      || header.heap_offset != sizeof(IndexHeader) + header.count * sizeof(IndexRecord)
+      || header.heap_offset > header.meta_offset
+      || header.meta_offset > size) {
+    return nullptr;
+  }
+  out->count_ = static_cast<size_t>(header.count);
+  out->records_ = static_cast<const unsigned char*>(map) + sizeof(IndexHeader);
+  out->heap_ = static_cast<const char*>(map) + header.heap_offset;
+  out->heap_size_ = static_cast<size_t>(header.meta_offset - header.heap_offset);
+  out->meta_.assign(static_cast<const char*>(map) + header.meta_offset, size - static_cast<size_t>(header.meta_offset));
+  ::madvise(map, size, MADV_RANDOM);
+  return out;
+}
+
+const unsigned char* MappedCrawlerIndex::record(size_t i) const {
+  return records_ + i * sizeof(IndexRecord);
+}
+
+CrawlerNode MappedCrawlerIndex::node_at(size_t i) const {
+  IndexRecord rec;
+  std::memcpy(&rec, record(i), sizeof(rec));
+  CrawlerNode node;
+  size_t end = static_cast<size_t>(rec.heap_off) + rec.ip_len + rec.loc_len;
+  if (end > heap_size_) return node;
+  node.ip.assign(heap_ + rec.heap_off, rec.ip_len);
+  node.location.assign(heap_ + rec.heap_off + rec.ip_len, rec.loc_len);
+  return node;
+}
+
+bool MappedCrawlerIndex::find(const std::string& userid, CrawlerNode& out) const {
+  if (userid.empty() || userid.size() >= kUseridBytes || count_ == 0) return false;
+  char key[kUseridBytes] = {0};
+  std::memcpy(key, userid.data(), userid.size());
+  size_t lo = 0;
+  size_t hi = count_;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = std::memcmp(record(mid), key, kUseridBytes);
+    if (cmp == 0) {
+      out = node_at(mid);
+      return true;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return false;
+}
+
+void MappedCrawlerIndex::for_each(
+    const std::function<void(const std::string& userid, const CrawlerNode& node)>& fn) const {
+  for (size_t i = 0; i < count_; ++i) {
+    const char* uid = reinterpret_cast<const char*>(record(i));
+    fn(std::string(uid, strnlen(uid, kUseridBytes)), node_at(i));
+  }
+}
+
+bool MappedCrawlerIndex::same_value(size_t i, const MappedCrawlerIndex& other, size_t j) const {
+  IndexRecord a;
+  IndexRecord b;
+  std::memcpy(&a, record(i), sizeof(a));
+  std::memcpy(&b, other.record(j), sizeof(b));
+  if (a.ip_len != b.ip_len || a.loc_len != b.loc_len) return false;
+  size_t len = static_cast<size_t>(a.ip_len) + a.loc_len;
+  if (a.heap_off + len > heap_size_ || b.heap_off + len > other.heap_size_) return false;
+  return std::memcmp(heap_ + a.heap_off, other.heap_ + b.heap_off, len) == 0;
+}
+
+size_t MappedCrawlerIndex::for_each_changed(
+    const MappedCrawlerIndex* prev,
+    const std::function<void(const std::string& userid, const CrawlerNode& node)>& fn) const {
+  size_t unchanged = 0;
+  size_t j = 0;
+  const size_t prev_count = prev ? prev->size() : 0;
+  for (size_t i = 0; i < count_; ++i) {
+    const unsigned char* key = record(i);
+    int cmp = 1;
+    while (j < prev_count && (cmp = std::memcmp(prev->record(j), key, kUseridBytes)) < 0) {
+      ++j;
+      cmp = 1;
+    }
+    if (j < prev_count && cmp == 0 && same_value(i, *prev, j)) {
+      ++unchanged;
+      continue;
+    }
+    const char* uid = reinterpret_cast<const char*>(key);
+    fn(std::string(uid, strnlen(uid, kUseridBytes)), node_at(i));
+  }
+  return unchanged;
+}
+
+CrawlerIndex::CrawlerIndex(const std::string& data_dir, size_t lookback_files, const std::string& cache_dir)
+    : data_dir_(data_dir),
+      lookback_files_(lookback_files),
+      cache_dir_(cache_dir),
+      index_path_(cache_dir + "/crawler_index.bin") {
+  auto snap = std::make_shared<CrawlerSnapshot>();
+  snap->index = MappedCrawlerIndex::open(index_path_);
+  if (snap->index) {
+    // meta: "<newest_mtime> <newest_file>\n<window signature>"
+    const std::string& sig = snap->index->meta_;
+    size_t nl = sig.find('\n');
+    size_t sp = sig.find(' ');
+    if (nl != std::string::npos && sp != std::string::npos && sp < nl) {
+      snap->newest_mtime = std::atoll(sig.substr(0, sp).c_str());
+      snap->newest_file = sig.substr(sp + 1, nl - sp - 1);
+      signature_ = sig.substr(nl + 1);
+      snap->fingerprint = window_fingerprint(signature_);
+    }
+  }
+  std::atomic_store(&current_, std::shared_ptr<const CrawlerSnapshot>(std::move(snap)));
+}
+
+CrawlerIndex::~CrawlerIndex() {
+  {
+    std::lock_guard<std::mutex> lock(loop_mu_);
+    loop_stop_ = true;
+  }
+  loop_cv_.notify_all();
+  if (loop_thread_.joinable()) loop_thread_.join();
+}
+
+void CrawlerIndex::start_refresh(int refresh_seconds) {
+  std::lock_guard<std::mutex> lock(loop_mu_);
+  if (refresh_seconds_ == 0 || refresh_seconds < refresh_seconds_) refresh_seconds_ = refresh_seconds;
+  if (!loop_thread_.joinable()) loop_thread_ = std::thread([this]() { refresh_loop(); });
+}
+
+// One pass per interval for the whole process, however many accounts share the index.
+void CrawlerIndex::refresh_loop() {
+  std::unique_lock<std::mutex> lock(loop_mu_);
+  while (!loop_stop_) {
+    lock.unlock();
+    RefreshResult r = refresh();
+    if (r.changed) {
+      log_line("[crawler-index] refreshed files=" + std::to_string(r.files)
+               + " parsed=" + std::to_string(r.parsed_files)
+               + " rows=" + std::to_string(r.rows)
+               + " ms=" + std::to_string(r.elapsed_ms));
+    } else if (r.failed_files > 0) {
+      log_warn("[crawler-index] refresh kept the previous index: "
+               + std::to_string(r.failed_files) + " file(s) failed to compile");
+    }
+    checked_ = true;
+    lock.lock();
+    loop_cv_.wait_for(lock, std::chrono::seconds(refresh_seconds_), [this]() { return loop_stop_; });
+  }
+}
+
+std::shared_ptr<CrawlerIndex> CrawlerIndex::shared(const std::string& data_dir,
+                                                   size_t lookback_files,
+                                                   const std::string& cache_dir) {
+  static std::mutex registry_mu;
+  static std::map<std::string, std::weak_ptr<CrawlerIndex>> registry;
+  const std::string key = expand_home(data_dir) + "|" + std::to_string(lookback_files) + "|" + cache_dir;
+  std::lock_guard<std::mutex> lock(registry_mu);
+  std::shared_ptr<CrawlerIndex> index = registry[key].lock();
+  if (!index) {
+    index = std::make_shared<CrawlerIndex>(data_dir, lookback_files, cache_dir);
+    registry[key] = index;
+  }
+  return index;
+}
+
+CrawlerIndex::RefreshResult CrawlerIndex::refresh() {
+  RefreshResult result;
+  std::unique_lock<std::mutex> refresh_lock(refresh_mu_, std::try_to_lock);
+  if (!refresh_lock.owns_lock()) return result;
+  auto started = std::chrono::steady_clock::now();
+  std::vector<std::string> files = find_recent_crawler_lsts(data_dir_, lookback_files_);
+  result.files = files.size();
+
+  std::string segment_dir = cache_dir_ + "/segments";
+  struct Candidate {
+    std::string path;
+    std::string segment;
+    bool compiled = false;
+    std::shared_ptr<const MappedCrawlerIndex> mapped;
+  };
+  std::vector<Candidate> window;
+  window.reserve(files.size());
+  std::string signature;
+  for (const auto& f : files) {
+    struct stat st{};
+    if (stat(f.c_str(), &st) != 0) continue;
+    long long mtime = static_cast<long long>(st.st_mtime);
+    long long size = static_cast<long long>(st.st_size);
+    signature += f + "|" + std::to_string(mtime) + "|" + std::to_string(size) + ";";
+    if (mtime >= result.newest_mtime) {
+      result.newest_mtime = mtime;
+      result.newest_file = f;
+    }
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx-%lld-%lld.seg",
+                  static_cast<unsigned long long>(fnv1a64(f)), mtime, size);
+    Candidate c;
+    c.path = f;
+    c.segment = segment_dir + "/" + name;
+    window.push_back(std::move(c));
+  }
+  // A missing or rotating crawler dir lists nothing; keep the current index
+  // and its segments rather than publishing an empty one.
+  if (window.empty()) return result;
+  if (signature == signature_) return result;
+  if (!mkdirs(segment_dir)) return result;
+
+  // Segments survive restarts; only files without one are compiled.
+  std::vector<size_t> todo;
+  for (size_t i = 0; i < window.size(); ++i) {
+    window[i].mapped = MappedCrawlerIndex::open(window[i].segment);
+    if (!window[i].mapped) todo.push_back(i);
+  }
+  result.parsed_files = todo.size();
+  if (!todo.empty()) {
+    unsigned int hw = std::thread::hardware_concurrency();
+    size_t workers = std::min<size_t>(todo.size(), std::max(1u, std::min(hw, 8u)));
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+      for (size_t k = next++; k < todo.size(); k = next++) {
+        Candidate& c = window[todo[k]];
+        if (compile_crawler_file(c.path, c.segment)) c.mapped = MappedCrawlerIndex::open(c.segment);
+      }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; ++i) pool.emplace_back(work);
+    work();
+    for (auto& t : pool) t.join();
+  }
+  // A file that did not compile (ENOSPC, a read error) would drop out of the
+  // merge; keep the old index and signature so the next refresh retries it.
+  for (size_t i : todo) {
+    if (!window[i].mapped) ++result.failed_files;
+  }
+  if (result.failed_files > 0) return result;
+
+  // K-way merge; on equal userids the newer segment (lower index) comes out first and wins.
+  struct Cursor {
+    size_t seg;
+    size_t pos;
+  };
+  auto key_of = [&](const Cursor& c) { return window[c.seg].mapped->record(c.pos); };
+  auto later = [&](const Cursor& a, const Cursor& b) {
+    int cmp = std::memcmp(key_of(a), key_of(b), MappedCrawlerIndex::kUseridBytes);
+    if (cmp != 0) return cmp > 0;
+    return a.seg > b.seg;
+  };
+  std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heap(later);
+  for (size_t i = 0; i < window.size(); ++i) {
+    if (window[i].mapped && window[i].mapped->size() > 0) heap.push(Cursor{i, 0});
+  }
+  IndexFileWriter writer(index_path_);
+  char last[MappedCrawlerIndex::kUseridBytes];
+  bool have_last = false;
+  while (!heap.empty()) {
+    Cursor c = heap.top();
+    heap.pop();
+    const MappedCrawlerIndex& seg = *window[c.seg].mapped;
+    const unsigned char* rec = seg.record(c.pos);
+    if (!have_last || std::memcmp(last, rec, sizeof(last)) != 0) {
+      std::memcpy(last, rec, sizeof(last));
+      have_last = true;
+      CrawlerNode node = seg.node_at(c.pos);
+      writer.add(last, strnlen(last, sizeof(last)),
+                 node.ip.data(), node.ip.size(),
+                 node.location.data(), node.location.size());
+    }
+    if (++c.pos < seg.size()) heap.push(c);
+  }
+  result.rows = writer.count();
+  if (!writer.publish(std::to_string(result.newest_mtime) + " " + result.newest_file + "\n" + signature)) return result;
+  std::shared_ptr<const MappedCrawlerIndex> next = MappedCrawlerIndex::open(index_path_);
+  if (!next) return result;
+  std::remove((index_path_ + ".sig").c_str());  // written beside the index by older versions
+  signature_ = signature;
+  auto snap = std::make_shared<CrawlerSnapshot>();
+  snap->index = std::move(next);
+  snap->newest_file = result.newest_file;
+  snap->newest_mtime = result.newest_mtime;
+  snap->fingerprint = window_fingerprint(signature);
+  std::atomic_store(&current_, std::shared_ptr<const CrawlerSnapshot>(std::move(snap)));
+
+  // Drop segments that fell out of the lookback window.
+  std::set<std::string> live;
+  for (const auto& c : window) live.insert(c.segment);
+  for (const auto& name : list_entries(segment_dir, false, false)) {
+    std::string full = segment_dir + "/" + name;
+    if (!live.count(full)) std::remove(full.c_str());
+  }
+
+  result.changed = true;
+  result.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - started).count();
+  return result;
+}
+
+std::shared_ptr<const CrawlerSnapshot> CrawlerIndex::snapshot() const {
+  return std::atomic_load(&current_);
+}
+
+bool CrawlerIndex::lookup(const std::string& userid, CrawlerNode& out) const {
+  std::shared_ptr<const CrawlerSnapshot> snap = snapshot();
+  return snap && snap->index && snap->index->find(userid, out);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Address of a Carrier node as reported by the crawler.
+struct CrawlerNode {
+  std::string ip;
+  std::string location;
+};
+
+// Read-only view of a compiled crawler index file: a header, fixed-width
+// records sorted by userid, then a heap holding the ip/location bytes.
+// The file is mmap()ed, so lookups are a binary search over mapped pages.
+class MappedCrawlerIndex {
+ public:
+  static constexpr size_t kUseridBytes = 48;  // NUL padded; longer userids are skipped
+
+  ~MappedCrawlerIndex();
+
+  // Maps path; returns nullptr when it is missing or not a valid index.
+  static std::shared_ptr<const MappedCrawlerIndex> open(const std::string& path);
+
+  size_t size() const { return count_; }
+  bool find(const std::string& userid, CrawlerNode& out) const;
+  // Visits records in userid order.
+  void for_each(const std::function<void(const std::string& userid, const CrawlerNode& node)>& fn) const;
+  // Visits records that are new or carry a different ip/location than in prev
+  // (every record when prev is null), by a linear merge of both sorted files.
+  // Returns the number of unchanged records.
+  size_t for_each_changed(const MappedCrawlerIndex* prev,
+                          const std::function<void(const std::string& userid, const CrawlerNode& node)>& fn) const;
+
+ private:
+  MappedCrawlerIndex() = default;
+  MappedCrawlerIndex(const MappedCrawlerIndex&) = delete;
+  MappedCrawlerIndex& operator=(const MappedCrawlerIndex&) = delete;
+
+  friend class CrawlerIndex;
+  const unsigned char* record(size_t i) const;
+  CrawlerNode node_at(size_t i) const;
+  bool same_value(size_t i, const MappedCrawlerIndex& other, size_t j) const;
+
+  void* map_ = nullptr;
+  size_t map_size_ = 0;
+  size_t count_ = 0;
+  const unsigned char* records_ = nullptr;
+  const char* heap_ = nullptr;
+  size_t heap_size_ = 0;
+  std::string meta_;
+};
+
+// Published state of a CrawlerIndex; immutable once shared.
+struct CrawlerSnapshot {
+  std::shared_ptr<const MappedCrawlerIndex> index;
+  std::string newest_file;  // newest `.lst` in the window that produced index
+  long long newest_mtime = 0;
+  // Hash of that window's file names, mtimes and sizes; equal fingerprints
+  // mean equal index contents. Empty when unknown.
+  std::string fingerprint;
+};
+
+// Index over the newest crawler `.lst` files (`<dataDir>/<date>/<name>.lst`,
+// lines `userid,ip,location`). Each `.lst` is compiled once into a sorted
+// binary segment under `<cacheDir>/segments`; a refresh compiles only new or
+// changed files (in parallel) and k-way merges the segments newest-first into
+// `<cacheDir>/crawler_index.bin`, so the most recent sighting of a userid wins.
+//
+// One instance is shared by every account of the process that reads the same
+// crawler directory (see shared()), and so is its refresh thread. Readers take
+// the current snapshot with an atomic shared_ptr load and never block on a refresh.
+class CrawlerIndex {
+ public:
+  struct RefreshResult {
+    bool changed = false;     // a new index file was published
+    size_t files = 0;         // files in the lookback window
+    size_t parsed_files = 0;  // files compiled by this refresh
+    size_t failed_files = 0;  // files that failed to compile; nothing was published
+    size_t rows = 0;          // distinct userids after the merge
+    std::string newest_file;
+    long long newest_mtime = 0;
+    long long elapsed_ms = 0;
+  };
+
+  // Reopens a previously published index from cache_dir right away.
+  CrawlerIndex(const std::string& data_dir, size_t lookback_files, const std::string& cache_dir);
+  ~CrawlerIndex();
+
+  CrawlerIndex(const CrawlerIndex&) = delete;
+  CrawlerIndex& operator=(const CrawlerIndex&) = delete;
+
+  // Process-wide instance for (data_dir, lookback_files, cache_dir), created on
+  // first use; later callers share it. It is released with the last holder.
+  static std::shared_ptr<CrawlerIndex> shared(const std::string& data_dir,
+                                              size_t lookback_files,
+                                              const std::string& cache_dir);
+
+  // Safe to call from several threads: while one refresh runs, other callers
+  // return immediately with changed=false and pick up its result via snapshot().
+  RefreshResult refresh();
+
+  // Starts the background thread that calls refresh() every refresh_seconds;
+  // later callers only shorten the interval. It stops with the last holder.
+  void start_refresh(int refresh_seconds);
+  // True once the refresh thread has finished a pass, so snapshot() reflects
+  // the crawler directory and not just the index reopened from cache_dir.
+  bool checked() const { return checked_.load(); }
+
+  bool lookup(const std::string& userid, CrawlerNode& out) const;
+
+  // Current snapshot (its index is null before the first successful refresh).
+  std::shared_ptr<const CrawlerSnapshot> snapshot() const;
+
+ private:
+  std::string data_dir_;
+  size_t lookback_files_;
+  std::string cache_dir_;
+  std::string index_path_;
+
+  std::mutex refresh_mu_;
+  std::string signature_;  // guarded by refresh_mu_
+
+  std::shared_ptr<const CrawlerSnapshot> current_;  // accessed with std::atomic_load/atomic_store
+
+  void refresh_loop();
+
+  std::mutex loop_mu_;
+  std::condition_variable loop_cv_;
+  std::thread loop_thread_;
+  bool loop_stop_ = false;
+  int refresh_seconds_ = 0;  // guarded by loop_mu_
+  std::atomic<bool> checked_{false};
+};
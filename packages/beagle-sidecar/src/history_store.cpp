@@ -0,0 +1,283 @@
+#include "history_store.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+static_assert(sizeof(uint64_t) * 3 + sizeof(uint32_t) * 2 == 32, "history index entries are 32 bytes");
+
+static uint64_t fnv1a64(const std::string& s) {
+  uint64_t h = 1469598103934665603ULL;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static long long now_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static bool write_all(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::write(fd, data, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+static bool pread_all(int fd, char* data, size_t len, uint64_t offset) {
+  while (len > 0) {
+    ssize_t n = ::pread(fd, data, len, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    len -= static_cast<size_t>(n);
+    offset += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+static void put_u32(std::string& out, uint32_t v) {
+  out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static void put_i64(std::string& out, int64_t v) {
+  out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static void put_str(std::string& out, const std::string& s) {
+  put_u32(out, static_cast<uint32_t>(s.size()));
+  out += s;
+}
+
+struct Reader {
+  const char* p;
+  const char* end;
+  bool ok = true;
+
+  template <typename T>
+  T get() {
+    T v{};
+    if (end - p < static_cast<ptrdiff_t>(sizeof(T))) {
+      ok = false;
+      return v;
+    }
+    std::memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return v;
+  }
+
+  std::string str() {
+    uint32_t len = get<uint32_t>();
+    if (!ok || end - p < static_cast<ptrdiff_t>(len)) {
+      ok = false;
+      return "";
+    }
+    std::string s(p, len);
+    p += len;
+    return s;
+  }
+};
+
+// Frame: u32 frame length (including itself), then the record fields.
+static std::string encode_record(const HistoryRecord& rec) {
+  std::string out;
+  put_u32(out, 0);
+  put_i64(out, rec.recorded_ms);
+  put_i64(out, rec.ts_ms);
+  out += static_cast<char>(rec.direction == "out" ? 1 : 0);
+  put_str(out, rec.peer);
+  put_str(out, rec.text);
+  put_str(out, rec.filename);
+  put_str(out, rec.media_type);
+  put_str(out, rec.msg_id);
+  uint32_t len = static_cast<uint32_t>(out.size());
+  std::memcpy(&out[0], &len, sizeof(len));
+  return out;
+}
+
+static bool decode_record(const std::string& frame, HistoryRecord& rec) {
+  Reader r{frame.data() + sizeof(uint32_t), frame.data() + frame.size()};
+  rec.recorded_ms = r.get<int64_t>();
+  rec.ts_ms = r.get<int64_t>();
+  rec.direction = r.get<char>() == 1 ? "out" : "in";
+  rec.peer = r.str();
+  rec.text = r.str();
+  rec.filename = r.str();
+  rec.media_type = r.str();
+  rec.msg_id = r.str();
+  return r.ok;
+}
+
+}  // namespace
+
+HistoryStore::HistoryStore(const std::string& dir)
+    : dir_(dir), data_path_(dir + "/messages.dat"), index_path_(dir + "/messages.idx") {}
+
+HistoryStore::~HistoryStore() {
+  if (data_fd_ >= 0) ::close(data_fd_);
+  if (index_fd_ >= 0) ::close(index_fd_);
+}
+
+bool HistoryStore::open() {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (data_fd_ >= 0) return true;
+  if (::mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) return false;
+  data_fd_ = ::open(data_path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  index_fd_ = ::open(index_path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (data_fd_ < 0 || index_fd_ < 0) {
+    log_warn("[history] open failed dir=" + dir_);
+    return false;
+  }
+  struct stat st{};
+  if (::fstat(data_fd_, &st) != 0) return false;
+  data_size_ = static_cast<uint64_t>(st.st_size);
+  if (::fstat(index_fd_, &st) != 0) return false;
+
+  size_t count = static_cast<size_t>(st.st_size) / sizeof(IndexEntry);
+  std::vector<IndexEntry> loaded(count);
+  if (count > 0 && !pread_all(index_fd_, reinterpret_cast<char*>(loaded.data()), count * sizeof(IndexEntry), 0)) {
+    loaded.clear();
+  }
+  // Entries pointing past the data file come from a torn write; drop them.
+  while (!loaded.empty() && loaded.back().offset + loaded.back().length > data_size_) loaded.pop_back();
+  if (static_cast<uint64_t>(st.st_size) != loaded.size() * sizeof(IndexEntry)) {
+    if (::ftruncate(index_fd_, static_cast<off_t>(loaded.size() * sizeof(IndexEntry))) != 0) return false;
+  }
+  entries_.reserve(loaded.size());
+  for (const auto& e : loaded) add_entry_locked(e);
+
+  // Re-index records appended after the last index entry.
+  uint64_t offset = entries_.empty() ? 0 : entries_.back().offset + entries_.back().length;
+  size_t recovered = 0;
+  while (offset + sizeof(uint32_t) <= data_size_) {
+    uint32_t len = 0;
+    if (!pread_all(data_fd_, reinterpret_cast<char*>(&len), sizeof(len), offset)) break;
+    if (len <= sizeof(uint32_t) || offset + len > data_size_) break;
+    std::string frame(len, '\0');
+    HistoryRecord rec;
+    if (!pread_all(data_fd_, &frame[0], len, offset) || !decode_record(frame, rec)) break;
+    IndexEntry e{offset, rec.recorded_ms, fnv1a64(rec.peer), len, 0};
+    if (!write_all(index_fd_, reinterpret_cast<const char*>(&e), sizeof(e))) break;
+    add_entry_locked(e);
+    offset += len;
+    recovered++;
+  }
+  if (offset < data_size_) {
+    if (::ftruncate(data_fd_, static_cast<off_t>(offset)) != 0) return false;
+    data_size_ = offset;
+  }
+  if (recovered > 0) log_line("[history] re-indexed records=" + std::to_string(recovered) + " dir=" + dir_);
+  return true;
+}
+
+void HistoryStore::add_entry_locked(const IndexEntry& e) {
+  by_peer_[e.peer_hash].push_back(static_cast<uint32_t>(entries_.size()));
+  entries_.push_back(e);
+}
+
+bool HistoryStore::append(HistoryRecord& rec) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (data_fd_ < 0) return false;
+  // Keep recorded_ms non-decreasing so it stays binary-searchable across clock steps.
+  long long recorded = now_ms();
+  if (!entries_.empty() && recorded < entries_.back().recorded_ms) recorded = entries_.back().recorded_ms;
+  rec.recorded_ms = recorded;
+  std::string frame = encode_record(rec);
+  if (!write_all(data_fd_, frame.data(), frame.size())) {
+    log_warn("[history] append failed dir=" + dir_);
+    // Drop a partial frame so the next record starts on a boundary.
+    if (::ftruncate(data_fd_, static_cast<off_t>(data_size_)) != 0) {
+      log_warn("[history] truncate failed path=" + data_path_);
+    }
+    return false;
+  }
+  IndexEntry e{data_size_, recorded, fnv1a64(rec.peer), static_cast<uint32_t>(frame.size()), 0};
+  data_size_ += frame.size();
+  // Once an index write fails the file stops short; open() re-indexes the data tail.
+  if (!index_short_ && !write_all(index_fd_, reinterpret_cast<const char*>(&e), sizeof(e))) {
+    index_short_ = true;
+    log_warn("[history] index write failed path=" + index_path_);
+  }
+  add_entry_locked(e);
+  rec.id = entries_.size();
+  return true;
+}
+
+bool HistoryStore::read_at(const IndexEntry& e, HistoryRecord& out) const {
+  std::string frame(e.length, '\0');
+  if (e.length <= sizeof(uint32_t) || !pread_all(data_fd_, &frame[0], e.length, e.offset)) return false;
+  return decode_record(frame, out);
+}
+
+bool HistoryStore::read(unsigned long long id, HistoryRecord& out) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (id == 0 || id > entries_.size()) return false;
+  if (!read_at(entries_[id - 1], out)) return false;
+  out.id = id;
+  return true;
+}
+
+unsigned long long HistoryStore::last_id() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return entries_.size();
+}
+
+bool HistoryStore::query(const HistoryQuery& q, HistoryPage& out) const {
+  out = HistoryPage();
+  size_t limit = q.limit == 0 ? 50 : q.limit;
+  std::lock_guard<std::mutex> lock(mu_);
+  if (data_fd_ < 0) return false;
+
+  // Candidate positions in append order: one peer's list, or every entry.
+  const std::vector<uint32_t>* positions = nullptr;
+  if (!q.peer.empty()) {
+    auto it = by_peer_.find(fnv1a64(q.peer));
+    if (it == by_peer_.end()) return true;
+    positions = &it->second;
+  }
+  const size_t total = positions ? positions->size() : entries_.size();
+  auto pos_at = [&](size_t i) -> size_t { return positions ? (*positions)[i] : i; };
+
+  // First candidate past both the time bound and the cursor (both grow with position).
+  size_t lo = 0;
+  size_t hi = total;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const size_t pos = pos_at(mid);
+    if (entries_[pos].recorded_ms < q.since_ms || pos + 1 <= q.after_id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  for (size_t i = lo; i < total; ++i) {
+    if (out.records.size() >= limit) {
+      out.next_cursor = out.records.back().id;
+      break;
+    }
+    const size_t pos = pos_at(i);
+    HistoryRecord rec;
+    if (!read_at(entries_[pos], rec)) continue;
+    if (!q.peer.empty() && rec.peer != q.peer) continue;  // hash collision
+    rec.id = pos + 1;
+    out.records.push_back(std::move(rec));
+  }
+  return true;
+}
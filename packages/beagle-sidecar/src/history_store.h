@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One inbound or outbound message kept in the conversation history.
+struct HistoryRecord {
+  unsigned long long id = 0;  // 1-based append order; also the pagination cursor
+  long long recorded_ms = 0;  // when the sidecar stored it; indexed for `since`
+  long long ts_ms = 0;        // message time (Carrier timestamp for inbound)
+  std::string peer;
+  std::string direction;  // "in" or "out"
+  std::string text;
+  std::string filename;
+  std::string media_type;
+  std::string msg_id;
+};
+
+struct HistoryQuery {
+  std::string peer;                // empty = all peers
+  long long since_ms = 0;          // recorded_ms lower bound (inclusive)
+  unsigned long long after_id = 0;  // cursor: only records with a larger id
+  size_t limit = 50;
+};
+
+struct HistoryPage {
+  std::vector<HistoryRecord> records;  // oldest first
+  unsigned long long next_cursor = 0;  // pass as after_id for the next page; 0 when exhausted
+};
+
+// Append-only history under `<dir>`: `messages.dat` holds length-prefixed
+// records and `messages.idx` one fixed 32-byte entry per record (offset,
+// recorded time, peer hash). The index is loaded into memory and grouped per
+// peer, so a query is a binary search on recorded time plus one pread per
+// returned record. A data tail missing from the index (crash between the two
+// writes) is re-indexed on open.
+class HistoryStore {
+ public:
+  explicit HistoryStore(const std::string& dir);
+  ~HistoryStore();
+
+  HistoryStore(const HistoryStore&) = delete;
+  HistoryStore& operator=(const HistoryStore&) = delete;
+
+  bool open();
+
+  // Assigns rec.id and rec.recorded_ms; returns false when the write failed.
+  bool append(HistoryRecord& rec);
+
+  bool query(const HistoryQuery& q, HistoryPage& out) const;
+  bool read(unsigned long long id, HistoryRecord& out) const;
+  unsigned long long last_id() const;
+
+ private:
+  struct IndexEntry {
+    uint64_t offset;
+    int64_t recorded_ms;
+    uint64_t peer_hash;
+    uint32_t length;
+    uint32_t reserved;
+  };
+
+  bool read_at(const IndexEntry& e, HistoryRecord& out) const;
+  void add_entry_locked(const IndexEntry& e);
+
+  std::string dir_;
+  std::string data_path_;
+  std::string index_path_;
+  int data_fd_ = -1;
+  int index_fd_ = -1;
+  uint64_t data_size_ = 0;
+  bool index_short_ = false;  // an index write failed; later entries live only in memory
+
+  mutable std::mutex mu_;
+  std::vector<IndexEntry> entries_;
+  std::unordered_map<uint64_t, std::vector<uint32_t>> by_peer_;  // peer hash -> entry positions
+};
@@ -0,0 +1,254 @@
+#include "host_facts.h"
+#include "logger.h"
+
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <utility>
+
+struct HostFacts::Shared {
+  mutable std::mutex mu;
+  std::condition_variable cv;
+  std::shared_ptr<const HostFactsSnapshot> snapshot;
+  bool stop = false;
+  bool exited = false;
+  int wake_pipe[2] = {-1, -1};
+  int local_refresh_s = 60;
+  int external_refresh_s = 3600;
+
+  ~Shared() {
+    if (wake_pipe[0] >= 0) close(wake_pipe[0]);
+    if (wake_pipe[1] >= 0) close(wake_pipe[1]);
+  }
+
+  bool stopping() const {
+    std::lock_guard<std::mutex> lock(mu);
+    return stop;
+  }
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::string trim_copy(const std::string& s) {
+  size_t start = 0;
+  while (start < s.size() && std::isspace(static_cast<unsigned char>(s[start]))) ++start;
+  size_t end = s.size();
+  while (end > start && std::isspace(static_cast<unsigned char>(s[end - 1]))) --end;
+  return s.substr(start, end - start);
+}
+
+/** One HTTPS GET; returns trimmed first line (IPv4/IPv6 text). Empty on failure. */
+std::string curl_fetch_text_line(const std::string& url) {
+  FILE* p = popen(("curl -fsS --max-time 8 " + url + " 2>/dev/null").c_str(), "r");
+  if (!p) return "";
+  char buf[128];
+  std::string out;
+  if (fgets(buf, sizeof(buf), p)) out = trim_copy(std::string(buf));
+  pclose(p);
+  return out;
+}
+
+std::string fetch_external_ip() {
+  static const char* urls[] = {
+      "https://api.ipify.org",
+      "https://icanhazip.com",
+      "https://ifconfig.me/ip",
+  };
+  for (const char* url : urls) {
+    std::string out = curl_fetch_text_line(url);
+    if (!out.empty()) return out;
+  }
+  return "";
+}
+
+std::string get_hostname() {
+  char buf[256] = {};
+  if (gethostname(buf, sizeof(buf) - 1) == 0) return std::string(buf);
+  return "";
+}
+
+std::string get_local_ip_address() {
+  struct ifaddrs* ifaddr = nullptr;
+  if (getifaddrs(&ifaddr) == -1) return "";
+  std::string result;
+  for (struct ifaddrs* ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+    if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET) continue;
+    char host[NI_MAXHOST];
+    if (getnameinfo(ifa->ifa_addr, sizeof(struct sockaddr_in),
+                    host, NI_MAXHOST, nullptr, 0, NI_NUMERICHOST) != 0) continue;
+    std::string addr(host);
+    if (addr != "127.0.0.1") { result = addr; break; }
+  }
+  freeifaddrs(ifaddr);
+  return result;
+}
+
+// Netlink socket that becomes readable when an interface address is added or
+// removed; -1 where unsupported (the periodic refresh still runs).
+int open_address_watch() {
+#ifdef __linux__
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+  if (fd < 0) return -1;
+  struct sockaddr_nl addr = {};
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+#else
+  return -1;
+#endif
+}
+
+void drain_fd(int fd) {
+  char buf[4096];
+  while (read(fd, buf, sizeof(buf)) > 0) {
+  }
+}
+
+}  // namespace
+
+HostFacts::HostFacts(int local_refresh_s, int external_refresh_s) : shared_(std::make_shared<Shared>()) {
+  shared_->local_refresh_s = std::max(1, local_refresh_s);
+  shared_->external_refresh_s = std::max(1, external_refresh_s);
+  if (pipe(shared_->wake_pipe) == 0) {
+    for (int fd : shared_->wake_pipe) {
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+  }
+  // Local facts are cheap; have them from the start.
+  auto first = std::make_shared<HostFactsSnapshot>();
+  first->host_name = get_hostname();
+  first->host_ip = get_local_ip_address();
+  const char* preset = std::getenv("BEAGLE_EXTERNAL_IP");
+  first->host_ip_external = trim_copy(preset ? preset : "");
+  first->external_checked = !first->host_ip_external.empty();
+  shared_->snapshot = std::move(first);
+  thread_ = std::thread(&HostFacts::run, shared_);
+}
+
+HostFacts::~HostFacts() {
+  stop();
+}
+
+std::shared_ptr<const HostFactsSnapshot> HostFacts::snapshot() const {
+  std::lock_guard<std::mutex> lock(shared_->mu);
+  return shared_->snapshot;
+}
+
+void HostFacts::stop() {
+  if (!thread_.joinable()) return;
+  bool exited = false;
+  {
+    std::unique_lock<std::mutex> lock(shared_->mu);
+    shared_->stop = true;
+    if (shared_->wake_pipe[1] >= 0) {
+      ssize_t ignored = write(shared_->wake_pipe[1], "x", 1);
+      (void)ignored;
+    }
+    // curl can take up to 8s per URL; do not hold shutdown for it.
+    exited = shared_->cv.wait_for(lock, std::chrono::milliseconds(500), [this]() { return shared_->exited; });
+  }
+  if (exited) {
+    thread_.join();
+  } else {
+    thread_.detach();
+  }
+}
+
+void HostFacts::run(std::shared_ptr<Shared> shared) {
+  const int watch = open_address_watch();
+  const std::string preset = shared->snapshot->host_ip_external;
+  std::string host_name = shared->snapshot->host_name;
+  std::string host_ip = shared->snapshot->host_ip;
+  std::string host_ip_ext = preset;
+  bool ext_checked = !preset.empty();
+  bool warned = false;
+  Clock::time_point next_local = Clock::now() + std::chrono::seconds(shared->local_refresh_s);
+  Clock::time_point next_external = Clock::now();
+
+  auto publish = [&]() {
+    std::lock_guard<std::mutex> lock(shared->mu);
+    const HostFactsSnapshot& cur = *shared->snapshot;
+    if (cur.host_name == host_name && cur.host_ip == host_ip && cur.host_ip_external == host_ip_ext &&
+        cur.external_checked == ext_checked) {
+      return;
+    }
+    log_debug("[host-facts] hostName=" + host_name + " hostIp=" + host_ip + " hostIpExternal=" + host_ip_ext);
+    auto next = std::make_shared<HostFactsSnapshot>();
+    next->host_name = host_name;
+    next->host_ip = host_ip;
+    next->host_ip_external = host_ip_ext;
+    next->external_checked = ext_checked;
+    shared->snapshot = std::move(next);
+  };
+
+  while (!shared->stopping()) {
+    if (Clock::now() >= next_local) {
+      host_name = get_hostname();
+      host_ip = get_local_ip_address();
+      next_local = Clock::now() + std::chrono::seconds(shared->local_refresh_s);
+      publish();
+    }
+    if (preset.empty() && Clock::now() >= next_external) {
+      std::string ip = fetch_external_ip();
+      if (shared->stopping()) break;
+      ext_checked = true;
+      if (ip.empty()) {
+        if (!warned) {
+          log_warn("[host-facts] hostIpExternal empty: set BEAGLE_EXTERNAL_IP or allow outbound HTTPS "
+                   "(tried api.ipify.org, icanhazip.com, ifconfig.me/ip).");
+        }
+        warned = true;
+        next_external = Clock::now() + std::chrono::seconds(std::min(300, shared->external_refresh_s));
+      } else {
+        host_ip_ext = ip;
+        warned = false;
+        next_external = Clock::now() + std::chrono::seconds(shared->external_refresh_s);
+      }
+      publish();
+    }
+
+    Clock::time_point wake_at = preset.empty() ? std::min(next_local, next_external) : next_local;
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(wake_at - Clock::now()).count();
+    struct pollfd fds[2] = {{shared->wake_pipe[0], POLLIN, 0}, {watch, POLLIN, 0}};
+    int rc = poll(fds, watch >= 0 ? 2 : 1, static_cast<int>(std::max<long long>(0, wait)));
+    if (rc <= 0) continue;
+    if (fds[0].revents & POLLIN) continue;  // stop()
+    if (watch >= 0 && (fds[1].revents & POLLIN)) {
+      // Addresses change in bursts (DHCP renew, VPN up); settle, then look.
+      drain_fd(watch);
+      if (poll(fds, 1, 1000) > 0) continue;
+      drain_fd(watch);
+      log_debug("[host-facts] interface address changed, refreshing");
+      next_local = Clock::now();
+      next_external = Clock::now();
+    }
+  }
+
+  if (watch >= 0) close(watch);
+  std::lock_guard<std::mutex> lock(shared->mu);
+  shared->exited = true;
+  shared->cv.notify_all();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <thread>
+
+// Facts about this host that go into directory profiles. A snapshot is never
+// modified; each refresh publishes a new one.
+struct HostFactsSnapshot {
+  std::string host_name;
+  std::string host_ip;           // first non-loopback IPv4 address
+  std::string host_ip_external;  // WAN address; empty until a lookup succeeds
+  bool external_checked = false;  // first WAN lookup finished (or BEAGLE_EXTERNAL_IP set)
+};
+
+// Keeps a HostFactsSnapshot current on a background thread so request paths
+// never call getifaddrs() or wait on curl. Local facts are re-read every
+// local_refresh_s seconds and the external IP every external_refresh_s
+// (BEAGLE_EXTERNAL_IP pins it; a failed lookup retries after five minutes).
+// On Linux a netlink subscription refreshes both as soon as an interface
+// address changes.
+class HostFacts {
+ public:
+  explicit HostFacts(int local_refresh_s = 60, int external_refresh_s = 3600);
+  ~HostFacts();
+
+  HostFacts(const HostFacts&) = delete;
+  HostFacts& operator=(const HostFacts&) = delete;
+
+  // Latest snapshot; never null.
+  std::shared_ptr<const HostFactsSnapshot> snapshot() const;
+
+  // Stops the refresh thread. An external lookup in flight is given a moment
+  // and is otherwise left to finish on its own; idempotent.
+  void stop();
+
+ private:
+  struct Shared;
+  static void run(std::shared_ptr<Shared> shared);
+
+  std::shared_ptr<Shared> shared_;
+  std::thread thread_;
+};
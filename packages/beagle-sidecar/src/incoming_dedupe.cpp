@@ -0,0 +1,36 @@
+#include "incoming_dedupe.h"
+
+#include <sstream>
+
+namespace {
+
+static std::string dedupe_text_fragment(const std::string& text) {
+  if (text.size() <= 256) return text;
+  return text.substr(0, 192) + "...|" + std::to_string(text.size()) + "|..." + text.substr(text.size() - 48);
+}
+
+}  // namespace
+
+std::string build_incoming_signature(const BeagleIncomingMessage& incoming, bool offline) {
+  std::ostringstream sig;
+  sig << incoming.peer << "|"
+      << incoming.ts << "|"
+      << (offline ? 1 : 0) << "|"
+      << incoming.filename << "|"
+      << incoming.media_type << "|"
+      << incoming.size << "|"
+      << dedupe_text_fragment(incoming.text);
+  return sig.str();
+}
+
+bool IncomingSignatureWindow::remember(const std::string& signature) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto inserted = seen_.insert(signature);
+  if (!inserted.second) return false;
+  order_.push_back(signature);
+  while (order_.size() > capacity_) {
+    seen_.erase(order_.front());
+    order_.pop_front();
+  }
+  return true;
+}
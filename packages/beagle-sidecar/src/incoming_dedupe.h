@@ -0,0 +1,29 @@
+#pragma once
+
+#include "beagle_sdk.h"
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+// Identity of an inbound message for replay detection: peer, Carrier
+// timestamp, mode, file metadata and a bounded fragment of the text.
+std::string build_incoming_signature(const BeagleIncomingMessage& incoming, bool offline);
+
+// The most recent `capacity` signatures; Carrier replays offline messages, so
+// a signature seen again within the window is dropped.
+class IncomingSignatureWindow {
+ public:
+  explicit IncomingSignatureWindow(size_t capacity = 20000) : capacity_(capacity) {}
+
+  // False when signature is already in the window.
+  bool remember(const std::string& signature);
+
+ private:
+  size_t capacity_;
+  std::mutex mu_;
+  std::unordered_set<std::string> seen_;
+  std::deque<std::string> order_;
+};
@@ -0,0 +1,129 @@
+#include "latency.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+
+namespace {
+
+// Log-linear buckets: exact below 16us, then 16 sub-buckets per power of two
+// (about 6% resolution) up to ~2^40us.
+constexpr int kLinear = 16;
+constexpr int kSubBits = 4;
+constexpr int kMaxExponent = 40;
+constexpr int kBuckets = kLinear + (kMaxExponent - 4 + 1) * (1 << kSubBits);
+
+const char* const kStageNames[] = {
+    "in.carrier_to_callback",
+    "in.callback_to_decoded",
+    "in.decoded_to_enqueued",
+    "in.enqueued_to_drained",
+    "in.total",
+    "out.request_to_send",
+    "out.send_call",
+    "out.send_to_receipt",
+    "out.total",
+};
+static_assert(sizeof(kStageNames) / sizeof(kStageNames[0]) == static_cast<size_t>(LatencyStage::Count),
+              "every latency stage needs a name");
+
+struct Histogram {
+  std::array<std::atomic<unsigned long long>, kBuckets> buckets{};
+  std::atomic<unsigned long long> sum{0};
+  std::atomic<unsigned long long> max{0};
+};
+
+std::array<Histogram, static_cast<size_t>(LatencyStage::Count)> g_histograms;
+thread_local long long t_request_start_us = 0;
+
+static int bucket_of(unsigned long long v) {
+  if (v < static_cast<unsigned long long>(kLinear)) return static_cast<int>(v);
+  int e = 63 - __builtin_clzll(v);
+  if (e > kMaxExponent) return kBuckets - 1;
+  int sub = static_cast<int>((v >> (e - kSubBits)) & ((1 << kSubBits) - 1));
+  return kLinear + (e - 4) * (1 << kSubBits) + sub;
+}
+
+// Upper edge of a bucket, reported as the percentile value.
+static unsigned long long bucket_upper(int b) {
+  if (b < kLinear) return static_cast<unsigned long long>(b);
+  int e = (b - kLinear) / (1 << kSubBits) + 4;
+  int sub = (b - kLinear) % (1 << kSubBits);
+  unsigned long long step = 1ULL << (e - kSubBits);
+  return (1ULL << e) + step * static_cast<unsigned long long>(sub + 1) - 1;
+}
+
+}  // namespace
+
+long long latency_now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void latency_record(LatencyStage stage, long long micros) {
+  if (micros < 0 || stage >= LatencyStage::Count) return;
+  Histogram& h = g_histograms[static_cast<size_t>(stage)];
+  unsigned long long v = static_cast<unsigned long long>(micros);
+  h.buckets[bucket_of(v)].fetch_add(1, std::memory_order_relaxed);
+  h.sum.fetch_add(v, std::memory_order_relaxed);
+  unsigned long long prev = h.max.load(std::memory_order_relaxed);
+  while (v > prev && !h.max.compare_exchange_weak(prev, v, std::memory_order_relaxed)) {
+  }
+}
+
+void latency_set_request_start(long long us) {
+  t_request_start_us = us;
+}
+
+long long latency_request_start() {
+  return t_request_start_us > 0 ? t_request_start_us : latency_now_us();
+}
+
+std::string latency_report_json() {
+  static const double kPercentiles[] = {0.5, 0.9, 0.99};
+  static const char* const kPercentileNames[] = {"p50", "p90", "p99"};
+  std::ostringstream oss;
+  oss << "{\"unit\":\"us\",\"stages\":{";
+  for (size_t s = 0; s < g_histograms.size(); ++s) {
+    const Histogram& h = g_histograms[s];
+    std::array<unsigned long long, kBuckets> counts;
+    unsigned long long total = 0;
+    for (int b = 0; b < kBuckets; ++b) {
+      counts[b] = h.buckets[b].load(std::memory_order_relaxed);
+      total += counts[b];
+    }
+    unsigned long long max = h.max.load(std::memory_order_relaxed);
+    if (s) oss << ",";
+    oss << "\"" << kStageNames[s] << "\":{\"count\":" << total
+        << ",\"mean\":" << (total ? h.sum.load(std::memory_order_relaxed) / total : 0);
+    for (size_t p = 0; p < 3; ++p) {
+      unsigned long long value = 0;
+      if (total) {
+        unsigned long long rank = static_cast<unsigned long long>(kPercentiles[p] * static_cast<double>(total));
+        if (rank >= total) rank = total - 1;
+        unsigned long long seen = 0;
+        for (int b = 0; b < kBuckets; ++b) {
+          seen += counts[b];
+          if (seen > rank) {
+            value = bucket_upper(b);
+            break;
+          }
+        }
+        if (value > max) value = max;
+      }
+      oss << ",\"" << kPercentileNames[p] << "\":" << value;
+    }
+    oss << ",\"max\":" << max << "}";
+  }
+  oss << "}}";
+  return oss.str();
+}
+
+void latency_reset() {
+  for (auto& h : g_histograms) {
+    for (auto& b : h.buckets) b.store(0, std::memory_order_relaxed);
+    h.sum.store(0, std::memory_order_relaxed);
+    h.max.store(0, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+// Pipeline stages timed for /debug/latency. Inbound stages follow one message
+// from Carrier to the /events poll; outbound ones follow a send request to the
+// Carrier receipt.
+enum class LatencyStage {
+  InCarrierToCallback,  // Carrier message timestamp -> friend_message_callback (online messages only)
+  InCallbackToDecoded,  // callback entry -> payload/media decoded
+  InDecodedToEnqueued,  // decoded -> push_event queued it for /events
+  InEnqueuedToDrained,  // queued -> drained by an /events poll
+  InTotal,              // callback entry -> drained
+  OutRequestToSend,     // HTTP request read -> carrier_send_friend_message called (includes outbox wait)
+  OutSendCall,          // time spent inside carrier_send_friend_message
+  OutSendToReceipt,     // send call -> receipt callback (text sends)
+  OutTotal,             // HTTP request read -> receipt callback
+  Count
+};
+
+// Monotonic clock in microseconds.
+long long latency_now_us();
+// Adds one sample (negative samples are ignored).
+void latency_record(LatencyStage stage, long long micros);
+// Start of the HTTP request being handled on this thread; sends capture it so
+// queued entries keep their original start. Falls back to now when unset.
+void latency_set_request_start(long long us);
+long long latency_request_start();
+// {"unit":"us","stages":{"in.total":{"count":..,"p50":..,...},...}}
+std::string latency_report_json();
+void latency_reset();
@@ -0,0 +1,336 @@
+#include "logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t kRingSlots = 8192;  // power of two
+constexpr size_t kSiteSlots = 1024;
+constexpr int kFlushIntervalMs = 20;
+
+struct LogRecord {
+  LogLevel level = LogLevel::Info;
+  long long ts_ms = 0;
+  unsigned int suppressed = 0;
+  std::string msg;
+};
+
+struct Slot {
+  std::atomic<size_t> seq{0};
+  LogRecord rec;
+};
+
+static const char* level_name(LogLevel level) {
+  switch (level) {
+    case LogLevel::Debug:
+      return "debug";
+    case LogLevel::Info:
+      return "info";
+    case LogLevel::Warn:
+      return "warn";
+    case LogLevel::Error:
+      return "error";
+  }
+  return "info";
+}
+
+static void append_json_escaped(std::string& out, const std::string& in) {
+  for (unsigned char c : in) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (c < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out += buf;
+        } else {
+          out += static_cast<char>(c);
+        }
+    }
+  }
+}
+
+class Logger {
+ public:
+  Logger() : ring_(kRingSlots), sites_(kSiteSlots) {
+    for (size_t i = 0; i < kRingSlots; ++i) ring_[i].seq.store(i, std::memory_order_relaxed);
+    for (auto& s : sites_) s.store(0, std::memory_order_relaxed);
+    LogOptions opts;
+    const char* level = std::getenv("BEAGLE_LOG_LEVEL");
+    if (level) parse_log_level(level, opts.level);
+    const char* format = std::getenv("BEAGLE_LOG_FORMAT");
+    if (format && std::strcmp(format, "json") == 0) opts.json = true;
+    const char* rate = std::getenv("BEAGLE_LOG_RATE_LIMIT");
+    if (rate && *rate) opts.rate_limit_per_second = std::atoi(rate);
+    configure(opts);
+    thread_ = std::thread([this]() { run(); });
+    thread_.detach();
+  }
+
+  void configure(const LogOptions& opts) {
+    level_.store(static_cast<int>(opts.level), std::memory_order_relaxed);
+    json_.store(opts.json, std::memory_order_relaxed);
+    rate_limit_.store(opts.rate_limit_per_second < 0 ? 0 : opts.rate_limit_per_second, std::memory_order_relaxed);
+  }
+
+  LogOptions options() const {
+    LogOptions opts;
+    opts.level = static_cast<LogLevel>(level_.load(std::memory_order_relaxed));
+    opts.json = json_.load(std::memory_order_relaxed);
+    opts.rate_limit_per_second = rate_limit_.load(std::memory_order_relaxed);
+    return opts;
+  }
+
+  bool enabled(LogLevel level) const {
+    return static_cast<int>(level) >= level_.load(std::memory_order_relaxed);
+  }
+
+  void write(LogLevel level, const char* file, int line, std::string msg) {
+    if (!enabled(level)) return;
+    long long now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    unsigned int suppressed = 0;
+    if (level != LogLevel::Error && !admit(file, line, now_ms / 1000, suppressed)) return;
+
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    for (;;) {
+      slot = &ring_[pos & (kRingSlots - 1)];
+      size_t seq = slot->seq.load(std::memory_order_acquire);
+      long diff = static_cast<long>(seq) - static_cast<long>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    slot->rec.level = level;
+    slot->rec.ts_ms = now_ms;
+    slot->rec.suppressed = suppressed;
+    slot->rec.msg = std::move(msg);
+    slot->seq.store(pos + 1, std::memory_order_release);
+  }
+
+  void flush() {
+    size_t target = tail_.load(std::memory_order_acquire);
+    for (int i = 0; i < 1000 && written_.load(std::memory_order_acquire) < target; ++i) {
+      cv_.notify_one();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+ private:
+  // Per-site fixed window: the slot packs the window second (high bits) and
+  // the number of lines seen in it (low 20 bits). Colliding sites share a slot.
+  bool admit(const char* file, int line, long long sec, unsigned int& suppressed) {
+    int limit = rate_limit_.load(std::memory_order_relaxed);
+    if (limit <= 0) return true;
+    size_t h = std::hash<const void*>()(file) ^ (static_cast<size_t>(line) * 2654435761u);
+    std::atomic<unsigned long long>& site = sites_[h & (kSiteSlots - 1)];
+    const unsigned long long window = static_cast<unsigned long long>(sec) << 20;
+    unsigned long long cur = site.load(std::memory_order_relaxed);
+    for (;;) {
+      if ((cur >> 20) != static_cast<unsigned long long>(sec)) {
+        if (site.compare_exchange_weak(cur, window | 1, std::memory_order_relaxed)) {
+          unsigned long long prev_count = cur & 0xFFFFF;
+          if (cur != 0 && prev_count > static_cast<unsigned long long>(limit)) {
+            suppressed = static_cast<unsigned int>(prev_count - limit);
+          }
+          return true;
+        }
+        continue;
+      }
+      if ((cur & 0xFFFFF) == 0xFFFFF) return false;
+      if (site.compare_exchange_weak(cur, cur + 1, std::memory_order_relaxed)) {
+        return (cur & 0xFFFFF) < static_cast<unsigned long long>(limit);
+      }
+    }
+  }
+
+  // Local-time "YYYY-MM-DD HH:MM:SS", formatted once per second.
+  const std::string& timestamp(long long sec) {
+    if (sec != cached_sec_) {
+      std::time_t t = static_cast<std::time_t>(sec);
+      std::tm tm_buf{};
+      localtime_r(&t, &tm_buf);
+      char out[32];
+      cached_ts_ = std::strftime(out, sizeof(out), "%Y-%m-%d %H:%M:%S", &tm_buf) ? out : "";
+      cached_sec_ = sec;
+    }
+    return cached_ts_;
+  }
+
+  void format(const LogRecord& rec, std::string& out) {
+    const std::string& ts = timestamp(rec.ts_ms / 1000);
+    if (json_.load(std::memory_order_relaxed)) {
+      char ms[8];
+      std::snprintf(ms, sizeof(ms), ".%03lld", rec.ts_ms % 1000);
+      out += "{\"ts\":\"";
+      out += ts;
+      out += ms;
+      out += "\",\"level\":\"";
+      out += level_name(rec.level);
+      out += "\"";
+      // "[module] text" -> module field
+      const std::string& m = rec.msg;
+      size_t body = 0;
+      if (!m.empty() && m[0] == '[') {
+        size_t close = m.find(']');
+        if (close != std::string::npos && close < 32) {
+          out += ",\"module\":\"";
+          append_json_escaped(out, m.substr(1, close - 1));
+          out += "\"";
+          body = close + 1;
+          if (body < m.size() && m[body] == ' ') body++;
+        }
+      }
+      out += ",\"msg\":\"";
+      append_json_escaped(out, m.substr(body));
+      out += "\"";
+      if (rec.suppressed) {
+        out += ",\"suppressed\":";
+        out += std::to_string(rec.suppressed);
+      }
+      out += "}\n";
+      return;
+    }
+    out += "[";
+    out += ts;
+    out += "] ";
+    if (rec.level == LogLevel::Warn || rec.level == LogLevel::Error || rec.level == LogLevel::Debug) {
+      out += level_name(rec.level);
+      out += ": ";
+    }
+    out += rec.msg;
+    if (rec.suppressed) {
+      out += " (suppressed ";
+      out += std::to_string(rec.suppressed);
+      out += " similar lines)";
+    }
+    out += "\n";
+  }
+
+  void run() {
+    std::string buf;
+    for (;;) {
+      buf.clear();
+      size_t n = 0;
+      for (;;) {
+        Slot& slot = ring_[head_ & (kRingSlots - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != head_ + 1) break;
+        format(slot.rec, buf);
+        slot.rec.msg.clear();
+        slot.rec.msg.shrink_to_fit();
+        slot.seq.store(head_ + kRingSlots, std::memory_order_release);
+        head_++;
+        if (++n >= 256) break;
+      }
+      unsigned long long dropped = dropped_.exchange(0, std::memory_order_relaxed);
+      if (dropped) {
+        LogRecord note;
+        note.level = LogLevel::Warn;
+        note.ts_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        note.msg = "[log] dropped " + std::to_string(dropped) + " lines (queue full)";
+        format(note, buf);
+      }
+      if (!buf.empty()) {
+        std::fwrite(buf.data(), 1, buf.size(), stderr);
+        std::fflush(stderr);
+      }
+      written_.store(head_, std::memory_order_release);
+      if (n >= 256) continue;
+      std::unique_lock<std::mutex> lock(wake_mu_);
+      cv_.wait_for(lock, std::chrono::milliseconds(kFlushIntervalMs));
+    }
+  }
+
+  std::vector<Slot> ring_;
+  std::vector<std::atomic<unsigned long long>> sites_;
+  std::atomic<size_t> tail_{0};
+  size_t head_ = 0;  // flush thread only
+  std::atomic<size_t> written_{0};
+  std::atomic<unsigned long long> dropped_{0};
+  std::atomic<int> level_{static_cast<int>(LogLevel::Info)};
+  std::atomic<bool> json_{false};
+  std::atomic<int> rate_limit_{50};
+  long long cached_sec_ = -1;
+  std::string cached_ts_;
+  std::mutex wake_mu_;
+  std::condition_variable cv_;
+  std::thread thread_;
+};
+
+// Never destroyed: threads may still log while static destructors run.
+static Logger& logger() {
+  static Logger* instance = []() {
+    Logger* l = new Logger();
+    std::atexit([]() { log_flush(); });
+    return l;
+  }();
+  return *instance;
+}
+
+}  // namespace
+
+bool parse_log_level(const std::string& name, LogLevel& out) {
+  if (name == "debug") {
+    out = LogLevel::Debug;
+  } else if (name == "info") {
+    out = LogLevel::Info;
+  } else if (name == "warn" || name == "warning") {
+    out = LogLevel::Warn;
+  } else if (name == "error") {
+    out = LogLevel::Error;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void log_configure(const LogOptions& options) {
+  logger().configure(options);
+}
+
+LogOptions log_options() {
+  return logger().options();
+}
+
+bool log_enabled(LogLevel level) {
+  return logger().enabled(level);
+}
+
+void log_write(LogLevel level, const char* file, int line, std::string msg) {
+  logger().write(level, file, line, std::move(msg));
+}
+
+void log_flush() {
+  logger().flush();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+enum class LogLevel { Debug = 0, Info = 1, Warn = 2, Error = 3 };
+
+struct LogOptions {
+  LogLevel level = LogLevel::Info;
+  bool json = false;              // one JSON object per line instead of "[ts] msg"
+  int rate_limit_per_second = 50;  // lines per call site per second; 0 = unlimited
+};
+
+// Process-wide asynchronous logger. Lines go into a bounded lock-free ring and
+// are written to stderr by a dedicated flush thread, so callers never block on
+// I/O or locks; when the ring is full lines are dropped and counted.
+// Defaults come from BEAGLE_LOG_LEVEL (debug|info|warn|error),
+// BEAGLE_LOG_FORMAT (text|json) and BEAGLE_LOG_RATE_LIMIT.
+void log_configure(const LogOptions& options);
+LogOptions log_options();
+bool log_enabled(LogLevel level);
+bool parse_log_level(const std::string& name, LogLevel& out);
+void log_write(LogLevel level, const char* file, int line, std::string msg);
+// Waits (up to about a second) until everything queued so far is written.
+void log_flush();
+
+// Call sites are identified by file/line for rate limiting.
+inline void log_debug(std::string msg, const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+  if (log_enabled(LogLevel::Debug)) log_write(LogLevel::Debug, file, line, std::move(msg));
+}
+inline void log_line(std::string msg, const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+  log_write(LogLevel::Info, file, line, std::move(msg));
+}
+inline void log_warn(std::string msg, const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+  log_write(LogLevel::Warn, file, line, std::move(msg));
+}
+inline void log_error(std::string msg, const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+  log_write(LogLevel::Error, file, line, std::move(msg));
+}
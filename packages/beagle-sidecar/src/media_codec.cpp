@@ -0,0 +1,435 @@
+#include "media_codec.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+static int b64_value(unsigned char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+static std::string trim_data_url_prefix(const std::string& data) {
+  size_t comma = data.find(',');
+  if (comma == std::string::npos) return data;
+  std::string prefix = lowercase(data.substr(0, comma));
+  if (prefix.find("base64") != std::string::npos) return data.substr(comma + 1);
+  return data;
+}
+
+static bool has_file_extension(const std::string& filename) {
+  size_t slash = filename.find_last_of("/\\");
+  size_t dot = filename.find_last_of('.');
+  return dot != std::string::npos && (slash == std::string::npos || dot > slash + 1);
+}
+
+}  // namespace
+
+std::string sanitize_filename(const std::string& name) {
+  std::string out;
+  out.reserve(name.size());
+  for (char c : name) {
+    if (c == '/' || c == '\\' || c == '\0') {
+      out.push_back('_');
+    } else {
+      out.push_back(c);
+    }
+  }
+  if (out.empty()) return "file.bin";
+  return out;
+}
+
+std::string lowercase(std::string s) {
+  for (char& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  return s;
+}
+
+std::string infer_media_type_from_filename(const std::string& filename) {
+  std::string lower = lowercase(filename);
+  if (lower.size() >= 4 && lower.rfind(".jpg") == lower.size() - 4) return "image/jpeg";
+  if (lower.size() >= 5 && lower.rfind(".jpeg") == lower.size() - 5) return "image/jpeg";
+  if (lower.size() >= 4 && lower.rfind(".png") == lower.size() - 4) return "image/png";
+  if (lower.size() >= 4 && lower.rfind(".gif") == lower.size() - 4) return "image/gif";
+  if (lower.size() >= 5 && lower.rfind(".webp") == lower.size() - 5) return "image/webp";
+  if (lower.size() >= 4 && lower.rfind(".mp4") == lower.size() - 4) return "video/mp4";
+  if (lower.size() >= 4 && lower.rfind(".mp3") == lower.size() - 4) return "audio/mpeg";
+  if (lower.size() >= 4 && lower.rfind(".wav") == lower.size() - 4) return "audio/wav";
+  if (lower.size() >= 4 && lower.rfind(".pdf") == lower.size() - 4) return "application/pdf";
+  return "application/octet-stream";
+}
+
+std::string json_quote(const std::string& in) {
+  std::string out;
+  out.reserve(in.size() + 2);
+  out.push_back('"');
+  for (char c : in) {
+    switch (c) {
+      case '\\': out += "\\\\"; break;
+      case '"': out += "\\\""; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[7];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+          out += buf;
+        } else {
+          out.push_back(c);
+        }
+    }
+  }
+  out.push_back('"');
+  return out;
+}
+
+bool parse_json_string_field(const std::string& json,
+                             const std::string& key,
+                             std::string& value) {
+  std::string marker = "\"" + key + "\"";
+  size_t pos = json.find(marker);
+  if (pos == std::string::npos) return false;
+  pos = json.find(':', pos + marker.size());
+  if (pos == std::string::npos) return false;
+  while (++pos < json.size() && std::isspace(static_cast<unsigned char>(json[pos]))) {}
+  if (pos >= json.size() || json[pos] != '"') return false;
+
+  std::string out;
+  bool escaped = false;
+  for (++pos; pos < json.size(); ++pos) {
+    char c = json[pos];
+    if (escaped) {
+      switch (c) {
+        case '"': out.push_back('"'); break;
+        case '\\': out.push_back('\\'); break;
+        case '/': out.push_back('/'); break;
+        case 'b': out.push_back('\b'); break;
+        case 'f': out.push_back('\f'); break;
+        case 'n': out.push_back('\n'); break;
+        case 'r': out.push_back('\r'); break;
+        case 't': out.push_back('\t'); break;
+        case 'u': {
+          if (pos + 4 >= json.size()) return false;
+          int code = 0;
+          for (int k = 1; k <= 4; ++k) {
+            char h = json[pos + k];
+            code <<= 4;
+            if (h >= '0' && h <= '9') code |= (h - '0');
+            else if (h >= 'a' && h <= 'f') code |= (h - 'a' + 10);
+            else if (h >= 'A' && h <= 'F') code |= (h - 'A' + 10);
+            else return false;
+          }
+          pos += 4;
+          if (code <= 0x7F) {
+            out.push_back(static_cast<char>(code));
+          } else if (code <= 0x7FF) {
+            out.push_back(static_cast<char>(0xC0 | ((code >> 6) & 0x1F)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+          } else {
+            out.push_back(static_cast<char>(0xE0 | ((code >> 12) & 0x0F)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+          }
+          break;
+        }
+        default: out.push_back(c); break;
+      }
+      escaped = false;
+      continue;
+    }
+    if (c == '\\') {
+      escaped = true;
+      continue;
+    }
+    if (c == '"') {
+      value = out;
+      return true;
+    }
+    out.push_back(c);
+  }
+  return false;
+}
+
+bool parse_json_u64_field(const std::string& json,
+                          const std::string& key,
+                          uint64_t& value) {
+  std::string marker = "\"" + key + "\"";
+  size_t pos = json.find(marker);
+  if (pos == std::string::npos) return false;
+  pos = json.find(':', pos + marker.size());
+  if (pos == std::string::npos) return false;
+  while (++pos < json.size() && std::isspace(static_cast<unsigned char>(json[pos]))) {}
+  if (pos >= json.size() || !std::isdigit(static_cast<unsigned char>(json[pos]))) return false;
+  uint64_t out = 0;
+  for (; pos < json.size() && std::isdigit(static_cast<unsigned char>(json[pos])); ++pos) {
+    out = out * 10 + static_cast<uint64_t>(json[pos] - '0');
+  }
+  value = out;
+  return true;
+}
+
+bool base64_decode(const std::string& in, std::vector<unsigned char>& out) {
+  out.clear();
+  out.reserve((in.size() * 3) / 4);
+  int val = 0;
+  int valb = -8;
+  for (unsigned char c : in) {
+    if (std::isspace(c)) continue;
+    if (c == '=') break;
+    int d = b64_value(c);
+    if (d < 0) return false;
+    val = (val << 6) + d;
+    valb += 6;
+    if (valb >= 0) {
+      out.push_back(static_cast<unsigned char>((val >> valb) & 0xFF));
+      valb -= 8;
+    }
+  }
+  return !out.empty();
+}
+
+bool decode_inline_json_media_payload(const void* msg, size_t len, InlineJsonMedia& out) {
+  if (!msg || len < 8 || len > (kMaxBeaglechatFileBytes * 2)) return false;
+  std::string body(static_cast<const char*>(msg), len);
+  while (!body.empty() && (body.back() == '\0' || std::isspace(static_cast<unsigned char>(body.back())))) {
+    body.pop_back();
+  }
+  size_t start = 0;
+  while (start < body.size() && std::isspace(static_cast<unsigned char>(body[start]))) start++;
+  if (start > 0) body.erase(0, start);
+  if (body.empty() || body.front() != '{' || body.back() != '}') return false;
+
+  std::string type;
+  if (!parse_json_string_field(body, "type", type)) return false;
+  type = lowercase(type);
+  if (type != "image" &&
+      type != "file" &&
+      type != "audio" &&
+      type != "text" &&
+      type != "unknown") return false;
+
+  std::string data;
+  if (!parse_json_string_field(body, "data", data) || data.empty()) return false;
+
+  std::string filename;
+  parse_json_string_field(body, "fileName", filename);
+  if (filename.empty()) parse_json_string_field(body, "filename", filename);
+  std::string ext;
+  parse_json_string_field(body, "fileExtension", ext);
+  if (!ext.empty() && ext[0] != '.') ext = "." + ext;
+  if (!filename.empty() && !ext.empty() && !has_file_extension(filename)) filename += ext;
+  if (filename.empty()) {
+    filename = (type == "image" ? "image" : "file");
+    if (!ext.empty()) filename += ext;
+  }
+  filename = sanitize_filename(filename);
+
+  std::string media_type;
+  if (!parse_json_string_field(body, "mediaType", media_type) || media_type.empty()) {
+    media_type = infer_media_type_from_filename(filename);
+  }
+
+  std::vector<unsigned char> decoded;
+  std::string b64 = trim_data_url_prefix(data);
+  if (!base64_decode(b64, decoded)) return false;
+  if (decoded.size() > kMaxBeaglechatFileBytes) return false;
+
+  out.filename = filename;
+  out.media_type = media_type;
+  out.bytes.swap(decoded);
+  return true;
+}
+
+bool is_swift_filemodel_json_payload(const void* msg, size_t len) {
+  if (!msg || len < 8 || len > (kMaxBeaglechatFileBytes * 2)) return false;
+  std::string body(static_cast<const char*>(msg), len);
+  while (!body.empty() && (body.back() == '\0' || std::isspace(static_cast<unsigned char>(body.back())))) {
+    body.pop_back();
+  }
+  size_t start = 0;
+  while (start < body.size() && std::isspace(static_cast<unsigned char>(body[start]))) start++;
+  if (start > 0) body.erase(0, start);
+  if (body.empty() || body.front() != '{' || body.back() != '}') return false;
+  std::string file_name;
+  std::string file_extension;
+  std::string data_b64;
+  if (!parse_json_string_field(body, "fileName", file_name) || file_name.empty()) return false;
+  if (!parse_json_string_field(body, "fileExtension", file_extension) || file_extension.empty()) return false;
+  if (!parse_json_string_field(body, "data", data_b64) || data_b64.empty()) return false;
+  if (data_b64.find("base64,") != std::string::npos) return false;
+  return true;
+}
+
+bool decode_beaglechat_file_payload(const void* msg, size_t len, PackedFilePayload& out) {
+  if (!msg || len < 5) return false;
+  const unsigned char* p = static_cast<const unsigned char*>(msg);
+  uint32_t meta_len = (static_cast<uint32_t>(p[0]) << 24)
+                    | (static_cast<uint32_t>(p[1]) << 16)
+                    | (static_cast<uint32_t>(p[2]) << 8)
+                    | static_cast<uint32_t>(p[3]);
+  if (meta_len == 0 || meta_len > 4096) return false;
+  if (static_cast<size_t>(meta_len) + 4 > len) return false;
+
+  std::string meta(reinterpret_cast<const char*>(p + 4), meta_len);
+  std::string type;
+  if (!parse_json_string_field(meta, "type", type) || type != "file") return false;
+
+  std::string filename;
+  if (!parse_json_string_field(meta, "filename", filename) || filename.empty()) return false;
+
+  std::string content_type;
+  if (!parse_json_string_field(meta, "contentType", content_type) || content_type.empty()) {
+    content_type = infer_media_type_from_filename(filename);
+  }
+
+  uint64_t declared_size = 0;
+  parse_json_u64_field(meta, "size", declared_size);
+
+  out.filename = sanitize_filename(filename);
+  out.content_type = content_type;
+  out.declared_size = declared_size;
+  out.bytes = p + 4 + meta_len;
+  out.bytes_len = len - 4 - meta_len;
+  return true;
+}
+
+bool encode_beaglechat_file_payload(const std::string& filename,
+                                    const std::string& content_type,
+                                    const std::vector<unsigned char>& data,
+                                    std::vector<unsigned char>& out) {
+  std::ostringstream meta;
+  meta << "{"
+       << "\"type\":\"file\","
+       << "\"filename\":" << json_quote(filename) << ","
+       << "\"contentType\":" << json_quote(content_type.empty() ? "application/octet-stream" : content_type) << ","
+       << "\"size\":" << data.size()
+       << "}";
+  std::string meta_json = meta.str();
+  if (meta_json.empty() || meta_json.size() > 4096) return false;
+
+  uint32_t meta_len = static_cast<uint32_t>(meta_json.size());
+  out.resize(4 + meta_len + data.size());
+  out[0] = static_cast<unsigned char>((meta_len >> 24) & 0xFF);
+  out[1] = static_cast<unsigned char>((meta_len >> 16) & 0xFF);
+  out[2] = static_cast<unsigned char>((meta_len >> 8) & 0xFF);
+  out[3] = static_cast<unsigned char>(meta_len & 0xFF);
+  std::memcpy(out.data() + 4, meta_json.data(), meta_json.size());
+  if (!data.empty()) std::memcpy(out.data() + 4 + meta_json.size(), data.data(), data.size());
+  return true;
+}
+
+std::string base64_encode_bytes(const std::vector<unsigned char>& data) {
+  static const char* kTable =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve(((data.size() + 2) / 3) * 4);
+  size_t i = 0;
+  while (i + 3 <= data.size()) {
+    uint32_t n = (static_cast<uint32_t>(data[i]) << 16)
+               | (static_cast<uint32_t>(data[i + 1]) << 8)
+               | static_cast<uint32_t>(data[i + 2]);
+    out.push_back(kTable[(n >> 18) & 0x3F]);
+    out.push_back(kTable[(n >> 12) & 0x3F]);
+    out.push_back(kTable[(n >> 6) & 0x3F]);
+    out.push_back(kTable[n & 0x3F]);
+    i += 3;
+  }
+  size_t rem = data.size() - i;
+  if (rem == 1) {
+    uint32_t n = static_cast<uint32_t>(data[i]) << 16;
+    out.push_back(kTable[(n >> 18) & 0x3F]);
+    out.push_back(kTable[(n >> 12) & 0x3F]);
+    out.push_back('=');
+    out.push_back('=');
+  } else if (rem == 2) {
+    uint32_t n = (static_cast<uint32_t>(data[i]) << 16)
+               | (static_cast<uint32_t>(data[i + 1]) << 8);
+    out.push_back(kTable[(n >> 18) & 0x3F]);
+    out.push_back(kTable[(n >> 12) & 0x3F]);
+    out.push_back(kTable[(n >> 6) & 0x3F]);
+    out.push_back('=');
+  }
+  return out;
+}
+
+bool encode_inline_json_media_payload(const std::string& filename,
+                                      const std::string& media_type,
+                                      const std::vector<unsigned char>& data,
+                                      std::string& out) {
+  if (filename.empty() || data.empty()) return false;
+  std::string mt = media_type.empty() ? infer_media_type_from_filename(filename) : media_type;
+  std::string type = lowercase(mt).rfind("image/", 0) == 0 ? "image" : "file";
+  std::string ext;
+  size_t dot = filename.find_last_of('.');
+  if (dot != std::string::npos && dot + 1 < filename.size()) {
+    ext = filename.substr(dot + 1);
+  }
+  std::string b64 = base64_encode_bytes(data);
+  if (b64.empty()) return false;
+  std::string data_url = "data:" + mt + ";base64," + b64;
+
+  std::ostringstream json;
+  json << "{"
+       << "\"type\":" << json_quote(type) << ","
+       << "\"fileName\":" << json_quote(filename) << ","
+       << "\"filename\":" << json_quote(filename) << ","
+       << "\"fileExtension\":" << json_quote(ext) << ","
+       << "\"mediaType\":" << json_quote(mt) << ","
+       << "\"data\":" << json_quote(data_url)
+       << "}";
+  out = json.str();
+  return !out.empty();
+}
+
+bool encode_swift_filemodel_media_payload(const std::string& filename,
+                                          const std::string& media_type,
+                                          const std::vector<unsigned char>& data,
+                                          std::string& out) {
+  if (filename.empty() || data.empty()) return false;
+  std::string stem = filename;
+  std::string ext = ".bin";
+  size_t dot = filename.find_last_of('.');
+  if (dot != std::string::npos && dot > 0 && dot + 1 < filename.size()) {
+    stem = filename.substr(0, dot);
+    ext = filename.substr(dot);
+  }
+  if (stem.empty()) stem = "file";
+  if (ext.empty() || ext[0] != '.') ext = "." + ext;
+  std::string mt = lowercase(media_type.empty() ? infer_media_type_from_filename(filename) : media_type);
+  std::string type = "unknown";
+  if (mt.rfind("image/", 0) == 0) type = "image";
+  else if (mt.rfind("audio/", 0) == 0) type = "audio";
+  else if (mt.rfind("text/", 0) == 0) type = "text";
+  std::string b64 = base64_encode_bytes(data);
+  if (b64.empty()) return false;
+
+  std::ostringstream json;
+  json << "{"
+       << "\"fileName\":" << json_quote(stem) << ","
+       << "\"fileExtension\":" << json_quote(ext) << ","
+       << "\"data\":" << json_quote(b64) << ","
+       << "\"type\":" << json_quote(type)
+       << "}";
+  out = json.str();
+  return !out.empty();
+}
+
+bool encode_legacy_inline_data_payload(const std::vector<unsigned char>& data,
+                                       std::string& out) {
+  if (data.empty()) return false;
+  std::string b64 = base64_encode_bytes(data);
+  if (b64.empty()) return false;
+  std::ostringstream json;
+  json << "{"
+       << "\"data\":" << json_quote(b64)
+       << "}";
+  out = json.str();
+  return !out.empty();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Wire formats Beagle Chat clients use for files sent as friend messages,
+// plus the small JSON/base64 helpers they are built on. Kept free of Carrier
+// types so the codecs can be benchmarked against the stub build.
+
+constexpr size_t kMaxBeaglechatFileBytes = 5 * 1024 * 1024;
+
+// Packed file message: big-endian u32 metadata length, JSON metadata, raw bytes.
+// bytes points into the decoded message.
+struct PackedFilePayload {
+  std::string filename;
+  std::string content_type;
+  uint64_t declared_size = 0;
+  const unsigned char* bytes = nullptr;
+  size_t bytes_len = 0;
+};
+
+// JSON message carrying a base64 (or data URL) file in "data".
+struct InlineJsonMedia {
+  std::string filename;
+  std::string media_type;
+  std::vector<unsigned char> bytes;
+};
+
+std::string sanitize_filename(const std::string& name);
+std::string lowercase(std::string s);
+std::string infer_media_type_from_filename(const std::string& filename);
+std::string json_quote(const std::string& in);
+bool parse_json_string_field(const std::string& json,
+                             const std::string& key,
+                             std::string& value);
+bool parse_json_u64_field(const std::string& json,
+                          const std::string& key,
+                          uint64_t& value);
+
+bool base64_decode(const std::string& in, std::vector<unsigned char>& out);
+std::string base64_encode_bytes(const std::vector<unsigned char>& data);
+
+bool decode_inline_json_media_payload(const void* msg, size_t len, InlineJsonMedia& out);
+bool is_swift_filemodel_json_payload(const void* msg, size_t len);
+bool decode_beaglechat_file_payload(const void* msg, size_t len, PackedFilePayload& out);
+
+bool encode_beaglechat_file_payload(const std::string& filename,
+                                    const std::string& content_type,
+                                    const std::vector<unsigned char>& data,
+                                    std::vector<unsigned char>& out);
+bool encode_inline_json_media_payload(const std::string& filename,
+                                      const std::string& media_type,
+                                      const std::vector<unsigned char>& data,
+                                      std::string& out);
+bool encode_swift_filemodel_media_payload(const std::string& filename,
+                                          const std::string& media_type,
+                                          const std::vector<unsigned char>& data,
+                                          std::string& out);
+bool encode_legacy_inline_data_payload(const std::vector<unsigned char>& data,
+                                       std::string& out);
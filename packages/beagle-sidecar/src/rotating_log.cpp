@@ -0,0 +1,288 @@
+#include "rotating_log.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if BEAGLE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+constexpr size_t kFlushThresholdBytes = 256 * 1024;
+constexpr size_t kMaxBufferedBytes = 8 * 1024 * 1024;
+
+static std::string dirname_of(const std::string& path) {
+  size_t slash = path.rfind('/');
+  if (slash == std::string::npos) return ".";
+  if (slash == 0) return "/";
+  return path.substr(0, slash);
+}
+
+static std::string basename_of(const std::string& path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static bool path_exists(const std::string& path) {
+  struct stat st{};
+  return ::stat(path.c_str(), &st) == 0;
+}
+
+static bool ends_with(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Rotated segments of path: `<name>.<YYYYmmdd-HHMMSS>[-N][.gz]`, oldest first.
+static std::vector<std::string> list_segments(const std::string& path) {
+  std::vector<std::string> out;
+  std::string dir = dirname_of(path);
+  std::string prefix = basename_of(path) + ".";
+  DIR* d = opendir(dir.c_str());
+  if (!d) return out;
+  while (dirent* ent = readdir(d)) {
+    std::string name = ent->d_name;
+    if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) continue;
+    if (!std::isdigit(static_cast<unsigned char>(name[prefix.size()]))) continue;
+    if (ends_with(name, ".tmp")) continue;
+    out.push_back(dir + "/" + name);
+  }
+  closedir(d);
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+// The live file's mtime moves with every write, so its start time is kept
+// beside it as epoch seconds; 0 when missing or unreadable.
+static std::time_t read_start_time(const std::string& path) {
+  FILE* f = std::fopen(path.c_str(), "rb");
+  if (!f) return 0;
+  long long t = 0;
+  if (std::fscanf(f, "%lld", &t) != 1) t = 0;
+  std::fclose(f);
+  return static_cast<std::time_t>(t);
+}
+
+static void write_start_time(const std::string& path, std::time_t t) {
+  std::string tmp = path + ".tmp";
+  FILE* f = std::fopen(tmp.c_str(), "wb");
+  if (!f) return;
+  bool ok = std::fprintf(f, "%lld\n", static_cast<long long>(t)) > 0;
+  ok = std::fclose(f) == 0 && ok;
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) std::remove(tmp.c_str());
+}
+
+#if BEAGLE_HAVE_ZLIB
+// Gives up (and leaves src alone) as soon as cancel is set.
+static bool gzip_file(const std::string& src, const std::string& dst, const std::atomic<bool>& cancel) {
+  FILE* in = std::fopen(src.c_str(), "rb");
+  if (!in) return false;
+  std::string tmp = dst + ".tmp";
+  gzFile out = gzopen(tmp.c_str(), "wb6");
+  if (!out) {
+    std::fclose(in);
+    return false;
+  }
+  char buf[1 << 16];
+  bool ok = true;
+  size_t n = 0;
+  while (ok && !cancel && (n = std::fread(buf, 1, sizeof(buf), in)) > 0) {
+    ok = gzwrite(out, buf, static_cast<unsigned>(n)) == static_cast<int>(n);
+  }
+  ok = !std::ferror(in) && !cancel && ok;
+  std::fclose(in);
+  ok = gzclose(out) == Z_OK && ok;
+  if (!ok || std::rename(tmp.c_str(), dst.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+#endif
+
+}  // namespace
+
+RotatingLogWriter::RotatingLogWriter(const std::string& path, const RotationPolicy& policy, int flush_ms)
+    : path_(path), start_path_(path + ".start"), policy_(policy), flush_ms_(flush_ms > 0 ? flush_ms : 500) {
+  if (!compression_available()) policy_.compress = false;
+  // Segments left uncompressed by an earlier run are picked up on the first pass.
+  if (policy_.compress) {
+    for (const auto& seg : list_segments(path_)) {
+      if (!ends_with(seg, ".gz")) to_compress_.push_back(seg);
+    }
+    compress_thread_ = std::thread([this]() { compress_run(); });
+  }
+  thread_ = std::thread([this]() { run(); });
+}
+
+RotatingLogWriter::~RotatingLogWriter() {
+  stop();
+}
+
+bool RotatingLogWriter::compression_available() {
+#if BEAGLE_HAVE_ZLIB
+  return true;
+#else
+  return false;
+#endif
+}
+
+void RotatingLogWriter::append(const std::string& line) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (stop_) return;
+  if (buffer_.size() + line.size() + 1 > kMaxBufferedBytes) {
+    dropped_++;
+    return;
+  }
+  buffer_ += line;
+  buffer_ += '\n';
+  if (buffer_.size() >= kFlushThresholdBytes) cv_.notify_one();
+}
+
+void RotatingLogWriter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) thread_.join();
+  {
+    // A segment still being gzipped is abandoned and picked up by the next run.
+    std::lock_guard<std::mutex> lock(compress_mu_);
+    compress_stop_ = true;
+  }
+  compress_cv_.notify_one();
+  if (compress_thread_.joinable()) compress_thread_.join();
+}
+
+bool RotatingLogWriter::open_file() {
+  if (file_) return true;
+  file_ = std::fopen(path_.c_str(), "ab");
+  if (!file_) {
+    log_warn("[beagle-log] open failed path=" + path_);
+    return false;
+  }
+  struct stat st{};
+  file_bytes_ = ::fstat(fileno(file_), &st) == 0 && st.st_size > 0 ? static_cast<size_t>(st.st_size) : 0;
+  file_opened_ = file_bytes_ > 0 ? read_start_time(start_path_) : 0;
+  if (file_opened_ == 0) {
+    // A fresh file, or one from before start times were kept: its age counts from now.
+    file_opened_ = std::time(nullptr);
+    write_start_time(start_path_, file_opened_);
+  }
+  return true;
+}
+
+void RotatingLogWriter::write_out(const std::string& data) {
+  if (data.empty() || !open_file()) return;
+  if (std::fwrite(data.data(), 1, data.size(), file_) != data.size() || std::fflush(file_) != 0) {
+    log_warn("[beagle-log] write failed path=" + path_);
+    std::fclose(file_);
+    file_ = nullptr;
+    return;
+  }
+  file_bytes_ += data.size();
+}
+
+void RotatingLogWriter::rotate() {
+  if (file_) {
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+  std::time_t now = std::time(nullptr);
+  std::tm tm_buf{};
+  localtime_r(&now, &tm_buf);
+  char stamp[32];
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm_buf);
+  std::string target = path_ + "." + stamp;
+  for (int n = 1; path_exists(target) || path_exists(target + ".gz"); ++n) {
+    target = path_ + "." + stamp + "-" + std::to_string(n);
+  }
+  if (std::rename(path_.c_str(), target.c_str()) != 0) {
+    log_warn("[beagle-log] rotate failed path=" + path_);
+    return;
+  }
+  log_line("[beagle-log] rotated " + path_ + " -> " + target + " bytes=" + std::to_string(file_bytes_));
+  file_bytes_ = 0;
+  if (!policy_.compress) {
+    prune();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(compress_mu_);
+    to_compress_.push_back(target);
+  }
+  compress_cv_.notify_one();
+}
+
+void RotatingLogWriter::compress_run() {
+#ifdef __linux__
+  // Nice only this thread: a 64 MiB gzip must not compete with the flush thread.
+  ::setpriority(PRIO_PROCESS, static_cast<id_t>(::syscall(SYS_gettid)), 19);
+#endif
+  std::unique_lock<std::mutex> lock(compress_mu_);
+  while (true) {
+    compress_cv_.wait(lock, [this]() { return compress_stop_ || !to_compress_.empty(); });
+    if (compress_stop_) return;
+    std::string seg = to_compress_.back();
+    to_compress_.pop_back();
+    lock.unlock();
+#if BEAGLE_HAVE_ZLIB
+    if (gzip_file(seg, seg + ".gz", compress_stop_)) {
+      std::remove(seg.c_str());
+    } else if (!compress_stop_) {
+      log_warn("[beagle-log] compress failed path=" + seg);
+    }
+#endif
+    prune();
+    lock.lock();
+  }
+}
+
+void RotatingLogWriter::prune() {
+  if (policy_.keep_segments == 0) return;
+  std::vector<std::string> segs = list_segments(path_);
+  if (segs.size() <= policy_.keep_segments) return;
+  for (size_t i = 0; i + policy_.keep_segments < segs.size(); ++i) std::remove(segs[i].c_str());
+}
+
+void RotatingLogWriter::run() {
+  std::string pending;
+  bool stopping = false;
+  while (!stopping) {
+    unsigned long long dropped = 0;
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      cv_.wait_for(lock, std::chrono::milliseconds(flush_ms_), [this]() {
+        return stop_ || buffer_.size() >= kFlushThresholdBytes;
+      });
+      pending.swap(buffer_);
+      dropped = dropped_;
+      dropped_ = 0;
+      stopping = stop_;
+    }
+    if (dropped) log_warn("[beagle-log] buffer full, dropped lines=" + std::to_string(dropped) + " path=" + path_);
+    write_out(pending);
+    pending.clear();
+
+    bool too_big = policy_.max_bytes > 0 && file_bytes_ >= policy_.max_bytes;
+    bool too_old = policy_.max_age_seconds > 0 && file_bytes_ > 0
+        && std::time(nullptr) - file_opened_ >= policy_.max_age_seconds;
+    if (!stopping && (too_big || too_old)) rotate();
+  }
+  if (file_) {
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+}
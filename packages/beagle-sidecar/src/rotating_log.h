@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct RotationPolicy {
+  size_t max_bytes = 64 * 1024 * 1024;  // rotate once the file reaches this size (0 = never)
+  long max_age_seconds = 24 * 60 * 60;  // ...or once it is this old (0 = never)
+  size_t keep_segments = 14;            // rotated segments kept next to the live file
+  bool compress = true;                 // gzip rotated segments (needs zlib)
+};
+
+// Append-only line log with a long-lived handle. append() only copies the
+// line into a buffer; a background thread writes the buffer every flush_ms
+// (or sooner once it grows large) and rotates the file to `<path>.<timestamp>`
+// by size or age. A second, low-priority thread gzips rotated segments and
+// prunes the oldest ones. The live file's start time is kept in `<path>.start`.
+class RotatingLogWriter {
+ public:
+  RotatingLogWriter(const std::string& path, const RotationPolicy& policy, int flush_ms = 500);
+  ~RotatingLogWriter();
+
+  RotatingLogWriter(const RotatingLogWriter&) = delete;
+  RotatingLogWriter& operator=(const RotatingLogWriter&) = delete;
+
+  // Queues one line; a trailing newline is added.
+  void append(const std::string& line);
+
+  // Writes what is buffered and joins the thread; idempotent.
+  void stop();
+
+  static bool compression_available();
+
+ private:
+  void run();
+  void write_out(const std::string& data);
+  bool open_file();
+  void rotate();
+  void compress_run();
+  void prune();
+
+  std::string path_;
+  std::string start_path_;
+  RotationPolicy policy_;
+  int flush_ms_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::string buffer_;
+  bool stop_ = false;
+  unsigned long long dropped_ = 0;
+
+  // Flush thread only.
+  FILE* file_ = nullptr;
+  size_t file_bytes_ = 0;
+  std::time_t file_opened_ = 0;
+
+  std::thread thread_;
+
+  std::mutex compress_mu_;
+  std::condition_variable compress_cv_;
+  std::vector<std::string> to_compress_;
+  std::atomic<bool> compress_stop_{false};
+  std::thread compress_thread_;
+};
@@ -0,0 +1,653 @@
+#include "search_index.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+
+constexpr size_t kMaxTermBytes = 64;
+constexpr size_t kFlushDocs = 512;           // delta size that triggers a segment write
+constexpr long long kFlushAgeMs = 30 * 1000;  // ...or how long a small delta may wait
+constexpr size_t kMaxSegments = 8;
+constexpr double kBm25K1 = 1.2;
+constexpr double kBm25B = 0.75;
+
+struct SegmentHeader {
+  char magic[8];
+  uint32_t doc_count;
+  uint32_t term_count;
+  uint64_t posting_count;
+  uint64_t first_id;
+  uint64_t last_id;
+  uint64_t total_length;  // sum of doc lengths, for the BM25 average
+};
+
+struct SegmentDoc {
+  uint64_t id;
+  uint64_t peer_hash;
+  uint32_t length;  // terms in the doc
+  uint32_t reserved;
+};
+
+struct SegmentPosting {
+  uint32_t doc;  // index into the doc table
+  uint32_t tf;
+};
+
+struct SegmentTerm {
+  uint64_t posting_start;
+  uint32_t posting_count;
+  uint32_t heap_off;  // u8 length, then the term bytes
+};
+
+static_assert(sizeof(SegmentHeader) == 48, "search segment header must stay 48 bytes");
+static_assert(sizeof(SegmentDoc) == 24, "search segment docs must stay 24 bytes");
+static_assert(sizeof(SegmentPosting) == 8, "search segment postings must stay 8 bytes");
+static_assert(sizeof(SegmentTerm) == 16, "search segment terms must stay 16 bytes");
+
+static const char kSegmentMagic[8] = {'B', 'S', 'R', 'C', 'H', '1', '\0', '\0'};
+
+static uint64_t fnv1a64(const std::string& s) {
+  uint64_t h = 1469598103934665603ULL;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static long long now_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string segment_name(uint64_t first_id, uint64_t last_id) {
+  char buf[64];
+  std::snprintf(buf, sizeof(buf), "seg-%020llu-%020llu.idx",
+                static_cast<unsigned long long>(first_id), static_cast<unsigned long long>(last_id));
+  return buf;
+}
+
+static bool is_cjk(uint32_t cp) {
+  return (cp >= 0x3040 && cp <= 0x30FF)     // kana
+      || (cp >= 0x3400 && cp <= 0x9FFF)     // CJK ideographs
+      || (cp >= 0xAC00 && cp <= 0xD7AF)     // hangul
+      || (cp >= 0xF900 && cp <= 0xFAFF)
+      || (cp >= 0x20000 && cp <= 0x2FFFF);
+}
+
+// Decodes one UTF-8 sequence at s[i]; returns its length (1 for invalid bytes).
+static size_t utf8_next(const std::string& s, size_t i, uint32_t& cp) {
+  unsigned char c = static_cast<unsigned char>(s[i]);
+  size_t len = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+  if (len == 1 || i + len > s.size()) {
+    cp = c;
+    return 1;
+  }
+  cp = c & (0x3F >> (len - 1));
+  for (size_t k = 1; k < len; ++k) {
+    unsigned char cc = static_cast<unsigned char>(s[i + k]);
+    if ((cc & 0xC0) != 0x80) {
+      cp = c;
+      return 1;
+    }
+    cp = (cp << 6) | (cc & 0x3F);
+  }
+  return len;
+}
+
+// Streams a segment into `<path>.tmp`: header placeholder, docs, postings
+// term by term, then the dictionary and heap; publishes it with rename().
+class SegmentWriter {
+ public:
+  ~SegmentWriter() {
+    if (file_) {
+      std::fclose(file_);
+      std::remove(tmp_.c_str());
+    }
+  }
+
+  bool begin(const std::string& path, const std::vector<SegmentDoc>& docs, uint64_t total_length) {
+    path_ = path;
+    tmp_ = path + ".tmp";
+    file_ = std::fopen(tmp_.c_str(), "wb");
+    if (!file_) return false;
+    std::memset(&header_, 0, sizeof(header_));
+    std::memcpy(header_.magic, kSegmentMagic, sizeof(kSegmentMagic));
+    header_.doc_count = static_cast<uint32_t>(docs.size());
+    header_.first_id = docs.empty() ? 0 : docs.front().id;
+    header_.last_id = docs.empty() ? 0 : docs.back().id;
+    header_.total_length = total_length;
+    return write(&header_, sizeof(header_)) && write(docs.data(), docs.size() * sizeof(SegmentDoc));
+  }
+
+  bool add_term(const std::string& term, const std::vector<SegmentPosting>& postings) {
+    if (postings.empty() || heap_.size() > UINT32_MAX - 256) return true;
+    SegmentTerm t{header_.posting_count, static_cast<uint32_t>(postings.size()),
+                  static_cast<uint32_t>(heap_.size())};
+    heap_ += static_cast<char>(term.size());
+    heap_ += term;
+    terms_.push_back(t);
+    header_.posting_count += postings.size();
+    return write(postings.data(), postings.size() * sizeof(SegmentPosting));
+  }
+
+  bool finish() {
+    header_.term_count = static_cast<uint32_t>(terms_.size());
+    bool ok = write(terms_.data(), terms_.size() * sizeof(SegmentTerm))
+        && write(heap_.data(), heap_.size())
+        && std::fseek(file_, 0, SEEK_SET) == 0
+        && write(&header_, sizeof(header_))
+        && std::fflush(file_) == 0
+        && ::fsync(fileno(file_)) == 0;
+    ok = std::fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    if (!ok || std::rename(tmp_.c_str(), path_.c_str()) != 0) {
+      std::remove(tmp_.c_str());
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  bool write(const void* data, size_t len) {
+    return len == 0 || std::fwrite(data, 1, len, file_) == len;
+  }
+
+  std::string path_;
+  std::string tmp_;
+  FILE* file_ = nullptr;
+  SegmentHeader header_{};
+  std::vector<SegmentTerm> terms_;
+  std::string heap_;
+};
+
+}  // namespace
+
+// One mmap()ed segment file.
+class SearchSegment {
+ public:
+  ~SearchSegment() {
+    if (map_) ::munmap(map_, map_size_);
+  }
+
+  static std::shared_ptr<const SearchSegment> open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SegmentHeader)) {
+      ::close(fd);
+      return nullptr;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return nullptr;
+    std::shared_ptr<SearchSegment> out(new SearchSegment());
+    out->path_ = path;
+    out->map_ = map;
+    out->map_size_ = size;
+    std::memcpy(&out->header_, map, sizeof(SegmentHeader));
+    const SegmentHeader& h = out->header_;
+    uint64_t heap_off = sizeof(SegmentHeader) + uint64_t(h.doc_count) * sizeof(SegmentDoc)
+        + h.posting_count * sizeof(SegmentPosting) + uint64_t(h.term_count) * sizeof(SegmentTerm);
+    if (std::memcmp(h.magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0 || heap_off > size) return nullptr;
+    const char* base = static_cast<const char*>(map);
+    out->docs_ = base + sizeof(SegmentHeader);
+    out->postings_ = out->docs_ + uint64_t(h.doc_count) * sizeof(SegmentDoc);
+    out->terms_ = out->postings_ + h.posting_count * sizeof(SegmentPosting);
+    out->heap_ = base + heap_off;
+    out->heap_size_ = size - heap_off;
+    ::madvise(map, size, MADV_RANDOM);
+    return out;
+  }
+
+  const std::string& path() const { return path_; }
+  uint64_t first_id() const { return header_.first_id; }
+  uint64_t last_id() const { return header_.last_id; }
+  size_t doc_count() const { return header_.doc_count; }
+  size_t term_count() const { return header_.term_count; }
+  uint64_t total_length() const { return header_.total_length; }
+
+  SegmentDoc doc(size_t i) const {
+    SegmentDoc d;
+    std::memcpy(&d, docs_ + i * sizeof(SegmentDoc), sizeof(d));
+    return d;
+  }
+
+  SegmentTerm term_entry(size_t i) const {
+    SegmentTerm t;
+    std::memcpy(&t, terms_ + i * sizeof(SegmentTerm), sizeof(t));
+    return t;
+  }
+
+  std::string term(size_t i) const {
+    SegmentTerm t = term_entry(i);
+    if (t.heap_off >= heap_size_) return "";
+    size_t len = static_cast<unsigned char>(heap_[t.heap_off]);
+    if (t.heap_off + 1 + len > heap_size_) return "";
+    return std::string(heap_ + t.heap_off + 1, len);
+  }
+
+  std::vector<SegmentPosting> postings(const SegmentTerm& t) const {
+    std::vector<SegmentPosting> out;
+    if (t.posting_start + t.posting_count > header_.posting_count) return out;
+    out.resize(t.posting_count);
+    std::memcpy(out.data(), postings_ + t.posting_start * sizeof(SegmentPosting),
+                out.size() * sizeof(SegmentPosting));
+    return out;
+  }
+
+  // Binary search over the sorted dictionary.
+  bool find(const std::string& term, SegmentTerm& out) const {
+    size_t lo = 0;
+    size_t hi = header_.term_count;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      int cmp = this->term(mid).compare(term);
+      if (cmp == 0) {
+        out = term_entry(mid);
+        return true;
+      }
+      if (cmp < 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return false;
+  }
+
+ private:
+  SearchSegment() = default;
+  SearchSegment(const SearchSegment&) = delete;
+  SearchSegment& operator=(const SearchSegment&) = delete;
+
+  std::string path_;
+  void* map_ = nullptr;
+  size_t map_size_ = 0;
+  SegmentHeader header_{};
+  const char* docs_ = nullptr;
+  const char* postings_ = nullptr;
+  const char* terms_ = nullptr;
+  const char* heap_ = nullptr;
+  size_t heap_size_ = 0;
+};
+
+std::vector<std::string> SearchIndex::tokenize(const std::string& text) {
+  std::vector<std::string> out;
+  std::string cur;
+  auto emit = [&]() {
+    if (!cur.empty()) out.push_back(cur.substr(0, kMaxTermBytes));
+    cur.clear();
+  };
+  for (size_t i = 0; i < text.size();) {
+    uint32_t cp = 0;
+    size_t len = utf8_next(text, i, cp);
+    if (cp < 0x80) {
+      if (std::isalnum(static_cast<int>(cp))) {
+        cur += static_cast<char>(std::tolower(static_cast<int>(cp)));
+      } else {
+        emit();
+      }
+    } else if (is_cjk(cp)) {
+      emit();
+      out.push_back(text.substr(i, len));
+    } else if (len > 1 && cp >= 0xC0) {
+      cur.append(text, i, len);  // other scripts: part of the word
+    } else {
+      emit();
+    }
+    i += len;
+  }
+  emit();
+  return out;
+}
+
+SearchIndex::SearchIndex(const std::string& dir, const HistoryStore& history)
+    : dir_(dir), history_(history) {}
+
+SearchIndex::~SearchIndex() {
+  stop();
+}
+
+bool SearchIndex::open() {
+  if (::mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) return false;
+  std::vector<std::string> names;
+  if (DIR* d = opendir(dir_.c_str())) {
+    while (dirent* ent = readdir(d)) {
+      std::string name = ent->d_name;
+      if (name.compare(0, 4, "seg-") != 0) continue;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) {
+        std::remove((dir_ + "/" + name).c_str());
+        continue;
+      }
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".idx") == 0) names.push_back(name);
+    }
+    closedir(d);
+  }
+  std::sort(names.begin(), names.end());
+
+  std::vector<std::shared_ptr<const SearchSegment>> loaded;
+  for (const auto& name : names) {
+    auto seg = SearchSegment::open(dir_ + "/" + name);
+    if (!seg) {
+      log_warn("[search] dropping unreadable segment " + name);
+      std::remove((dir_ + "/" + name).c_str());
+      continue;
+    }
+    loaded.push_back(seg);
+  }
+  // A crash between publishing a merge and deleting its inputs leaves
+  // segments covered by the merged one; keep the widest range.
+  std::sort(loaded.begin(), loaded.end(), [](const auto& a, const auto& b) {
+    if (a->first_id() != b->first_id()) return a->first_id() < b->first_id();
+    return a->last_id() > b->last_id();
+  });
+  std::vector<std::shared_ptr<const SearchSegment>> kept;
+  for (const auto& seg : loaded) {
+    if (!kept.empty() && seg->first_id() <= kept.back()->last_id()) {
+      std::remove(seg->path().c_str());
+      continue;
+    }
+    kept.push_back(seg);
+  }
+
+  std::lock_guard<std::mutex> lock(mu_);
+  segments_ = std::move(kept);
+  indexed_id_ = segments_.empty() ? 0 : segments_.back()->last_id();
+  // Catch up with records the previous run did not write out.
+  size_t caught_up = 0;
+  for (unsigned long long id = indexed_id_ + 1, last = history_.last_id(); id <= last; ++id) {
+    HistoryRecord rec;
+    if (!history_.read(id, rec)) continue;
+    add_locked(rec);
+    caught_up++;
+  }
+  if (caught_up > 0) log_line("[search] indexed " + std::to_string(caught_up) + " record(s) from history");
+  if (!thread_.joinable()) thread_ = std::thread([this]() { run(); });
+  return true;
+}
+
+void SearchIndex::add_locked(const HistoryRecord& rec) {
+  if (rec.id <= indexed_id_) return;
+  indexed_id_ = rec.id;
+  std::vector<std::string> tokens = tokenize(rec.text + " " + rec.filename + " " + rec.media_type);
+  if (tokens.empty()) return;
+  std::unordered_map<std::string, uint32_t> tf;
+  for (const auto& t : tokens) tf[t]++;
+  for (const auto& kv : tf) delta_terms_[kv.first].push_back(DeltaPosting{rec.id, kv.second});
+  delta_docs_.push_back(DeltaDoc{rec.id, fnv1a64(rec.peer), static_cast<uint32_t>(tokens.size())});
+  delta_length_ += tokens.size();
+  if (delta_docs_.size() == 1) delta_since_ms_ = now_ms();
+}
+
+void SearchIndex::add(const HistoryRecord& rec) {
+  std::lock_guard<std::mutex> lock(mu_);
+  add_locked(rec);
+  if (delta_docs_.size() >= kFlushDocs) cv_.notify_one();
+}
+
+bool SearchIndex::search(const std::string& query,
+                         const std::string& peer,
+                         size_t limit,
+                         std::vector<SearchHit>& out) const {
+  out.clear();
+  std::vector<std::string> terms = tokenize(query);
+  std::sort(terms.begin(), terms.end());
+  terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+  if (terms.empty() || limit == 0) return true;
+  const uint64_t peer_hash = peer.empty() ? 0 : fnv1a64(peer);
+
+  struct TermHits {
+    std::vector<std::pair<uint64_t, double>> docs;  // id, normalized tf part
+    size_t df = 0;
+  };
+  std::vector<TermHits> hits(terms.size());
+  // Only the delta is copied under mu_: add() takes it on the Carrier callback
+  // thread. Segments are immutable mmaps, so their posting scans run without it.
+  struct DeltaHit {
+    uint64_t id;
+    uint32_t tf;
+    uint32_t length;
+  };
+  std::vector<std::vector<DeltaHit>> delta_hits(terms.size());
+  std::vector<std::shared_ptr<const SearchSegment>> segments;
+  size_t total_docs = 0;
+  uint64_t total_length = 0;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    segments = segments_;
+    total_docs = delta_docs_.size();
+    total_length = delta_length_;
+    for (size_t t = 0; t < terms.size(); ++t) {
+      auto it = delta_terms_.find(terms[t]);
+      if (it == delta_terms_.end()) continue;
+      hits[t].df += it->second.size();
+      for (const auto& p : it->second) {
+        auto doc = std::lower_bound(delta_docs_.begin(), delta_docs_.end(), p.id,
+                                    [](const DeltaDoc& d, uint64_t id) { return d.id < id; });
+        if (doc == delta_docs_.end() || doc->id != p.id) continue;
+        if (peer_hash && doc->peer_hash != peer_hash) continue;
+        delta_hits[t].push_back(DeltaHit{p.id, p.tf, doc->length});
+      }
+    }
+  }
+  for (const auto& seg : segments) {
+    total_docs += seg->doc_count();
+    total_length += seg->total_length();
+  }
+  if (total_docs == 0) return true;
+  const double avg_len = static_cast<double>(total_length) / static_cast<double>(total_docs);
+  auto tf_part = [&](uint32_t tf, uint32_t len) {
+    double norm = kBm25K1 * (1.0 - kBm25B + kBm25B * static_cast<double>(len) / avg_len);
+    return (tf * (kBm25K1 + 1.0)) / (tf + norm);
+  };
+
+  for (size_t t = 0; t < terms.size(); ++t) {
+    for (const auto& seg : segments) {
+      SegmentTerm entry;
+      if (!seg->find(terms[t], entry)) continue;
+      hits[t].df += entry.posting_count;
+      for (const auto& p : seg->postings(entry)) {
+        if (p.doc >= seg->doc_count()) continue;
+        SegmentDoc d = seg->doc(p.doc);
+        if (peer_hash && d.peer_hash != peer_hash) continue;
+        hits[t].docs.emplace_back(d.id, tf_part(p.tf, d.length));
+      }
+    }
+    for (const auto& d : delta_hits[t]) hits[t].docs.emplace_back(d.id, tf_part(d.tf, d.length));
+  }
+
+  std::unordered_map<uint64_t, double> scores;
+  for (const auto& th : hits) {
+    if (th.docs.empty()) continue;
+    double n = static_cast<double>(total_docs);
+    double df = static_cast<double>(th.df);
+    double idf = std::log(1.0 + (n - df + 0.5) / (df + 0.5));
+    for (const auto& d : th.docs) scores[d.first] += idf * d.second;
+  }
+  std::vector<std::pair<uint64_t, double>> ranked(scores.begin(), scores.end());
+  std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+    if (a.second != b.second) return a.second > b.second;
+    return a.first > b.first;
+  });
+  for (const auto& r : ranked) {
+    if (out.size() >= limit) break;
+    SearchHit hit;
+    if (!history_.read(r.first, hit.record)) continue;
+    if (!peer.empty() && hit.record.peer != peer) continue;  // hash collision
+    hit.score = r.second;
+    out.push_back(std::move(hit));
+  }
+  return true;
+}
+
+bool SearchIndex::flush_delta() {
+  std::vector<SegmentDoc> docs;
+  std::map<std::string, std::vector<DeltaPosting>> terms;
+  uint64_t total_length = 0;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (delta_docs_.empty()) return true;
+    docs.reserve(delta_docs_.size());
+    for (const auto& d : delta_docs_) docs.push_back(SegmentDoc{d.id, d.peer_hash, d.length, 0});
+    terms = delta_terms_;
+    total_length = delta_length_;
+  }
+  const uint64_t last_id = docs.back().id;
+  std::string path = dir_ + "/" + segment_name(docs.front().id, last_id);
+  SegmentWriter writer;
+  bool ok = writer.begin(path, docs, total_length);
+  std::vector<SegmentPosting> postings;
+  for (auto it = terms.begin(); ok && it != terms.end(); ++it) {
+    postings.clear();
+    for (const auto& p : it->second) {
+      auto doc = std::lower_bound(docs.begin(), docs.end(), p.id,
+                                  [](const SegmentDoc& d, uint64_t id) { return d.id < id; });
+      postings.push_back(SegmentPosting{static_cast<uint32_t>(doc - docs.begin()), p.tf});
+    }
+    ok = writer.add_term(it->first, postings);
+  }
+  ok = ok && writer.finish();
+  auto seg = ok ? SearchSegment::open(path) : nullptr;
+  if (!seg) {
+    log_warn("[search] segment write failed path=" + path);
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mu_);
+  segments_.push_back(seg);
+  // Records added while the segment was written stay in the delta.
+  size_t keep_from = docs.size();
+  delta_docs_.erase(delta_docs_.begin(), delta_docs_.begin() + keep_from);
+  delta_length_ -= total_length;
+  for (auto it = delta_terms_.begin(); it != delta_terms_.end();) {
+    auto& list = it->second;
+    auto cut = std::upper_bound(list.begin(), list.end(), last_id,
+                                [](uint64_t id, const DeltaPosting& p) { return id < p.id; });
+    list.erase(list.begin(), cut);
+    it = list.empty() ? delta_terms_.erase(it) : std::next(it);
+  }
+  if (!delta_docs_.empty()) delta_since_ms_ = now_ms();
+  log_debug("[search] wrote segment docs=" + std::to_string(docs.size()) + " terms="
+            + std::to_string(terms.size()) + " path=" + path);
+  return true;
+}
+
+// Merges the newest run of segments whose sizes are within 4x of everything
+// newer, so large old segments are rewritten rarely.
+bool SearchIndex::merge_segments() {
+  std::vector<std::shared_ptr<const SearchSegment>> inputs;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (segments_.size() <= kMaxSegments) return true;
+    size_t start = segments_.size() - 1;
+    size_t acc = segments_.back()->doc_count();
+    while (start > 0 && segments_[start - 1]->doc_count() <= 4 * acc) {
+      --start;
+      acc += segments_[start]->doc_count();
+    }
+    if (segments_.size() - start < 2) start = segments_.size() - 2;
+    inputs.assign(segments_.begin() + start, segments_.end());
+  }
+
+  std::vector<SegmentDoc> docs;
+  std::vector<uint32_t> doc_base;
+  uint64_t total_length = 0;
+  for (const auto& seg : inputs) {
+    doc_base.push_back(static_cast<uint32_t>(docs.size()));
+    for (size_t i = 0; i < seg->doc_count(); ++i) docs.push_back(seg->doc(i));
+    total_length += seg->total_length();
+  }
+  std::string path = dir_ + "/" + segment_name(inputs.front()->first_id(), inputs.back()->last_id());
+  SegmentWriter writer;
+  bool ok = writer.begin(path, docs, total_length);
+
+  // k-way merge of the sorted dictionaries; inputs are in id order, so
+  // concatenated postings stay sorted by doc.
+  std::vector<size_t> cursor(inputs.size(), 0);
+  std::vector<std::string> current(inputs.size());
+  for (size_t s = 0; s < inputs.size(); ++s) {
+    if (inputs[s]->term_count() > 0) current[s] = inputs[s]->term(0);
+  }
+  std::vector<SegmentPosting> postings;
+  size_t term_count = 0;
+  while (ok) {
+    const std::string* smallest = nullptr;
+    for (size_t s = 0; s < inputs.size(); ++s) {
+      if (cursor[s] >= inputs[s]->term_count()) continue;
+      if (!smallest || current[s] < *smallest) smallest = &current[s];
+    }
+    if (!smallest) break;
+    const std::string term = *smallest;
+    postings.clear();
+    for (size_t s = 0; s < inputs.size(); ++s) {
+      if (cursor[s] >= inputs[s]->term_count() || current[s] != term) continue;
+      for (auto p : inputs[s]->postings(inputs[s]->term_entry(cursor[s]))) {
+        p.doc += doc_base[s];
+        postings.push_back(p);
+      }
+      if (++cursor[s] < inputs[s]->term_count()) current[s] = inputs[s]->term(cursor[s]);
+    }
+    ok = writer.add_term(term, postings);
+    term_count++;
+  }
+  ok = ok && writer.finish();
+  auto merged = ok ? SearchSegment::open(path) : nullptr;
+  if (!merged) {
+    log_warn("[search] merge failed path=" + path);
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto first = std::find(segments_.begin(), segments_.end(), inputs.front());
+    if (first == segments_.end()) return false;
+    auto pos = segments_.erase(first, first + static_cast<std::ptrdiff_t>(inputs.size()));
+    segments_.insert(pos, merged);
+  }
+  for (const auto& seg : inputs) std::remove(seg->path().c_str());
+  log_line("[search] merged segments=" + std::to_string(inputs.size()) + " docs=" + std::to_string(docs.size())
+           + " terms=" + std::to_string(term_count));
+  return true;
+}
+
+void SearchIndex::run() {
+  bool stopping = false;
+  while (!stopping) {
+    bool flush = false;
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      cv_.wait_for(lock, std::chrono::seconds(5), [this]() {
+        return stop_ || delta_docs_.size() >= kFlushDocs;
+      });
+      stopping = stop_;
+      flush = !delta_docs_.empty()
+          && (stopping || delta_docs_.size() >= kFlushDocs || now_ms() - delta_since_ms_ >= kFlushAgeMs);
+    }
+    if (flush) flush_delta();
+    if (!stopping) merge_segments();
+  }
+}
+
+void SearchIndex::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) thread_.join();
+}
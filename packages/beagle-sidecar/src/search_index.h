@@ -0,0 +1,78 @@
+#pragma once
+
+#include "history_store.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SearchHit {
+  HistoryRecord record;
+  double score = 0;
+};
+
+class SearchSegment;
+
+// Full-text index over a HistoryStore. Text, filename and media type of each
+// record are tokenized (lowercased ASCII words; CJK characters one per term)
+// and kept as immutable segment files `<dir>/seg-<firstId>-<lastId>.idx`:
+// doc table, postings, a sorted term dictionary and a string heap, mmap()ed
+// for lookups. add() only updates an in-memory delta that is searchable at
+// once; a background thread writes the delta as a new segment and merges the
+// newest similar-sized segments so their number stays small. On open the
+// index catches up with records appended to the history since the last
+// segment, so nothing is lost when the delta was not flushed.
+class SearchIndex {
+ public:
+  SearchIndex(const std::string& dir, const HistoryStore& history);
+  ~SearchIndex();
+
+  SearchIndex(const SearchIndex&) = delete;
+  SearchIndex& operator=(const SearchIndex&) = delete;
+
+  bool open();
+  void add(const HistoryRecord& rec);
+  // BM25-ranked hits for query (any term matches; best first, newer first on
+  // ties). peer restricts hits to one conversation when not empty.
+  bool search(const std::string& query, const std::string& peer, size_t limit, std::vector<SearchHit>& out) const;
+  // Writes the delta and joins the background thread; idempotent.
+  void stop();
+
+  static std::vector<std::string> tokenize(const std::string& text);
+
+ private:
+  struct DeltaPosting {
+    uint64_t id;
+    uint32_t tf;
+  };
+  struct DeltaDoc {
+    uint64_t id;
+    uint64_t peer_hash;
+    uint32_t length;
+  };
+
+  void run();
+  bool flush_delta();
+  bool merge_segments();
+  void add_locked(const HistoryRecord& rec);
+
+  std::string dir_;
+  const HistoryStore& history_;
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  std::vector<std::shared_ptr<const SearchSegment>> segments_;  // oldest first, disjoint id ranges
+  std::map<std::string, std::vector<DeltaPosting>> delta_terms_;
+  std::vector<DeltaDoc> delta_docs_;
+  uint64_t delta_length_ = 0;
+  uint64_t indexed_id_ = 0;  // highest record id in segments or delta
+  long long delta_since_ms_ = 0;
+  bool stop_ = false;
+
+  std::thread thread_;
+};
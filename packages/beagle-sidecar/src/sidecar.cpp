@@ -0,0 +1,2159 @@
+#include "sidecar.h"
+#include "beagle_sdk.h"
+#include "host_facts.h"
+#include "latency.h"
+#include "logger.h"
+#include "timer_wheel.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct AgentProfile {
+  std::string account_id;
+  std::string agent_id;
+  std::string name;
+  std::string gender;
+  std::string phone;
+  std::string email;
+  std::string description;
+  std::string region;
+  std::string public_display_name;
+  std::string public_headline;
+  std::string public_avatar;
+  std::string public_homepage;
+  std::vector<std::pair<std::string, std::string>> public_links;
+};
+
+// Pending -> Starting -> Started | Failed; sdk is only used once Started.
+enum class AccountPhase { Pending, Starting, Started, Failed };
+
+static const char* account_phase_name(AccountPhase phase) {
+  switch (phase) {
+    case AccountPhase::Pending:
+      return "pending";
+    case AccountPhase::Starting:
+      return "starting";
+    case AccountPhase::Started:
+      return "started";
+    case AccountPhase::Failed:
+      return "failed";
+  }
+  return "";
+}
+
+struct AccountRuntime {
+  std::string account_id;
+  std::string agent_id;
+  std::string default_agent_name;
+  std::string agent_name;
+  std::string public_profile_json;
+  std::string public_display_name;
+  std::string public_headline;
+  std::string public_avatar;
+  std::string public_homepage;
+  std::vector<std::pair<std::string, std::string>> public_links;
+  std::unique_ptr<BeagleSdk> sdk;
+  BeagleSdkOptions sdk_options;
+  std::atomic<AccountPhase> phase{AccountPhase::Pending};
+
+  bool started() const { return phase == AccountPhase::Started; }
+};
+
+static std::mutex g_events_mu;
+static std::vector<Event> g_events;
+/** Parallel copy of inbound events for GET /directory-events so the OpenClaw directory web
+ *  poller does not lose profile JSON when beagle-channel consumes GET /events first. */
+static std::vector<Event> g_directory_events;
+
+// SIGTERM/SIGINT and sidecar_request_stop() write to this pipe to end the accept loop.
+static int g_stop_pipe[2] = {-1, -1};
+static std::atomic<bool> g_stop_requested{false};
+
+static void request_stop() {
+  g_stop_requested = true;
+  if (g_stop_pipe[1] >= 0) {
+    ssize_t n = write(g_stop_pipe[1], "x", 1);
+    (void)n;
+  }
+}
+
+static void on_stop_signal(int) {
+  int saved_errno = errno;
+  request_stop();
+  errno = saved_errno;
+}
+
+static void open_stop_pipe() {
+  if (g_stop_pipe[0] < 0 && pipe(g_stop_pipe) == 0) {
+    for (int fd : g_stop_pipe) {
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+  }
+}
+
+void sidecar_install_signal_handlers() {
+  open_stop_pipe();
+  struct sigaction sa{};
+  sa.sa_handler = on_stop_signal;
+  // Blocking socket calls resume after the handler; the poll() in the accept
+  // loop still returns early, and the self-pipe wakes it anyway.
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGTERM, &sa, nullptr);
+  sigaction(SIGINT, &sa, nullptr);
+}
+
+void sidecar_request_stop() {
+  request_stop();
+}
+
+static bool decode_json_string(const std::string& body, size_t start, std::string& out, size_t& end_pos) {
+  if (start >= body.size() || body[start] != '"') return false;
+  out.clear();
+  for (size_t i = start + 1; i < body.size(); ++i) {
+    char c = body[i];
+    if (c == '"') {
+      end_pos = i;
+      return true;
+    }
+    if (c != '\\') {
+      out.push_back(c);
+      continue;
+    }
+    if (i + 1 >= body.size()) return false;
+    char esc = body[++i];
+    switch (esc) {
+      case '"': out.push_back('"'); break;
+      case '\\': out.push_back('\\'); break;
+      case '/': out.push_back('/'); break;
+      case 'b': out.push_back('\b'); break;
+      case 'f': out.push_back('\f'); break;
+      case 'n': out.push_back('\n'); break;
+      case 'r': out.push_back('\r'); break;
+      case 't': out.push_back('\t'); break;
+      case 'u': {
+        if (i + 4 >= body.size()) return false;
+        int code = 0;
+        for (int k = 0; k < 4; ++k) {
+          char h = body[i + 1 + k];
+          code <<= 4;
+          if (h >= '0' && h <= '9') code |= (h - '0');
+          else if (h >= 'a' && h <= 'f') code |= (h - 'a' + 10);
+          else if (h >= 'A' && h <= 'F') code |= (h - 'A' + 10);
+          else return false;
+        }
+        i += 4;
+        if (code <= 0x7F) {
+          out.push_back(static_cast<char>(code));
+        } else if (code <= 0x7FF) {
+          out.push_back(static_cast<char>(0xC0 | ((code >> 6) & 0x1F)));
+          out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else {
+          out.push_back(static_cast<char>(0xE0 | ((code >> 12) & 0x0F)));
+          out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+          out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return false;
+}
+
+bool extract_json_string(const std::string& body, const std::string& key, std::string& out) {
+  std::string needle = "\"" + key + "\"";
+  size_t pos = body.find(needle);
+  if (pos == std::string::npos) return false;
+  pos = body.find(':', pos + needle.size());
+  if (pos == std::string::npos) return false;
+  pos = body.find('"', pos);
+  if (pos == std::string::npos) return false;
+  size_t end_pos = pos;
+  return decode_json_string(body, pos, out, end_pos);
+}
+
+static bool extract_json_int(const std::string& body, const std::string& key, int& out) {
+  std::string needle = "\"" + key + "\"";
+  size_t pos = body.find(needle);
+  if (pos == std::string::npos) return false;
+  pos = body.find(':', pos + needle.size());
+  if (pos == std::string::npos) return false;
+  ++pos;
+  while (pos < body.size() && (body[pos] == ' ' || body[pos] == '\t' || body[pos] == '\r' || body[pos] == '\n')) {
+    ++pos;
+  }
+  if (pos >= body.size()) return false;
+
+  if (body[pos] == '"') {
+    std::string text;
+    size_t end_pos = pos;
+    if (!decode_json_string(body, pos, text, end_pos)) return false;
+    try {
+      out = std::stoi(text);
+      return true;
+    } catch (...) {
+      return false;
+    }
+  }
+
+  size_t end = pos;
+  if (body[end] == '-') ++end;
+  while (end < body.size() && std::isdigit(static_cast<unsigned char>(body[end]))) ++end;
+  if (end == pos) return false;
+  try {
+    out = std::stoi(body.substr(pos, end - pos));
+    return true;
+  } catch (...) {
+    return false;
+  }
+}
+
+std::string json_escape(const std::string& in) {
+  std::string out;
+  out.reserve(in.size() + 8);
+  for (char c : in) {
+    switch (c) {
+      case '\\': out += "\\\\"; break;
+      case '"': out += "\\\""; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[7];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+          out += buf;
+        } else {
+          out += c;
+        }
+        break;
+    }
+  }
+  return out;
+}
+
+static std::string send_outcome_json(bool ok, const BeagleSendOutcome& outcome) {
+  if (!ok) return "{\"ok\":false}";
+  if (outcome.duplicate) return "{\"ok\":true,\"duplicate\":true}";
+  if (outcome.queued) return "{\"ok\":true,\"queued\":true}";
+  return "{\"ok\":true}";
+}
+
+// For log lines: "queued" sends are only in the outbox, not delivered yet.
+static const char* send_outcome_label(bool ok, const BeagleSendOutcome& outcome) {
+  if (!ok) return "failed";
+  return outcome.queued ? "queued" : "ok";
+}
+
+static std::string trim_copy(const std::string& s) {
+  size_t b = 0;
+  while (b < s.size() && std::isspace(static_cast<unsigned char>(s[b]))) ++b;
+  size_t e = s.size();
+  while (e > b && std::isspace(static_cast<unsigned char>(s[e - 1]))) --e;
+  return s.substr(b, e - b);
+}
+
+static std::string lowercase_copy(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  return s;
+}
+
+static std::string get_env(const char* key) {
+  const char* value = std::getenv(key);
+  return value ? std::string(value) : std::string();
+}
+
+static bool file_exists(const std::string& path) {
+  return access(path.c_str(), R_OK) == 0;
+}
+
+static bool dir_exists(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static std::string expand_home(const std::string& path) {
+  if (path.empty() || path[0] != '~') return path;
+  const std::string home = get_env("HOME");
+  if (home.empty()) return path;
+  if (path.size() == 1) return home;
+  if (path[1] == '/') return home + path.substr(1);
+  return path;
+}
+
+static std::string sanitize_account_id(const std::string& raw) {
+  std::string in = trim_copy(raw);
+  if (in.empty()) return "";
+  std::string out;
+  out.reserve(in.size());
+  for (char c : in) {
+    if (std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.') {
+      out.push_back(c);
+    } else if (std::isspace(static_cast<unsigned char>(c)) || c == '/' || c == '\\' || c == ':') {
+      out.push_back('_');
+    }
+  }
+  while (!out.empty() && out.front() == '_') out.erase(out.begin());
+  while (!out.empty() && out.back() == '_') out.pop_back();
+  return out;
+}
+
+static bool read_file_to_string(const std::string& path, std::string& out) {
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if (!in) return false;
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  out = ss.str();
+  return true;
+}
+
+static size_t skip_json_ws(const std::string& body, size_t pos) {
+  while (pos < body.size() && std::isspace(static_cast<unsigned char>(body[pos]))) ++pos;
+  return pos;
+}
+
+static bool find_matching_json_bracket(const std::string& body,
+                                       size_t start,
+                                       char open_char,
+                                       char close_char,
+                                       size_t& end) {
+  if (start >= body.size() || body[start] != open_char) return false;
+  int depth = 0;
+  bool in_string = false;
+  bool escaped = false;
+  for (size_t i = start; i < body.size(); ++i) {
+    char c = body[i];
+    if (in_string) {
+      if (escaped) {
+        escaped = false;
+      } else if (c == '\\') {
+        escaped = true;
+      } else if (c == '"') {
+        in_string = false;
+      }
+      continue;
+    }
+    if (c == '"') {
+      in_string = true;
+      continue;
+    }
+    if (c == open_char) {
+      ++depth;
+      continue;
+    }
+    if (c == close_char) {
+      --depth;
+      if (depth == 0) {
+        end = i;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static bool extract_json_container_by_key(const std::string& body,
+                                          const std::string& key,
+                                          char open_char,
+                                          char close_char,
+                                          size_t& start,
+                                          size_t& end) {
+  const std::string needle = "\"" + key + "\"";
+  size_t key_pos = body.find(needle);
+  if (key_pos == std::string::npos) return false;
+  size_t colon = body.find(':', key_pos + needle.size());
+  if (colon == std::string::npos) return false;
+  size_t pos = skip_json_ws(body, colon + 1);
+  if (pos >= body.size() || body[pos] != open_char) return false;
+  if (!find_matching_json_bracket(body, pos, open_char, close_char, end)) return false;
+  start = pos;
+  return true;
+}
+
+static std::string extract_first_json_string(const std::string& body,
+                                             const std::initializer_list<const char*>& keys) {
+  for (const char* key : keys) {
+    std::string value;
+    if (key && extract_json_string(body, key, value) && !trim_copy(value).empty()) {
+      return trim_copy(value);
+    }
+  }
+  return "";
+}
+
+static AgentProfile parse_agent_profile_from_object(const std::string& object_body,
+                                                    const std::string& key_hint) {
+  AgentProfile profile;
+  profile.agent_id = extract_first_json_string(object_body, {"id", "agentId", "agent_id", "slug"});
+  if (profile.agent_id.empty()) profile.agent_id = key_hint;
+  profile.account_id = sanitize_account_id(profile.agent_id.empty() ? key_hint : profile.agent_id);
+  profile.name = extract_first_json_string(object_body, {"name", "displayName", "title"});
+  profile.gender = extract_first_json_string(object_body, {"gender"});
+  profile.phone = extract_first_json_string(object_body, {"phone"});
+  profile.email = extract_first_json_string(object_body, {"email"});
+  profile.description = extract_first_json_string(object_body, {"description", "bio", "summary"});
+  profile.region = extract_first_json_string(object_body, {"region", "location"});
+  if (profile.name.empty()) profile.name = profile.agent_id;
+  return profile;
+}
+
+static size_t skip_json_value(const std::string& body, size_t pos) {
+  pos = skip_json_ws(body, pos);
+  if (pos >= body.size()) return std::string::npos;
+  char c = body[pos];
+  if (c == '"') {
+    std::string ignored;
+    size_t end_pos = pos;
+    if (!decode_json_string(body, pos, ignored, end_pos)) return std::string::npos;
+    return end_pos + 1;
+  }
+  if (c == '{') {
+    size_t end = pos;
+    if (!find_matching_json_bracket(body, pos, '{', '}', end)) return std::string::npos;
+    return end + 1;
+  }
+  if (c == '[') {
+    size_t end = pos;
+    if (!find_matching_json_bracket(body, pos, '[', ']', end)) return std::string::npos;
+    return end + 1;
+  }
+  while (pos < body.size()) {
+    char ch = body[pos];
+    if (ch == ',' || ch == '}' || ch == ']') break;
+    ++pos;
+  }
+  return pos;
+}
+
+static bool is_reserved_agent_key(const std::string& key) {
+  static const char* reserved[] = {
+    "defaults", "default", "list", "models", "meta", "wizard",
+    "plugins", "gateway", "auth", "channels", "session", nullptr
+  };
+  std::string lower = key;
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  for (const char** p = reserved; *p; ++p) {
+    if (lower == *p) return true;
+  }
+  return false;
+}
+
+static void parse_agent_object_map(const std::string& object_body, std::vector<AgentProfile>& out) {
+  if (object_body.empty() || object_body.front() != '{') return;
+  size_t pos = 1;
+  while (pos < object_body.size()) {
+    pos = skip_json_ws(object_body, pos);
+    if (pos >= object_body.size() || object_body[pos] == '}') break;
+    if (object_body[pos] != '"') break;
+
+    std::string key;
+    size_t key_end = pos;
+    if (!decode_json_string(object_body, pos, key, key_end)) break;
+    pos = skip_json_ws(object_body, key_end + 1);
+    if (pos >= object_body.size() || object_body[pos] != ':') break;
+    ++pos;
+    pos = skip_json_ws(object_body, pos);
+    if (pos >= object_body.size()) break;
+
+    if (object_body[pos] == '{') {
+      size_t obj_end = pos;
+      if (!find_matching_json_bracket(object_body, pos, '{', '}', obj_end)) break;
+      if (!is_reserved_agent_key(key)) {
+        AgentProfile profile = parse_agent_profile_from_object(
+            object_body.substr(pos, obj_end - pos + 1),
+            sanitize_account_id(key));
+        if (!profile.account_id.empty()) out.push_back(std::move(profile));
+      }
+      pos = obj_end + 1;
+    } else {
+      size_t next = skip_json_value(object_body, pos);
+      if (next == std::string::npos) break;
+      pos = next;
+    }
+
+    pos = skip_json_ws(object_body, pos);
+    if (pos < object_body.size() && object_body[pos] == ',') ++pos;
+  }
+}
+
+static void parse_agent_array(const std::string& array_body, std::vector<AgentProfile>& out) {
+  if (array_body.empty() || array_body.front() != '[') return;
+  size_t pos = 1;
+  while (pos < array_body.size()) {
+    pos = skip_json_ws(array_body, pos);
+    if (pos >= array_body.size() || array_body[pos] == ']') break;
+    if (array_body[pos] == '{') {
+      size_t obj_end = pos;
+      if (!find_matching_json_bracket(array_body, pos, '{', '}', obj_end)) break;
+      AgentProfile profile = parse_agent_profile_from_object(
+          array_body.substr(pos, obj_end - pos + 1), "");
+      if (!profile.account_id.empty()) out.push_back(std::move(profile));
+      pos = obj_end + 1;
+    } else {
+      size_t next = skip_json_value(array_body, pos);
+      if (next == std::string::npos) break;
+      pos = next;
+    }
+    pos = skip_json_ws(array_body, pos);
+    if (pos < array_body.size() && array_body[pos] == ',') ++pos;
+  }
+}
+
+static std::vector<AgentProfile> load_agent_profiles_from_openclaw_config(const std::string& config_path) {
+  std::vector<AgentProfile> profiles;
+  std::string body;
+  if (config_path.empty() || !read_file_to_string(config_path, body)) return profiles;
+
+  const char* section_keys[] = {"agents", "characters"};
+  for (const char* section_key : section_keys) {
+    size_t start = 0;
+    size_t end = 0;
+    if (extract_json_container_by_key(body, section_key, '{', '}', start, end)) {
+      std::string section_object = body.substr(start, end - start + 1);
+      if (std::string(section_key) == "agents") {
+        size_t list_start = 0;
+        size_t list_end = 0;
+        if (extract_json_container_by_key(section_object, "list", '[', ']', list_start, list_end)) {
+          parse_agent_array(section_object.substr(list_start, list_end - list_start + 1), profiles);
+        }
+      }
+      parse_agent_object_map(section_object, profiles);
+      continue;
+    }
+    if (extract_json_container_by_key(body, section_key, '[', ']', start, end)) {
+      parse_agent_array(body.substr(start, end - start + 1), profiles);
+    }
+  }
+
+  std::unordered_map<std::string, AgentProfile> deduped;
+  for (const auto& p : profiles) {
+    if (p.account_id.empty()) continue;
+    auto it = deduped.find(p.account_id);
+    if (it == deduped.end()) {
+      deduped.emplace(p.account_id, p);
+      continue;
+    }
+    if (it->second.name.empty() && !p.name.empty()) it->second.name = p.name;
+    if (it->second.description.empty() && !p.description.empty()) it->second.description = p.description;
+    if (it->second.gender.empty() && !p.gender.empty()) it->second.gender = p.gender;
+    if (it->second.phone.empty() && !p.phone.empty()) it->second.phone = p.phone;
+    if (it->second.email.empty() && !p.email.empty()) it->second.email = p.email;
+    if (it->second.region.empty() && !p.region.empty()) it->second.region = p.region;
+    if (it->second.agent_id.empty() && !p.agent_id.empty()) it->second.agent_id = p.agent_id;
+  }
+
+  std::vector<AgentProfile> out;
+  out.reserve(deduped.size());
+  for (const auto& kv : deduped) out.push_back(kv.second);
+  std::sort(out.begin(), out.end(), [](const AgentProfile& a, const AgentProfile& b) {
+    return a.account_id < b.account_id;
+  });
+  return out;
+}
+
+static bool profile_list_has_account_id(const std::vector<AgentProfile>& profiles,
+                                       const std::string& id) {
+  for (const auto& p : profiles) {
+    if (sanitize_account_id(p.account_id) == id) return true;
+    if (sanitize_account_id(p.agent_id) == id) return true;
+  }
+  return false;
+}
+
+static void merge_profiles_from_agents_dir(std::vector<AgentProfile>& profiles,
+                                          const std::string& home) {
+  if (home.empty()) return;
+  std::string base = home + "/.openclaw/agents";
+  DIR* d = opendir(base.c_str());
+  if (!d) return;
+  while (struct dirent* ent = readdir(d)) {
+    std::string name = ent->d_name;
+    if (name == "." || name == ".." || name.empty()) continue;
+    if (name[0] == '.') continue;
+    std::string sanitized = sanitize_account_id(name);
+    if (sanitized.empty()) continue;
+    if (profile_list_has_account_id(profiles, sanitized)) continue;
+    std::string full = base + "/" + name;
+    struct stat st;
+    if (stat(full.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+
+    AgentProfile ap;
+    ap.agent_id = sanitized;
+    ap.account_id = sanitized;
+    ap.name = sanitized;
+    std::string meta_path = full + "/agent/openclaw.json";
+    if (!file_exists(meta_path)) meta_path = full + "/openclaw.json";
+    std::string meta_body;
+    if (read_file_to_string(meta_path, meta_body)) {
+      std::string nm;
+      if (extract_json_string(meta_body, "name", nm) && !trim_copy(nm).empty()) {
+        ap.name = trim_copy(nm);
+      } else if (extract_json_string(meta_body, "displayName", nm) && !trim_copy(nm).empty()) {
+        ap.name = trim_copy(nm);
+      }
+    }
+    profiles.push_back(std::move(ap));
+  }
+  closedir(d);
+  std::sort(profiles.begin(), profiles.end(), [](const AgentProfile& a, const AgentProfile& b) {
+    return a.account_id < b.account_id;
+  });
+}
+
+static std::string exec_first_line(const char* cmd) {
+  FILE* p = popen(cmd, "r");
+  if (!p) return "";
+  char buf[512];
+  std::string out;
+  if (fgets(buf, sizeof(buf), p)) out = trim_copy(std::string(buf));
+  pclose(p);
+  return out;
+}
+
+static std::string parse_last_touched_version_from_openclaw_json(const std::string& body) {
+  const char* key = "\"lastTouchedVersion\"";
+  size_t pos = body.find(key);
+  if (pos == std::string::npos) return "";
+  pos = body.find(':', pos);
+  if (pos == std::string::npos) return "";
+  pos = body.find('"', pos);
+  if (pos == std::string::npos) return "";
+  ++pos;
+  size_t end = body.find('"', pos);
+  if (end == std::string::npos) return "";
+  return trim_copy(body.substr(pos, end - pos));
+}
+
+// Version of the openclaw CLI reported to the directory. Asking the CLI
+// (`openclaw --version`) boots Node.js and can take seconds, so it never runs
+// on the start-up path: the value comes from <data-dir>/openclaw_version.json
+// while that still matches the binary's path and stamp (see
+// openclaw_binary_stamp), and is otherwise refreshed on a background thread
+// (readers see the new value once it lands).
+class OpenclawVersion {
+ public:
+  std::string get() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return value_;
+  }
+
+  void set(const std::string& value) {
+    std::lock_guard<std::mutex> lock(mu_);
+    value_ = value;
+  }
+
+ private:
+  mutable std::mutex mu_;
+  std::string value_ = "unknown";
+};
+
+// First executable `name` on PATH, as found (symlinks not resolved).
+static std::string find_executable_in_path(const std::string& name) {
+  std::string path = get_env("PATH");
+  size_t pos = 0;
+  while (pos <= path.size()) {
+    size_t end = path.find(':', pos);
+    if (end == std::string::npos) end = path.size();
+    std::string dir = path.substr(pos, end - pos);
+    if (dir.empty()) dir = ".";
+    std::string candidate = dir + "/" + name;
+    struct stat st;
+    if (stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(candidate.c_str(), X_OK) == 0) {
+      return candidate;
+    }
+    pos = end + 1;
+  }
+  return "";
+}
+
+// Identifies one install of the openclaw binary. npm upgrades replace the
+// package (a new inode and ctime even when the file's mtime is preserved) and
+// may just repoint the bin symlink, so the symlink's own mtime is part of it.
+static std::string openclaw_binary_stamp(const std::string& bin, const struct stat& st) {
+  struct stat lst;
+  long long link_mtime = lstat(bin.c_str(), &lst) == 0 ? static_cast<long long>(lst.st_mtime) : 0;
+  return std::to_string(static_cast<long long>(st.st_mtime)) + ":"
+      + std::to_string(static_cast<long long>(st.st_ctime)) + ":"
+      + std::to_string(static_cast<unsigned long long>(st.st_ino)) + ":"
+      + std::to_string(link_mtime);
+}
+
+static std::shared_ptr<OpenclawVersion> resolve_openclaw_version(const std::string& config_path,
+                                                                 const std::string& data_dir) {
+  auto version = std::make_shared<OpenclawVersion>();
+  std::string v = trim_copy(get_env("OPENCLAW_VERSION"));
+  if (!v.empty()) {
+    version->set(v);
+    return version;
+  }
+
+  std::string fallback = "unknown";
+  std::string body;
+  if (!config_path.empty() && read_file_to_string(config_path, body)) {
+    v = parse_last_touched_version_from_openclaw_json(body);
+    if (!v.empty()) fallback = v;
+  }
+  const std::string bin = find_executable_in_path("openclaw");
+  struct stat st;
+  if (bin.empty() || stat(bin.c_str(), &st) != 0) {
+    version->set(fallback);
+    return version;
+  }
+  const std::string stamp = openclaw_binary_stamp(bin, st);
+
+  const std::string cache_path = data_dir + "/openclaw_version.json";
+  std::string cached_path, cached_stamp, cached_version;
+  if (read_file_to_string(cache_path, body)) {
+    extract_json_string(body, "path", cached_path);
+    extract_json_string(body, "stamp", cached_stamp);
+    extract_json_string(body, "version", cached_version);
+    cached_version = trim_copy(cached_version);
+  }
+  if (!cached_version.empty() && cached_path == bin && cached_stamp == stamp) {
+    version->set(cached_version);
+    return version;
+  }
+
+  // Stale or missing cache: serve what we have until the CLI answers.
+  version->set(cached_version.empty() ? fallback : cached_version);
+  std::thread([version, bin, stamp, data_dir, cache_path]() {
+    std::string quoted = "'";
+    for (char c : bin) quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    quoted += "'";
+    std::string v = exec_first_line((quoted + " --version 2>/dev/null").c_str());
+    if (v.empty() || g_stop_requested) return;
+    version->set(v);
+    log_line("[sidecar] openclaw version=" + v + " (from " + bin + ")");
+    // Written aside and renamed so a crash never leaves a torn cache behind.
+    // On a first run the accounts may not have created data_dir yet.
+    mkdir(data_dir.c_str(), 0755);
+    const std::string tmp_path = cache_path + ".tmp";
+    {
+      std::ofstream out(tmp_path, std::ios::trunc);
+      out << "{\"path\":\"" << json_escape(bin) << "\",\"stamp\":\"" << stamp
+          << "\",\"version\":\"" << json_escape(v) << "\"}\n";
+      out.flush();
+      if (!out) {
+        log_debug("[sidecar] cannot write " + tmp_path);
+        std::remove(tmp_path.c_str());
+        return;
+      }
+    }
+    if (std::rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+      log_debug("[sidecar] cannot replace " + cache_path);
+      std::remove(tmp_path.c_str());
+    }
+  }).detach();
+  return version;
+}
+
+static std::string resolve_beagle_channel_version_from_path() {
+  std::string v = trim_copy(get_env("BEAGLE_CHANNEL_VERSION"));
+  if (!v.empty()) return v;
+  std::string home = get_env("HOME");
+  if (home.empty()) return "unknown";
+  std::string path = home + "/.openclaw/extensions/beagle/package.json";
+  std::string body;
+  if (!read_file_to_string(path, body)) return "unknown";
+  if (extract_json_string(body, "version", v) && !trim_copy(v).empty()) return trim_copy(v);
+  return "unknown";
+}
+
+std::string events_to_json(std::vector<Event> events) {
+  std::ostringstream oss;
+  oss << "[";
+  for (size_t i = 0; i < events.size(); ++i) {
+    const auto& ev = events[i];
+    if (i) oss << ",";
+    oss << "{"
+        << "\"accountId\":\"" << json_escape(ev.account_id) << "\""
+        << ",\"peer\":\"" << json_escape(ev.peer) << "\"";
+    if (!ev.text.empty()) oss << ",\"text\":\"" << json_escape(ev.text) << "\"";
+    if (!ev.media_url.empty()) oss << ",\"mediaUrl\":\"" << json_escape(ev.media_url) << "\"";
+    if (!ev.media_path.empty()) oss << ",\"mediaPath\":\"" << json_escape(ev.media_path) << "\"";
+    if (!ev.media_type.empty()) oss << ",\"mediaType\":\"" << json_escape(ev.media_type) << "\"";
+    if (!ev.filename.empty()) oss << ",\"filename\":\"" << json_escape(ev.filename) << "\"";
+    if (ev.size > 0) oss << ",\"size\":" << ev.size;
+    if (!ev.msg_id.empty()) oss << ",\"msgId\":\"" << json_escape(ev.msg_id) << "\"";
+    if (ev.ts != 0) oss << ",\"ts\":" << ev.ts;
+    oss << "}";
+  }
+  oss << "]";
+  return oss.str();
+}
+
+static std::string read_until(int fd, const std::string& marker) {
+  std::string data;
+  char buf[4096];
+  while (data.find(marker) == std::string::npos) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    data.append(buf, buf + n);
+  }
+  return data;
+}
+
+static int get_content_length(const std::string& headers) {
+  std::string lower = headers;
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  std::string needle = "content-length:";
+  size_t pos = lower.find(needle);
+  if (pos == std::string::npos) return 0;
+  pos += needle.size();
+  while (pos < lower.size() && (lower[pos] == ' ' || lower[pos] == '\t')) pos++;
+  size_t end = lower.find("\r\n", pos);
+  if (end == std::string::npos) end = lower.size();
+  return std::atoi(lower.substr(pos, end - pos).c_str());
+}
+
+static std::string header_value(const std::string& headers, const std::string& key) {
+  const std::string wanted = lowercase_copy(trim_copy(key));
+  if (wanted.empty()) return "";
+  size_t line_start = 0;
+  while (line_start < headers.size()) {
+    size_t line_end = headers.find("\r\n", line_start);
+    if (line_end == std::string::npos) line_end = headers.size();
+    if (line_end == line_start) break;
+    size_t colon = headers.find(':', line_start);
+    if (colon != std::string::npos && colon < line_end) {
+      std::string k = lowercase_copy(trim_copy(headers.substr(line_start, colon - line_start)));
+      if (k == wanted) {
+        return trim_copy(headers.substr(colon + 1, line_end - colon - 1));
+      }
+    }
+    if (line_end >= headers.size()) break;
+    line_start = line_end + 2;
+  }
+  return "";
+}
+
+static void send_response(int fd, int code, const std::string& content_type, const std::string& body) {
+  std::ostringstream oss;
+  oss << "HTTP/1.1 " << code << " " << (code == 200 ? "OK" : "ERROR") << "\r\n"
+      << "Content-Type: " << content_type << "\r\n"
+      << "Content-Length: " << body.size() << "\r\n"
+      << "Connection: close\r\n\r\n"
+      << body;
+  std::string out = oss.str();
+  send(fd, out.c_str(), out.size(), 0);
+}
+
+static std::string client_ip(int fd) {
+  sockaddr_in addr{};
+  socklen_t len = sizeof(addr);
+  if (getpeername(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) return "";
+  char buf[INET_ADDRSTRLEN] = {0};
+  if (!inet_ntop(AF_INET, &addr.sin_addr, buf, sizeof(buf))) return "";
+  return std::string(buf);
+}
+
+static std::string to_iso8601(long long ts) {
+  if (ts <= 0) return "";
+  time_t t = static_cast<time_t>(ts);
+  struct tm tm_buf;
+  if (!localtime_r(&t, &tm_buf)) return "";
+  char out[32];
+  if (strftime(out, sizeof(out), "%Y-%m-%d %H:%M:%S", &tm_buf) == 0) return "";
+  return std::string(out);
+}
+
+static void push_event(const std::string& account_id, const BeagleIncomingMessage& msg) {
+  Event ev;
+  ev.account_id = account_id;
+  ev.peer = msg.peer;
+  ev.text = msg.text;
+  ev.media_path = msg.media_path;
+  ev.media_url = msg.media_url;
+  ev.media_type = msg.media_type;
+  ev.filename = msg.filename;
+  ev.size = msg.size;
+  ev.msg_id = msg.msg_id;
+  ev.ts = msg.ts;
+  ev.received_us = msg.received_us;
+  ev.enqueued_us = latency_now_us();
+  if (msg.decoded_us > 0) latency_record(LatencyStage::InDecodedToEnqueued, ev.enqueued_us - msg.decoded_us);
+
+  {
+    std::lock_guard<std::mutex> lock(g_events_mu);
+    g_events.push_back(ev);
+    g_directory_events.push_back(std::move(ev));
+  }
+  log_debug(std::string("[sidecar] queued event account=") + account_id
+            + " peer=" + msg.peer
+            + " text_len=" + std::to_string(msg.text.size())
+            + " ts=" + std::to_string(msg.ts));
+}
+
+// Events nobody drained before shutdown, kept across the restart. Numbers and
+// short fields come first and text last, so key lookups on a line cannot hit
+// a quoted key inside the message text.
+static std::string pending_event_line(const Event& ev, const char* queue) {
+  std::ostringstream oss;
+  oss << "{\"queue\":\"" << queue << "\""
+      << ",\"ts\":" << ev.ts
+      << ",\"size\":" << ev.size
+      << ",\"accountId\":\"" << json_escape(ev.account_id) << "\""
+      << ",\"peer\":\"" << json_escape(ev.peer) << "\""
+      << ",\"msgId\":\"" << json_escape(ev.msg_id) << "\""
+      << ",\"mediaUrl\":\"" << json_escape(ev.media_url) << "\""
+      << ",\"mediaPath\":\"" << json_escape(ev.media_path) << "\""
+      << ",\"mediaType\":\"" << json_escape(ev.media_type) << "\""
+      << ",\"filename\":\"" << json_escape(ev.filename) << "\""
+      << ",\"text\":\"" << json_escape(ev.text) << "\"}";
+  return oss.str();
+}
+
+static long long pending_event_number(const std::string& line, const std::string& key) {
+  std::string needle = "\"" + key + "\":";
+  size_t pos = line.find(needle);
+  if (pos == std::string::npos) return 0;
+  return std::strtoll(line.c_str() + pos + needle.size(), nullptr, 10);
+}
+
+// Newest events kept per queue; /directory-events is not polled everywhere and
+// would otherwise carry every message ever received from restart to restart.
+constexpr size_t kMaxSavedEventsPerQueue = 10000;
+
+static size_t save_pending_events(const std::string& path) {
+  std::vector<std::string> lines;
+  {
+    std::lock_guard<std::mutex> lock(g_events_mu);
+    auto append = [&](const std::vector<Event>& queue, const char* name) {
+      size_t skip = queue.size() > kMaxSavedEventsPerQueue ? queue.size() - kMaxSavedEventsPerQueue : 0;
+      for (size_t i = skip; i < queue.size(); ++i) lines.push_back(pending_event_line(queue[i], name));
+    };
+    append(g_events, "events");
+    append(g_directory_events, "directory");
+  }
+  if (lines.empty()) return 0;
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    for (const auto& line : lines) out << line << "\n";
+    out.flush();
+    if (!out) {
+      log_warn("[sidecar] failed to save undrained events path=" + path);
+      std::remove(tmp.c_str());
+      return 0;
+    }
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    log_warn("[sidecar] failed to save undrained events path=" + path);
+    return 0;
+  }
+  return lines.size();
+}
+
+// Puts events saved by the previous shutdown ahead of anything queued since.
+static size_t load_pending_events(const std::string& path) {
+  std::ifstream in(path);
+  if (!in) return 0;
+  std::vector<Event> events;
+  std::vector<Event> directory_events;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] != '{') continue;
+    Event ev;
+    std::string queue;
+    extract_json_string(line, "queue", queue);
+    ev.ts = pending_event_number(line, "ts");
+    ev.size = static_cast<unsigned long long>(pending_event_number(line, "size"));
+    extract_json_string(line, "accountId", ev.account_id);
+    extract_json_string(line, "peer", ev.peer);
+    extract_json_string(line, "msgId", ev.msg_id);
+    extract_json_string(line, "mediaUrl", ev.media_url);
+    extract_json_string(line, "mediaPath", ev.media_path);
+    extract_json_string(line, "mediaType", ev.media_type);
+    extract_json_string(line, "filename", ev.filename);
+    extract_json_string(line, "text", ev.text);
+    if (ev.peer.empty()) continue;
+    (queue == "directory" ? directory_events : events).push_back(std::move(ev));
+  }
+  in.close();
+  std::remove(path.c_str());
+  size_t loaded = events.size() + directory_events.size();
+  std::lock_guard<std::mutex> lock(g_events_mu);
+  g_events.insert(g_events.begin(), std::make_move_iterator(events.begin()), std::make_move_iterator(events.end()));
+  g_directory_events.insert(g_directory_events.begin(),
+                            std::make_move_iterator(directory_events.begin()),
+                            std::make_move_iterator(directory_events.end()));
+  return loaded;
+}
+
+struct ServerOptions {
+  int port = 39091;
+  std::string token;
+  std::string data_dir = "./data";
+  std::string config_path;
+  std::string openclaw_config_path;
+  std::string directory_address;
+  std::string directory_hello = "openclaw-beagle-channel";
+  bool emit_presence = false;
+  std::string log_level;  // overrides BEAGLE_LOG_LEVEL
+  bool log_json = false;
+  int shutdown_timeout_ms = 10000;  // deadline for stopping all accounts on SIGTERM/SIGINT
+  int start_concurrency = 4;        // accounts whose SDK starts at the same time
+};
+
+static ServerOptions parse_args(int argc, char** argv) {
+  ServerOptions opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--port" && i + 1 < argc) {
+      opts.port = std::atoi(argv[++i]);
+    } else if (arg == "--token" && i + 1 < argc) {
+      opts.token = argv[++i];
+    } else if (arg == "--data-dir" && i + 1 < argc) {
+      opts.data_dir = argv[++i];
+    } else if (arg == "--config" && i + 1 < argc) {
+      opts.config_path = argv[++i];
+    } else if (arg == "--openclaw-config" && i + 1 < argc) {
+      opts.openclaw_config_path = argv[++i];
+    } else if (arg == "--directory-address" && i + 1 < argc) {
+      opts.directory_address = argv[++i];
+    } else if (arg == "--directory-hello" && i + 1 < argc) {
+      opts.directory_hello = argv[++i];
+    } else if (arg == "--emit-presence") {
+      opts.emit_presence = true;
+    } else if (arg == "--log-level" && i + 1 < argc) {
+      opts.log_level = argv[++i];
+    } else if (arg == "--log-json") {
+      opts.log_json = true;
+    } else if (arg == "--start-concurrency" && i + 1 < argc) {
+      opts.start_concurrency = std::atoi(argv[++i]);
+    } else if (arg == "--shutdown-timeout-ms" && i + 1 < argc) {
+      opts.shutdown_timeout_ms = std::atoi(argv[++i]);
+    }
+  }
+  return opts;
+}
+
+static std::string resolve_config_path(const ServerOptions& opts) {
+  if (!opts.config_path.empty()) return opts.config_path;
+
+  std::string env_config = get_env("BEAGLE_CONFIG");
+  if (!env_config.empty()) return env_config;
+
+  std::string sdk_root = get_env("BEAGLE_SDK_ROOT");
+  if (!sdk_root.empty()) {
+    std::string candidate = sdk_root + "/config/carrier.conf";
+    if (file_exists(candidate)) return candidate;
+  }
+
+  if (file_exists("./carrier.conf")) return "./carrier.conf";
+
+  return std::string();
+}
+
+static std::string resolve_openclaw_config_path(const ServerOptions& opts) {
+  if (!opts.openclaw_config_path.empty()) return expand_home(opts.openclaw_config_path);
+  std::string env_path = get_env("BEAGLE_OPENCLAW_CONFIG");
+  if (env_path.empty()) env_path = get_env("OPENCLAW_CONFIG");
+  if (!env_path.empty()) return expand_home(env_path);
+  std::string home = get_env("HOME");
+  if (!home.empty()) {
+    std::string default_path = home + "/.openclaw/openclaw.json";
+    if (file_exists(default_path)) return default_path;
+  }
+  return "";
+}
+
+static std::string resolve_directory_address(const ServerOptions& opts) {
+  if (!trim_copy(opts.directory_address).empty()) return trim_copy(opts.directory_address);
+  std::string env_addr = get_env("BEAGLE_DIRECTORY_ADDRESS");
+  if (env_addr.empty()) env_addr = get_env("OPENCLAW_DIRECTORY_ADDRESS");
+  return trim_copy(env_addr);
+}
+
+static std::string resolve_directory_hello(const ServerOptions& opts) {
+  if (!trim_copy(opts.directory_hello).empty()) return trim_copy(opts.directory_hello);
+  std::string env_hello = get_env("BEAGLE_DIRECTORY_HELLO");
+  if (env_hello.empty()) env_hello = get_env("OPENCLAW_DIRECTORY_HELLO");
+  env_hello = trim_copy(env_hello);
+  if (env_hello.empty()) env_hello = "openclaw-beagle-channel";
+  return env_hello;
+}
+
+static std::string account_data_dir(const std::string& base_data_dir,
+                                    const std::string& account_id,
+                                    bool multi_account) {
+  if (!multi_account) return base_data_dir;
+  std::string cleaned = sanitize_account_id(account_id);
+  if (cleaned.empty()) cleaned = "default";
+  std::string nested = base_data_dir + "/accounts/" + cleaned;
+
+  if ((cleaned == "main" || cleaned == "default") && dir_exists(base_data_dir) && !dir_exists(nested)) {
+    DIR* dir = opendir(base_data_dir.c_str());
+    if (dir) {
+      bool has_legacy_entries = false;
+      for (dirent* ent = readdir(dir); ent; ent = readdir(dir)) {
+        std::string name = ent->d_name;
+        if (name.empty() || name == "." || name == ".." || name == "accounts") continue;
+        has_legacy_entries = true;
+        break;
+      }
+      closedir(dir);
+      if (has_legacy_entries) {
+        log_line(std::string("[sidecar] legacy Carrier root detected; reusing ")
+                 + base_data_dir + " for account=" + cleaned);
+        return base_data_dir;
+      }
+    }
+  }
+
+  return nested;
+}
+
+static std::string requested_account_id(const std::string& headers, const std::string& body) {
+  std::string account_id = trim_copy(header_value(headers, "X-Beagle-Account"));
+  if (account_id.empty()) extract_json_string(body, "accountId", account_id);
+  return sanitize_account_id(account_id);
+}
+
+static std::string url_decode(const std::string& in) {
+  std::string out;
+  out.reserve(in.size());
+  for (size_t i = 0; i < in.size(); ++i) {
+    if (in[i] == '+') {
+      out += ' ';
+    } else if (in[i] == '%' && i + 2 < in.size() && std::isxdigit(static_cast<unsigned char>(in[i + 1]))
+               && std::isxdigit(static_cast<unsigned char>(in[i + 2]))) {
+      out += static_cast<char>(std::stoi(in.substr(i + 1, 2), nullptr, 16));
+      i += 2;
+    } else {
+      out += in[i];
+    }
+  }
+  return out;
+}
+
+// Value of `name` in an `a=1&b=2` query string, percent-decoded; empty when absent.
+static std::string query_param(const std::string& query, const std::string& name) {
+  size_t pos = 0;
+  while (pos <= query.size()) {
+    size_t amp = query.find('&', pos);
+    if (amp == std::string::npos) amp = query.size();
+    size_t eq = query.find('=', pos);
+    if (eq != std::string::npos && eq < amp && query.compare(pos, eq - pos, name) == 0 && eq - pos == name.size()) {
+      return url_decode(query.substr(eq + 1, amp - eq - 1));
+    }
+    pos = amp + 1;
+  }
+  return "";
+}
+
+static long long query_number(const std::string& query, const std::string& name, long long fallback) {
+  std::string raw = query_param(query, name);
+  if (raw.empty()) return fallback;
+  char* end = nullptr;
+  long long v = std::strtoll(raw.c_str(), &end, 10);
+  return end && *end == '\0' ? v : fallback;
+}
+
+static std::string build_directory_profile_payload(const AccountRuntime* runtime,
+                                                   const HostFactsSnapshot& host,
+                                                   const std::string& openclaw_version,
+                                                   const std::string& beagle_channel_version) {
+  if (!runtime || !runtime->sdk) return "";
+
+  std::string public_profile = trim_copy(runtime->public_profile_json);
+  if (public_profile.empty()) {
+    bool has_public_profile = false;
+    auto append_public_field = [&](const std::string& key, const std::string& value) {
+      if (value.empty()) return;
+      public_profile += has_public_profile ? "," : "";
+      public_profile += "\"" + json_escape(key) + "\":\"" + json_escape(value) + "\"";
+      has_public_profile = true;
+    };
+
+    append_public_field("displayName", runtime->public_display_name);
+    append_public_field("headline", runtime->public_headline);
+    append_public_field("avatarUrl", runtime->public_avatar);
+    append_public_field("homepageUrl", runtime->public_homepage);
+
+    if (!runtime->public_links.empty()) {
+      std::string links_json;
+      bool has_links = false;
+      for (const auto& kv : runtime->public_links) {
+        if (kv.first.empty() || kv.second.empty()) continue;
+        links_json += has_links ? "," : "";
+        links_json += "\"" + json_escape(kv.first) + "\":\"" + json_escape(kv.second) + "\"";
+        has_links = true;
+      }
+      if (has_links) {
+        public_profile += has_public_profile ? "," : "";
+        public_profile += "\"socials\":{" + links_json + "}";
+      }
+    }
+  }
+
+  std::string payload = std::string("{\"profile\":{\"address\":\"")
+      + json_escape(runtime->sdk->address())
+      + "\",\"agentName\":\"" + json_escape(runtime->agent_name)
+      + "\",\"openclawVersion\":\"" + json_escape(openclaw_version)
+      + "\",\"beagleChannelVersion\":\"" + json_escape(beagle_channel_version)
+      + "\",\"hostName\":\"" + json_escape(host.host_name)
+      + "\",\"hostIp\":\"" + json_escape(host.host_ip)
+      + "\",\"hostIpExternal\":\"" + json_escape(host.host_ip_external) + "\"";
+  if (!public_profile.empty()) {
+    payload += ",\"publicProfile\":" + public_profile;
+  }
+  payload += "}}";
+  return payload;
+}
+
+// Befriends one directory from one account and pushes the profile once the
+// directory is online. Each step() is one attempt of the former blocking
+// loop: up to 12 add attempts, then a wait of up to 4 minutes for the
+// directory to connect and up to 6 pushes 2s apart each time it is online.
+// The profile is sent only once, so the first push also waits up to 30s for
+// HostFacts' first WAN lookup rather than going out without hostIpExternal.
+// The wait is a when_friend_online() subscription that wakes the task on
+// the scheduler; the scheduled delay only serves as the timeout.
+struct DirectoryBootstrap : std::enable_shared_from_this<DirectoryBootstrap> {
+  enum class Phase { Start, AddFriend, WaitOnline, PushProfile };
+
+  TimerWheel* wheel = nullptr;
+  AccountRuntime* account = nullptr;
+  std::string account_id;
+  std::string dir_addr;
+  std::string hello;
+  const HostFacts* host_facts = nullptr;
+  std::shared_ptr<const OpenclawVersion> openclaw_version;
+  std::string beagle_channel_version;
+
+  Phase phase = Phase::Start;
+  int add_attempt = 0;
+  int push_attempt = 0;
+  long long wait_deadline_ms = 0;
+  long long facts_deadline_ms = 0;
+  bool waiting = false;
+  uint64_t waiter_id = 0;
+  std::atomic<bool> online{false};
+  std::string dir_userid;
+
+  // Milliseconds until the next step, or -1 when done.
+  long long step() {
+    if (!account || !account->sdk) return -1;
+    switch (phase) {
+      case Phase::Start:
+        if (account->sdk->has_friend(dir_addr)) {
+          log_debug(std::string("[sidecar] directory friend already exists, skipping add account=")
+                    + account_id + " address=" + dir_addr);
+          return befriended();
+        }
+        phase = Phase::AddFriend;
+        return add_friend();
+      case Phase::AddFriend:
+        return add_friend();
+      case Phase::WaitOnline:
+        return wait_online();
+      case Phase::PushProfile:
+        return push_profile();
+    }
+    return -1;
+  }
+
+ private:
+  long long add_friend() {
+    if (++add_attempt > 12) {
+      log_warn(std::string("[sidecar] directory friend add failed after retries account=")
+               + account_id + " address=" + dir_addr);
+      return -1;
+    }
+    if (!account->sdk->status().ready) return 2000;
+    bool added = account->sdk->add_friend(dir_addr, hello);
+    log_line(std::string("[sidecar] directory friend add account=") + account_id
+             + " address=" + dir_addr
+             + " attempt=" + std::to_string(add_attempt)
+             + " result=" + (added ? "ok" : "failed"));
+    return added ? befriended() : 5000;
+  }
+
+  long long befriended() {
+    dir_userid = account->sdk->id_from_address(dir_addr);
+    if (dir_userid.empty()) {
+      log_warn(std::string("[sidecar] directory friend but cannot derive userid account=")
+               + account_id + " address=" + dir_addr);
+      return -1;
+    }
+    phase = Phase::WaitOnline;
+    return wait_online();
+  }
+
+  long long wait_online() {
+    const long long now_ms = latency_now_us() / 1000;
+    if (wait_deadline_ms == 0) wait_deadline_ms = now_ms + 240 * 1000;
+    if (!waiting) {
+      waiting = true;
+      const uint64_t task = TimerWheel::current_task();
+      auto self = shared_from_this();
+      // Fires inline when the directory is online already; the step then
+      // goes straight on, so only wake the task from other threads.
+      waiter_id = account->sdk->when_friend_online(dir_userid, [self, task](const std::string&) {
+        self->online = true;
+        if (TimerWheel::current_task() != task) self->wheel->wake(task);
+      });
+    }
+    if (!online.exchange(false)) {
+      if (now_ms < wait_deadline_ms) return wait_deadline_ms - now_ms;
+      account->sdk->cancel_friend_online_wait(waiter_id);
+      log_warn(std::string("[sidecar] directory auto profile push timeout account=")
+               + account_id + " address=" + dir_addr + " peer=" + dir_userid);
+      return -1;
+    }
+    waiting = false;
+    phase = Phase::PushProfile;
+    push_attempt = 0;
+    return push_profile();
+  }
+
+  long long push_profile() {
+    std::shared_ptr<const HostFactsSnapshot> facts = host_facts->snapshot();
+    if (!facts->external_checked) {
+      const long long now_ms = latency_now_us() / 1000;
+      if (facts_deadline_ms == 0) facts_deadline_ms = now_ms + 30 * 1000;
+      if (now_ms < facts_deadline_ms) return 1000;
+    }
+    ++push_attempt;
+    // Built per push so it carries the host facts and version current now.
+    std::string profile_payload = build_directory_profile_payload(
+        account, *facts, openclaw_version->get(), beagle_channel_version);
+    BeagleSendOutcome outcome;
+    bool profile_ok = account->sdk->send_text(dir_userid, profile_payload, std::string(), &outcome);
+    log_line(std::string("[sidecar] directory auto profile push account=") + account_id
+             + " address=" + dir_addr
+             + " peer=" + dir_userid
+             + " push_attempt=" + std::to_string(push_attempt)
+             + " result=" + send_outcome_label(profile_ok, outcome));
+    // A queued push is the outbox's to deliver from here on.
+    if (profile_ok) return -1;
+    if (push_attempt < 6) return 2000;
+    // Out of pushes for this online window; wait for the next connect.
+    phase = Phase::WaitOnline;
+    return 4000;
+  }
+};
+
+// Stops every account on its own thread so slow Carrier teardowns overlap.
+// False if some account is still stopping at the deadline; those threads
+// are left running and the caller must not tear down shared state.
+static bool stop_accounts(const std::map<std::string, std::unique_ptr<AccountRuntime>>& accounts, int timeout_ms) {
+  struct Progress {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::set<std::string> stopping;
+  };
+  auto progress = std::make_shared<Progress>();
+  for (const auto& kv : accounts) {
+    BeagleSdk* sdk = kv.second ? kv.second->sdk.get() : nullptr;
+    if (!sdk) continue;
+    const std::string account_id = kv.first;
+    {
+      std::lock_guard<std::mutex> lock(progress->mu);
+      progress->stopping.insert(account_id);
+    }
+    std::thread([progress, sdk, account_id]() {
+      sdk->stop();
+      std::lock_guard<std::mutex> lock(progress->mu);
+      progress->stopping.erase(account_id);
+      progress->cv.notify_all();
+    }).detach();
+  }
+  std::unique_lock<std::mutex> lock(progress->mu);
+  if (progress->cv.wait_for(lock, std::chrono::milliseconds(std::max(0, timeout_ms)),
+                            [&]() { return progress->stopping.empty(); })) {
+    return true;
+  }
+  std::string still;
+  for (const auto& id : progress->stopping) still += (still.empty() ? "" : ",") + id;
+  log_warn("[sidecar] accounts still stopping after " + std::to_string(timeout_ms) + "ms: " + still);
+  return false;
+}
+
+int sidecar_main(int argc, char** argv) {
+  ServerOptions opts = parse_args(argc, argv);
+  open_stop_pipe();
+  if (!opts.log_level.empty() || opts.log_json) {
+    LogOptions log_opts = log_options();
+    if (!opts.log_level.empty() && !parse_log_level(opts.log_level, log_opts.level)) {
+      log_warn("[sidecar] unknown --log-level " + opts.log_level);
+    }
+    if (opts.log_json) log_opts.json = true;
+    log_configure(log_opts);
+  }
+  std::string config_path = resolve_config_path(opts);
+  if (config_path.empty()) {
+    log_error("Missing Carrier config. Provide --config or set BEAGLE_SDK_ROOT.");
+    return 1;
+  }
+
+  std::string openclaw_config_path = resolve_openclaw_config_path(opts);
+  std::string directory_address = resolve_directory_address(opts);
+  std::string directory_hello = resolve_directory_hello(opts);
+  std::shared_ptr<OpenclawVersion> openclaw_version = resolve_openclaw_version(openclaw_config_path, opts.data_dir);
+  std::string beagle_channel_version = resolve_beagle_channel_version_from_path();
+  std::vector<AgentProfile> agent_profiles;
+  if (!openclaw_config_path.empty() && file_exists(openclaw_config_path)) {
+    agent_profiles = load_agent_profiles_from_openclaw_config(openclaw_config_path);
+    log_line(std::string("[sidecar] openclaw config=") + openclaw_config_path
+             + " discovered_agents=" + std::to_string(agent_profiles.size()));
+  }
+  std::string home = get_env("HOME");
+  if (agent_profiles.empty() && !home.empty()) {
+    size_t n_before = agent_profiles.size();
+    merge_profiles_from_agents_dir(agent_profiles, home);
+    if (agent_profiles.size() > n_before) {
+      log_line(std::string("[sidecar] discovered agent dirs from ~/.openclaw/agents/ total=") +
+               std::to_string(agent_profiles.size()));
+    }
+  }
+
+  if (agent_profiles.empty()) {
+    AgentProfile fallback;
+    // OpenClaw's default agent slug is "main" (see `openclaw agents list`), not "default".
+    fallback.account_id = "main";
+    fallback.agent_id = "main";
+    std::string dn = trim_copy(get_env("BEAGLE_DEFAULT_AGENT_NAME"));
+    fallback.name = dn.empty() ? std::string("main") : dn;
+    fallback.description = "OpenClaw Beagle agent";
+    fallback.region = "California";
+    agent_profiles.push_back(std::move(fallback));
+  }
+
+
+  const bool multi_account = agent_profiles.size() > 1;
+  std::map<std::string, std::unique_ptr<AccountRuntime>> accounts;
+  std::string default_account_id;
+
+  for (const auto& profile : agent_profiles) {
+    std::string account_id = sanitize_account_id(profile.account_id);
+    if (account_id.empty()) account_id = sanitize_account_id(profile.agent_id);
+    if (account_id.empty()) account_id = "default";
+    if (accounts.find(account_id) != accounts.end()) continue;
+
+    std::unique_ptr<AccountRuntime> runtime(new AccountRuntime());
+    runtime->account_id = account_id;
+    runtime->agent_id = profile.agent_id.empty() ? account_id : profile.agent_id;
+    runtime->default_agent_name = profile.name.empty() ? runtime->agent_id : profile.name;
+    runtime->agent_name = runtime->default_agent_name;
+    runtime->public_display_name = profile.public_display_name;
+    runtime->public_headline = profile.public_headline;
+    runtime->public_avatar = profile.public_avatar;
+    runtime->public_homepage = profile.public_homepage;
+    runtime->public_links = profile.public_links;
+    runtime->sdk.reset(new BeagleSdk());
+
+    BeagleSdkOptions& sdk_opts = runtime->sdk_options;
+    sdk_opts.config_path = config_path;
+    sdk_opts.data_dir = account_data_dir(opts.data_dir, account_id, multi_account);
+    sdk_opts.account_id = account_id;
+    sdk_opts.profile_name = runtime->agent_name;
+    sdk_opts.profile_gender = profile.gender;
+    sdk_opts.profile_phone = profile.phone;
+    sdk_opts.profile_email = profile.email;
+    sdk_opts.profile_description = profile.description;
+    sdk_opts.profile_region = profile.region;
+    sdk_opts.openclaw_agent_id = runtime->agent_id;
+    // Process-wide, whichever account happens to start first.
+    sdk_opts.crawler_cache_dir = opts.data_dir + "/crawler_index";
+    sdk_opts.emit_presence = opts.emit_presence || !get_env("BEAGLE_EMIT_PRESENCE").empty();
+    accounts.emplace(account_id, std::move(runtime));
+  }
+
+  if (accounts.empty()) {
+    log_line("Failed to start any Beagle account");
+    return 1;
+  }
+  if (accounts.find("main") != accounts.end()) {
+    default_account_id = "main";
+  } else if (accounts.find("default") != accounts.end()) {
+    default_account_id = "default";
+  } else if (!accounts.empty()) {
+    default_account_id = accounts.begin()->first;
+  }
+
+  // ── Directory auto-bootstrap ─────────────────────────────────────
+  //
+  // Use the OpenClaw directory as the built-in default so new installs
+  // work without extra BEAGLE_DIRECTORY_ADDRESS setup, while keeping the
+  // previous directory as a backup bootstrap target.
+  const std::string DEFAULT_DIR = "ZJUCSC38KFw7DSwpfLp1HCem3dJEA5NG2ZvahbEjAUFZ4WUb1jV2";
+  const std::string DEFAULT_DIR_1 = "bKaapxLjDGwuCZ7oohVFMVbcHWFYy7yNVGXkVSVL8AkAxbokCGi2";
+
+  std::vector<std::string> dir_addresses;
+  if (!trim_copy(directory_address).empty()) {
+    dir_addresses.push_back(trim_copy(directory_address));
+  } else {
+    dir_addresses.push_back(DEFAULT_DIR);
+    dir_addresses.push_back(DEFAULT_DIR_1);
+  }
+
+  // Host name and IPs for directory profiles, kept fresh off the request path.
+  HostFacts host_facts;
+  // Bootstrap waits and /addFriend retries run as steps on one timer thread.
+  TimerWheel scheduler;
+  auto schedule_directory_bootstrap = [&](AccountRuntime* started) {
+    for (const std::string& dir_addr : dir_addresses) {
+      if (started->sdk->address() == dir_addr) continue;
+
+      auto bootstrap = std::make_shared<DirectoryBootstrap>();
+      bootstrap->wheel = &scheduler;
+      bootstrap->host_facts = &host_facts;
+      bootstrap->account = started;
+      bootstrap->account_id = started->account_id;
+      bootstrap->dir_addr = dir_addr;
+      bootstrap->hello = directory_hello;
+      bootstrap->openclaw_version = openclaw_version;
+      bootstrap->beagle_channel_version = beagle_channel_version;
+      scheduler.schedule(0, [bootstrap]() { return bootstrap->step(); });
+    }
+  };
+
+  int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (server_fd < 0) {
+    log_line("Failed to create socket");
+    return 1;
+  }
+
+  int opt = 1;
+  setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_port = htons(static_cast<uint16_t>(opts.port));
+
+  if (bind(server_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    log_error(std::string("Bind failed on 0.0.0.0:") + std::to_string(opts.port) + " — "
+              + std::strerror(errno)
+              + " (another process may already use this port; stop the other beagle-sidecar or pick --port)");
+    close(server_fd);
+    return 1;
+  }
+
+  if (listen(server_fd, 16) < 0) {
+    log_error(std::string("Listen failed on port ") + std::to_string(opts.port) + ": " + std::strerror(errno));
+    close(server_fd);
+    return 1;
+  }
+
+  log_line(std::string("Beagle sidecar listening on 0.0.0.0:") + std::to_string(opts.port));
+
+  // Accounts start in the background, at most --start-concurrency at a time,
+  // while the listener already answers; /health and /status report each
+  // account's state and requests for a starting account get 503.
+  std::vector<AccountRuntime*> start_queue;
+  for (auto& kv : accounts) start_queue.push_back(kv.second.get());
+  std::atomic<size_t> next_start{0};
+  std::atomic<size_t> failed_starts{0};
+  std::vector<std::thread> starters;
+  const size_t start_workers = std::min(start_queue.size(), static_cast<size_t>(std::max(1, opts.start_concurrency)));
+  for (size_t w = 0; w < start_workers; ++w) {
+    starters.emplace_back([&]() {
+      for (size_t i = next_start++; i < start_queue.size() && !g_stop_requested; i = next_start++) {
+        AccountRuntime* runtime = start_queue[i];
+        runtime->phase = AccountPhase::Starting;
+        const std::string callback_account = runtime->account_id;
+        if (!runtime->sdk->start(runtime->sdk_options, [callback_account](const BeagleIncomingMessage& msg) {
+              push_event(callback_account, msg);
+            })) {
+          runtime->phase = AccountPhase::Failed;
+          log_error(std::string("Failed to start Beagle SDK account=") + runtime->account_id);
+          if (++failed_starts == start_queue.size()) {
+            log_error("Failed to start any Beagle account");
+            request_stop();
+          }
+          continue;
+        }
+        runtime->phase = AccountPhase::Started;
+        log_line(std::string("[sidecar] started account=") + runtime->account_id
+                 + " agent=" + runtime->agent_id
+                 + " user_id=" + runtime->sdk->userid()
+                 + " address=" + runtime->sdk->address());
+        schedule_directory_bootstrap(runtime);
+      }
+    });
+  }
+
+  const std::string pending_events_path = opts.data_dir + "/pending_events.jsonl";
+  if (size_t loaded = load_pending_events(pending_events_path)) {
+    log_line("[sidecar] restored " + std::to_string(loaded) + " undrained event(s) from " + pending_events_path);
+  }
+
+  auto resolve_account = [&](const std::string& wanted) -> AccountRuntime* {
+    if (!wanted.empty()) {
+      auto it = accounts.find(wanted);
+      if (it != accounts.end()) return it->second.get();
+      // OpenClaw doctor often nests Beagle settings under channels.beagle.accounts.default while
+      // Carrier runtimes are keyed from agents.* (e.g. main, dirs). Map "default" to the same
+      // runtime we use when no X-Beagle-Account header is sent.
+      if (wanted == "default" && !default_account_id.empty()) {
+        auto fb = accounts.find(default_account_id);
+        if (fb != accounts.end()) return fb->second.get();
+      }
+      // Single-account sidecars are often queried through a deployment-specific
+      // account name (for example "dirs" or "default"). Treat that as the only
+      // runtime instead of reporting unknown_account forever.
+      if (accounts.size() == 1) return accounts.begin()->second.get();
+      return nullptr;
+    }
+    auto it = accounts.find(default_account_id);
+    if (it != accounts.end()) return it->second.get();
+    if (!accounts.empty()) return accounts.begin()->second.get();
+    return nullptr;
+  };
+
+  // Requests are served one at a time, so a stop request takes effect once
+  // the request in flight has been answered.
+  while (!g_stop_requested) {
+    pollfd fds[2] = {{server_fd, POLLIN, 0}, {g_stop_pipe[0], POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) continue;
+    if (fds[1].revents) break;
+    if (!(fds[0].revents & POLLIN)) continue;
+    int client_fd = accept(server_fd, nullptr, nullptr);
+    if (client_fd < 0) continue;
+
+    std::string request = read_until(client_fd, "\r\n\r\n");
+    size_t header_end = request.find("\r\n\r\n");
+    std::string headers = header_end == std::string::npos ? request : request.substr(0, header_end + 2);
+
+    int content_length = get_content_length(headers);
+    std::string body;
+    if (content_length > 0) {
+      body = request.substr(header_end + 4);
+      while (static_cast<int>(body.size()) < content_length) {
+        char buf[4096];
+        ssize_t n = recv(client_fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        body.append(buf, buf + n);
+      }
+    }
+    latency_set_request_start(latency_now_us());
+
+    std::istringstream line_stream(request);
+    std::string method;
+    std::string path;
+    line_stream >> method >> path;
+    std::string query;
+    size_t query_start = path.find('?');
+    if (query_start != std::string::npos) {
+      query = path.substr(query_start + 1);
+      path.resize(query_start);
+    }
+
+    if (!opts.token.empty()) {
+      std::string auth = header_value(headers, "Authorization");
+      std::string expected = "Bearer " + opts.token;
+      if (auth != expected) {
+        log_warn(std::string("[sidecar] unauthorized request for ") + path
+                 + " from " + client_ip(client_fd));
+        send_response(client_fd, 401, "application/json", "{\"ok\":false,\"error\":\"unauthorized\"}");
+        close(client_fd);
+        continue;
+      }
+    }
+
+    std::string wanted_account_id = requested_account_id(headers, body);
+    if (wanted_account_id.empty()) wanted_account_id = sanitize_account_id(query_param(query, "accountId"));
+    AccountRuntime* account = resolve_account(wanted_account_id);
+    // Queue drains and diagnostics never touch the SDK; everything else waits for it.
+    if (account && !account->started() && path != "/health" && path != "/status" && path != "/events"
+        && path != "/directory-events" && path != "/debug/latency") {
+      send_response(client_fd, 503, "application/json",
+                    std::string("{\"ok\":false,\"error\":\"account_not_ready\",\"state\":\"")
+                        + account_phase_name(account->phase) + "\"}");
+      close(client_fd);
+      continue;
+    }
+
+    if (method == "GET" && path == "/health") {
+      if (!wanted_account_id.empty() && !account) {
+        send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"unknown_account\"}");
+        close(client_fd);
+        continue;
+      }
+      std::ostringstream oss;
+      oss << "{"
+          << "\"ok\":true"
+          << ",\"requestedAccountId\":\"" << json_escape(account ? account->account_id : "") << "\""
+          << ",\"userId\":\"" << json_escape(account && account->started() ? account->sdk->userid() : "") << "\""
+          << ",\"address\":\"" << json_escape(account && account->started() ? account->sdk->address() : "") << "\""
+          << ",\"accounts\":[";
+      bool first = true;
+      for (const auto& kv : accounts) {
+        const AccountRuntime* runtime = kv.second.get();
+        if (!runtime || !runtime->sdk) continue;
+        if (!first) oss << ",";
+        first = false;
+        const bool started = runtime->started();
+        oss << "{"
+            << "\"accountId\":\"" << json_escape(runtime->account_id) << "\""
+            << ",\"agentId\":\"" << json_escape(runtime->agent_id) << "\""
+            << ",\"agentName\":\"" << json_escape(runtime->agent_name) << "\""
+            << ",\"state\":\"" << account_phase_name(runtime->phase) << "\""
+            << ",\"ready\":" << (started && runtime->sdk->status().ready ? "true" : "false")
+            << ",\"userId\":\"" << json_escape(started ? runtime->sdk->userid() : "") << "\""
+            << ",\"address\":\"" << json_escape(started ? runtime->sdk->address() : "") << "\""
+            << "}";
+      }
+      oss << "]"
+          << "}";
+      send_response(client_fd, 200, "application/json", oss.str());
+    } else if (method == "GET" && path == "/status") {
+      if (!account) {
+        send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"unknown_account\"}");
+        close(client_fd);
+        continue;
+      }
+      BeagleStatus status = account->started() ? account->sdk->status() : BeagleStatus();
+      std::string last_online_human = to_iso8601(status.last_online_ts);
+      std::string last_offline_human = to_iso8601(status.last_offline_ts);
+      std::ostringstream oss;
+      oss << "{"
+          << "\"ok\":true"
+          << ",\"accountId\":\"" << json_escape(account->account_id) << "\""
+          << ",\"agentId\":\"" << json_escape(account->agent_id) << "\""
+          << ",\"state\":\"" << account_phase_name(account->phase) << "\""
+          << ",\"ready\":" << (status.ready ? "true" : "false")
+          << ",\"connected\":" << (status.connected ? "true" : "false")
+          << ",\"lastPeer\":\"" << json_escape(status.last_peer) << "\""
+          << ",\"lastOnlineTs\":" << status.last_online_ts
+          << ",\"lastOfflineTs\":" << status.last_offline_ts
+          << ",\"lastOnline\":\"" << json_escape(last_online_human) << "\""
+          << ",\"lastOffline\":\"" << json_escape(last_offline_human) << "\""
+          << ",\"onlineCount\":" << status.online_count
+          << ",\"outboxPending\":" << status.outbox_pending
+          << ",\"offlineCount\":" << status.offline_count
+          << "}";
+      send_response(client_fd, 200, "application/json", oss.str());
+    } else if (method == "GET" && path == "/history") {
+      if (!account) {
+        send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"unknown_account\"}");
+        close(client_fd);
+        continue;
+      }
+      HistoryQuery hq;
+      hq.peer = query_param(query, "peer");
+      hq.since_ms = query_number(query, "since", 0);
+      long long cursor = query_number(query, "cursor", 0);
+      hq.after_id = cursor > 0 ? static_cast<unsigned long long>(cursor) : 0;
+      long long limit = query_number(query, "limit", 50);
+      hq.limit = static_cast<size_t>(std::max(1LL, std::min(limit, 500LL)));
+      HistoryPage page;
+      if (!account->sdk->history(hq, page)) {
+        send_response(client_fd, 503, "application/json", "{\"ok\":false,\"error\":\"history_unavailable\"}");
+        close(client_fd);
+        continue;
+      }
+      std::ostringstream oss;
+      oss << "{\"ok\":true"
+          << ",\"accountId\":\"" << json_escape(account->account_id) << "\""
+          << ",\"messages\":[";
+      for (size_t i = 0; i < page.records.size(); ++i) {
+        const HistoryRecord& rec = page.records[i];
+        if (i) oss << ",";
+        oss << "{"
+            << "\"id\":\"" << rec.id << "\""
+            << ",\"peer\":\"" << json_escape(rec.peer) << "\""
+            << ",\"direction\":\"" << rec.direction << "\""
+            << ",\"text\":\"" << json_escape(rec.text) << "\""
+            << ",\"filename\":\"" << json_escape(rec.filename) << "\""
+            << ",\"mediaType\":\"" << json_escape(rec.media_type) << "\""
+            << ",\"msgId\":\"" << json_escape(rec.msg_id) << "\""
+            << ",\"ts\":" << rec.ts_ms
+            << ",\"recordedAt\":" << rec.recorded_ms
+            << "}";
+      }
+      oss << "],\"nextCursor\":";
+      if (page.next_cursor) {
+        oss << "\"" << page.next_cursor << "\"";
+      } else {
+        oss << "null";
+      }
+      oss << "}";
+      send_response(client_fd, 200, "application/json", oss.str());
+    } else if (method == "GET" && path == "/search") {
+      if (!account) {
+        send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"unknown_account\"}");
+        close(client_fd);
+        continue;
+      }
+      std::string q = query_param(query, "q");
+      if (trim_copy(q).empty()) {
+        send_response(client_fd, 400, "application/json", "{\"ok\":false,\"error\":\"missing_query\"}");
+        close(client_fd);
+        continue;
+      }
+      long long limit = query_number(query, "limit", 20);
+      std::vector<SearchHit> hits;
+      if (!account->sdk->search(q, query_param(query, "peer"),
+                                static_cast<size_t>(std::max(1LL, std::min(limit, 200LL))), hits)) {
+        send_response(client_fd, 503, "application/json", "{\"ok\":false,\"error\":\"search_unavailable\"}");
+        close(client_fd);
+        continue;
+      }
+      std::ostringstream oss;
+      oss << "{\"ok\":true"
+          << ",\"accountId\":\"" << json_escape(account->account_id) << "\""
+          << ",\"hits\":[";
+      for (size_t i = 0; i < hits.size(); ++i) {
+        const HistoryRecord& rec = hits[i].record;
+        if (i) oss << ",";
+        oss << "{"
+            << "\"id\":\"" << rec.id << "\""
+            << ",\"score\":" << hits[i].score
+            << ",\"peer\":\"" << json_escape(rec.peer) << "\""
+            << ",\"direction\":\"" << rec.direction << "\""
+            << ",\"text\":\"" << json_escape(rec.text) << "\""
+            << ",\"filename\":\"" << json_escape(rec.filename) << "\""
+            << ",\"mediaType\":\"" << json_escape(rec.media_type) << "\""
+            << ",\"msgId\":\"" << json_escape(rec.msg_id) << "\""
+            << ",\"ts\":" << rec.ts_ms
+            << ",\"recordedAt\":" << rec.recorded_ms
+            << "}";
+      }
+      oss << "]}";
+      send_response(client_fd, 200, "application/json", oss.str());
+    } else if (method == "GET" && path == "/events") {
+      if (!wanted_account_id.empty() && !account) {
+        send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"unknown_account\"}");
+        close(client_fd);
+        continue;
+      }
+      std::vector<Event> events;
+      std::vector<Event> remaining;
+      const std::string selected_account = account ? account->account_id : "";
+      {
+        std::lock_guard<std::mutex> lock(g_events_mu);
+        remaining.reserve(g_events.size());
+        for (auto& ev : g_events) {
+          if (selected_account.empty() || ev.account_id == selected_account) {
+            events.push_back(std::move(ev));
+          } else {
+            remaining.push_back(std::move(ev));
+          }
+        }
+        g_events.swap(remaining);
+      }
+      if (!events.empty()) {
+        std::string ua = header_value(headers, "User-Agent");
+        std::ostringstream msg;
+        msg << "[sidecar] /events account=" << (selected_account.empty() ? "(all)" : selected_account)
+            << " -> " << events.size() << " event(s)"
+            << " from " << client_ip(client_fd);
+        if (!ua.empty()) msg << " ua=" << ua;
+        log_debug(msg.str());
+      }
+      const long long drained_us = latency_now_us();
+      for (const auto& ev : events) {
+        if (ev.enqueued_us > 0) latency_record(LatencyStage::InEnqueuedToDrained, drained_us - ev.enqueued_us);
+        if (ev.received_us > 0) latency_record(LatencyStage::InTotal, drained_us - ev.received_us);
+      }
+      send_response(client_fd, 200, "application/json", events_to_json(std::move(events)));
+    } else if (method == "GET" && path == "/debug/latency") {
+      std::string report = "{\"ok\":true,\"latency\":" + latency_report_json() + "}";
+      if (query_param(query, "reset") == "1") latency_reset();
+      send_response(client_fd, 200, "application/json", report);
+    } else if (method == "GET" && path == "/directory-events") {
+      // Same shape as /events but drains g_directory_events (mirrored at enqueue). Use this for
+      // the OpenClaw directory SQLite poller so it never races beagle-channel on /events.
+      if (!wanted_account_id.empty() && !account) {
+        send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"unknown_account\"}");
+        close(client_fd);
+        continue;
+      }
+      std::vector<Event> events;
+      std::vector<Event> remaining;
+      const std::string selected_account = account ? account->account_id : "";
+      {
+        std::lock_guard<std::mutex> lock(g_events_mu);
+        remaining.reserve(g_directory_events.size());
+        for (auto& ev : g_directory_events) {
+          if (selected_account.empty() || ev.account_id == selected_account) {
+            events.push_back(std::move(ev));
+          } else {
+            remaining.push_back(std::move(ev));
+          }
+        }
+        g_directory_events.swap(remaining);
+      }
+      if (!events.empty()) {
+        std::string ua = header_value(headers, "User-Agent");
+        std::ostringstream msg;
+        msg << "[sidecar] /directory-events account=" << (selected_account.empty() ? "(all)" : selected_account)
+            << " -> " << events.size() << " event(s)"
+            << " from " << client_ip(client_fd);
+        if (!ua.empty()) msg << " ua=" << ua;
+        log_debug(msg.str());
+      }
+      send_response(client_fd, 200, "application/json", events_to_json(std::move(events)));
+    } else if (method == "POST" && path == "/sendText") {
+      if (!account) {
+        send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"unknown_account\"}");
+        close(client_fd);
+        continue;
+      }
+      std::string peer;
+      std::string text;
+      std::string dedupe_key;
+      extract_json_string(body, "peer", peer);
+      extract_json_string(body, "text", text);
+      extract_json_string(body, "dedupeKey", dedupe_key);
+      log_line(std::string("[sidecar] /sendText account=") + account->account_id
+               + " peer=" + peer
+               + " text_len=" + std::to_string(text.size())
+               + (dedupe_key.empty() ? "" : " dedupe_key=" + dedupe_key));
+
+      BeagleSendOutcome outcome;
+      bool ok = account->sdk->send_text(peer, text, dedupe_key, &outcome);
+      send_response(client_fd, ok ? 200 : 500, "application/json", send_outcome_json(ok, outcome));
+    } else if (method == "POST" && path == "/sendMedia") {
+      if (!account) {
+        send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"unknown_account\"}");
+        close(client_fd);
+        continue;
+      }
+      std::string peer;
+      std::string caption;
+      std::string media_path;
+      std::string media_url;
+      std::string media_type;
+      std::string filename;
+      std::string out_format;
+      std::string dedupe_key;
+      extract_json_string(body, "peer", peer);
+      extract_json_string(body, "caption", caption);
+      extract_json_string(body, "mediaPath", media_path);
+      extract_json_string(body, "mediaUrl", media_url);
+      extract_json_string(body, "mediaType", media_type);
+      extract_json_string(body, "filename", filename);
+      extract_json_string(body, "outFormat", out_format);
+      extract_json_string(body, "dedupeKey", dedupe_key);
+      log_line(std::string("[sidecar] /sendMedia account=") + account->account_id
+               + " peer=" + peer
+               + " caption_len=" + std::to_string(caption.size())
+               + " media_url_len=" + std::to_string(media_url.size())
+               + " media_path_len=" + std::to_string(media_path.size())
+               + " out_format=" + (out_format.empty() ? "(default)" : out_format));
+
+      BeagleSendOutcome outcome;
+      bool ok = account->sdk->send_media(peer,
+                                         caption,
+                                         media_path,
+                                         media_url,
+                                         media_type,
+                                         filename,
+                                         out_format,
+                                         dedupe_key,
+                                         &outcome);
+      send_response(client_fd, ok ? 200 : 500, "application/json", send_outcome_json(ok, outcome));
+    } else if (method == "POST" && path == "/sendStatus") {
+      if (!account) {
+        send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"unknown_account\"}");
+        close(client_fd);
+        continue;
+      }
+      std::string peer;
+      std::string state;
+      std::string phase;
+      std::string chat_type;
+      std::string group_user_id;
+      std::string group_address;
+      std::string group_name;
+      std::string seq;
+      int ttl_ms = 12000;
+      extract_json_string(body, "peer", peer);
+      extract_json_string(body, "state", state);
+      extract_json_string(body, "phase", phase);
+      extract_json_string(body, "chatType", chat_type);
+      extract_json_string(body, "groupUserId", group_user_id);
+      extract_json_string(body, "groupAddress", group_address);
+      extract_json_string(body, "groupName", group_name);
+      extract_json_string(body, "seq", seq);
+      int parsed_ttl = 0;
+      if (extract_json_int(body, "ttlMs", parsed_ttl) && parsed_ttl > 0) ttl_ms = parsed_ttl;
+      log_line(std::string("[sidecar] /sendStatus account=") + account->account_id
+               + " peer=" + peer
+               + " state=" + state
+               + " phase=" + phase
+               + " chat_type=" + (chat_type.empty() ? "(auto)" : chat_type)
+               + " ttl_ms=" + std::to_string(ttl_ms));
+      bool ok = account->sdk->send_status(peer,
+                                          state,
+                                          phase,
+                                          ttl_ms,
+                                          chat_type,
+                                          group_user_id,
+                                          group_address,
+                                          group_name,
+                                          seq);
+      send_response(client_fd, ok ? 200 : 500, "application/json", ok ? "{\"ok\":true}" : "{\"ok\":false}");
+    } else if (method == "POST" && path == "/setPublicProfile") {
+      if (!account) {
+        send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"unknown_account\"}");
+        close(client_fd);
+        continue;
+      }
+
+      std::string agent_name;
+      bool has_agent_name = extract_json_string(body, "agentName", agent_name);
+      agent_name = trim_copy(agent_name);
+      size_t public_profile_start = 0;
+      size_t public_profile_end = 0;
+      bool has_public_profile = extract_json_container_by_key(
+          body, "publicProfile", '{', '}', public_profile_start, public_profile_end);
+      std::string public_profile_json = has_public_profile
+          ? trim_copy(body.substr(public_profile_start, public_profile_end - public_profile_start + 1))
+          : std::string();
+
+      if (!has_agent_name && !has_public_profile) {
+        send_response(client_fd, 400, "application/json", "{\"ok\":false,\"error\":\"missing_profile\"}");
+        close(client_fd);
+        continue;
+      }
+
+      if (has_agent_name) {
+        account->agent_name = agent_name.empty() ? account->default_agent_name : agent_name;
+      }
+      if (has_public_profile) {
+        account->public_profile_json = public_profile_json;
+      }
+
+      std::string profile_payload = build_directory_profile_payload(
+          account, *host_facts.snapshot(), openclaw_version->get(), beagle_channel_version);
+      int pushed = 0;
+      for (const std::string& dir_addr : dir_addresses) {
+        if (!account->sdk || account->sdk->address() == dir_addr) continue;
+        std::string peer_userid = account->sdk->id_from_address(dir_addr);
+        if (peer_userid.empty()) continue;
+        if (!account->sdk->friend_is_online(peer_userid)) continue;
+        BeagleSendOutcome outcome;
+        bool ok = account->sdk->send_text(peer_userid, profile_payload, std::string(), &outcome);
+        log_line(std::string("[sidecar] /setPublicProfile push account=") + account->account_id
+                 + " address=" + dir_addr
+                 + " peer=" + peer_userid
+                 + " result=" + send_outcome_label(ok, outcome));
+        if (ok) pushed += 1;
+      }
+
+      std::ostringstream oss;
+      oss << "{"
+          << "\"ok\":true"
+          << ",\"accountId\":\"" << json_escape(account->account_id) << "\""
+          << ",\"agentName\":\"" << json_escape(account->agent_name) << "\""
+          << ",\"pushed\":" << pushed
+          << "}";
+      send_response(client_fd, 200, "application/json", oss.str());
+    } else if (method == "POST" && path == "/addFriend") {
+      if (!account) {
+        send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"unknown_account\"}");
+        close(client_fd);
+        continue;
+      }
+      std::string address;
+      std::string hello;
+      extract_json_string(body, "address", address);
+      if (trim_copy(address).empty()) extract_json_string(body, "peer", address);
+      extract_json_string(body, "hello", hello);
+      if (trim_copy(hello).empty()) hello = "openclaw-beagle-channel";
+
+      if (trim_copy(address).empty()) {
+        send_response(client_fd, 400, "application/json", "{\"ok\":false,\"error\":\"missing_address\"}");
+        close(client_fd);
+        continue;
+      }
+
+      log_line(std::string("[sidecar] /addFriend account=") + account->account_id
+               + " address=" + address);
+      bool ok = account->sdk->add_friend(address, hello);
+      if (ok) {
+        std::string peer_userid = account->sdk->id_from_address(address);
+        if (peer_userid.empty()) {
+          log_warn(std::string("[sidecar] /addFriend cannot derive userid from address=") + address);
+          send_response(client_fd, 500, "application/json",
+                        "{\"ok\":false,\"error\":\"cannot_derive_userid\"}");
+          close(client_fd);
+          continue;
+        }
+        std::string profile_payload = build_directory_profile_payload(
+            account, *host_facts.snapshot(), openclaw_version->get(), beagle_channel_version);
+        // A peer that is not online yet gets the push queued in the outbox,
+        // which retries it; a failure here is permanent and not worth repeating.
+        BeagleSendOutcome outcome;
+        bool profile_ok = account->sdk->send_text(peer_userid, profile_payload, std::string(), &outcome);
+        log_line(std::string("[sidecar] /addFriend profile push account=") + account->account_id
+                 + " address=" + address
+                 + " peer=" + peer_userid
+                 + " result=" + send_outcome_label(profile_ok, outcome));
+        send_response(client_fd, 200, "application/json", "{\"ok\":true}");
+      } else {
+        send_response(client_fd, 500, "application/json", "{\"ok\":false,\"error\":\"add_friend_failed\"}");
+      }
+    } else {
+      send_response(client_fd, 404, "application/json", "{\"ok\":false,\"error\":\"not_found\"}");
+    }
+
+    close(client_fd);
+  }
+
+  close(server_fd);
+  log_line("[sidecar] shutting down: listener closed, stopping " + std::to_string(accounts.size())
+           + " account(s)");
+  // Starters finish the account they are on and take no new ones.
+  for (auto& t : starters) t.join();
+  scheduler.stop();
+  host_facts.stop();
+  // Stopping an account flushes its outbox, history, search and event logs.
+  bool stopped = stop_accounts(accounts, opts.shutdown_timeout_ms);
+  size_t saved = save_pending_events(pending_events_path);
+  if (saved > 0) {
+    log_line("[sidecar] saved " + std::to_string(saved) + " undrained event(s) to " + pending_events_path);
+  }
+  log_line(std::string("[sidecar] shutdown ") + (stopped ? "complete" : "timed out"));
+  log_flush();
+  // Accounts that missed the deadline still run on their stop threads.
+  if (!stopped) _exit(1);
+  return failed_starts == start_queue.size() ? 1 : 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// One inbound message waiting to be drained by GET /events.
+struct Event {
+  std::string account_id;
+  std::string peer;
+  std::string text;
+  std::string media_url;
+  std::string media_path;
+  std::string media_type;
+  std::string filename;
+  unsigned long long size = 0;
+  std::string msg_id;
+  long long ts = 0;
+  long long received_us = 0;  // latency_now_us() when the SDK callback saw it
+  long long enqueued_us = 0;  // latency_now_us() when push_event queued it
+};
+
+// The whole sidecar: parses the command line, starts the accounts and runs
+// the HTTP server. main() only forwards here so tools can link the sidecar.
+int sidecar_main(int argc, char** argv);
+// Makes sidecar_main() shut down as on SIGTERM: the listener closes after the
+// request in flight, accounts stop and undrained events are saved.
+void sidecar_request_stop();
+// Routes SIGTERM/SIGINT to sidecar_request_stop(). Only main() installs it;
+// tools that run sidecar_main() in-process keep their own signal handling.
+void sidecar_install_signal_handlers();
+
+// Request/response helpers of the HTTP layer, exposed for benchmarks.
+std::string json_escape(const std::string& in);
+bool extract_json_string(const std::string& body, const std::string& key, std::string& out);
+std::string events_to_json(std::vector<Event> events);
@@ -0,0 +1,197 @@
+#include "tcp_peers.h"
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+
+struct RawPeer {
+  int family = AF_INET;
+  unsigned char addr[16] = {0};
+  int port = 0;
+  unsigned long inode = 0;
+};
+
+// Inodes of the sockets this process has open (/proc/self/fd -> "socket:[N]").
+static std::unordered_set<unsigned long> own_socket_inodes() {
+  std::unordered_set<unsigned long> out;
+  DIR* dir = opendir("/proc/self/fd");
+  if (!dir) return out;
+  char link[64];
+  char path[sizeof("/proc/self/fd/") + NAME_MAX];
+  while (dirent* ent = readdir(dir)) {
+    if (ent->d_name[0] == '.') continue;
+    std::snprintf(path, sizeof(path), "/proc/self/fd/%s", ent->d_name);
+    ssize_t n = readlink(path, link, sizeof(link) - 1);
+    if (n <= 0) continue;
+    link[n] = '\0';
+    unsigned long inode = 0;
+    if (std::sscanf(link, "socket:[%lu]", &inode) == 1) out.insert(inode);
+  }
+  closedir(dir);
+  return out;
+}
+
+// Dumps established TCP sockets of one address family; false when sock_diag is unavailable.
+static bool sock_diag_dump(int family, std::vector<RawPeer>& out) {
+  int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+  if (fd < 0) return false;
+  struct {
+    nlmsghdr nlh;
+    inet_diag_req_v2 req;
+  } msg{};
+  msg.nlh.nlmsg_len = sizeof(msg);
+  msg.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+  msg.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  msg.req.sdiag_family = static_cast<unsigned char>(family);
+  msg.req.sdiag_protocol = IPPROTO_TCP;
+  msg.req.idiag_states = 1u << TCP_ESTABLISHED;
+  sockaddr_nl kernel{};
+  kernel.nl_family = AF_NETLINK;
+  if (sendto(fd, &msg, sizeof(msg), 0, reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel)) < 0) {
+    close(fd);
+    return false;
+  }
+  alignas(nlmsghdr) char buf[32768];
+  bool ok = false;
+  bool done = false;
+  while (!done) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) break;
+    int len = static_cast<int>(n);
+    for (nlmsghdr* h = reinterpret_cast<nlmsghdr*>(buf); NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+      if (h->nlmsg_type == NLMSG_DONE) {
+        ok = true;
+        done = true;
+        break;
+      }
+      if (h->nlmsg_type == NLMSG_ERROR) {
+        done = true;
+        break;
+      }
+      const inet_diag_msg* m = static_cast<const inet_diag_msg*>(NLMSG_DATA(h));
+      RawPeer p;
+      p.family = m->idiag_family;
+      std::memcpy(p.addr, m->id.idiag_dst, m->idiag_family == AF_INET6 ? 16 : 4);
+      p.port = ntohs(m->id.idiag_dport);
+      p.inode = m->idiag_inode;
+      out.push_back(p);
+    }
+  }
+  close(fd);
+  return ok;
+}
+
+// /proc/net/tcp{,6}: addresses are the raw 32-bit words printed in hex, so they
+// decode back into network order on the same host.
+static bool proc_net_tcp(const char* path, int family, std::vector<RawPeer>& out) {
+  FILE* fp = std::fopen(path, "r");
+  if (!fp) return false;
+  char line[512];
+  if (!std::fgets(line, sizeof(line), fp)) {
+    std::fclose(fp);
+    return false;
+  }
+  while (std::fgets(line, sizeof(line), fp)) {
+    char local[64];
+    char remote[64];
+    unsigned int st = 0;
+    unsigned long inode = 0;
+    if (std::sscanf(line, " %*d: %63s %63s %x %*s %*s %*s %*d %*d %lu", local, remote, &st, &inode) != 4) continue;
+    if (st != TCP_ESTABLISHED) continue;
+    char* colon = std::strchr(remote, ':');
+    if (!colon) continue;
+    *colon = '\0';
+    RawPeer p;
+    p.family = family;
+    p.port = static_cast<int>(std::strtoul(colon + 1, nullptr, 16));
+    p.inode = inode;
+    size_t words = family == AF_INET6 ? 4 : 1;
+    if (std::strlen(remote) != words * 8) continue;
+    for (size_t w = 0; w < words; ++w) {
+      char hex[9];
+      std::memcpy(hex, remote + w * 8, 8);
+      hex[8] = '\0';
+      uint32_t word = static_cast<uint32_t>(std::strtoul(hex, nullptr, 16));
+      std::memcpy(p.addr + w * 4, &word, 4);
+    }
+    out.push_back(p);
+  }
+  std::fclose(fp);
+  return true;
+}
+
+static std::string peer_ip_string(const RawPeer& p) {
+  char buf[INET6_ADDRSTRLEN] = {0};
+  static const unsigned char kV4Mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+  if (p.family == AF_INET6 && std::memcmp(p.addr, kV4Mapped, sizeof(kV4Mapped)) == 0) {
+    inet_ntop(AF_INET, p.addr + 12, buf, sizeof(buf));
+  } else {
+    inet_ntop(p.family, p.addr, buf, sizeof(buf));
+  }
+  return buf;
+}
+
+static std::vector<TcpPeer> scan_tcp_peers() {
+  std::vector<RawPeer> raw;
+  if (!sock_diag_dump(AF_INET, raw) || !sock_diag_dump(AF_INET6, raw)) {
+    raw.clear();
+    proc_net_tcp("/proc/net/tcp", AF_INET, raw);
+    proc_net_tcp("/proc/net/tcp6", AF_INET6, raw);
+  }
+  std::unordered_set<unsigned long> own = own_socket_inodes();
+  std::vector<TcpPeer> out;
+  out.reserve(raw.size());
+  for (const auto& p : raw) {
+    TcpPeer peer;
+    peer.ip = peer_ip_string(p);
+    peer.port = p.port;
+    peer.own = p.inode != 0 && own.count(p.inode) > 0;
+    if (!peer.ip.empty()) out.push_back(std::move(peer));
+  }
+  return out;
+}
+
+#else
+
+static std::vector<TcpPeer> scan_tcp_peers() {
+  return {};
+}
+
+#endif
+
+}  // namespace
+
+std::vector<TcpPeer> established_tcp_peers(int max_age_ms) {
+  static std::mutex mu;
+  static std::vector<TcpPeer> cached;
+  static std::chrono::steady_clock::time_point cached_at;
+  static bool have_cache = false;
+  std::lock_guard<std::mutex> lock(mu);
+  auto now = std::chrono::steady_clock::now();
+  if (!have_cache || now - cached_at > std::chrono::milliseconds(max_age_ms)) {
+    cached = scan_tcp_peers();
+    cached_at = now;
+    have_cache = true;
+  }
+  return cached;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Remote end of an established TCP connection on this host.
+struct TcpPeer {
+  std::string ip;
+  int port = 0;
+  bool own = false;  // the socket belongs to this process
+};
+
+// Established TCP connections, read through NETLINK_SOCK_DIAG (falling back
+// to /proc/net/tcp{,6}) and matched against this process's socket inodes.
+// Results are cached for max_age_ms so callers on hot paths stay cheap.
+// Thread-safe; returns an empty list on platforms without either source.
+std::vector<TcpPeer> established_tcp_peers(int max_age_ms = 2000);
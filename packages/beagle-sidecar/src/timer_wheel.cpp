@@ -0,0 +1,162 @@
+#include "timer_wheel.h"
+#include "logger.h"
+
+#include <chrono>
+#include <exception>
+#include <string>
+#include <utility>
+
+namespace {
+
+thread_local uint64_t t_current_task = 0;
+
+}  // namespace
+
+TimerWheel::TimerWheel(int tick_ms, size_t slots)
+    : tick_ms_(tick_ms > 0 ? tick_ms : 100), slots_(slots > 0 ? slots : 512) {
+  thread_ = std::thread([this]() { run(); });
+}
+
+TimerWheel::~TimerWheel() {
+  stop();
+}
+
+uint64_t TimerWheel::schedule(long long delay_ms, Task task) {
+  if (!task) return 0;
+  uint64_t id = 0;
+  bool was_idle = false;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (stop_) return 0;
+    id = next_id_++;
+    was_idle = slot_of_.empty();
+    insert_locked(id, delay_ms, std::move(task));
+  }
+  if (was_idle) cv_.notify_one();
+  return id;
+}
+
+bool TimerWheel::cancel(uint64_t id) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = slot_of_.find(id);
+  if (it == slot_of_.end()) return false;
+  auto& slot = slots_[it->second];
+  for (auto timer = slot.begin(); timer != slot.end(); ++timer) {
+    if (timer->id != id) continue;
+    slot.erase(timer);
+    break;
+  }
+  slot_of_.erase(it);
+  return true;
+}
+
+bool TimerWheel::wake(uint64_t id) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (running_.count(id)) {
+    woken_.insert(id);
+    return true;
+  }
+  auto it = slot_of_.find(id);
+  if (it == slot_of_.end()) return false;
+  auto& slot = slots_[it->second];
+  for (auto timer = slot.begin(); timer != slot.end(); ++timer) {
+    if (timer->id != id) continue;
+    Task task = std::move(timer->task);
+    slot.erase(timer);
+    insert_locked(id, 0, std::move(task));
+    break;
+  }
+  return true;
+}
+
+uint64_t TimerWheel::current_task() {
+  return t_current_task;
+}
+
+size_t TimerWheel::pending() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return slot_of_.size();
+}
+
+void TimerWheel::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (stop_ && !thread_.joinable()) return;
+    stop_ = true;
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) thread_.join();
+  std::lock_guard<std::mutex> lock(mu_);
+  for (auto& slot : slots_) slot.clear();
+  slot_of_.clear();
+}
+
+void TimerWheel::insert_locked(uint64_t id, long long delay_ms, Task task) {
+  // Rounded up to whole ticks; the first tick after scheduling may be partial,
+  // so a step can run up to one tick early.
+  long long ticks = delay_ms <= 0 ? 1 : (delay_ms + tick_ms_ - 1) / tick_ms_;
+  const size_t n = slots_.size();
+  size_t slot = (cursor_ + static_cast<size_t>(ticks % static_cast<long long>(n))) % n;
+  Timer timer;
+  timer.id = id;
+  timer.rounds = static_cast<size_t>((ticks - 1) / static_cast<long long>(n));
+  timer.task = std::move(task);
+  slots_[slot].push_back(std::move(timer));
+  slot_of_[id] = slot;
+}
+
+void TimerWheel::run() {
+  const auto tick = std::chrono::milliseconds(tick_ms_);
+  auto next_tick = std::chrono::steady_clock::now() + tick;
+  std::vector<Timer> due;
+  std::unique_lock<std::mutex> lock(mu_);
+  while (!stop_) {
+    if (slot_of_.empty()) {
+      // Nothing pending: sleep until schedule() or stop() instead of ticking.
+      cv_.wait(lock, [this]() { return stop_ || !slot_of_.empty(); });
+      next_tick = std::chrono::steady_clock::now() + tick;
+      continue;
+    }
+    if (cv_.wait_until(lock, next_tick, [this]() { return stop_; })) break;
+    // After a slow step the following ticks come back to back until caught up.
+    next_tick += tick;
+    cursor_ = (cursor_ + 1) % slots_.size();
+    auto& slot = slots_[cursor_];
+    for (auto it = slot.begin(); it != slot.end();) {
+      if (it->rounds > 0) {
+        it->rounds--;
+        ++it;
+        continue;
+      }
+      slot_of_.erase(it->id);
+      running_.insert(it->id);
+      due.push_back(std::move(*it));
+      it = slot.erase(it);
+    }
+    if (due.empty()) continue;
+
+    lock.unlock();
+    std::vector<std::pair<Timer, long long>> results;
+    results.reserve(due.size());
+    for (auto& timer : due) {
+      long long next = -1;
+      t_current_task = timer.id;
+      try {
+        next = timer.task();
+      } catch (const std::exception& e) {
+        log_warn(std::string("[timer] task ") + std::to_string(timer.id) + " threw: " + e.what());
+      }
+      t_current_task = 0;
+      results.emplace_back(std::move(timer), next);
+    }
+    due.clear();
+    lock.lock();
+    for (auto& result : results) {
+      const uint64_t id = result.first.id;
+      running_.erase(id);
+      bool woken = woken_.erase(id) > 0;
+      if (result.second < 0 || stop_) continue;
+      insert_locked(id, woken ? 0 : result.second, std::move(result.first.task));
+    }
+  }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Single-threaded scheduler for retry loops and other long-running waits.
+// A task is a step function: it does one attempt and returns the delay in
+// milliseconds until its next step, or a negative value once it is done, so
+// dozens of "retry every few seconds" loops share one thread instead of
+// sleeping in one thread each. Timers live in a hashed wheel of `slots`
+// buckets of tick_ms each; scheduling and cancelling are O(1) and the thread
+// sleeps until the next tick only while something is pending.
+//
+// Steps run on the scheduler thread one at a time and should not block for
+// long; a slow step delays every other task by as much.
+class TimerWheel {
+ public:
+  using Task = std::function<long long()>;
+
+  explicit TimerWheel(int tick_ms = 100, size_t slots = 512);
+  ~TimerWheel();
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Runs task's first step after delay_ms (0 = next tick). Returns an id for
+  // cancel(), or 0 once the wheel has been stopped.
+  uint64_t schedule(long long delay_ms, Task task);
+
+  // Drops a task before its next step; false if it already finished or is
+  // running right now (a running step still decides whether it continues).
+  bool cancel(uint64_t id);
+
+  // Brings a task's next step forward to the next tick, for event-driven
+  // waits that still keep a timeout as their scheduled delay. If the step is
+  // running right now, the delay it returns is cut to the next tick instead
+  // (a negative return still ends it). False if the task is gone.
+  bool wake(uint64_t id);
+
+  // Id of the task whose step is running on this thread, 0 elsewhere.
+  static uint64_t current_task();
+
+  size_t pending() const;
+
+  // Drops every pending task and joins the thread; idempotent.
+  void stop();
+
+ private:
+  struct Timer {
+    uint64_t id = 0;
+    size_t rounds = 0;  // full turns of the wheel left before it fires
+    Task task;
+  };
+
+  void run();
+  void insert_locked(uint64_t id, long long delay_ms, Task task);
+
+  const int tick_ms_;
+  std::vector<std::list<Timer>> slots_;
+  size_t cursor_ = 0;
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  std::unordered_map<uint64_t, size_t> slot_of_;  // pending id -> slot
+  std::unordered_set<uint64_t> running_;         // ids whose step is running
+  std::unordered_set<uint64_t> woken_;           // running ids wake() was called for
+  uint64_t next_id_ = 1;
+  bool stop_ = false;
+
+  std::thread thread_;
+};
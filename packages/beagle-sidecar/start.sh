@@ -83,6 +83,14 @@ ensure_real_build() {
   if [[ ! -f "$cache" ]]; then
     return 0
   fi
+  if grep -q '^BEAGLE_SDK_FAKE:BOOL=ON$' "$cache"; then
+    if [[ "${BEAGLE_ALLOW_STUB:-}" == "1" ]]; then
+      echo "Warning: build/beagle-sidecar is configured with BEAGLE_SDK_FAKE=ON; Carrier is simulated in-process." >&2
+      return 0
+    fi
+    echo "build/beagle-sidecar is configured with BEAGLE_SDK_FAKE=ON (simulated Carrier); rebuild with -DBEAGLE_SDK_FAKE=OFF or set BEAGLE_ALLOW_STUB=1." >&2
+    exit 1
+  fi
   if grep -q '^BEAGLE_SDK_STUB:BOOL=ON$' "$cache"; then
     if [[ "${BEAGLE_ALLOW_STUB:-}" == "1" ]]; then
       echo "Warning: build/beagle-sidecar is configured with BEAGLE_SDK_STUB=ON; no real Carrier account will be created." >&2
@@ -0,0 +1,290 @@
+// beagle-sidecar-bench: micro benchmarks for the sidecar hot paths plus an
+// end-to-end HTTP throughput run against the real server loop (stub SDK).
+//
+//   beagle-sidecar-bench [--filter <substring>] [--scale <factor>] [--http-requests <n>] [--http-clients <n>]
+
+#include "incoming_dedupe.h"
+#include "logger.h"
+#include "media_codec.h"
+#include "sidecar.h"
+#include "tool_support.h"
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+  std::string filter;
+  double scale = 1.0;
+  int http_requests = 2000;
+  int http_clients = 4;
+};
+
+// Keeps results alive so the optimizer cannot drop the measured work.
+std::atomic<size_t> g_sink{0};
+
+// Runs fn `iterations` times (after a short warm-up) and prints ns/op and,
+// when bytes_per_op is set, MB/s.
+static void run_bench(const BenchOptions& opts,
+                      const std::string& name,
+                      long iterations,
+                      size_t bytes_per_op,
+                      const std::function<void()>& fn) {
+  if (!opts.filter.empty() && name.find(opts.filter) == std::string::npos) return;
+  iterations = std::max(1L, static_cast<long>(iterations * opts.scale));
+  for (long i = 0; i < std::min(iterations / 10 + 1, 1000L); ++i) fn();
+  double start = now_seconds();
+  for (long i = 0; i < iterations; ++i) fn();
+  double elapsed = now_seconds() - start;
+  double ns_per_op = elapsed * 1e9 / static_cast<double>(iterations);
+  std::printf("%-40s %10ld ops %12.1f ns/op", name.c_str(), iterations, ns_per_op);
+  if (bytes_per_op > 0) {
+    std::printf(" %10.1f MB/s", static_cast<double>(bytes_per_op) * iterations / elapsed / 1e6);
+  }
+  std::printf("\n");
+}
+
+static std::vector<unsigned char> make_bytes(size_t n) {
+  std::vector<unsigned char> out(n);
+  uint32_t x = 2463534242u;
+  for (auto& b : out) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    b = static_cast<unsigned char>(x);
+  }
+  return out;
+}
+
+static std::string make_text(size_t n) {
+  static const char* kWords[] = {"hello", "agent", "\"quoted\"", "line\nbreak", "tab\there", "你好", "path\\to"};
+  std::string out;
+  size_t i = 0;
+  while (out.size() < n) {
+    out += kWords[i++ % (sizeof(kWords) / sizeof(kWords[0]))];
+    out += ' ';
+  }
+  out.resize(n);
+  return out;
+}
+
+static void bench_json(const BenchOptions& opts) {
+  std::string short_text = "ok, see you tomorrow";
+  std::string long_text = make_text(4096);
+  run_bench(opts, "json_escape/short", 2000000, short_text.size(), [&]() {
+    g_sink += json_escape(short_text).size();
+  });
+  run_bench(opts, "json_escape/4k_mixed", 100000, long_text.size(), [&]() {
+    g_sink += json_escape(long_text).size();
+  });
+
+  std::string body = "{\"accountId\":\"main\",\"peer\":\"7NPDz3Xkq9h4VvSvtz1cYjXqBbs3c1AHD6N2tNbbpW7q\","
+                     "\"text\":\"" + json_escape(long_text) + "\",\"dedupeKey\":\"reply-123\"}";
+  std::string out;
+  run_bench(opts, "extract_json_string/first_key", 1000000, 0, [&]() {
+    extract_json_string(body, "accountId", out);
+    g_sink += out.size();
+  });
+  run_bench(opts, "extract_json_string/4k_text", 100000, body.size(), [&]() {
+    extract_json_string(body, "text", out);
+    g_sink += out.size();
+  });
+  run_bench(opts, "extract_json_string/after_text", 100000, body.size(), [&]() {
+    extract_json_string(body, "dedupeKey", out);
+    g_sink += out.size();
+  });
+}
+
+static void bench_base64(const BenchOptions& opts) {
+  std::vector<unsigned char> data = make_bytes(64 * 1024);
+  std::string encoded = base64_encode_bytes(data);
+  std::vector<unsigned char> decoded;
+  run_bench(opts, "base64_encode_bytes/64k", 5000, data.size(), [&]() {
+    g_sink += base64_encode_bytes(data).size();
+  });
+  run_bench(opts, "base64_decode/64k", 5000, encoded.size(), [&]() {
+    base64_decode(encoded, decoded);
+    g_sink += decoded.size();
+  });
+}
+
+static void bench_media(const BenchOptions& opts) {
+  std::vector<unsigned char> data = make_bytes(256 * 1024);
+  std::string inline_json;
+  std::string swift_json;
+  std::string legacy_json;
+  std::vector<unsigned char> packed;
+  encode_inline_json_media_payload("photo.jpg", "image/jpeg", data, inline_json);
+  encode_beaglechat_file_payload("photo.jpg", "image/jpeg", data, packed);
+
+  run_bench(opts, "encode_inline_json_media/256k", 500, data.size(), [&]() {
+    encode_inline_json_media_payload("photo.jpg", "image/jpeg", data, inline_json);
+    g_sink += inline_json.size();
+  });
+  run_bench(opts, "encode_swift_filemodel_media/256k", 500, data.size(), [&]() {
+    encode_swift_filemodel_media_payload("photo.jpg", "image/jpeg", data, swift_json);
+    g_sink += swift_json.size();
+  });
+  run_bench(opts, "encode_legacy_inline_data/256k", 500, data.size(), [&]() {
+    encode_legacy_inline_data_payload(data, legacy_json);
+    g_sink += legacy_json.size();
+  });
+  run_bench(opts, "encode_beaglechat_file/256k", 2000, data.size(), [&]() {
+    encode_beaglechat_file_payload("photo.jpg", "image/jpeg", data, packed);
+    g_sink += packed.size();
+  });
+  InlineJsonMedia media;
+  run_bench(opts, "decode_inline_json_media/256k", 500, inline_json.size(), [&]() {
+    decode_inline_json_media_payload(inline_json.data(), inline_json.size(), media);
+    g_sink += media.bytes.size();
+  });
+  run_bench(opts, "is_swift_filemodel_json/256k", 500, swift_json.size(), [&]() {
+    g_sink += is_swift_filemodel_json_payload(swift_json.data(), swift_json.size()) ? 1 : 0;
+  });
+  PackedFilePayload file;
+  run_bench(opts, "decode_beaglechat_file/256k", 200000, 0, [&]() {
+    decode_beaglechat_file_payload(packed.data(), packed.size(), file);
+    g_sink += file.bytes_len;
+  });
+  std::string text = make_text(512);
+  run_bench(opts, "decode_inline_json_media/text_miss", 1000000, text.size(), [&]() {
+    g_sink += decode_inline_json_media_payload(text.data(), text.size(), media) ? 1 : 0;
+  });
+}
+
+static void bench_events(const BenchOptions& opts) {
+  std::vector<Event> events(100);
+  for (size_t i = 0; i < events.size(); ++i) {
+    events[i].account_id = "main";
+    events[i].peer = "7NPDz3Xkq9h4VvSvtz1cYjXqBbs3c1AHD6N2tNbbpW7q";
+    events[i].text = make_text(200 + i);
+    events[i].msg_id = std::to_string(i);
+    events[i].ts = 1700000000000000LL + static_cast<long long>(i);
+  }
+  run_bench(opts, "events_to_json/100_events", 5000, 0, [&]() {
+    g_sink += events_to_json(events).size();
+  });
+}
+
+static void bench_dedupe(const BenchOptions& opts) {
+  BeagleIncomingMessage msg;
+  msg.peer = "7NPDz3Xkq9h4VvSvtz1cYjXqBbs3c1AHD6N2tNbbpW7q";
+  msg.text = make_text(300);
+  run_bench(opts, "build_incoming_signature", 500000, 0, [&]() {
+    msg.ts++;
+    g_sink += build_incoming_signature(msg, false).size();
+  });
+  IncomingSignatureWindow window;
+  long long ts = 0;
+  run_bench(opts, "remember_incoming_signature/unique", 500000, 0, [&]() {
+    msg.ts = ++ts;
+    g_sink += window.remember(build_incoming_signature(msg, false)) ? 1 : 0;
+  });
+  std::string repeated = build_incoming_signature(msg, false);
+  run_bench(opts, "remember_incoming_signature/replay", 1000000, 0, [&]() {
+    g_sink += window.remember(repeated) ? 1 : 0;
+  });
+}
+
+static void bench_http(const BenchOptions& opts) {
+  if (!opts.filter.empty() && std::string("http GET /status /events /health").find(opts.filter) == std::string::npos) {
+    return;
+  }
+  int port = free_port();
+  std::string dir = make_temp_dir("beagle-bench");
+  if (port == 0 || dir.empty()) {
+    std::printf("http: cannot prepare a port or data dir, skipped\n");
+    return;
+  }
+  std::string config = dir + "/carrier.conf";
+  std::ofstream(config) << "{}\n";
+  if (!start_sidecar({"--port", std::to_string(port), "--config", config,
+                      "--data-dir", dir + "/data", "--log-level", "warn"},
+                     port)) {
+    std::printf("http: sidecar did not come up on port %d, skipped\n", port);
+    return;
+  }
+
+  const char* paths[] = {"/status", "/events", "/health"};
+  for (const char* path : paths) {
+    const int clients = std::max(1, opts.http_clients);
+    const int per_client = std::max(1, static_cast<int>(opts.http_requests * opts.scale) / clients);
+    std::atomic<int> failures{0};
+    std::vector<double> latencies(static_cast<size_t>(clients * per_client));
+    double start = now_seconds();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; ++c) {
+      threads.emplace_back([&, c]() {
+        for (int i = 0; i < per_client; ++i) {
+          double t0 = now_seconds();
+          if (!http_get(port, path)) failures++;
+          latencies[static_cast<size_t>(c * per_client + i)] = now_seconds() - t0;
+        }
+      });
+    }
+    for (auto& t : threads) t.join();
+    double elapsed = now_seconds() - start;
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("%-40s %10zu req %12.0f req/s  p50 %.0fus  p99 %.0fus  failures %d\n",
+                (std::string("http GET ") + path + " x" + std::to_string(clients)).c_str(),
+                latencies.size(), latencies.size() / elapsed,
+                percentile(latencies, 0.5) * 1e6, percentile(latencies, 0.99) * 1e6, failures.load());
+  }
+  stop_sidecar();
+}
+
+static void usage() {
+  std::fprintf(stderr,
+               "usage: beagle-sidecar-bench [--filter <substring>] [--scale <factor>]\n"
+               "                            [--http-requests <n>] [--http-clients <n>]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  BenchOptions opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+    if (arg == "--filter") {
+      opts.filter = next();
+    } else if (arg == "--scale") {
+      opts.scale = std::atof(next().c_str());
+    } else if (arg == "--http-requests") {
+      opts.http_requests = std::atoi(next().c_str());
+    } else if (arg == "--http-clients") {
+      opts.http_clients = std::atoi(next().c_str());
+    } else {
+      usage();
+      return arg == "--help" || arg == "-h" ? 0 : 2;
+    }
+  }
+  if (opts.scale <= 0) opts.scale = 1.0;
+  // The server loop logs every start-up step; keep the report readable.
+  LogOptions log_opts = log_options();
+  log_opts.level = LogLevel::Warn;
+  log_configure(log_opts);
+
+  bench_json(opts);
+  bench_base64(opts);
+  bench_media(opts);
+  bench_events(opts);
+  bench_dedupe(opts);
+  bench_http(opts);
+
+  std::printf("(sink %zu)\n", g_sink.load());
+  std::fflush(stdout);
+  log_flush();
+  return 0;
+}
@@ -0,0 +1,516 @@
+// beagle-sidecar-loadgen: runs the sidecar in-process with M agent accounts
+// and drives it like production traffic. Simulated peers send messages and
+// files and flap their presence at fixed rates (fake Carrier builds); at the
+// same time the tool is the channel consumer, polling /events per account and
+// answering each message with /sendText. Stub builds have no inbound side, so
+// there the peers' messages become /sendText calls and only the HTTP paths
+// are measured.
+//
+//   beagle-sidecar-loadgen [--accounts <m>] [--peers <n>] [--duration <s>]
+//                          [--msg-rate <per s>] [--file-rate <per s>] [--file-size <bytes>]
+//                          [--flap-rate <per s>] [--flap-ms <ms>]
+//                          [--latency-ms <ms>] [--jitter-ms <ms>] [--loss <0..1>]
+//                          [--poll-ms <ms>] [--no-reply]
+
+#include "logger.h"
+#include "sidecar.h"
+#include "tool_support.h"
+
+#if BEAGLE_SDK_FAKE
+#include "fake_carrier.h"
+#endif
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct LoadOptions {
+  int accounts = 2;
+  int peers = 20;
+  double duration_s = 10;
+  double msg_rate = 200;
+  double file_rate = 2;
+  size_t file_size = 16 * 1024;
+  double flap_rate = 1;
+  int flap_ms = 500;
+  int latency_ms = 20;
+  int jitter_ms = 10;
+  double loss = 0;
+  int poll_ms = 10;
+  bool reply = true;
+};
+
+// Latency samples in microseconds.
+class Samples {
+ public:
+  void add(double us) {
+    std::lock_guard<std::mutex> lock(mu_);
+    values_.push_back(us);
+  }
+  size_t count() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return values_.size();
+  }
+  std::string summary() const {
+    std::vector<double> sorted;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      sorted = values_;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "p50 %8.2fms  p99 %8.2fms  max %8.2fms",
+                  percentile(sorted, 0.5) / 1e3, percentile(sorted, 0.99) / 1e3,
+                  sorted.empty() ? 0.0 : sorted.back() / 1e3);
+    return buf;
+  }
+
+ private:
+  mutable std::mutex mu_;
+  std::vector<double> values_;
+};
+
+struct Account {
+  std::string id;
+  std::string user_id;
+#if BEAGLE_SDK_FAKE
+  Carrier* carrier = nullptr;
+#endif
+};
+
+struct Counters {
+  std::atomic<uint64_t> msgs_sent{0};
+  std::atomic<uint64_t> msgs_received{0};
+  std::atomic<uint64_t> files_sent{0};
+  std::atomic<uint64_t> files_received{0};
+  std::atomic<uint64_t> other_events{0};
+  std::atomic<uint64_t> polls{0};
+  std::atomic<uint64_t> replies_ok{0};
+  std::atomic<uint64_t> replies_failed{0};
+  std::atomic<uint64_t> replies_delivered{0};
+  std::atomic<uint64_t> flaps{0};
+};
+
+Counters g_counters;
+Samples g_inbound_msg;   // peer send -> event drained by the consumer
+Samples g_inbound_file;
+Samples g_reply;         // /sendText issued -> message reached the peer
+Samples g_round_trip;    // peer send -> reply reached the peer
+Samples g_send_http;     // /sendText request duration
+std::atomic<bool> g_stop_generators{false};
+std::atomic<bool> g_stop_consumers{false};
+
+static long long now_us() {
+  return static_cast<long long>(now_seconds() * 1e6);
+}
+
+// "lg:<seq>:<us>" or "lg-<seq>-<us>.bin": the send time is the last number.
+static long long trailing_us(const std::string& s, char sep) {
+  size_t pos = s.rfind(sep);
+  if (pos == std::string::npos) return 0;
+  return std::atoll(s.c_str() + pos + 1);
+}
+
+static std::string json_body(const std::vector<std::pair<std::string, std::string>>& fields) {
+  std::string out = "{";
+  for (size_t i = 0; i < fields.size(); ++i) {
+    if (i) out += ",";
+    out += "\"" + fields[i].first + "\":\"" + json_escape(fields[i].second) + "\"";
+  }
+  return out + "}";
+}
+
+static bool send_text(int port, const Account& account, const std::string& peer, const std::string& text) {
+  HttpResponse resp;
+  long long t0 = now_us();
+  bool ok = http_request(port, "POST", "/sendText",
+                         json_body({{"peer", peer}, {"text", text}}),
+                         {{"X-Beagle-Account", account.id}}, &resp)
+            && resp.status == 200;
+  g_send_http.add(static_cast<double>(now_us() - t0));
+  return ok;
+}
+
+// Paces a generator at `rate` events per second until g_stop_generators.
+static void run_at_rate(double rate, const std::function<void(uint64_t)>& fn) {
+  if (rate <= 0) return;
+  const double interval = 1.0 / rate;
+  double next = now_seconds();
+  for (uint64_t seq = 0; !g_stop_generators; ++seq) {
+    fn(seq);
+    next += interval;
+    double wait = next - now_seconds();
+    if (wait > 0) std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+  }
+}
+
+static void consumer_loop(int port, const Account& account, const LoadOptions& opts) {
+  while (!g_stop_consumers) {
+    HttpResponse resp;
+    if (!http_request(port, "GET", "/events", "", {{"X-Beagle-Account", account.id}}, &resp)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(opts.poll_ms));
+      continue;
+    }
+    g_counters.polls++;
+    long long drained = now_us();
+    std::vector<std::string> events = split_json_objects(resp.body);
+    for (const auto& ev : events) {
+      std::string peer, text, filename;
+      extract_json_string(ev, "peer", peer);
+      extract_json_string(ev, "text", text);
+      extract_json_string(ev, "filename", filename);
+      if (filename.compare(0, 3, "lg-") == 0) {
+        g_counters.files_received++;
+        g_inbound_file.add(static_cast<double>(drained - trailing_us(filename.substr(0, filename.find('.')), '-')));
+        continue;
+      }
+      if (text.compare(0, 3, "lg:") != 0) {
+        g_counters.other_events++;
+        continue;
+      }
+      long long sent_us = trailing_us(text, ':');
+      g_counters.msgs_received++;
+      g_inbound_msg.add(static_cast<double>(drained - sent_us));
+      if (!opts.reply) continue;
+      std::string reply = "re:" + text.substr(3) + ":" + std::to_string(now_us());
+      if (send_text(port, account, peer, reply)) {
+        g_counters.replies_ok++;
+      } else {
+        g_counters.replies_failed++;
+      }
+    }
+    if (events.empty()) std::this_thread::sleep_for(std::chrono::milliseconds(opts.poll_ms));
+  }
+}
+
+#if BEAGLE_SDK_FAKE
+
+std::mutex g_peers_mu;
+std::vector<std::string> g_peer_ids;
+std::vector<bool> g_peer_online;
+
+// Round-robins over peers that are currently online; empty when none are.
+static std::string next_online_peer(uint64_t seq) {
+  std::lock_guard<std::mutex> lock(g_peers_mu);
+  for (size_t i = 0; i < g_peer_ids.size(); ++i) {
+    size_t idx = (seq + i) % g_peer_ids.size();
+    if (g_peer_online[idx]) return g_peer_ids[idx];
+  }
+  return std::string();
+}
+
+static void setup_fake_peers(const LoadOptions& opts) {
+  FakePeerOptions peer;
+  peer.latency_ms = opts.latency_ms;
+  peer.jitter_ms = opts.jitter_ms;
+  peer.loss = opts.loss;
+  for (int i = 0; i < opts.peers; ++i) {
+    peer.name = "lg-peer-" + std::to_string(i);
+    std::string id = fake_carrier_make_userid(peer.name);
+    fake_carrier_add_peer(id, peer);
+    g_peer_ids.push_back(id);
+    g_peer_online.push_back(true);
+  }
+  // Replies are "re:<seq>:<peer send us>:<request us>".
+  fake_carrier_set_outbound_hook([](const FakeOutbound& out) {
+    if (out.file || out.payload.compare(0, 3, "re:") != 0) return;
+    long long now = now_us();
+    size_t last = out.payload.rfind(':');
+    size_t prev = out.payload.rfind(':', last - 1);
+    if (last == std::string::npos || prev == std::string::npos) return;
+    g_counters.replies_delivered++;
+    g_reply.add(static_cast<double>(now - std::atoll(out.payload.c_str() + last + 1)));
+    g_round_trip.add(static_cast<double>(now - std::atoll(out.payload.c_str() + prev + 1)));
+  });
+}
+
+static std::vector<std::thread> start_generators(int port, const LoadOptions& opts, const std::vector<Account>& accounts) {
+  (void)port;
+  std::vector<std::thread> threads;
+  threads.emplace_back([&opts, &accounts]() {
+    run_at_rate(opts.msg_rate, [&](uint64_t seq) {
+      std::string peer = next_online_peer(seq);
+      if (peer.empty()) return;
+      const Account& account = accounts[seq % accounts.size()];
+      std::string text = "lg:" + std::to_string(seq) + ":" + std::to_string(now_us());
+      if (fake_carrier_deliver(account.carrier, peer, text) > 0) g_counters.msgs_sent++;
+    });
+  });
+  threads.emplace_back([&opts, &accounts]() {
+    std::string bytes(opts.file_size, '\0');
+    std::mt19937 rng(7);
+    for (auto& b : bytes) b = static_cast<char>(rng());
+    run_at_rate(opts.file_rate, [&](uint64_t seq) {
+      std::string peer = next_online_peer(seq * 7 + 3);
+      if (peer.empty()) return;
+      const Account& account = accounts[seq % accounts.size()];
+      std::string name = "lg-" + std::to_string(seq) + "-" + std::to_string(now_us()) + ".bin";
+      if (fake_carrier_send_file(account.carrier, peer, name, bytes) > 0) g_counters.files_sent++;
+    });
+  });
+  threads.emplace_back([&opts]() {
+    std::mt19937 rng(11);
+    std::vector<std::pair<double, size_t>> restores;  // (time, peer index)
+    auto restore_due = [&](bool all) {
+      double now = now_seconds();
+      for (auto it = restores.begin(); it != restores.end();) {
+        if (!all && it->first > now) {
+          ++it;
+          continue;
+        }
+        std::string id;
+        {
+          std::lock_guard<std::mutex> lock(g_peers_mu);
+          g_peer_online[it->second] = true;
+          id = g_peer_ids[it->second];
+        }
+        fake_carrier_set_peer_online(id, true);
+        it = restores.erase(it);
+      }
+    };
+    run_at_rate(opts.flap_rate, [&](uint64_t) {
+      restore_due(false);
+      size_t idx = 0;
+      std::string id;
+      {
+        std::lock_guard<std::mutex> lock(g_peers_mu);
+        if (g_peer_ids.empty()) return;
+        idx = rng() % g_peer_ids.size();
+        if (!g_peer_online[idx]) return;
+        g_peer_online[idx] = false;
+        id = g_peer_ids[idx];
+      }
+      fake_carrier_set_peer_online(id, false);
+      restores.emplace_back(now_seconds() + opts.flap_ms / 1000.0, idx);
+      g_counters.flaps++;
+    });
+    restore_due(true);
+  });
+  return threads;
+}
+
+#else
+
+// Without a Carrier there is no inbound path: exercise /sendText instead.
+static std::vector<std::thread> start_generators(int port, const LoadOptions& opts, const std::vector<Account>& accounts) {
+  std::vector<std::thread> threads;
+  threads.emplace_back([port, &opts, &accounts]() {
+    run_at_rate(opts.msg_rate, [&](uint64_t seq) {
+      const Account& account = accounts[seq % accounts.size()];
+      std::string peer = "stub-peer-" + std::to_string(seq % static_cast<uint64_t>(std::max(1, opts.peers)));
+      if (send_text(port, account, peer, "lg:" + std::to_string(seq))) {
+        g_counters.msgs_sent++;
+      } else {
+        g_counters.replies_failed++;
+      }
+    });
+  });
+  return threads;
+}
+
+#endif
+
+static bool discover_accounts(int port, std::vector<Account>& out) {
+  HttpResponse resp;
+  if (!http_get(port, "/health", &resp)) return false;
+  size_t list = resp.body.find("\"accounts\":");
+  if (list == std::string::npos) return false;
+  for (const auto& obj : split_json_objects(resp.body.substr(list))) {
+    Account account;
+    extract_json_string(obj, "accountId", account.id);
+    extract_json_string(obj, "userId", account.user_id);
+    if (account.id.empty()) continue;
+#if BEAGLE_SDK_FAKE
+    for (Carrier* c : fake_carrier_instances()) {
+      if (fake_carrier_instance_userid(c) == account.user_id) account.carrier = c;
+    }
+    if (!account.carrier) return false;
+#endif
+    out.push_back(account);
+  }
+  return !out.empty();
+}
+
+static bool wait_ready(int port, const std::vector<Account>& accounts, int wait_ms) {
+  for (const auto& account : accounts) {
+    bool ready = false;
+    for (int waited = 0; waited < wait_ms && !ready; waited += 50) {
+      HttpResponse resp;
+      ready = http_get(port, "/status?accountId=" + account.id, &resp)
+              && resp.body.find("\"ready\":true") != std::string::npos;
+      if (!ready) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    if (!ready) return false;
+  }
+  return true;
+}
+
+static void print_line(const char* name, uint64_t sent, uint64_t received, double elapsed, const Samples& samples) {
+  std::printf("%-16s sent %8llu  done %8llu  %9.1f/s  %s\n", name,
+              static_cast<unsigned long long>(sent), static_cast<unsigned long long>(received),
+              elapsed > 0 ? received / elapsed : 0.0, samples.summary().c_str());
+}
+
+static void usage() {
+  std::fprintf(stderr,
+               "usage: beagle-sidecar-loadgen [--accounts <m>] [--peers <n>] [--duration <s>]\n"
+               "                              [--msg-rate <per s>] [--file-rate <per s>] [--file-size <bytes>]\n"
+               "                              [--flap-rate <per s>] [--flap-ms <ms>]\n"
+               "                              [--latency-ms <ms>] [--jitter-ms <ms>] [--loss <0..1>]\n"
+               "                              [--poll-ms <ms>] [--no-reply]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  LoadOptions opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+    if (arg == "--accounts") {
+      opts.accounts = std::max(1, std::atoi(next().c_str()));
+    } else if (arg == "--peers") {
+      opts.peers = std::max(1, std::atoi(next().c_str()));
+    } else if (arg == "--duration") {
+      opts.duration_s = std::atof(next().c_str());
+    } else if (arg == "--msg-rate") {
+      opts.msg_rate = std::atof(next().c_str());
+    } else if (arg == "--file-rate") {
+      opts.file_rate = std::atof(next().c_str());
+    } else if (arg == "--file-size") {
+      opts.file_size = static_cast<size_t>(std::max(1, std::atoi(next().c_str())));
+    } else if (arg == "--flap-rate") {
+      opts.flap_rate = std::atof(next().c_str());
+    } else if (arg == "--flap-ms") {
+      opts.flap_ms = std::atoi(next().c_str());
+    } else if (arg == "--latency-ms") {
+      opts.latency_ms = std::atoi(next().c_str());
+    } else if (arg == "--jitter-ms") {
+      opts.jitter_ms = std::atoi(next().c_str());
+    } else if (arg == "--loss") {
+      opts.loss = std::atof(next().c_str());
+    } else if (arg == "--poll-ms") {
+      opts.poll_ms = std::max(1, std::atoi(next().c_str()));
+    } else if (arg == "--no-reply") {
+      opts.reply = false;
+    } else {
+      usage();
+      return arg == "--help" || arg == "-h" ? 0 : 2;
+    }
+  }
+  LogOptions log_opts = log_options();
+  log_opts.level = LogLevel::Warn;
+  log_configure(log_opts);
+
+  int port = free_port();
+  std::string dir = make_temp_dir("beagle-loadgen");
+  if (port == 0 || dir.empty()) {
+    std::fprintf(stderr, "loadgen: cannot prepare a port or data dir\n");
+    return 1;
+  }
+  std::string config = dir + "/carrier.conf";
+  std::ofstream(config) << "{}\n";
+  std::string openclaw = dir + "/openclaw.json";
+  {
+    std::ofstream out(openclaw);
+    out << "{\"agents\":{\"list\":[";
+    for (int i = 0; i < opts.accounts; ++i) out << (i ? "," : "") << "{\"id\":\"agent" << i << "\"}";
+    out << "]}}\n";
+  }
+
+#if BEAGLE_SDK_FAKE
+  const char* mode = "fake-carrier";
+  setup_fake_peers(opts);
+#else
+  const char* mode = "stub (outbound /sendText only)";
+#endif
+
+  if (!start_sidecar({"--port", std::to_string(port), "--config", config, "--data-dir", dir + "/data",
+                      "--openclaw-config", openclaw, "--log-level", "error"},
+                     port, 20000)) {
+    std::fprintf(stderr, "loadgen: sidecar did not come up on port %d\n", port);
+    return 1;
+  }
+  std::vector<Account> accounts;
+  if (!discover_accounts(port, accounts) || !wait_ready(port, accounts, 20000)) {
+    std::fprintf(stderr, "loadgen: accounts did not become ready\n");
+    stop_sidecar();
+    return 1;
+  }
+  // Start-up traffic (welcome messages, presence) is not part of the measurement.
+  for (const auto& account : accounts) {
+    http_request(port, "GET", "/events", "", {{"X-Beagle-Account", account.id}}, nullptr);
+  }
+  http_get(port, "/debug/latency?reset=1");
+
+  std::printf("loadgen: mode=%s accounts=%zu peers=%d duration=%.1fs msg-rate=%.1f/s file-rate=%.1f/s "
+              "file-size=%zu flap-rate=%.1f/s latency=%dms jitter=%dms loss=%.3f\n",
+              mode, accounts.size(), opts.peers, opts.duration_s, opts.msg_rate, opts.file_rate,
+              opts.file_size, opts.flap_rate, opts.latency_ms, opts.jitter_ms, opts.loss);
+  std::fflush(stdout);
+
+  std::vector<std::thread> consumers;
+  for (const auto& account : accounts) {
+    consumers.emplace_back([port, &account, &opts]() { consumer_loop(port, account, opts); });
+  }
+  double start = now_seconds();
+  std::vector<std::thread> generators = start_generators(port, opts, accounts);
+  std::this_thread::sleep_for(std::chrono::duration<double>(opts.duration_s));
+  g_stop_generators = true;
+  for (auto& t : generators) t.join();
+  double elapsed = now_seconds() - start;
+
+  // Let in-flight messages, files and replies settle (bounded).
+  for (int i = 0; i < 100; ++i) {
+    bool settled = g_counters.msgs_received >= g_counters.msgs_sent
+                   && g_counters.files_received >= g_counters.files_sent
+                   && (!opts.reply || g_counters.replies_delivered >= g_counters.replies_ok);
+#if !BEAGLE_SDK_FAKE
+    settled = true;
+#endif
+    if (settled) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  g_stop_consumers = true;
+  for (auto& t : consumers) t.join();
+
+  std::printf("elapsed %.2fs  /events polls %llu  other events %llu\n", elapsed,
+              static_cast<unsigned long long>(g_counters.polls.load()),
+              static_cast<unsigned long long>(g_counters.other_events.load()));
+#if BEAGLE_SDK_FAKE
+  print_line("inbound msgs", g_counters.msgs_sent, g_counters.msgs_received, elapsed, g_inbound_msg);
+  print_line("inbound files", g_counters.files_sent, g_counters.files_received, elapsed, g_inbound_file);
+  print_line("replies", g_counters.replies_ok, g_counters.replies_delivered, elapsed, g_reply);
+  print_line("round trip", g_counters.msgs_received, g_counters.replies_delivered, elapsed, g_round_trip);
+  FakeCarrierStats stats = fake_carrier_stats();
+  std::printf("carrier          flaps %llu  lost %llu  offline-refused %llu  reply-failures %llu\n",
+              static_cast<unsigned long long>(g_counters.flaps.load()),
+              static_cast<unsigned long long>(stats.lost),
+              static_cast<unsigned long long>(stats.offline_errors),
+              static_cast<unsigned long long>(g_counters.replies_failed.load()));
+#else
+  print_line("sendText", g_counters.msgs_sent + g_counters.replies_failed, g_counters.msgs_sent, elapsed,
+             g_send_http);
+#endif
+  std::printf("%-16s %zu calls  %s\n", "/sendText http", g_send_http.count(), g_send_http.summary().c_str());
+  HttpResponse stages;
+  if (http_get(port, "/debug/latency", &stages)) std::printf("sidecar stages   %s\n", stages.body.c_str());
+  std::fflush(stdout);
+  stop_sidecar();
+  log_flush();
+  return 0;
+}
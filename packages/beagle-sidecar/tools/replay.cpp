@@ -0,0 +1,366 @@
+// beagle-sidecar-replay: feeds a captured incoming_events.jsonl back through
+// friend_message_callback of an in-process sidecar (fake Carrier build) and
+// reports how the run handled it: dedupe and stale-offline decisions next to
+// the recorded ones, and how long messages queued before /events drained them.
+//
+//   beagle-sidecar-replay [--speed <x>] [--keep-ts] [--poll-ms <ms>] [--show <n>] <incoming_events.jsonl>...
+//
+// --speed 1 keeps the recorded arrival spacing, 10 replays ten times faster and
+// 0 injects back to back. Carrier timestamps are shifted by the same offset so
+// that, relative to the new start-up, they are as old as they were originally
+// (--keep-ts injects them unchanged). Rotated .gz segments must be gunzipped first.
+
+#include "fake_carrier.h"
+#include "logger.h"
+#include "media_codec.h"
+#include "sidecar.h"
+#include "tool_support.h"
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct ReplayOptions {
+  double speed = 1.0;
+  bool keep_ts = false;
+  int poll_ms = 5;
+  size_t show = 10;
+  std::vector<std::string> files;
+};
+
+// One line of incoming_events.jsonl.
+struct Recorded {
+  size_t line = 0;
+  std::string logged_at;
+  std::string action;
+  std::string peer;
+  bool offline = false;
+  long long carrier_ts = 0;
+  long long startup_ts = 0;
+  std::string kind;
+  std::string text;
+  std::string filename;
+  std::string media_type;
+  unsigned long long size = 0;
+  long long arrival_us = 0;  // estimated original arrival, for pacing
+};
+
+static bool json_number(const std::string& body, const std::string& key, long long& out) {
+  std::string needle = "\"" + key + "\":";
+  size_t pos = body.find(needle);
+  if (pos == std::string::npos) return false;
+  char* end = nullptr;
+  const char* start = body.c_str() + pos + needle.size();
+  out = std::strtoll(start, &end, 10);
+  return end != start;
+}
+
+// loggedAt is local time with second precision ("%Y-%m-%d %H:%M:%S").
+static long long parse_logged_at_us(const std::string& s) {
+  std::tm tm{};
+  if (!strptime(s.c_str(), "%Y-%m-%d %H:%M:%S", &tm)) return 0;
+  tm.tm_isdst = -1;
+  return static_cast<long long>(std::mktime(&tm)) * 1000000LL;
+}
+
+static bool load_file(const std::string& path, std::vector<Recorded>& out) {
+  std::ifstream in(path);
+  if (!in) return false;
+  std::string line;
+  size_t n = 0;
+  while (std::getline(in, line)) {
+    ++n;
+    if (line.empty() || line[0] != '{') continue;
+    Recorded rec;
+    rec.line = n;
+    extract_json_string(line, "loggedAt", rec.logged_at);
+    extract_json_string(line, "action", rec.action);
+    extract_json_string(line, "peer", rec.peer);
+    std::string mode;
+    extract_json_string(line, "mode", mode);
+    rec.offline = mode == "offline";
+    json_number(line, "carrierTs", rec.carrier_ts);
+    json_number(line, "startupTs", rec.startup_ts);
+    extract_json_string(line, "kind", rec.kind);
+    if (!extract_json_string(line, "text", rec.text) || rec.text.empty()) {
+      extract_json_string(line, "textPreview", rec.text);
+    }
+    extract_json_string(line, "filename", rec.filename);
+    extract_json_string(line, "mediaType", rec.media_type);
+    long long size = 0;
+    if (json_number(line, "size", size) && size > 0) rec.size = static_cast<unsigned long long>(size);
+    if (rec.peer.empty()) continue;
+    // Online Carrier timestamps are finer than loggedAt; use them when they agree.
+    long long logged_us = parse_logged_at_us(rec.logged_at);
+    rec.arrival_us = logged_us;
+    if (!rec.offline && rec.carrier_ts > 0 && logged_us > 0
+        && rec.carrier_ts >= logged_us - 1000000 && rec.carrier_ts < logged_us + 2000000) {
+      rec.arrival_us = rec.carrier_ts;
+    }
+    out.push_back(std::move(rec));
+  }
+  return true;
+}
+
+// Files show up as kind "file", or as text when they were rejected for size.
+static bool is_file_record(const Recorded& rec) {
+  return rec.kind == "file" || (!rec.filename.empty() && rec.size > kMaxBeaglechatFileBytes);
+}
+
+// Rebuilds what the peer sent: files as packed Beagle Chat payloads of the
+// recorded size, everything else as the text.
+static std::string build_payload(const Recorded& rec) {
+  if (!is_file_record(rec)) return rec.text;
+  std::vector<unsigned char> bytes(static_cast<size_t>(std::min<unsigned long long>(rec.size, 6 * 1024 * 1024)));
+  for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = static_cast<unsigned char>(i * 131 + 7);
+  std::vector<unsigned char> packed;
+  if (!encode_beaglechat_file_payload(rec.filename, rec.media_type, bytes, packed)) return rec.text;
+  return std::string(packed.begin(), packed.end());
+}
+
+static std::string event_key(const std::string& peer, const std::string& text, const std::string& filename) {
+  return peer + "\n" + (filename.empty() ? text : "file:" + filename);
+}
+
+// Injection times per message key, drained FIFO as /events returns them.
+std::mutex g_pending_mu;
+std::map<std::string, std::deque<long long>> g_pending;
+std::mutex g_drain_mu;
+std::vector<double> g_drain_us;
+std::atomic<uint64_t> g_drained{0};
+std::atomic<bool> g_stop{false};
+
+static void consumer_loop(int port, int poll_ms) {
+  while (!g_stop) {
+    HttpResponse resp;
+    if (!http_get(port, "/events", &resp)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+      continue;
+    }
+    long long now = static_cast<long long>(now_seconds() * 1e6);
+    std::vector<std::string> events = split_json_objects(resp.body);
+    for (const auto& ev : events) {
+      std::string peer, text, filename;
+      extract_json_string(ev, "peer", peer);
+      extract_json_string(ev, "text", text);
+      extract_json_string(ev, "filename", filename);
+      g_drained++;
+      long long injected = 0;
+      {
+        std::lock_guard<std::mutex> lock(g_pending_mu);
+        auto it = g_pending.find(event_key(peer, text, filename));
+        if (it == g_pending.end() || it->second.empty()) continue;
+        injected = it->second.front();
+        it->second.pop_front();
+      }
+      std::lock_guard<std::mutex> lock(g_drain_mu);
+      g_drain_us.push_back(static_cast<double>(now - injected));
+    }
+    if (events.empty()) std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+  }
+}
+
+static std::string short_peer(const std::string& peer) {
+  return peer.size() > 10 ? peer.substr(0, 10) + "..." : peer;
+}
+
+static void usage() {
+  std::fprintf(stderr,
+               "usage: beagle-sidecar-replay [--speed <x>] [--keep-ts] [--poll-ms <ms>] [--show <n>]\n"
+               "                             <incoming_events.jsonl>...\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ReplayOptions opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+    if (arg == "--speed") {
+      opts.speed = std::max(0.0, std::atof(next().c_str()));
+    } else if (arg == "--keep-ts") {
+      opts.keep_ts = true;
+    } else if (arg == "--poll-ms") {
+      opts.poll_ms = std::max(1, std::atoi(next().c_str()));
+    } else if (arg == "--show") {
+      opts.show = static_cast<size_t>(std::max(0, std::atoi(next().c_str())));
+    } else if (!arg.empty() && arg[0] != '-') {
+      opts.files.push_back(arg);
+    } else {
+      usage();
+      return arg == "--help" || arg == "-h" ? 0 : 2;
+    }
+  }
+  if (opts.files.empty()) {
+    usage();
+    return 2;
+  }
+
+  std::vector<Recorded> records;
+  for (const auto& path : opts.files) {
+    if (!load_file(path, records)) {
+      std::fprintf(stderr, "replay: cannot read %s\n", path.c_str());
+      return 1;
+    }
+  }
+  if (records.empty()) {
+    std::fprintf(stderr, "replay: no events found\n");
+    return 1;
+  }
+
+  LogOptions log_opts = log_options();
+  log_opts.level = LogLevel::Warn;
+  log_configure(log_opts);
+
+  // Every recorded sender becomes an online friend with no network delay, so
+  // the only timing is the pacing below.
+  std::set<std::string> peers;
+  for (const auto& rec : records) peers.insert(rec.peer);
+  for (const auto& peer : peers) fake_carrier_add_peer(peer, FakePeerOptions());
+
+  int port = free_port();
+  std::string dir = make_temp_dir("beagle-replay");
+  if (port == 0 || dir.empty()) {
+    std::fprintf(stderr, "replay: cannot prepare a port or data dir\n");
+    return 1;
+  }
+  std::string config = dir + "/carrier.conf";
+  std::ofstream(config) << "{}\n";
+  std::string openclaw = dir + "/openclaw.json";
+  std::ofstream(openclaw) << "{\"agents\":{\"list\":[{\"id\":\"replay\"}]}}\n";
+  long long startup_us = static_cast<long long>(std::time(nullptr)) * 1000000LL;
+  if (!start_sidecar({"--port", std::to_string(port), "--config", config, "--data-dir", dir + "/data",
+                      "--openclaw-config", openclaw, "--log-level", "error"},
+                     port, 20000)) {
+    std::fprintf(stderr, "replay: sidecar did not come up on port %d\n", port);
+    return 1;
+  }
+  std::vector<Carrier*> instances = fake_carrier_instances();
+  if (instances.size() != 1) {
+    std::fprintf(stderr, "replay: expected one Carrier instance, found %zu\n", instances.size());
+    stop_sidecar();
+    return 1;
+  }
+  Carrier* carrier = instances.front();
+  for (int i = 0; i < 400; ++i) {
+    HttpResponse resp;
+    if (http_get(port, "/status", &resp) && resp.body.find("\"ready\":true") != std::string::npos) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+  }
+  http_get(port, "/events");
+  http_get(port, "/debug/latency?reset=1");
+
+  const long long ts_shift = opts.keep_ts || records.front().startup_ts <= 0
+      ? 0 : startup_us - records.front().startup_ts;
+  std::thread consumer([&]() { consumer_loop(port, opts.poll_ms); });
+
+  // Recorded arrivals never go backwards in the schedule.
+  long long first_arrival = records.front().arrival_us;
+  long long last_arrival = first_arrival;
+  double start = now_seconds();
+  std::map<long long, size_t> per_second;
+  for (const auto& rec : records) {
+    long long arrival = std::max(last_arrival, rec.arrival_us > 0 ? rec.arrival_us : last_arrival);
+    last_arrival = arrival;
+    per_second[arrival / 1000000]++;
+    if (opts.speed > 0) {
+      double due = start + static_cast<double>(arrival - first_arrival) / 1e6 / opts.speed;
+      double wait = due - now_seconds();
+      if (wait > 0) std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+    }
+    std::string payload = build_payload(rec);
+    long long ts = rec.carrier_ts > 0 ? rec.carrier_ts + ts_shift : 0;
+    bool is_file = is_file_record(rec);
+    {
+      std::lock_guard<std::mutex> lock(g_pending_mu);
+      g_pending[event_key(rec.peer, is_file ? "" : rec.text, is_file ? sanitize_filename(rec.filename) : "")]
+          .push_back(static_cast<long long>(now_seconds() * 1e6));
+    }
+    fake_carrier_deliver(carrier, rec.peer, payload, ts, rec.offline);
+  }
+  double inject_elapsed = now_seconds() - start;
+
+  // The replayed run logs its own decisions; its log writer flushes every 500ms.
+  const std::string log_path = dir + "/data/incoming_events.jsonl";
+  std::vector<Recorded> replayed;
+  for (int i = 0; i < 100; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    replayed.clear();
+    load_file(log_path, replayed);
+    if (replayed.size() >= records.size()) break;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  g_stop = true;
+  consumer.join();
+
+  std::map<std::string, std::pair<size_t, size_t>> decisions;  // action -> (recorded, replayed)
+  for (const auto& rec : records) decisions[rec.action].first++;
+  for (const auto& rec : replayed) decisions[rec.action].second++;
+  std::vector<std::string> mismatches;
+  size_t compared = std::min(records.size(), replayed.size());
+  size_t mismatch_count = 0;
+  for (size_t i = 0; i < compared; ++i) {
+    const Recorded& a = records[i];
+    const Recorded& b = replayed[i];
+    if (a.action == b.action && a.peer == b.peer) continue;
+    mismatch_count++;
+    if (mismatches.size() >= opts.show) continue;
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "  #%zu %s %s %s: recorded %s, replayed %s%s",
+                  i + 1, short_peer(a.peer).c_str(), a.offline ? "offline" : "online", a.kind.c_str(),
+                  a.action.c_str(), b.action.c_str(), a.peer == b.peer ? "" : " (different peer: order changed)");
+    mismatches.push_back(buf);
+  }
+
+  size_t peak = 0;
+  for (const auto& kv : per_second) peak = std::max(peak, kv.second);
+  double span = static_cast<double>(last_arrival - first_arrival) / 1e6;
+  char speed[32];
+  if (opts.speed > 0) {
+    std::snprintf(speed, sizeof(speed), "%gx", opts.speed);
+  } else {
+    std::snprintf(speed, sizeof(speed), "max");
+  }
+  std::printf("replay: %zu events from %zu peer(s), recorded span %.1fs (peak %zu/s), injected in %.2fs at speed %s\n",
+              records.size(), peers.size(), span, peak, inject_elapsed, speed);
+  std::printf("timestamps: %s\n", ts_shift ? "shifted to the new start-up" : "unchanged");
+  std::printf("%-24s %10s %10s\n", "decision", "recorded", "replayed");
+  for (const auto& kv : decisions) {
+    std::printf("%-24s %10zu %10zu\n", kv.first.c_str(), kv.second.first, kv.second.second);
+  }
+  std::printf("mismatches: %zu of %zu compared%s\n", mismatch_count, compared,
+              replayed.size() < records.size() ? " (replayed log incomplete)" : "");
+  for (const auto& line : mismatches) std::printf("%s\n", line.c_str());
+
+  std::vector<double> drains;
+  {
+    std::lock_guard<std::mutex> lock(g_drain_mu);
+    drains = g_drain_us;
+  }
+  std::sort(drains.begin(), drains.end());
+  std::printf("inject -> /events: %zu drained, %zu matched  p50 %.2fms  p99 %.2fms  max %.2fms\n",
+              static_cast<size_t>(g_drained.load()), drains.size(),
+              percentile(drains, 0.5) / 1e3, percentile(drains, 0.99) / 1e3,
+              drains.empty() ? 0.0 : drains.back() / 1e3);
+  HttpResponse stages;
+  if (http_get(port, "/debug/latency", &stages)) std::printf("sidecar stages: %s\n", stages.body.c_str());
+  std::fflush(stdout);
+  stop_sidecar();
+  log_flush();
+  return mismatch_count == 0 ? 0 : 3;
+}
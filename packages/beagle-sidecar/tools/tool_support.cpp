@@ -0,0 +1,165 @@
+#include "tool_support.h"
+
+#include "sidecar.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+double now_seconds() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int free_port() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return 0;
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  int port = 0;
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0
+      && getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0) {
+    port = ntohs(addr.sin_port);
+  }
+  close(fd);
+  return port;
+}
+
+std::string make_temp_dir(const std::string& prefix) {
+  std::string tmpl = "/tmp/" + prefix + "-XXXXXX";
+  if (!mkdtemp(&tmpl[0])) return std::string();
+  return tmpl;
+}
+
+bool http_request(int port,
+                  const std::string& method,
+                  const std::string& path,
+                  const std::string& body,
+                  const HttpHeaders& headers,
+                  HttpResponse* out) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return false;
+  }
+  std::string req = method + " " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+  for (const auto& h : headers) req += h.first + ": " + h.second + "\r\n";
+  if (!body.empty() || method == "POST") {
+    req += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+  }
+  req += "\r\n";
+  req += body;
+  size_t off = 0;
+  while (off < req.size()) {
+    ssize_t n = send(fd, req.data() + off, req.size() - off, 0);
+    if (n <= 0) {
+      close(fd);
+      return false;
+    }
+    off += static_cast<size_t>(n);
+  }
+  std::string raw;
+  char buf[8192];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) raw.append(buf, static_cast<size_t>(n));
+  close(fd);
+  if (raw.compare(0, 9, "HTTP/1.1 ") != 0) return false;
+  if (out) {
+    out->status = std::atoi(raw.c_str() + 9);
+    size_t split = raw.find("\r\n\r\n");
+    out->body = split == std::string::npos ? std::string() : raw.substr(split + 4);
+  }
+  return true;
+}
+
+bool http_get(int port, const std::string& path, HttpResponse* out) {
+  HttpResponse resp;
+  if (!http_request(port, "GET", path, "", {}, &resp)) return false;
+  bool ok = resp.status == 200;
+  if (out) *out = std::move(resp);
+  return ok;
+}
+
+namespace {
+
+std::thread g_sidecar_thread;
+int g_sidecar_rc = 0;
+
+}  // namespace
+
+bool start_sidecar(const std::vector<std::string>& args, int port, int wait_ms) {
+  if (g_sidecar_thread.joinable()) return false;
+  g_sidecar_thread = std::thread([args]() {
+    // sidecar_main keeps pointers into argv until it returns.
+    std::vector<std::string> owned;
+    owned.push_back("beagle-sidecar");
+    owned.insert(owned.end(), args.begin(), args.end());
+    std::vector<char*> argv;
+    for (auto& a : owned) argv.push_back(&a[0]);
+    argv.push_back(nullptr);
+    g_sidecar_rc = sidecar_main(static_cast<int>(owned.size()), argv.data());
+  });
+
+  // The listener comes up before the accounts; wait until none is still starting.
+  for (int waited = 0; waited < wait_ms; waited += 25) {
+    HttpResponse resp;
+    if (http_get(port, "/health", &resp) && resp.body.find("\"state\":\"pending\"") == std::string::npos
+        && resp.body.find("\"state\":\"starting\"") == std::string::npos) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+  }
+  stop_sidecar();
+  return false;
+}
+
+int stop_sidecar() {
+  if (!g_sidecar_thread.joinable()) return 0;
+  sidecar_request_stop();
+  g_sidecar_thread.join();
+  return g_sidecar_rc;
+}
+
+std::vector<std::string> split_json_objects(const std::string& array) {
+  std::vector<std::string> out;
+  int depth = 0;
+  bool in_string = false;
+  size_t start = 0;
+  for (size_t i = 0; i < array.size(); ++i) {
+    char c = array[i];
+    if (in_string) {
+      if (c == '\\') {
+        ++i;
+      } else if (c == '"') {
+        in_string = false;
+      }
+      continue;
+    }
+    if (c == '"') {
+      in_string = true;
+    } else if (c == '{') {
+      if (depth++ == 0) start = i;
+    } else if (c == '}') {
+      if (depth > 0 && --depth == 0) out.push_back(array.substr(start, i - start + 1));
+    }
+  }
+  return out;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t idx = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Plumbing shared by the developer tools in tools/: loopback HTTP against the
+// sidecar and running sidecar_main() in-process.
+
+double now_seconds();
+int free_port();
+// mkdtemp() under /tmp; empty on failure.
+std::string make_temp_dir(const std::string& prefix);
+
+struct HttpResponse {
+  int status = 0;
+  std::string body;
+};
+
+using HttpHeaders = std::vector<std::pair<std::string, std::string>>;
+
+// One request on a fresh loopback connection (the server closes after each
+// response). Returns false when the connection or the exchange failed.
+bool http_request(int port,
+                  const std::string& method,
+                  const std::string& path,
+                  const std::string& body,
+                  const HttpHeaders& headers,
+                  HttpResponse* out);
+// True on a 200 response.
+bool http_get(int port, const std::string& path, HttpResponse* out = nullptr);
+
+// Starts sidecar_main(args) on a background thread (args excludes argv[0]) and
+// waits up to wait_ms for /health on port to list every account as started
+// (or failed). On a timeout the server is stopped again.
+bool start_sidecar(const std::vector<std::string>& args, int port, int wait_ms = 5000);
+// Shuts down the server started by start_sidecar() as on SIGTERM and waits
+// for sidecar_main() to return; its exit code, or 0 when none is running.
+int stop_sidecar();
+
+// Top-level objects of a JSON array such as an /events response.
+std::vector<std::string> split_json_objects(const std::string& array);
+
+// Value at fraction p (0..1) of sorted samples; 0 when empty.
+double percentile(const std::vector<double>& sorted, double p);